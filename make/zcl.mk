@@ -13,8 +13,6 @@ OUT_DIR += \
 /zigbee/zcl/general \
 /zigbee/zcl/commissioning \
 /zigbee/zcl/closures \
-
-#$(OUT_PATH)/zigbee/zcl/zcl_reporting.o \
  
 OBJS += \
 $(OUT_PATH)/zigbee/zcl/zcl.o \
@@ -2,6 +2,7 @@
 OUT_DIR += \
 /$(SRC_PATH) \
 /$(SRC_PATH)/common \
+/$(SRC_PATH)/zcl \
 /$(SRC_PATH)/devices
  
 OBJS += \
@@ -20,6 +21,8 @@ $(OUT_PATH)/$(SRC_PATH)/app_button.o \
 $(OUT_PATH)/$(SRC_PATH)/app_arith64.o \
 $(OUT_PATH)/$(SRC_PATH)/app_tamper.o \
 $(OUT_PATH)/$(SRC_PATH)/devices/device.o \
+$(OUT_PATH)/$(SRC_PATH)/devices/axdr.o \
+$(OUT_PATH)/$(SRC_PATH)/devices/dlms_gcm.o \
 $(OUT_PATH)/$(SRC_PATH)/devices/nartis_i300.o \
 $(OUT_PATH)/$(SRC_PATH)/app_main.o
 
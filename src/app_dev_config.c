@@ -1,9 +1,31 @@
 #include "app_main.h"
 
-#define ID_CONFIG   0x0FED141A
-#define TOP_MASK    0xFFFFFFFF
+#define ID_CONFIG       0x0FED141A
+#define ID_LOAD_PROFILE 0x0FED1470
+#define ID_METER_CACHE  0x0FED14CA
+#define ID_SECURITY     0x0FED14DC
+#define ID_BUS          0x0FED14E8
+#define TOP_MASK        0xFFFFFFFF
 
 dev_config_t dev_config;
+load_profile_cfg_t load_profile_cfg;
+meter_cache_t meter_cache;
+security_cfg_t security_cfg;
+
+#if METER_MAX > 1
+static bus_cfg_t bus_cfg;
+#endif
+static uint8_t meter_cfg_idx;               /* meter of load_profile_cfg and meter_cache    */
+
+/* config before poll classes, one measurement period for everything */
+typedef struct __attribute__((packed)) {
+    uint32_t        id;
+    uint16_t        measurement_period;
+    uint8_t         device_model;
+    uint32_t        device_address;
+    m_password_t    device_password;
+    uint16_t        crc;
+} dev_config_old_t;
 
 static uint16_t checksum(const uint8_t *src_buffer, uint8_t len) {
 
@@ -27,13 +49,100 @@ static uint16_t checksum(const uint8_t *src_buffer, uint8_t len) {
     return crc;
 }
 
+/* keeps the meter settings of the previous firmware, the periods become default */
+static uint8_t read_old_config() {
+
+    dev_config_old_t old_config;
+
+    if (nv_flashReadNew(1, NV_MODULE_APP,  NV_ITEM_APP_USER_CFG, sizeof(dev_config_old_t), (uint8_t*)&old_config) != NV_SUCC ||
+            old_config.id != ID_CONFIG || checksum((uint8_t*)&old_config, sizeof(dev_config_old_t)) != old_config.crc) {
+        return false;
+    }
+
+    memset(&dev_config, 0, sizeof(dev_config_t));
+    dev_config.id = ID_CONFIG;
+    dev_config.poll_period[POLL_POWER] = DEFAULT_POWER_PERIOD;
+    dev_config.poll_period[POLL_VOLTAGE] = DEFAULT_VOLTAGE_PERIOD;
+    dev_config.poll_period[POLL_TARIFF] = old_config.measurement_period;
+    dev_config.profile_depth = DEFAULT_PROFILE_DEPTH;
+    dev_config.device_model = old_config.device_model;
+    dev_config.device_address = old_config.device_address;
+    memcpy(&dev_config.device_password, &old_config.device_password, sizeof(m_password_t));
+    write_config();
+
+    return true;
+}
+
 static void init_default_config() {
     memset(&dev_config, 0, sizeof(dev_config_t));
     dev_config.id = ID_CONFIG;
-    dev_config.measurement_period = DEFAULT_MEASUREMENT_PERIOD;
+    dev_config.poll_period[POLL_POWER] = DEFAULT_POWER_PERIOD;
+    dev_config.poll_period[POLL_VOLTAGE] = DEFAULT_VOLTAGE_PERIOD;
+    dev_config.poll_period[POLL_TARIFF] = DEFAULT_TARIFF_PERIOD;
+    dev_config.profile_depth = DEFAULT_PROFILE_DEPTH;
     write_config();
 }
 
+/* the first meter keeps the items of the firmware with one meter */
+static uint8_t meter_item(uint8_t item) {
+
+    if (meter_cfg_idx == 0) return item;
+
+    return NV_ITEM_APP_BUS_METER + (meter_cfg_idx-1) * 2 + (item == NV_ITEM_APP_METER_CACHE);
+}
+
+static void init_load_profile_cfg() {
+
+    nv_sts_t st = nv_flashReadNew(1, NV_MODULE_APP,  meter_item(NV_ITEM_APP_LOAD_PROFILE), sizeof(load_profile_cfg_t), (uint8_t*)&load_profile_cfg);
+
+    if (st != NV_SUCC || load_profile_cfg.id != ID_LOAD_PROFILE ||
+            checksum((uint8_t*)&load_profile_cfg, sizeof(load_profile_cfg_t)) != load_profile_cfg.crc) {
+        /* written with the first entry */
+        memset(&load_profile_cfg, 0, sizeof(load_profile_cfg_t));
+        load_profile_cfg.id = ID_LOAD_PROFILE;
+    }
+}
+
+static void init_meter_cache() {
+
+    nv_sts_t st = nv_flashReadNew(1, NV_MODULE_APP,  meter_item(NV_ITEM_APP_METER_CACHE), sizeof(meter_cache_t), (uint8_t*)&meter_cache);
+
+    if (st != NV_SUCC || meter_cache.id != ID_METER_CACHE ||
+            checksum((uint8_t*)&meter_cache, sizeof(meter_cache_t)) != meter_cache.crc) {
+        /* filled by the driver in the first session */
+        memset(&meter_cache, 0, sizeof(meter_cache_t));
+        meter_cache.id = ID_METER_CACHE;
+    }
+}
+
+static void init_security_cfg() {
+
+    nv_sts_t st = nv_flashReadNew(1, NV_MODULE_APP,  NV_ITEM_APP_SECURITY, sizeof(security_cfg_t), (uint8_t*)&security_cfg);
+
+    if (st != NV_SUCC || security_cfg.id != ID_SECURITY ||
+            checksum((uint8_t*)&security_cfg, sizeof(security_cfg_t)) != security_cfg.crc) {
+        /* LLS until the keys are set, the system title is the IEEE address */
+        memset(&security_cfg, 0, sizeof(security_cfg_t));
+        security_cfg.id = ID_SECURITY;
+        for (uint8_t i = 0; i < SECURITY_TITLE_SIZE; i++) {
+            security_cfg.system_title[i] = MAC_IB().extAddress[SECURITY_TITLE_SIZE-1-i];
+        }
+    }
+}
+
+#if METER_MAX > 1
+static void init_bus_cfg() {
+
+    nv_sts_t st = nv_flashReadNew(1, NV_MODULE_APP,  NV_ITEM_APP_BUS, sizeof(bus_cfg_t), (uint8_t*)&bus_cfg);
+
+    if (st != NV_SUCC || bus_cfg.id != ID_BUS || checksum((uint8_t*)&bus_cfg, sizeof(bus_cfg_t)) != bus_cfg.crc) {
+        /* the first meter only until the addresses of the others are set */
+        memset(&bus_cfg, 0, sizeof(bus_cfg_t));
+        bus_cfg.id = ID_BUS;
+    }
+}
+#endif
+
 void init_config(uint8_t print) {
 
     nv_sts_t st = NV_SUCC;
@@ -49,10 +158,16 @@ void init_config(uint8_t print) {
     uint16_t crc = checksum((uint8_t*)&dev_config, sizeof(dev_config_t));
 
     if (st != NV_SUCC || dev_config.id != ID_CONFIG || crc != dev_config.crc) {
+        if (read_old_config()) {
 #if UART_PRINTF_MODE && DEBUG_CONFIG
-        printf("No saved config! Init.\r\n");
+            printf("Old config is converted.\r\n");
 #endif /* UART_PRINTF_MODE */
-        init_default_config();
+        } else {
+#if UART_PRINTF_MODE && DEBUG_CONFIG
+            printf("No saved config! Init.\r\n");
+#endif /* UART_PRINTF_MODE */
+            init_default_config();
+        }
     } else {
 #if UART_PRINTF_MODE && DEBUG_CONFIG
         printf("Read config from nv_ram in module NV_MODULE_APP (%d) item NV_ITEM_APP_USER_CFG (%d)\r\n",
@@ -60,6 +175,12 @@ void init_config(uint8_t print) {
 #endif /* UART_PRINTF_MODE */
     }
 
+    init_load_profile_cfg();
+    init_meter_cache();
+    init_security_cfg();
+#if METER_MAX > 1
+    init_bus_cfg();
+#endif
 }
 
 void write_config() {
@@ -72,3 +193,96 @@ void write_config() {
 #endif /* UART_PRINTF_MODE */
 }
 
+void write_load_profile_cfg() {
+    load_profile_cfg.crc = checksum((uint8_t*)&(load_profile_cfg), sizeof(load_profile_cfg_t));
+    nv_flashWriteNew(1, NV_MODULE_APP,  meter_item(NV_ITEM_APP_LOAD_PROFILE), sizeof(load_profile_cfg_t), (uint8_t*)&load_profile_cfg);
+
+#if UART_PRINTF_MODE && DEBUG_CONFIG
+    printf("Save load profile to nv_ram in module NV_MODULE_APP (%d) item NV_ITEM_APP_LOAD_PROFILE (%d)\r\n",
+            NV_MODULE_APP,  meter_item(NV_ITEM_APP_LOAD_PROFILE));
+#endif /* UART_PRINTF_MODE */
+}
+
+void write_meter_cache() {
+    meter_cache.crc = checksum((uint8_t*)&(meter_cache), sizeof(meter_cache_t));
+    nv_flashWriteNew(1, NV_MODULE_APP,  meter_item(NV_ITEM_APP_METER_CACHE), sizeof(meter_cache_t), (uint8_t*)&meter_cache);
+
+#if UART_PRINTF_MODE && DEBUG_CONFIG
+    printf("Save meter cache to nv_ram in module NV_MODULE_APP (%d) item NV_ITEM_APP_METER_CACHE (%d)\r\n",
+            NV_MODULE_APP,  meter_item(NV_ITEM_APP_METER_CACHE));
+#endif /* UART_PRINTF_MODE */
+}
+
+void write_security_cfg() {
+    security_cfg.crc = checksum((uint8_t*)&(security_cfg), sizeof(security_cfg_t));
+    nv_flashWriteNew(1, NV_MODULE_APP,  NV_ITEM_APP_SECURITY, sizeof(security_cfg_t), (uint8_t*)&security_cfg);
+
+#if UART_PRINTF_MODE && DEBUG_CONFIG
+    printf("Save security to nv_ram in module NV_MODULE_APP (%d) item NV_ITEM_APP_SECURITY (%d)\r\n",
+            NV_MODULE_APP,  NV_ITEM_APP_SECURITY);
+#endif /* UART_PRINTF_MODE */
+}
+
+/* HDLC address of the meter on the bus, the first meter is in dev_config. By value, the configs are packed */
+uint32_t meter_address(uint8_t idx) {
+
+#if METER_MAX > 1
+    if (idx) return bus_cfg.meter[idx-1].device_address;
+#endif
+
+    return dev_config.device_address;
+}
+
+void set_meter_address(uint8_t idx, uint32_t address) {
+
+#if METER_MAX > 1
+    if (idx) {
+        bus_cfg.meter[idx-1].device_address = address;
+        return;
+    }
+#endif
+
+    dev_config.device_address = address;
+}
+
+m_password_t *meter_password(uint8_t idx) {
+
+#if METER_MAX > 1
+    if (idx) return &bus_cfg.meter[idx-1].device_password;
+#endif
+
+    return &dev_config.device_password;
+}
+
+/* the first meter is always polled, the others when their address is set */
+uint8_t meter_present(uint8_t idx) {
+
+    return idx == 0 || (idx < METER_MAX && meter_address(idx));
+}
+
+void write_meter_cfg(uint8_t idx) {
+
+#if METER_MAX > 1
+    if (idx) {
+        bus_cfg.crc = checksum((uint8_t*)&(bus_cfg), sizeof(bus_cfg_t));
+        nv_flashWriteNew(1, NV_MODULE_APP,  NV_ITEM_APP_BUS, sizeof(bus_cfg_t), (uint8_t*)&bus_cfg);
+#if UART_PRINTF_MODE && DEBUG_CONFIG
+        printf("Save bus to nv_ram in module NV_MODULE_APP (%d) item NV_ITEM_APP_BUS (%d)\r\n",
+                NV_MODULE_APP,  NV_ITEM_APP_BUS);
+#endif /* UART_PRINTF_MODE */
+        return;
+    }
+#endif
+
+    write_config();
+}
+
+/* load_profile_cfg and meter_cache of the meter which the driver works with */
+void select_meter_cfg(uint8_t idx) {
+
+    if (idx == meter_cfg_idx) return;
+
+    meter_cfg_idx = idx;
+    init_load_profile_cfg();
+    init_meter_cache();
+}
@@ -13,6 +13,7 @@
 #define R               ACCESS_CONTROL_READ
 #define RW              ACCESS_CONTROL_READ | ACCESS_CONTROL_WRITE
 #define RR              ACCESS_CONTROL_READ | ACCESS_CONTROL_REPORTABLE
+#define W               ACCESS_CONTROL_WRITE
 
 #define ZCL_UINT8       ZCL_DATA_TYPE_UINT8
 #define ZCL_UINT16      ZCL_DATA_TYPE_UINT16
@@ -46,6 +47,9 @@ const uint16_t app_inClusterList[] = {
     ZCL_CLUSTER_SE_METERING,
     ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT,
     ZCL_CLUSTER_GEN_DEVICE_TEMP_CONFIG,
+#ifdef ZCL_DIAGNOSTICS
+    ZCL_CLUSTER_GEN_DIAGNOSTICS,
+#endif
 };
 
 /**
@@ -172,93 +176,121 @@ const zclAttrInfo_t time_attrTbl[] =
 
 #define ZCL_TIME_ATTR_NUM    sizeof(time_attrTbl) / sizeof(zclAttrInfo_t)
 
-zcl_seAttr_t g_zcl_seAttrs = {
-    .tariff_1 = 0,
-    .tariff_2 = 0,
-    .tariff_3 = 0,
-    .tariff_4 = 0,
-    .unit_of_measure = 0x00,                                        // kWh
-    .multiplier = 1,
-    .divisor = 1,
-    .summation_formatting = 0xFA,                                   // bit7 - 1, bit6-bit3 - 15, bit2-bit0 - 2 (b11111010)
-    .status = 0,
-    .device_type = 0,                                               // 0 - Electric Metering
-    .battery_percentage = 100,
-    .serial_number = {8,'1','1','1','1','1','1','1','1'},
-    .date_release = {10,'x','x','.','x','x','.','x','x','x','x'},
-    .device_model = DEVICE_UNDEFINED, // Electric Metering
-    .device_address = 0,
-    .device_name = {9,'N','o',' ','D','e','v','i','c','e'},
-    .device_password = {1, '0'},
-    .measurement_period = DEFAULT_MEASUREMENT_PERIOD / 60,          // in minutes
+/* Value blocks of the meters, the meters 1.. get a copy of the first one on registration */
+zcl_seAttr_t g_zcl_seAttrs[METER_MAX] = {
+    [0] = {
+        .tariff_1 = 0,
+        .tariff_2 = 0,
+        .tariff_3 = 0,
+        .tariff_4 = 0,
+        .unit_of_measure = 0x00,                                    // kWh
+        .multiplier = 1,
+        .divisor = 1,
+        .summation_formatting = 0xFA,                               // bit7 - 1, bit6-bit3 - 15, bit2-bit0 - 2 (b11111010)
+        .status = 0,
+        .device_type = 0,                                           // 0 - Electric Metering
+        .battery_percentage = 100,
+        .serial_number = {8,'1','1','1','1','1','1','1','1'},
+        .date_release = {10,'x','x','.','x','x','.','x','x','x','x'},
+        .device_address = 0,
+        .device_name = {9,'N','o',' ','D','e','v','i','c','e'},
+        .device_password = {1, '0'},
+    },
 };
 
-const zclAttrInfo_t se_attrTbl[] = {
-    {ZCL_ATTRID_CURRENT_SUMMATION_DELIVERD,         ZCL_UINT48,     RR, (uint8_t*)&g_zcl_seAttrs.cur_sum_delivered      },
-    {ZCL_ATTRID_CURRENT_TIER_1_SUMMATION_DELIVERD,  ZCL_UINT48,     RR, (uint8_t*)&g_zcl_seAttrs.tariff_1               },
-    {ZCL_ATTRID_CURRENT_TIER_2_SUMMATION_DELIVERD,  ZCL_UINT48,     RR, (uint8_t*)&g_zcl_seAttrs.tariff_2               },
-    {ZCL_ATTRID_CURRENT_TIER_3_SUMMATION_DELIVERD,  ZCL_UINT48,     RR, (uint8_t*)&g_zcl_seAttrs.tariff_3               },
-    {ZCL_ATTRID_CURRENT_TIER_4_SUMMATION_DELIVERD,  ZCL_UINT48,     RR, (uint8_t*)&g_zcl_seAttrs.tariff_4               },
-    {ZCL_ATTRID_STATUS,                             ZCL_BITMAP8,    RR,  (uint8_t*)&g_zcl_seAttrs.status                },
-    {ZCL_ATTRID_UNIT_OF_MEASURE,                    ZCL_UINT8,      R,  (uint8_t*)&g_zcl_seAttrs.unit_of_measure        },
-    {ZCL_ATTRID_MULTIPLIER,                         ZCL_UINT24,     RR, (uint8_t*)&g_zcl_seAttrs.multiplier             },
-    {ZCL_ATTRID_DIVISOR,                            ZCL_UINT24,     RR, (uint8_t*)&g_zcl_seAttrs.divisor                },
-    {ZCL_ATTRID_SUMMATION_FORMATTING,               ZCL_BITMAP8,    R,  (uint8_t*)&g_zcl_seAttrs.summation_formatting   },
-    {ZCL_ATTRID_REMAINING_BATTERY_LIFE,             ZCL_UINT8,      RR, (uint8_t*)&g_zcl_seAttrs.battery_percentage     },
-    {ZCL_ATTRID_METER_SERIAL_NUMBER,                ZCL_OCTET_STR,  RR, (uint8_t*)&g_zcl_seAttrs.serial_number          },
-    {ZCL_ATTRID_METERING_DEVICE_TYPE,               ZCL_BITMAP8,    R,  (uint8_t*)&g_zcl_seAttrs.device_type            },
-    {ZCL_ATTRID_CUSTOM_DEVICE_MANUFACTURER,         ZCL_ENUM8,      RW, (uint8_t*)&g_zcl_seAttrs.device_model           },
-    {ZCL_ATTRID_CUSTOM_DEVICE_ADDRESS,              ZCL_UINT32,     RW, (uint8_t*)&g_zcl_seAttrs.device_address         },
-    {ZCL_ATTRID_CUSTOM_DEVICE_PASSWORD,             ZCL_OCTET_STR,  RW, (uint8_t*)&g_zcl_seAttrs.device_password        },
-    {ZCL_ATTRID_CUSTOM_MEASUREMENT_PERIOD,          ZCL_UINT8,      RW, (uint8_t*)&g_zcl_seAttrs.measurement_period     },
-    {ZCL_ATTRID_CUSTOM_DATE_RELEASE,                ZCL_OCTET_STR,  RR, (uint8_t*)&g_zcl_seAttrs.date_release           },
-    {ZCL_ATTRID_CUSTOM_DEVICE_MODEL,                ZCL_OCTET_STR,  RR, (uint8_t*)&g_zcl_seAttrs.device_name            },
+zcl_seBusAttr_t g_zcl_seBusAttrs = {
+    .device_model = DEVICE_UNDEFINED, // Electric Metering
+    .measurement_period = DEFAULT_TARIFF_PERIOD / 60,               // in minutes
+    .power_period = DEFAULT_POWER_PERIOD,                           // in sec
+    .voltage_period = DEFAULT_VOLTAGE_PERIOD,                       // in sec
+    .profile_depth = DEFAULT_PROFILE_DEPTH,
+    .keep_session = false,
+};
 
+/* Attributes of the meter n, one template for all endpoints */
+#define SE_METER_ATTRS(n) \
+    {ZCL_ATTRID_CURRENT_SUMMATION_DELIVERD,         ZCL_UINT48,     RR, (uint8_t*)&g_zcl_seAttrs[n].cur_sum_delivered   }, \
+    {ZCL_ATTRID_CURRENT_TIER_1_SUMMATION_DELIVERD,  ZCL_UINT48,     RR, (uint8_t*)&g_zcl_seAttrs[n].tariff_1            }, \
+    {ZCL_ATTRID_CURRENT_TIER_2_SUMMATION_DELIVERD,  ZCL_UINT48,     RR, (uint8_t*)&g_zcl_seAttrs[n].tariff_2            }, \
+    {ZCL_ATTRID_CURRENT_TIER_3_SUMMATION_DELIVERD,  ZCL_UINT48,     RR, (uint8_t*)&g_zcl_seAttrs[n].tariff_3            }, \
+    {ZCL_ATTRID_CURRENT_TIER_4_SUMMATION_DELIVERD,  ZCL_UINT48,     RR, (uint8_t*)&g_zcl_seAttrs[n].tariff_4            }, \
+    {ZCL_ATTRID_STATUS,                             ZCL_BITMAP8,    RR, (uint8_t*)&g_zcl_seAttrs[n].status              }, \
+    {ZCL_ATTRID_UNIT_OF_MEASURE,                    ZCL_UINT8,      R,  (uint8_t*)&g_zcl_seAttrs[n].unit_of_measure     }, \
+    {ZCL_ATTRID_MULTIPLIER,                         ZCL_UINT24,     RR, (uint8_t*)&g_zcl_seAttrs[n].multiplier          }, \
+    {ZCL_ATTRID_DIVISOR,                            ZCL_UINT24,     RR, (uint8_t*)&g_zcl_seAttrs[n].divisor             }, \
+    {ZCL_ATTRID_SUMMATION_FORMATTING,               ZCL_BITMAP8,    R,  (uint8_t*)&g_zcl_seAttrs[n].summation_formatting}, \
+    {ZCL_ATTRID_REMAINING_BATTERY_LIFE,             ZCL_UINT8,      RR, (uint8_t*)&g_zcl_seAttrs[n].battery_percentage  }, \
+    {ZCL_ATTRID_METER_SERIAL_NUMBER,                ZCL_OCTET_STR,  RR, (uint8_t*)&g_zcl_seAttrs[n].serial_number       }, \
+    {ZCL_ATTRID_METERING_DEVICE_TYPE,               ZCL_BITMAP8,    R,  (uint8_t*)&g_zcl_seAttrs[n].device_type         }, \
+    {ZCL_ATTRID_CUSTOM_DEVICE_ADDRESS,              ZCL_UINT32,     RW, (uint8_t*)&g_zcl_seAttrs[n].device_address      }, \
+    {ZCL_ATTRID_CUSTOM_DEVICE_PASSWORD,             ZCL_OCTET_STR,  RW, (uint8_t*)&g_zcl_seAttrs[n].device_password     }, \
+    {ZCL_ATTRID_CUSTOM_PROFILE_TIME,                ZCL_UTC,        RR, (uint8_t*)&g_zcl_seAttrs[n].profile_time        }, \
+    {ZCL_ATTRID_CUSTOM_PROFILE_ENERGY,              ZCL_UINT32,     RR, (uint8_t*)&g_zcl_seAttrs[n].profile_energy      }, \
+    {ZCL_ATTRID_CUSTOM_PROFILE_ENTRIES,             ZCL_OCTET_STR,  RR, (uint8_t*)&g_zcl_seAttrs[n].profile_entries     }, \
+    {ZCL_ATTRID_CUSTOM_DATE_RELEASE,                ZCL_OCTET_STR,  RR, (uint8_t*)&g_zcl_seAttrs[n].date_release        }, \
+    {ZCL_ATTRID_CUSTOM_DEVICE_MODEL,                ZCL_OCTET_STR,  RR, (uint8_t*)&g_zcl_seAttrs[n].device_name         }, \
     { ZCL_ATTRID_GLOBAL_CLUSTER_REVISION,           ZCL_UINT16,     R,  (uint8_t*)&zcl_attr_global_clusterRevision      },
+
+const zclAttrInfo_t se_attrTbl[] = {
+    SE_METER_ATTRS(0)
+    {ZCL_ATTRID_CUSTOM_DEVICE_MANUFACTURER,         ZCL_ENUM8,      RW, (uint8_t*)&g_zcl_seBusAttrs.device_model        },
+    {ZCL_ATTRID_CUSTOM_MEASUREMENT_PERIOD,          ZCL_UINT8,      RW, (uint8_t*)&g_zcl_seBusAttrs.measurement_period  },
+    {ZCL_ATTRID_CUSTOM_POWER_PERIOD,                ZCL_UINT16,     RW, (uint8_t*)&g_zcl_seBusAttrs.power_period        },
+    {ZCL_ATTRID_CUSTOM_VOLTAGE_PERIOD,              ZCL_UINT16,     RW, (uint8_t*)&g_zcl_seBusAttrs.voltage_period      },
+    {ZCL_ATTRID_CUSTOM_PROFILE_DEPTH,               ZCL_UINT16,     RW, (uint8_t*)&g_zcl_seBusAttrs.profile_depth       },
+    {ZCL_ATTRID_CUSTOM_KEEP_SESSION,                ZCL_BOOLEAN,    RW, (uint8_t*)&g_zcl_seBusAttrs.keep_session        },
+    {ZCL_ATTRID_CUSTOM_SECURITY_LEVEL,              ZCL_ENUM8,      RW, (uint8_t*)&g_zcl_seBusAttrs.security_level      },
+    {ZCL_ATTRID_CUSTOM_SYSTEM_TITLE,                ZCL_OCTET_STR,  RW, (uint8_t*)&g_zcl_seBusAttrs.system_title        },
+    {ZCL_ATTRID_CUSTOM_ENCRYPTION_KEY,              ZCL_OCTET_STR,  W,  (uint8_t*)&g_zcl_seBusAttrs.encryption_key      },
+    {ZCL_ATTRID_CUSTOM_AUTHENTICATION_KEY,          ZCL_OCTET_STR,  W,  (uint8_t*)&g_zcl_seBusAttrs.authentication_key  },
 };
 
 #define ZCL_SE_ATTR_NUM    sizeof(se_attrTbl) / sizeof(zclAttrInfo_t)
 
-zcl_msAttr_t g_zcl_msAttrs = {
-    .type = (MS_ACTIVE | MS_PHASE_A | MS_PHASE_B | MS_PHASE_C),
-    .currentA = 0xffff,
-    .currentB = 0xffff,
-    .currentC = 0xffff,
-    .currentN = 0xffff,
-    .current_multiplier = 1,
-    .current_divisor = 1,
-    .voltageA = 0xffff,
-    .voltageB = 0xffff,
-    .voltageC = 0xffff,
-    .voltage_multiplier = 1,
-    .voltage_divisor = 1,
-    .powerA = 0xffff,
-    .powerB = 0xffff,
-    .powerC = 0xffff,
-    .power_multiplier = 1,
-    .power_divisor = 1,
+zcl_msAttr_t g_zcl_msAttrs[METER_MAX] = {
+    [0] = {
+        .type = (MS_ACTIVE | MS_PHASE_A | MS_PHASE_B | MS_PHASE_C),
+        .currentA = 0xffff,
+        .currentB = 0xffff,
+        .currentC = 0xffff,
+        .currentN = 0xffff,
+        .current_multiplier = 1,
+        .current_divisor = 1,
+        .voltageA = 0xffff,
+        .voltageB = 0xffff,
+        .voltageC = 0xffff,
+        .voltage_multiplier = 1,
+        .voltage_divisor = 1,
+        .powerA = 0xffff,
+        .powerB = 0xffff,
+        .powerC = 0xffff,
+        .power_multiplier = 1,
+        .power_divisor = 1,
+    },
 };
 
+#define MS_METER_ATTRS(n) \
+    {ZCL_ATTRID_MEASUREMENT_TYPE,           ZCL_BITMAP32, R,    (uint8_t*)&g_zcl_msAttrs[n].type                }, \
+    {ZCL_ATTRID_RMS_CURRENT,                ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs[n].currentA            }, \
+    {ZCL_ATTRID_RMS_CURRENT_PHB,            ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs[n].currentB            }, \
+    {ZCL_ATTRID_RMS_CURRENT_PHC,            ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs[n].currentC            }, \
+    {ZCL_ATTRID_NEUTRAL_CURRENT,            ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs[n].currentN            }, \
+    {ZCL_ATTRID_AC_CURRENT_MULTIPLIER,      ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs[n].current_multiplier  }, \
+    {ZCL_ATTRID_AC_CURRENT_DIVISOR,         ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs[n].current_divisor     }, \
+    {ZCL_ATTRID_RMS_VOLTAGE,                ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs[n].voltageA            }, \
+    {ZCL_ATTRID_RMS_VOLTAGE_PHB,            ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs[n].voltageB            }, \
+    {ZCL_ATTRID_RMS_VOLTAGE_PHC,            ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs[n].voltageC            }, \
+    {ZCL_ATTRID_AC_VOLTAGE_MULTIPLIER,      ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs[n].voltage_multiplier  }, \
+    {ZCL_ATTRID_AC_VOLTAGE_DIVISOR,         ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs[n].voltage_divisor     }, \
+    {ZCL_ATTRID_ACTIVE_POWER,               ZCL_INT16,    RR,   (uint8_t*)&g_zcl_msAttrs[n].powerA              }, \
+    {ZCL_ATTRID_ACTIVE_POWER_PHB,           ZCL_INT16,    RR,   (uint8_t*)&g_zcl_msAttrs[n].powerB              }, \
+    {ZCL_ATTRID_ACTIVE_POWER_PHC,           ZCL_INT16,    RR,   (uint8_t*)&g_zcl_msAttrs[n].powerC              }, \
+    {ZCL_ATTRID_AC_POWER_MULTIPLIER,        ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs[n].power_multiplier    }, \
+    {ZCL_ATTRID_AC_POWER_DIVISOR,           ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs[n].power_divisor       }, \
+    { ZCL_ATTRID_GLOBAL_CLUSTER_REVISION,   ZCL_UINT16,   R,    (uint8_t*)&zcl_attr_global_clusterRevision      },
+
 const zclAttrInfo_t ms_attrTbl[] = {
-    {ZCL_ATTRID_MEASUREMENT_TYPE,           ZCL_BITMAP32, R,    (uint8_t*)&g_zcl_msAttrs.type               },
-    {ZCL_ATTRID_RMS_CURRENT,                ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs.currentA           },
-    {ZCL_ATTRID_RMS_CURRENT_PHB,            ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs.currentB           },
-    {ZCL_ATTRID_RMS_CURRENT_PHC,            ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs.currentC           },
-    {ZCL_ATTRID_NEUTRAL_CURRENT,            ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs.currentN           },
-    {ZCL_ATTRID_AC_CURRENT_MULTIPLIER,      ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs.current_multiplier },
-    {ZCL_ATTRID_AC_CURRENT_DIVISOR,         ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs.current_divisor    },
-    {ZCL_ATTRID_RMS_VOLTAGE,                ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs.voltageA           },
-    {ZCL_ATTRID_RMS_VOLTAGE_PHB,            ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs.voltageB           },
-    {ZCL_ATTRID_RMS_VOLTAGE_PHC,            ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs.voltageC           },
-    {ZCL_ATTRID_AC_VOLTAGE_MULTIPLIER,      ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs.voltage_multiplier },
-    {ZCL_ATTRID_AC_VOLTAGE_DIVISOR,         ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs.voltage_divisor    },
-    {ZCL_ATTRID_ACTIVE_POWER,               ZCL_INT16,    RR,   (uint8_t*)&g_zcl_msAttrs.powerA             },
-    {ZCL_ATTRID_ACTIVE_POWER_PHB,           ZCL_INT16,    RR,   (uint8_t*)&g_zcl_msAttrs.powerB             },
-    {ZCL_ATTRID_ACTIVE_POWER_PHC,           ZCL_INT16,    RR,   (uint8_t*)&g_zcl_msAttrs.powerC             },
-    {ZCL_ATTRID_AC_POWER_MULTIPLIER,        ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs.power_multiplier   },
-    {ZCL_ATTRID_AC_POWER_DIVISOR,           ZCL_UINT16,   RR,   (uint8_t*)&g_zcl_msAttrs.power_divisor      },
-
-    { ZCL_ATTRID_GLOBAL_CLUSTER_REVISION,   ZCL_UINT16,   R,    (uint8_t*)&zcl_attr_global_clusterRevision  },
+    MS_METER_ATTRS(0)
 };
 
 #define ZCL_MS_ATTR_NUM    sizeof(ms_attrTbl) / sizeof(zclAttrInfo_t)
@@ -280,6 +312,52 @@ const zclAttrInfo_t temp_attrTbl[] =
 
 #define ZCL_TEMP_ATTR_NUM    sizeof(temp_attrTbl) / sizeof(zclAttrInfo_t)
 
+#ifdef ZCL_DIAGNOSTICS
+/* Diagnostics, the counters of the uart and of the link of every meter. The attributes are
+ * manufacturer specific, the cluster is registered with the code of the node */
+zcl_diagAttr_t g_zcl_diagAttrs[METER_MAX] = {
+    [0] = {
+        .cycle_min      = 0xffff,
+    },
+};
+
+uint8_t g_zcl_diagMeter;
+
+#define DIAG_METER_ATTRS(n) \
+    {ZCL_ATTRID_CUSTOM_UART_RX_BYTES,                         ZCL_UINT32, R,  (uint8_t*)&g_zcl_diagAttrs[n].uart_rx_bytes                         }, \
+    {ZCL_ATTRID_CUSTOM_UART_RING_OVERRUNS,                    ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].uart_ring_overruns                    }, \
+    {ZCL_ATTRID_CUSTOM_UART_DMA_OVERFLOWS,                    ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].uart_dma_overflows                    }, \
+    {ZCL_ATTRID_CUSTOM_FRAMES_OK,                             ZCL_UINT32, R,  (uint8_t*)&g_zcl_diagAttrs[n].frames_ok                             }, \
+    {ZCL_ATTRID_CUSTOM_RETRIES,                               ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].retries                               }, \
+    {ZCL_ATTRID_CUSTOM_ASSOCIATION_FAILURES,                  ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].assoc_failures                        }, \
+    {ZCL_ATTRID_CUSTOM_CYCLES,                                ZCL_UINT32, R,  (uint8_t*)&g_zcl_diagAttrs[n].cycles                                }, \
+    {ZCL_ATTRID_CUSTOM_CYCLE_MIN,                             ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].cycle_min                             }, \
+    {ZCL_ATTRID_CUSTOM_CYCLE_AVG,                             ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].cycle_avg                             }, \
+    {ZCL_ATTRID_CUSTOM_CYCLE_MAX,                             ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].cycle_max                             }, \
+    {ZCL_ATTRID_CUSTOM_PKT_ERROR(PKT_ERR_NO_PKT),             ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].pkt_errors[PKT_ERR_NO_PKT]            }, \
+    {ZCL_ATTRID_CUSTOM_PKT_ERROR(PKT_ERR_TIMEOUT),            ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].pkt_errors[PKT_ERR_TIMEOUT]           }, \
+    {ZCL_ATTRID_CUSTOM_PKT_ERROR(PKT_ERR_UNKNOWN_FORMAT),     ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].pkt_errors[PKT_ERR_UNKNOWN_FORMAT]    }, \
+    {ZCL_ATTRID_CUSTOM_PKT_ERROR(PKT_ERR_DIFFERENT_COMMAND),  ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].pkt_errors[PKT_ERR_DIFFERENT_COMMAND] }, \
+    {ZCL_ATTRID_CUSTOM_PKT_ERROR(PKT_ERR_INCOMPLETE),         ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].pkt_errors[PKT_ERR_INCOMPLETE]        }, \
+    {ZCL_ATTRID_CUSTOM_PKT_ERROR(PKT_ERR_UNSTUFFING),         ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].pkt_errors[PKT_ERR_UNSTUFFING]        }, \
+    {ZCL_ATTRID_CUSTOM_PKT_ERROR(PKT_ERR_ADDRESS),            ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].pkt_errors[PKT_ERR_ADDRESS]           }, \
+    {ZCL_ATTRID_CUSTOM_PKT_ERROR(PKT_ERR_DEST_ADDRESS),       ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].pkt_errors[PKT_ERR_DEST_ADDRESS]      }, \
+    {ZCL_ATTRID_CUSTOM_PKT_ERROR(PKT_ERR_SRC_ADDRESS),        ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].pkt_errors[PKT_ERR_SRC_ADDRESS]       }, \
+    {ZCL_ATTRID_CUSTOM_PKT_ERROR(PKT_ERR_RESPONSE),           ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].pkt_errors[PKT_ERR_RESPONSE]          }, \
+    {ZCL_ATTRID_CUSTOM_PKT_ERROR(PKT_ERR_CRC),                ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].pkt_errors[PKT_ERR_CRC]               }, \
+    {ZCL_ATTRID_CUSTOM_PKT_ERROR(PKT_ERR_UART),               ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].pkt_errors[PKT_ERR_UART]              }, \
+    {ZCL_ATTRID_CUSTOM_PKT_ERROR(PKT_ERR_TYPE),               ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].pkt_errors[PKT_ERR_TYPE]              }, \
+    {ZCL_ATTRID_CUSTOM_PKT_ERROR(PKT_ERR_SEGMENTATION),       ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].pkt_errors[PKT_ERR_SEGMENTATION]      }, \
+    {ZCL_ATTRID_CUSTOM_PKT_ERROR(PKT_ERR_SECURITY),           ZCL_UINT16, R,  (uint8_t*)&g_zcl_diagAttrs[n].pkt_errors[PKT_ERR_SECURITY]          }, \
+    {ZCL_ATTRID_GLOBAL_CLUSTER_REVISION,                      ZCL_UINT16, R,  (uint8_t*)&zcl_attr_global_clusterRevision                          },
+
+const zclAttrInfo_t diag_attrTbl[] = {
+    DIAG_METER_ATTRS(0)
+};
+
+#define ZCL_DIAG_ATTR_NUM    sizeof(diag_attrTbl) / sizeof(zclAttrInfo_t)
+#endif
+
 #ifdef ZCL_GROUP
 /* Group */
 zcl_groupAttr_t g_zcl_groupAttrs =
@@ -341,7 +419,159 @@ const zcl_specClusterInfo_t g_appClusterList[] =
     {ZCL_CLUSTER_SE_METERING,               MANUFACTURER_CODE_NONE, ZCL_SE_ATTR_NUM,        se_attrTbl,         zcl_metering_register,          app_meteringCb  },
     {ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, MANUFACTURER_CODE_NONE, ZCL_MS_ATTR_NUM,        ms_attrTbl,         zcl_electricalMeasure_register, NULL            },
     {ZCL_CLUSTER_GEN_DEVICE_TEMP_CONFIG,    MANUFACTURER_CODE_NONE, ZCL_TEMP_ATTR_NUM,      temp_attrTbl,       zcl_devTemperatureCfg_register, NULL            },
+#ifdef ZCL_DIAGNOSTICS
+    {ZCL_CLUSTER_GEN_DIAGNOSTICS,           MANUFACTURER_CODE_TELINK, ZCL_DIAG_ATTR_NUM,    diag_attrTbl,       zcl_diagnostics_register,       NULL            },
+#endif
 };
 
 uint8_t APP_CB_CLUSTER_NUM = (sizeof(g_appClusterList)/sizeof(g_appClusterList[0]));
 
+
+#if METER_MAX > 1
+/*
+ *  Endpoints of the meters 1.. on the bus. The cluster list and the attribute templates are shared,
+ *  the tables of every meter are instanced in flash and point to its own value blocks in RAM.
+ */
+#if METER_MAX + ZCL_GP_SUPPORT > MAX_ACTIVE_EP_NUMBER
+#error "METER_MAX is too big for MAX_ACTIVE_EP_NUMBER"
+#endif
+
+const uint16_t app_meterInClusterList[] = {
+    ZCL_CLUSTER_SE_METERING,
+    ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT,
+#ifdef ZCL_DIAGNOSTICS
+    ZCL_CLUSTER_GEN_DIAGNOSTICS,
+#endif
+};
+
+#define APP_METER_IN_CLUSTER_NUM    (sizeof(app_meterInClusterList)/sizeof(app_meterInClusterList[0]))
+
+#ifdef ZCL_DIAGNOSTICS
+#define METER_ATTR_TBL(n) \
+    const zclAttrInfo_t se_attrTbl_##n[] = { SE_METER_ATTRS(n) }; \
+    const zclAttrInfo_t ms_attrTbl_##n[] = { MS_METER_ATTRS(n) }; \
+    const zclAttrInfo_t diag_attrTbl_##n[] = { DIAG_METER_ATTRS(n) };
+
+#define METER_DIAG_CLUSTER(n) \
+    {ZCL_CLUSTER_GEN_DIAGNOSTICS,           MANUFACTURER_CODE_TELINK, ZCL_DIAG_ATTR_NUM,    diag_attrTbl_##n,   zcl_diagnostics_register,       NULL            },
+#else
+#define METER_ATTR_TBL(n) \
+    const zclAttrInfo_t se_attrTbl_##n[] = { SE_METER_ATTRS(n) }; \
+    const zclAttrInfo_t ms_attrTbl_##n[] = { MS_METER_ATTRS(n) };
+
+#define METER_DIAG_CLUSTER(n)
+#endif
+
+#define METER_SIMPLE_DESC(n) \
+    { HA_PROFILE_ID, HA_DEV_METER_INTERFACE, METER_ENDPOINT(n), 1, 0, \
+      APP_METER_IN_CLUSTER_NUM, 0, (uint16_t *)app_meterInClusterList, NULL },
+
+#define METER_CLUSTER_LIST(n) { \
+    {ZCL_CLUSTER_SE_METERING,               MANUFACTURER_CODE_NONE, ZCL_SE_METER_ATTR_NUM,  se_attrTbl_##n,     zcl_metering_register,          app_meteringCb  }, \
+    {ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, MANUFACTURER_CODE_NONE, ZCL_MS_ATTR_NUM,        ms_attrTbl_##n,     zcl_electricalMeasure_register, NULL            }, \
+    METER_DIAG_CLUSTER(n) \
+},
+
+/* X(n) for every meter 1..METER_MAX-1 */
+#define METER_EP_1(X)   X(1)
+#if METER_MAX > 2
+#define METER_EP_2(X)   X(2)
+#else
+#define METER_EP_2(X)
+#endif
+#if METER_MAX > 3
+#define METER_EP_3(X)   X(3)
+#else
+#define METER_EP_3(X)
+#endif
+#if METER_MAX > 4
+#define METER_EP_4(X)   X(4)
+#else
+#define METER_EP_4(X)
+#endif
+#if METER_MAX > 5
+#define METER_EP_5(X)   X(5)
+#else
+#define METER_EP_5(X)
+#endif
+#if METER_MAX > 6
+#define METER_EP_6(X)   X(6)
+#else
+#define METER_EP_6(X)
+#endif
+#if METER_MAX > 7
+#define METER_EP_7(X)   X(7)
+#else
+#define METER_EP_7(X)
+#endif
+
+#define METER_EP_EACH(X) \
+    METER_EP_1(X) METER_EP_2(X) METER_EP_3(X) METER_EP_4(X) METER_EP_5(X) METER_EP_6(X) METER_EP_7(X)
+
+METER_EP_EACH(METER_ATTR_TBL)
+
+#define ZCL_SE_METER_ATTR_NUM   sizeof(se_attrTbl_1) / sizeof(zclAttrInfo_t)
+
+const af_simple_descriptor_t app_meterSimpleDesc[METER_MAX-1] = {
+    METER_EP_EACH(METER_SIMPLE_DESC)
+};
+
+const zcl_specClusterInfo_t g_meterClusterList[METER_MAX-1][APP_METER_CB_CLUSTER_NUM] = {
+    METER_EP_EACH(METER_CLUSTER_LIST)
+};
+#endif /* METER_MAX > 1 */
+
+/* Endpoint/cluster -> cluster of ZCL. zcl_findCluster() of the SDK walks the whole cluster
+ * list, which grows with every meter, the lookups of the poll cycle stop at the cache */
+#define APP_CLUSTER_CACHE_NUM   (ZCL_CLUSTER_NUM_MAX * 2)
+
+static clusterInfo_t *app_clusterCache[APP_CLUSTER_CACHE_NUM];
+
+clusterInfo_t *app_findCluster(uint8_t endpoint, uint16_t clusterId) {
+
+    uint8_t h = (clusterId ^ (clusterId >> 8) ^ (endpoint * 13)) % APP_CLUSTER_CACHE_NUM;
+    clusterInfo_t *pCluster = app_clusterCache[h];
+
+    if (pCluster && pCluster->endpoint == endpoint && pCluster->clusterID == clusterId) {
+        return pCluster;
+    }
+
+    /* the clusters are registered once at start, the pointer does not change */
+    pCluster = zcl_findCluster(endpoint, clusterId);
+    if (pCluster) {
+        app_clusterCache[h] = pCluster;
+    }
+
+    return pCluster;
+}
+
+zclAttrInfo_t *app_findAttribute(uint8_t endpoint, uint16_t clusterId, uint16_t attrId) {
+
+    clusterInfo_t *pCluster = app_findCluster(endpoint, clusterId);
+
+    if (!pCluster) {
+        return NULL;
+    }
+
+    for (uint8_t i = 0; i < pCluster->attrNum; i++) {
+        if (pCluster->attrTable[i].id == attrId) {
+            return (zclAttrInfo_t*)&pCluster->attrTable[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* zcl_setAttrVal() through the cache */
+status_t app_setAttrVal(uint8_t endpoint, uint16_t clusterId, uint16_t attrId, uint8_t *val) {
+
+    zclAttrInfo_t *pAttrEntry = app_findAttribute(endpoint, clusterId, attrId);
+
+    if (!pAttrEntry) {
+        return ZCL_STA_UNSUPPORTED_ATTRIBUTE;
+    }
+
+    memcpy(pAttrEntry->data, val, zcl_getAttrSize(pAttrEntry->type, val));
+
+    return ZCL_STA_SUCCESS;
+}
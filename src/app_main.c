@@ -104,6 +104,19 @@ void user_app_init(void)
 	/* Register ZCL specific cluster information */
 	zcl_register(APP_ENDPOINT_1, APP_CB_CLUSTER_NUM, (zcl_specClusterInfo_t *)g_appClusterList);
 
+#if METER_MAX > 1
+	/* Register endPoints of the meters on the bus, values from the template of the first meter */
+	for (uint8_t idx = 1; idx < METER_MAX; idx++) {
+	    g_zcl_seAttrs[idx] = g_zcl_seAttrs[0];
+	    g_zcl_msAttrs[idx] = g_zcl_msAttrs[0];
+#ifdef ZCL_DIAGNOSTICS
+	    g_zcl_diagAttrs[idx] = g_zcl_diagAttrs[0];
+#endif
+	    af_endpointRegister(METER_ENDPOINT(idx), (af_simple_descriptor_t *)&app_meterSimpleDesc[idx-1], zcl_rx_handler, NULL);
+	    zcl_register(METER_ENDPOINT(idx), APP_METER_CB_CLUSTER_NUM, (zcl_specClusterInfo_t *)g_meterClusterList[idx-1]);
+	}
+#endif
+
 #if ZCL_GP_SUPPORT
 	/* Initialize GP */
 	gp_init(APP_ENDPOINT_1);
@@ -142,6 +155,7 @@ void app_task(void) {
 
     button_handler();
     tamper_handler();
+    app_uart_handler();
 
     if(BDB_STATE_GET() == BDB_STATE_IDLE){
 
@@ -176,7 +176,7 @@ void get_temp_handler(void *args) {
 #if UART_PRINTF_MODE && DEBUG_TEMPERATURE
         printf("Temperature: %d\r\n", temp3);
 #endif
-        zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_GEN_DEVICE_TEMP_CONFIG, ZCL_ATTRID_DEV_TEMP_CURR_TEMP, (uint8_t*)&temp3);
+        app_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_GEN_DEVICE_TEMP_CONFIG, ZCL_ATTRID_DEV_TEMP_CURR_TEMP, (uint8_t*)&temp3);
     }
 }
 
@@ -1,8 +1,76 @@
 #include "app_main.h"
 
-uart_data_t rec_buff = {0,  {0, } };
-uint8_t  uart_buff[UART_BUFF_SIZE];
-uint16_t uart_head, uart_tail;
+/* the dma receives into one buffer while the other one is copied to the ring */
+uart_data_t rec_buff[2];
+static uint8_t rec_idx = 0;
+
+/*
+ *  Single producer (uart irq) / single consumer (main loop) ring buffer.
+ *  The indices run free, head is written by the producer only, tail by the consumer only.
+ *  The data is stored before head moves and read before tail moves.
+ */
+#if (UART_BUFF_SIZE & UART_BUFF_MASK) || UART_BUFF_SIZE > 0x8000
+#error "UART_BUFF_SIZE must be a power of 2"
+#endif
+
+static uint8_t  uart_buff[UART_BUFF_SIZE];
+static volatile uint16_t uart_head, uart_tail;
+
+#define UART_BARRIER()  __asm__ __volatile__("" ::: "memory")
+
+static uart_rx_handler_t uart_rx_handler = NULL;
+
+/*
+ *  Transmit queue, the main loop writes whole frames, the dma of the SDK sends them in chunks
+ *  of UART_DATA_LEN. A one-shot hardware timer comes at the estimated end of the chunk, checks
+ *  that the fifo is empty and starts the next one. The done handler is called from the main
+ *  loop with the time the last stop bit has gone out.
+ */
+#if (UART_TX_BUFF_SIZE & UART_TX_BUFF_MASK) || UART_TX_BUFF_SIZE > 0x8000
+#error "UART_TX_BUFF_SIZE must be a power of 2"
+#endif
+
+static uint8_t  uart_tx_buff[UART_TX_BUFF_SIZE];
+static volatile uint16_t uart_tx_head, uart_tx_tail;
+static uart_data_t tx_dma;                          /* the chunk the dma is reading */
+static volatile uint8_t uart_tx_busy = false;       /* from the first dma to the end of the last stop bit */
+static uint32_t uart_char_us;                       /* one character of 10 bits at the baudrate */
+static volatile uint8_t uart_tx_complete = false;
+static volatile uint32_t uart_tx_done_time;
+
+static uart_tx_done_handler_t uart_tx_done_handler = NULL;
+
+#if UART_RS485
+/* the pre guard is waited for in the main loop, the post guard is a step of the tx timer */
+#if UART_DE_PRE_US > 200
+#error "UART_DE_PRE_US is a busy wait, keep it short"
+#endif
+#if UART_DE_POST_US > 0xffff
+#error "UART_DE_POST_US is too long"
+#endif
+
+#if UART_RS485_ECHO
+/* the sent bytes stay in the tx queue until their echo is received, from uart_echo_tail to uart_tx_tail */
+static volatile uint16_t uart_echo_tail;
+#endif
+#if UART_DE_POST_US
+static uint8_t uart_de_hold = false;                /* the line is idle, the bus is held for the post guard */
+#endif
+
+/* takes the bus, the transceiver needs some time before the start bit */
+static void uart_de_on() {
+
+    drv_gpio_write(GPIO_UART_DE, 1);
+#if UART_DE_PRE_US
+    sleep_us(UART_DE_PRE_US);
+#endif
+}
+
+static void uart_de_off() {
+
+    drv_gpio_write(GPIO_UART_DE, 0);
+}
+#endif
 
 uint8_t available_buff_uart() {
     if (uart_head != uart_tail) {
@@ -12,56 +80,216 @@ uint8_t available_buff_uart() {
 }
 
 size_t get_queue_len_buff_uart() {
-   return (uart_head - uart_tail) & (UART_BUFF_MASK);
-}
-
-static size_t get_freespace_buff_uart() {
-    return (sizeof(uart_buff)/sizeof(uart_buff[0]) - get_queue_len_buff_uart());
+   return (uint16_t)(uart_head - uart_tail);
 }
 
+/* consumer side, drops what has been received */
 void flush_buff_uart() {
-    uart_head = uart_tail = 0;
-    memset(uart_buff, 0, UART_BUFF_SIZE);
+    uart_tail = uart_head;
 }
 
 uint8_t read_byte_from_buff_uart() {
-    uint8_t ch = uart_buff[uart_tail++];
-    uart_tail &= UART_BUFF_MASK;
+    uint16_t tail = uart_tail;
+    uint8_t ch = uart_buff[tail & UART_BUFF_MASK];
+    UART_BARRIER();
+    uart_tail = tail + 1;
     return ch;
+}
 
+/* contiguous bytes from tail up to the end of the buffer, to be parsed in place and consumed */
+uint8_t *span_buff_uart(size_t *len) {
+    uint16_t tail = uart_tail;
+    size_t queue_len = (uint16_t)(uart_head - tail);
+    size_t offset = tail & UART_BUFF_MASK;
+
+    UART_BARRIER();
+
+    if (queue_len > UART_BUFF_SIZE - offset) queue_len = UART_BUFF_SIZE - offset;
+
+    *len = queue_len;
+
+    return queue_len ? uart_buff + offset : NULL;
 }
 
+/* copies up to len bytes, both segments of the ring, without consuming them */
+size_t peek_bytes_buff_uart(uint8_t *data, size_t len) {
+    uint16_t tail = uart_tail;
+    size_t queue_len = (uint16_t)(uart_head - tail);
+    size_t offset = tail & UART_BUFF_MASK;
+    size_t first;
+
+    UART_BARRIER();
+
+    if (len > queue_len) len = queue_len;
+
+    first = UART_BUFF_SIZE - offset;
+    if (first > len) first = len;
+
+    memcpy(data, uart_buff + offset, first);
+    memcpy(data + first, uart_buff, len - first);
+
+    return len;
+}
+
+void consume_buff_uart(size_t len) {
+    uint16_t tail = uart_tail;
+    size_t queue_len = (uint16_t)(uart_head - tail);
+
+    if (len > queue_len) len = queue_len;
+
+    UART_BARRIER();
+    uart_tail = tail + len;
+}
+
+size_t read_bytes_from_buff_uart(uint8_t *data, size_t len) {
+    len = peek_bytes_buff_uart(data, len);
+    consume_buff_uart(len);
+    return len;
+}
+
+/* producer side, called from the uart irq */
 static size_t write_bytes_to_buff_uart(uint8_t *data, size_t len) {
 
-    size_t free_space = get_freespace_buff_uart();
-    size_t put_len;
+    uint16_t head = uart_head;
+    size_t free_space = UART_BUFF_SIZE - (uint16_t)(head - uart_tail);
+    size_t offset = head & UART_BUFF_MASK;
+    size_t first;
+
+    if (len > free_space) len = free_space;
+
+    first = UART_BUFF_SIZE - offset;
+    if (first > len) first = len;
+
+    memcpy(uart_buff + offset, data, first);
+    memcpy(uart_buff, data + first, len - first);
+
+    UART_BARRIER();
+    uart_head = head + len;
+
+    return len;
+}
+
+
+/* irq or irq disabled, starts the dma on the next chunk of the queue, returns its length */
+static size_t uart_tx_next() {
+
+    uint16_t tail = uart_tx_tail;
+    size_t len = (uint16_t)(uart_tx_head - tail);
+    size_t offset = tail & UART_TX_BUFF_MASK;
+    size_t first;
+
+    if (len == 0) return 0;
+    if (len > UART_DATA_LEN) len = UART_DATA_LEN;
+
+    first = UART_TX_BUFF_SIZE - offset;
+    if (first > len) first = len;
 
-    if (free_space >= len) put_len = len;
-    else put_len = free_space;
+    memcpy(tx_dma.data, uart_tx_buff + offset, first);
+    memcpy(tx_dma.data + first, uart_tx_buff, len - first);
+    tx_dma.dma_len = len;
 
-    for (int i = 0; i < put_len; i++) {
-        uart_buff[uart_head++] = data[i];
-        uart_head &= UART_BUFF_MASK;
+    uart_dma_send((uint8_t*)&tx_dma);
+
+    uart_tx_tail = tail + len;
+
+    return len;
+}
+
+/* irq, the received bytes go from the dma buffer to the ring. tx_over - the sending has ended,
+ * what is not its echo by now is the answer */
+static void uart_rx_take(uint8_t tx_over) {
+
+    uart_data_t *rec = &rec_buff[rec_idx];
+    uint32_t skip = 0, len;
+
+#if UART_RS485 && UART_RS485_ECHO
+    uint16_t echo = uart_echo_tail;
+#endif
+
+    if (rec->dma_len) {
+        /* swap first so the next bytes go to the other buffer while this one is copied */
+        rec_idx ^= 1;
+        rec_buff[rec_idx].dma_len = 0;
+#if defined(MCU_CORE_8258) || defined(MCU_CORE_8278)
+        uart_recbuff_init((uint8_t*)&rec_buff[rec_idx], sizeof(uart_data_t));
+#endif
+    }
+
+#if UART_RS485 && UART_RS485_ECHO
+    /* the echo of the sent bytes is ahead of the answer, it is dropped while it matches them.
+     * The first other byte is the answer */
+    while (skip < rec->dma_len && echo != uart_tx_tail &&
+           rec->data[skip] == uart_tx_buff[echo & UART_TX_BUFF_MASK]) {
+        skip++;
+        echo++;
     }
 
-    return put_len;
+    /* the answer has started, or the sending is over and the rest of its echo has been lost */
+    if (skip < rec->dma_len || tx_over) echo = uart_tx_tail;
+    uart_echo_tail = echo;
+#endif
+
+    if (rec->dma_len == 0) return;
+
+    zcl_diagAdd(uart_rx_bytes, rec->dma_len);
+    if (rec->dma_len >= UART_DATA_LEN) zcl_diagInc(uart_dma_overflows);
+
+    len = rec->dma_len - skip;
+    if (write_bytes_to_buff_uart(rec->data + skip, len) < len) zcl_diagInc(uart_ring_overruns);
+    rec->dma_len = 0;
 }
 
+/* hardware timer at the estimated end of the chunk, the irq_handler of the SDK calls it.
+ * Returns the next interval in us, -1 stops the timer */
+static int app_uartTxTimerCb(void *arg) {
 
-static void app_uartRecvCb() {
+    size_t len;
+
+    /* the dma has started late, the fifo is still sending */
+    if (uart_tx_is_busy()) return UART_TX_POLL_US;
+
+    /* the line is idle, unless more has been queued meanwhile */
+    len = uart_tx_next();
 
-    uint8_t write_len;
+#if UART_RS485 && UART_RS485_ECHO
+    /* the echo of the chunk is in. It leaves the rx buffer now, not on the rx timeout after the
+     * answer, so the echo and a quick answer do not overflow one dma buffer together */
+    uart_rx_take(len == 0);
+#endif
 
-    write_len = write_bytes_to_buff_uart(rec_buff.data, rec_buff.dma_len);
+    if (len) {
+#if UART_RS485 && UART_DE_POST_US
+        uart_de_hold = false;
+#endif
+        return len * uart_char_us;
+    }
 
-    if (write_len != 0) {
-        if (write_len == rec_buff.dma_len) {
-            rec_buff.dma_len = 0;
-        } else if (write_len < rec_buff.dma_len) {
-            memcpy(rec_buff.data, rec_buff.data+write_len, rec_buff.dma_len-write_len);
-            rec_buff.dma_len -= write_len;
-        }
+#if UART_RS485 && UART_DE_POST_US
+    /* the bus is released on the next step, not waited for in the irq */
+    if (!uart_de_hold) {
+        uart_de_hold = true;
+        uart_tx_done_time = clock_time();
+        return UART_DE_POST_US;
     }
+    uart_de_hold = false;
+#else
+    uart_tx_done_time = clock_time();
+#endif
+
+#if UART_RS485
+    uart_de_off();
+#endif
+
+    uart_tx_busy = false;
+    uart_tx_complete = true;
+
+    return -1;
+}
+
+/* comes on the rx timeout, i.e. the line has been idle after the last byte of a frame */
+static void app_uartRecvCb() {
+
+    uart_rx_take(!uart_tx_busy);
 }
 
 void app_uart_init(uint32_t baudrate) {
@@ -80,16 +308,98 @@ void app_uart_init(uint32_t baudrate) {
 //            break;
 //    }
 
-    drv_uart_init(baudrate, (uint8_t*)&rec_buff, sizeof(uart_data_t), app_uartRecvCb);
+    rec_idx = 0;
+    rec_buff[0].dma_len = rec_buff[1].dma_len = 0;
+
+    drv_hwTmr_cancel(UART_TX_TIMER);
+    drv_hwTmr_init(UART_TX_TIMER, TIMER_MODE_SCLK);
+    uart_char_us = (10 * 1000000 + baudrate - 1) / baudrate;
+
+    uart_tx_tail = uart_tx_head;
+    uart_tx_busy = uart_tx_complete = false;
+#if UART_RS485
+#if UART_RS485_ECHO
+    uart_echo_tail = uart_tx_tail;
+#endif
+#if UART_DE_POST_US
+    uart_de_hold = false;
+#endif
+    drv_gpio_write(GPIO_UART_DE, 0);
+#endif
+
+    drv_uart_init(baudrate, (uint8_t*)&rec_buff[rec_idx], sizeof(uart_data_t), app_uartRecvCb);
+
+#if defined(MCU_CORE_8258) || defined(MCU_CORE_8278)
+    /* the tx dma is started here directly, not by drv_uart_tx_start(). Its irq would run
+     * drv_uart_tx_irq_handler() and change the status of the SDK driver on every chunk, so it
+     * is masked. The SDK tx path is left idle, drv_uart_tx_start() is not to be used with this */
+    dma_irq_disable(FLD_DMA_CHN_UART_TX);
+
+    /* end of frame after one character (12 bit times) of silence instead of two */
+    reg_uart_rx_timeout1 = (reg_uart_rx_timeout1 & ~FLD_UART_TIMEOUT_MUL) | UART_BW_MUL1;
+#endif
 }
 
+/* queues the whole data or nothing, does not wait for the uart */
 size_t write_bytes_to_uart(uint8_t *data, size_t len) {
 
-    if (len > UART_DATA_LEN) len = UART_DATA_LEN;
+    uint16_t head = uart_tx_head;
+    size_t offset = head & UART_TX_BUFF_MASK;
+    size_t first, chunk;
+    uint8_t r;
+#if UART_RS485 && UART_RS485_ECHO
+    uint16_t tail = uart_echo_tail;                 /* the sent bytes are kept for the echo */
+#else
+    uint16_t tail = uart_tx_tail;
+#endif
 
-    if (drv_uart_tx_start(data, len)) return len;
+    if (len == 0 || len > UART_TX_BUFF_SIZE - (uint16_t)(head - tail)) return 0;
 
-    return 0;
+    first = UART_TX_BUFF_SIZE - offset;
+    if (first > len) first = len;
+
+    memcpy(uart_tx_buff + offset, data, first);
+    memcpy(uart_tx_buff, data + first, len - first);
+
+    UART_BARRIER();
+    uart_tx_head = head + len;
+
+    /* a running transfer takes the new bytes itself */
+    if (!uart_tx_busy) {
+#if UART_RS485
+        uart_de_on();
+#endif
+        r = irq_disable();
+        chunk = uart_tx_next();
+        uart_tx_busy = true;
+        drv_hwTmr_set(UART_TX_TIMER, chunk * uart_char_us, app_uartTxTimerCb, NULL);
+        irq_restore(r);
+    }
+
+    return len;
+}
+
+void app_uart_set_tx_done_handler(uart_tx_done_handler_t handler) {
+
+    uart_tx_done_handler = handler;
+}
+
+void app_uart_set_rx_handler(uart_rx_handler_t handler) {
+
+    uart_rx_handler = handler;
+}
+
+/* called from the main loop, passes the received bytes to the protocol outside of the interrupt */
+void app_uart_handler() {
+
+    if (uart_tx_complete) {
+        uart_tx_complete = false;
+        if (uart_tx_done_handler) uart_tx_done_handler(uart_tx_done_time);
+    }
+
+    if (uart_rx_handler && available_buff_uart()) {
+        uart_rx_handler();
+    }
 }
 
 void app_uart_rx_off() {
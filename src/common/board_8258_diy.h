@@ -71,6 +71,19 @@ enum {
 #define GPIO_UART_TX            UART_TX_PD7
 #define GPIO_UART_RX            UART_RX_PA0
 
+#if UART_RS485
+/* DE and /RE of the transceiver. The pre guard is from DE to the start bit, the post guard
+ * from the last stop bit to the release of the bus. With /RE tied low the sent bytes come back */
+#define GPIO_UART_DE            GPIO_PB4
+#define PB4_FUNC                AS_GPIO
+#define PB4_OUTPUT_ENABLE       ON
+#define PB4_INPUT_ENABLE        OFF
+#define PB4_DATA_OUT            OFF
+#define UART_DE_PRE_US          50
+#define UART_DE_POST_US         0
+#define UART_RS485_ECHO         ON
+#endif
+
 #if UART_PRINTF_MODE
 #define DEBUG_INFO_TX_PIN       GPIO_PB1    //printf
 #define DEBUG_BAUDRATE          115200
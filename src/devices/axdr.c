@@ -0,0 +1,443 @@
+#include "tl_common.h"
+
+#include "axdr.h"
+
+/* bytes of the value after the type tag, AXDR_LENGTH - the length follows the tag */
+int8_t axdr_value_size(uint8_t tag) {
+
+    switch(tag) {
+        case TYPE_NULL:
+            return 0;
+        case TYPE_BOOLEAN:
+        case TYPE_BCD:
+        case TYPE_INTEGER:
+        case TYPE_UNSIGNED:
+        case TYPE_ENUM:
+            return 1;
+        case TYPE_LONG:
+        case TYPE_UNSIGNED_16:
+            return 2;
+        case TYPE_SIGNED_32:
+        case TYPE_UNSIGNED_32:
+        case TYPE_FLOAT_32:
+        case TYPE_TIME:
+            return 4;
+        case TYPE_DATE:
+            return 5;
+        case TYPE_SIGNED_64:
+        case TYPE_UNSIGNED_64:
+        case TYPE_FLOAT_64:
+            return 8;
+        case TYPE_DATE_TIME:
+            return AXDR_DATE_TIME_SIZE;
+        case TYPE_ARRAY:
+        case TYPE_STRUCTURE:
+        case TYPE_BIT_STRING:
+        case TYPE_OCTET_STRING:
+        case TYPE_VISIBLE_STRING:
+        case TYPE_UTF8_STRING:
+        case TYPE_COMPACT_ARRAY:
+            return AXDR_LENGTH;
+        default:
+            return AXDR_UNKNOWN;
+    }
+}
+
+static uint8_t axdr_fail(axdr_t *axdr) {
+
+    axdr->error = true;
+
+    return false;
+}
+
+/* n bytes left in the buffer */
+static uint8_t axdr_left(axdr_t *axdr, size_t n) {
+
+    if (axdr->error || (size_t)(axdr->end - axdr->ptr) < n) return axdr_fail(axdr);
+
+    return true;
+}
+
+/* big endian, up to 8 bytes */
+static uint64_t axdr_read(axdr_t *axdr, uint8_t n) {
+
+    uint64_t value = 0;
+
+    while (n--) {
+        value = (value << 8) | *axdr->ptr++;
+    }
+
+    return value;
+}
+
+void axdr_init(axdr_t *axdr, uint8_t *data, size_t len) {
+
+    axdr->ptr = data;
+    axdr->end = data + len;
+    axdr->error = false;
+}
+
+/* all data is taken without errors */
+uint8_t axdr_end(axdr_t *axdr) {
+
+    return !axdr->error && axdr->ptr == axdr->end;
+}
+
+/* type tag of the next value, the cursor does not move */
+uint8_t axdr_peek(axdr_t *axdr, uint8_t *tag) {
+
+    if (!axdr_left(axdr, 1)) return false;
+
+    *tag = *axdr->ptr;
+
+    return true;
+}
+
+/* length of string or number of elements: | 0..0x7f | or | 0x81 len | or | 0x82 len 2 | */
+uint8_t axdr_get_length(axdr_t *axdr, uint16_t *len) {
+
+    uint8_t n;
+
+    if (!axdr_left(axdr, 1)) return false;
+
+    n = *axdr->ptr++;
+
+    if (n < 0x80) {
+        *len = n;
+        return true;
+    }
+
+    n &= 0x7f;
+
+    if (n == 0 || n > 2 || !axdr_left(axdr, n)) return axdr_fail(axdr);
+
+    *len = axdr_read(axdr, n);
+
+    return true;
+}
+
+/* header of array or structure, the cursor moves to the first element */
+uint8_t axdr_get_container(axdr_t *axdr, uint8_t tag, uint16_t *count) {
+
+    if (!axdr_left(axdr, 1) || *axdr->ptr != tag) return axdr_fail(axdr);
+
+    axdr->ptr++;
+
+    return axdr_get_length(axdr, count);
+}
+
+/* any integer, enum or boolean. Unsigned 64 above INT64_MAX comes as negative */
+uint8_t axdr_get_int(axdr_t *axdr, int64_t *value) {
+
+    uint8_t tag;
+    int8_t size;
+
+    if (!axdr_peek(axdr, &tag)) return false;
+
+    switch(tag) {
+        case TYPE_BOOLEAN:
+        case TYPE_INTEGER:
+        case TYPE_LONG:
+        case TYPE_SIGNED_32:
+        case TYPE_SIGNED_64:
+        case TYPE_UNSIGNED:
+        case TYPE_UNSIGNED_16:
+        case TYPE_UNSIGNED_32:
+        case TYPE_UNSIGNED_64:
+        case TYPE_ENUM:
+            break;
+        default:
+            return axdr_fail(axdr);
+    }
+
+    size = axdr_value_size(tag);
+
+    if (!axdr_left(axdr, size+1)) return false;
+
+    axdr->ptr++;
+
+    *value = axdr_read(axdr, size);
+
+    switch(tag) {
+        case TYPE_INTEGER:
+            *value = (int8_t)*value;
+            break;
+        case TYPE_LONG:
+            *value = (int16_t)*value;
+            break;
+        case TYPE_SIGNED_32:
+            *value = (int32_t)*value;
+            break;
+        default:
+            break;
+    }
+
+    return true;
+}
+
+uint8_t axdr_get_float(axdr_t *axdr, float *value) {
+
+    uint8_t tag;
+    union {
+        uint32_t    u;
+        float       f;
+    } f32;
+    union {
+        uint64_t    u;
+        double      d;
+    } f64;
+
+    if (!axdr_peek(axdr, &tag)) return false;
+
+    if (tag == TYPE_FLOAT_32) {
+        if (!axdr_left(axdr, 5)) return false;
+        axdr->ptr++;
+        f32.u = axdr_read(axdr, 4);
+        *value = f32.f;
+    } else if (tag == TYPE_FLOAT_64) {
+        if (!axdr_left(axdr, 9)) return false;
+        axdr->ptr++;
+        f64.u = axdr_read(axdr, 8);
+        *value = f64.d;
+    } else {
+        return axdr_fail(axdr);
+    }
+
+    return true;
+}
+
+/* octet, visible, utf8 or bit string. The pointer is into the buffer, len of bit string is in bits */
+uint8_t axdr_get_string(axdr_t *axdr, uint8_t *tag, uint8_t **str, uint16_t *len) {
+
+    uint16_t size;
+
+    if (!axdr_peek(axdr, tag)) return false;
+
+    switch(*tag) {
+        case TYPE_OCTET_STRING:
+        case TYPE_VISIBLE_STRING:
+        case TYPE_UTF8_STRING:
+        case TYPE_BIT_STRING:
+            break;
+        default:
+            return axdr_fail(axdr);
+    }
+
+    axdr->ptr++;
+
+    if (!axdr_get_length(axdr, len)) return false;
+
+    size = (*tag == TYPE_BIT_STRING) ? (*len + 7) / 8 : *len;
+
+    if (!axdr_left(axdr, size)) return false;
+
+    *str = axdr->ptr;
+    axdr->ptr += size;
+
+    return true;
+}
+
+/* date-time, date, time or octet string of 12 bytes. Fields which are not sent are 0xff */
+uint8_t axdr_get_date_time(axdr_t *axdr, axdr_date_time_t *date_time) {
+
+    uint8_t tag;
+    uint8_t *ptr;
+    uint16_t len;
+
+    if (!axdr_peek(axdr, &tag)) return false;
+
+    memset(date_time, 0xff, sizeof(axdr_date_time_t));
+    date_time->deviation = (int16_t)0x8000;
+
+    switch(tag) {
+        case TYPE_OCTET_STRING:
+            if (!axdr_get_string(axdr, &tag, &ptr, &len)) return false;
+            if (len != AXDR_DATE_TIME_SIZE) return axdr_fail(axdr);
+            break;
+        case TYPE_DATE_TIME:
+        case TYPE_DATE:
+        case TYPE_TIME:
+            len = axdr_value_size(tag);
+            if (!axdr_left(axdr, len+1)) return false;
+            ptr = ++axdr->ptr;
+            axdr->ptr += len;
+            break;
+        default:
+            return axdr_fail(axdr);
+    }
+
+    if (tag != TYPE_TIME) {
+        date_time->year = (ptr[0] << 8) | ptr[1];
+        date_time->month = ptr[2];
+        date_time->day = ptr[3];
+        date_time->day_of_week = ptr[4];
+        ptr += 5;
+    }
+
+    if (tag != TYPE_DATE) {
+        date_time->hour = ptr[0];
+        date_time->minute = ptr[1];
+        date_time->second = ptr[2];
+        date_time->hundredths = ptr[3];
+        ptr += 4;
+    }
+
+    if (len == AXDR_DATE_TIME_SIZE) {
+        date_time->deviation = (int16_t)((ptr[0] << 8) | ptr[1]);
+        date_time->status = ptr[2];
+    }
+
+    return true;
+}
+
+#define LEAP_YEAR(y)    (((y) % 4 == 0 && (y) % 100 != 0) || (y) % 400 == 0)
+
+/* days before the month in not leap year */
+static const uint16_t month_days[12] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+
+/* seconds from 2000-01-01 00:00:00 in the time of the meter, all fields up to seconds must be specified */
+uint8_t axdr_date_time_to_sec(const axdr_date_time_t *date_time, uint32_t *sec) {
+
+    uint32_t days = 0;
+
+    if (date_time->year < 2000 || date_time->year > 2099 ||
+        date_time->month < 1 || date_time->month > 12 ||
+        date_time->day < 1 || date_time->day > 31 ||
+        date_time->hour > 23 || date_time->minute > 59 || date_time->second > 59) {
+        return false;
+    }
+
+    for (uint16_t year = 2000; year < date_time->year; year++) {
+        days += LEAP_YEAR(year) ? 366 : 365;
+    }
+
+    days += month_days[date_time->month-1] + date_time->day - 1;
+
+    if (date_time->month > 2 && LEAP_YEAR(date_time->year)) days++;
+
+    *sec = ((days * 24 + date_time->hour) * 60 + date_time->minute) * 60 + date_time->second;
+
+    return true;
+}
+
+/* back from seconds from 2000, deviation and status are not specified */
+void axdr_sec_to_date_time(uint32_t sec, axdr_date_time_t *date_time) {
+
+    uint32_t days = sec / 86400;
+    uint16_t year_days, leap;
+    uint8_t month;
+
+    memset(date_time, 0xff, sizeof(axdr_date_time_t));
+    date_time->deviation = (int16_t)0x8000;
+
+    sec %= 86400;
+    date_time->hour = sec / 3600;
+    date_time->minute = (sec / 60) % 60;
+    date_time->second = sec % 60;
+    date_time->hundredths = 0;
+    /* 2000-01-01 is saturday, 1 - monday */
+    date_time->day_of_week = (days + 5) % 7 + 1;
+
+    for (date_time->year = 2000; ; date_time->year++) {
+        year_days = LEAP_YEAR(date_time->year) ? 366 : 365;
+        if (days < year_days) break;
+        days -= year_days;
+    }
+
+    leap = LEAP_YEAR(date_time->year);
+
+    for (month = 12; month > 1; month--) {
+        if (days >= month_days[month-1] + (month > 2 ? leap : 0)) break;
+    }
+
+    date_time->month = month;
+    date_time->day = days - month_days[month-1] - (month > 2 ? leap : 0) + 1;
+}
+
+/* contents of octet string of 12 bytes */
+void axdr_put_date_time(uint8_t *buf, const axdr_date_time_t *date_time) {
+
+    *buf++ = date_time->year >> 8;
+    *buf++ = date_time->year & 0xff;
+    *buf++ = date_time->month;
+    *buf++ = date_time->day;
+    *buf++ = date_time->day_of_week;
+    *buf++ = date_time->hour;
+    *buf++ = date_time->minute;
+    *buf++ = date_time->second;
+    *buf++ = date_time->hundredths;
+    *buf++ = (uint16_t)date_time->deviation >> 8;
+    *buf++ = (uint16_t)date_time->deviation & 0xff;
+    *buf++ = date_time->status;
+}
+
+/* type description of compact array, without recursion */
+static uint8_t axdr_skip_description(axdr_t *axdr) {
+
+    uint32_t pending = 1;
+    uint16_t count;
+    uint8_t tag;
+
+    while (pending--) {
+        if (!axdr_left(axdr, 1)) return false;
+        tag = *axdr->ptr++;
+        if (tag == TYPE_ARRAY) {
+            /* | long-unsigned number of elements | description | */
+            if (!axdr_left(axdr, 2)) return false;
+            axdr->ptr += 2;
+            pending++;
+        } else if (tag == TYPE_STRUCTURE) {
+            if (!axdr_get_length(axdr, &count)) return false;
+            pending += count;
+        } else if (axdr_value_size(tag) == AXDR_UNKNOWN) {
+            return axdr_fail(axdr);
+        }
+    }
+
+    return true;
+}
+
+/* the whole next value with nested arrays and structures, without recursion */
+uint8_t axdr_skip(axdr_t *axdr) {
+
+    uint32_t pending = 1;
+    uint16_t len;
+    uint8_t tag;
+    int8_t size;
+
+    while (pending--) {
+        if (!axdr_left(axdr, 1)) return false;
+        tag = *axdr->ptr++;
+        size = axdr_value_size(tag);
+        if (size == AXDR_UNKNOWN) return axdr_fail(axdr);
+        if (size != AXDR_LENGTH) {
+            if (!axdr_left(axdr, size)) return false;
+            axdr->ptr += size;
+            continue;
+        }
+        switch(tag) {
+            case TYPE_ARRAY:
+            case TYPE_STRUCTURE:
+                if (!axdr_get_length(axdr, &len)) return false;
+                pending += len;
+                break;
+            case TYPE_COMPACT_ARRAY:
+                /* | description | length | contents | */
+                if (!axdr_skip_description(axdr) || !axdr_get_length(axdr, &len) || !axdr_left(axdr, len)) return false;
+                axdr->ptr += len;
+                break;
+            case TYPE_BIT_STRING:
+                if (!axdr_get_length(axdr, &len)) return false;
+                len = (len + 7) / 8;
+                if (!axdr_left(axdr, len)) return false;
+                axdr->ptr += len;
+                break;
+            default:
+                if (!axdr_get_length(axdr, &len) || !axdr_left(axdr, len)) return false;
+                axdr->ptr += len;
+                break;
+        }
+    }
+
+    return true;
+}
@@ -12,7 +12,46 @@ uint8_t new_start = true;
 pkt_error_t pkt_error_no;
 measure_meter_f measure_meter = NULL;
 uint8_t fault_measure_flag = 0;
-ev_timer_event_t *timerFaultMeasurementEvt = NULL;
+static ev_timer_event_t *timerFaultMeasurementEvt = NULL;
+
+#if METER_MAX > 8
+#error "fault_measure_flag has a bit per meter, METER_MAX must be no more than 8"
+#endif
+
+#define POLL_NEXT_METER 20                      /* ms, the next meter is due right after the cycle */
+#define POLL_WAIT_MAX   60                      /* sec, the longest wait of the measurement timer  */
+
+static uint32_t poll_at[METER_MAX][POLL_CLASS_MAX];     /* poll_clock() when the class is due   */
+static uint32_t poll_sec;                       /* sec counted by poll_clock()              */
+static uint32_t poll_tick;                      /* clock_time() of poll_sec                 */
+static uint32_t poll_started;                   /* poll_clock() at the start of the cycle   */
+static uint8_t  poll_classes;                   /* classes of the running cycle             */
+static uint8_t  poll_meter;                     /* meter of the running or the last cycle   */
+#ifdef ZCL_DIAGNOSTICS
+static uint32_t poll_start;                     /* clock_time() at the start of the cycle   */
+static uint32_t poll_ms_sum[METER_MAX];         /* ms of the cycles in the average          */
+static uint32_t poll_ms_num[METER_MAX];         /* cycles in the average                    */
+#endif
+
+/* sec since start. clock_time() wraps in 268 sec, so the timer waits no longer than POLL_WAIT_MAX */
+uint32_t poll_clock() {
+
+    uint32_t sec = (clock_time() - poll_tick) / CLOCK_16M_SYS_TIMER_CLK_1S;
+
+    poll_tick += sec * CLOCK_16M_SYS_TIMER_CLK_1S;
+    poll_sec += sec;
+
+    return poll_sec;
+}
+
+/* g_appCtx is packed, the timer is cancelled through a copy of the pointer */
+static void measure_timer_start(uint32_t timeout) {
+
+    ev_timer_event_t *evt = g_appCtx.timerMeasurementEvt;
+
+    if (evt) TL_ZB_TIMER_CANCEL(&evt);
+    g_appCtx.timerMeasurementEvt = TL_ZB_TIMER_SCHEDULE(measure_meterCb, NULL, timeout);
+}
 
 uint8_t device_model[DEVICE_MAX][32] = {
     {"No Device"},
@@ -42,7 +81,7 @@ uint8_t set_device_model(device_model_t model) {
 
     measure_meter = NULL;
 
-    fault_measure_flag = false;
+    fault_measure_flag = 0;
 
     switch (model) {
         case DEVICE_NARTIS_I300: {
@@ -51,30 +90,26 @@ uint8_t set_device_model(device_model_t model) {
             nartis_i300_init();
             measure_meter = measure_meter_nartis_i300;
             baudrate = 9600;
-            energy_divisor = 1000;
-            voltage_divisor = 100;
-            current_divisor = 1000;
-            power_divisor = 1;
 
-            if (set_zcl_str(device_model[DEVICE_NARTIS_I300], name, DEVICE_NAME_LEN)) {
-                zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DEVICE_MODEL, (uint8_t*)&name);
-            }
+            set_zcl_str(device_model[DEVICE_NARTIS_I300], name, DEVICE_NAME_LEN);
             break;
         }
         default:
-            if (set_zcl_str(device_model[DEVICE_UNDEFINED], name, DEVICE_NAME_LEN)) {
-                zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DEVICE_MODEL, (uint8_t*)&name);
-            }
-            if (set_zcl_str(sn, serial_number, SE_ATTR_SN_SIZE)) {
-                zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_METER_SERIAL_NUMBER, (uint8_t*)&serial_number);
-            }
-            if (set_zcl_str(dr, date_release, DATA_MAX_LEN+1)) {
-                zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DATE_RELEASE, (uint8_t*)&date_release);
-            }
-
+            set_zcl_str(device_model[DEVICE_UNDEFINED], name, DEVICE_NAME_LEN);
+            set_zcl_str(sn, serial_number, SE_ATTR_SN_SIZE);
+            set_zcl_str(dr, date_release, DATA_MAX_LEN+1);
             break;
     }
 
+    /* everything is read in the first cycle of every meter, after the cycle aborted by the driver init */
+    poll_clock();
+    for (uint8_t idx = 0; idx < METER_MAX; idx++) {
+        for (uint8_t poll = POLL_ONCE+1; poll < POLL_CLASS_MAX; poll++) {
+            poll_at[idx][poll] = poll_sec;
+        }
+    }
+    poll_meter = METER_MAX-1;
+
     if (dev_config.device_model != model) {
         dev_config.device_model = model;
         save = true;
@@ -84,49 +119,74 @@ uint8_t set_device_model(device_model_t model) {
 #endif
     }
 
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CURRENT_TIER_1_SUMMATION_DELIVERD, (uint8_t*)&tariff);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CURRENT_TIER_2_SUMMATION_DELIVERD, (uint8_t*)&tariff);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CURRENT_TIER_3_SUMMATION_DELIVERD, (uint8_t*)&tariff);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CURRENT_TIER_4_SUMMATION_DELIVERD, (uint8_t*)&tariff);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CURRENT_SUMMATION_DELIVERD, (uint8_t*)&tariff);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_ACTIVE_POWER, (uint8_t*)&power);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_ACTIVE_POWER_PHB, (uint8_t*)&power);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_ACTIVE_POWER_PHC, (uint8_t*)&power);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_VOLTAGE, (uint8_t*)&volts);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_VOLTAGE_PHB, (uint8_t*)&volts);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_VOLTAGE_PHC, (uint8_t*)&volts);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_CURRENT, (uint8_t*)&current);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_CURRENT_PHB, (uint8_t*)&current);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_CURRENT_PHC, (uint8_t*)&current);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_NEUTRAL_CURRENT, (uint8_t*)&current);
-
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_MULTIPLIER, (uint8_t*)&energy_multiplier);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_DIVISOR, (uint8_t*)&energy_divisor);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_VOLTAGE_MULTIPLIER, (uint8_t*)&voltage_multiplier);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_VOLTAGE_DIVISOR, (uint8_t*)&voltage_divisor);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_CURRENT_MULTIPLIER, (uint8_t*)&current_multiplier);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_CURRENT_DIVISOR, (uint8_t*)&current_divisor);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_POWER_MULTIPLIER, (uint8_t*)&power_multiplier);
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_POWER_DIVISOR, (uint8_t*)&power_divisor);
+    for (uint8_t idx = 0; idx < METER_MAX; idx++) {
+        uint8_t endpoint = METER_ENDPOINT(idx);
 
-    app_uart_init(baudrate);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DEVICE_MODEL, (uint8_t*)&name);
+        if (serial_number[0]) {
+            app_setAttrVal(endpoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_METER_SERIAL_NUMBER, (uint8_t*)&serial_number);
+            app_setAttrVal(endpoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DATE_RELEASE, (uint8_t*)&date_release);
+        }
 
-    /* start timer get data from device */
-    if(g_appCtx.timerMeasurementEvt) TL_ZB_TIMER_CANCEL(&g_appCtx.timerMeasurementEvt);
-    g_appCtx.timerMeasurementEvt = TL_ZB_TIMER_SCHEDULE(measure_meterCb, NULL, TIMEOUT_1SEC);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CURRENT_TIER_1_SUMMATION_DELIVERD, (uint8_t*)&tariff);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CURRENT_TIER_2_SUMMATION_DELIVERD, (uint8_t*)&tariff);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CURRENT_TIER_3_SUMMATION_DELIVERD, (uint8_t*)&tariff);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CURRENT_TIER_4_SUMMATION_DELIVERD, (uint8_t*)&tariff);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CURRENT_SUMMATION_DELIVERD, (uint8_t*)&tariff);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_ACTIVE_POWER, (uint8_t*)&power);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_ACTIVE_POWER_PHB, (uint8_t*)&power);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_ACTIVE_POWER_PHC, (uint8_t*)&power);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_VOLTAGE, (uint8_t*)&volts);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_VOLTAGE_PHB, (uint8_t*)&volts);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_VOLTAGE_PHC, (uint8_t*)&volts);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_CURRENT, (uint8_t*)&current);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_CURRENT_PHB, (uint8_t*)&current);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_CURRENT_PHC, (uint8_t*)&current);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_NEUTRAL_CURRENT, (uint8_t*)&current);
+
+        app_setAttrVal(endpoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_MULTIPLIER, (uint8_t*)&energy_multiplier);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_DIVISOR, (uint8_t*)&energy_divisor);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_VOLTAGE_MULTIPLIER, (uint8_t*)&voltage_multiplier);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_VOLTAGE_DIVISOR, (uint8_t*)&voltage_divisor);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_CURRENT_MULTIPLIER, (uint8_t*)&current_multiplier);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_CURRENT_DIVISOR, (uint8_t*)&current_divisor);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_POWER_MULTIPLIER, (uint8_t*)&power_multiplier);
+        app_setAttrVal(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_POWER_DIVISOR, (uint8_t*)&power_divisor);
+    }
+
+    uint8_t period_in_min = dev_config.poll_period[POLL_TARIFF] / 60;
+    app_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_MEASUREMENT_PERIOD, (uint8_t*)&period_in_min);
+    app_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_POWER_PERIOD, (uint8_t*)&dev_config.poll_period[POLL_POWER]);
+    app_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_VOLTAGE_PERIOD, (uint8_t*)&dev_config.poll_period[POLL_VOLTAGE]);
+    app_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_PROFILE_DEPTH, (uint8_t*)&dev_config.profile_depth);
+    app_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_KEEP_SESSION, &dev_config.keep_session);
+
+    uint8_t system_title[1+SECURITY_TITLE_SIZE] = {SECURITY_TITLE_SIZE};
+    memcpy(system_title+1, security_cfg.system_title, SECURITY_TITLE_SIZE);
+    app_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_SECURITY_LEVEL, &security_cfg.level);
+    app_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_SYSTEM_TITLE, system_title);
 
-    app_forcedReport(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_METER_SERIAL_NUMBER);
-    app_forcedReport(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DATE_RELEASE);
-    app_forcedReport(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DEVICE_MODEL);
+    app_uart_init(baudrate);
 
-    app_forcedReport(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_MULTIPLIER);
-    app_forcedReport(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_DIVISOR);
-    app_forcedReport(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_CURRENT_MULTIPLIER);
-    app_forcedReport(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_CURRENT_DIVISOR);
-    app_forcedReport(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_VOLTAGE_MULTIPLIER);
-    app_forcedReport(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_VOLTAGE_DIVISOR);
-    app_forcedReport(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_POWER_MULTIPLIER);
-    app_forcedReport(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_POWER_DIVISOR);
+    /* start timer get data from device */
+    measure_timer_start(TIMEOUT_1SEC);
+
+    for (uint8_t idx = 0; idx < METER_MAX; idx++) {
+        uint8_t endpoint = METER_ENDPOINT(idx);
+
+        app_forcedReport(endpoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_METER_SERIAL_NUMBER);
+        app_forcedReport(endpoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DATE_RELEASE);
+        app_forcedReport(endpoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DEVICE_MODEL);
+
+        app_forcedReport(endpoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_MULTIPLIER);
+        app_forcedReport(endpoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_DIVISOR);
+        app_forcedReport(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_CURRENT_MULTIPLIER);
+        app_forcedReport(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_CURRENT_DIVISOR);
+        app_forcedReport(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_VOLTAGE_MULTIPLIER);
+        app_forcedReport(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_VOLTAGE_DIVISOR);
+        app_forcedReport(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_POWER_MULTIPLIER);
+        app_forcedReport(endpoint, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_POWER_DIVISOR);
+    }
 
 
     sleep_ms(250);
@@ -135,36 +195,168 @@ uint8_t set_device_model(device_model_t model) {
     return save;
 }
 
+/* the bus is reloaded when no meter answers, one lost meter does not stop the others */
+static int32_t fault_measure_meterCb(void *arg) {
+
+    uint8_t present = 0;
+
+    for (uint8_t idx = 0; idx < METER_MAX; idx++) {
+        if (meter_present(idx)) present |= 1 << idx;
+    }
+
+    if (fault_measure_flag && (fault_measure_flag & present) == present) {
+#if UART_PRINTF_MODE
+        printf("Fault get data from device. Reload electricity!!!\r\n");
+#endif
+//        zb_resetDevice();
+        set_device_model(dev_config.device_model);
+    }
+
+    timerFaultMeasurementEvt = NULL;
+    return -1;
+}
+
+/* classes of the meter whose period is over */
+static uint8_t poll_due(uint8_t idx, uint32_t now) {
+
+    uint8_t classes = 0;
+
+    for (uint8_t poll = POLL_ONCE+1; poll < POLL_CLASS_MAX; poll++) {
+        if ((int32_t)(now - poll_at[idx][poll]) >= 0) classes |= POLL_BIT(poll);
+    }
+
+    return classes;
+}
+
+/* sec to the nearest class of the meters on the bus, 0 - one of them is due now */
+static uint16_t poll_next() {
+
+    uint32_t now = poll_clock();
+    int32_t left, wait = POLL_WAIT_MAX;
+
+    for (uint8_t idx = 0; idx < METER_MAX; idx++) {
+        if (!meter_present(idx)) continue;
+        for (uint8_t poll = POLL_ONCE+1; poll < POLL_CLASS_MAX; poll++) {
+            left = (int32_t)(poll_at[idx][poll] - now);
+            if (left < wait) wait = left > 0 ? left : 0;
+        }
+    }
+
+    return wait;
+}
+
+static void poll_schedule(uint16_t wait) {
+
+    measure_timer_start(wait ? wait * 1000 : POLL_NEXT_METER);
+}
+
+/* the classes of the meter are read again after the fault period, the other meters go on */
+static void poll_fault(uint8_t idx, uint8_t classes) {
+
+    uint32_t at = poll_clock() + FAULT_MEASUREMENT_PERIOD;
+
+    for (uint8_t poll = POLL_ONCE+1; poll < POLL_CLASS_MAX; poll++) {
+        if (classes & POLL_BIT(poll)) poll_at[idx][poll] = at;
+    }
+}
+
+/* one cycle reads only the classes of one meter which are due, all of them in one session.
+ * The meters take turns, the next one after the meter of the last cycle goes first */
 int32_t measure_meterCb(void *arg) {
 
-    int32_t period = DEFAULT_MEASUREMENT_PERIOD * 1000;
+    uint8_t idx, classes;
+    uint32_t now = poll_clock();
 
+    g_appCtx.timerMeasurementEvt = NULL;
 
     if (dev_config.device_model && measure_meter) {
-        if (measure_meter()) {
-            period = dev_config.measurement_period * 1000;
-//            for test
-//            period = 15 * 1000;
-        } else {
-            period = FAULT_MEASUREMENT_PERIOD * 1000;
+        for (uint8_t n = 0; n < METER_MAX; n++) {
+            idx = (poll_meter + 1 + n) % METER_MAX;
+            if (!meter_present(idx) || !(classes = poll_due(idx, now))) continue;
+            poll_meter = idx;
+            poll_classes = classes;
+            poll_started = now;
+#ifdef ZCL_DIAGNOSTICS
+            poll_start = clock_time();
+#endif
+            zcl_diagMeterSet(idx);
+            if (measure_meter(idx, classes)) {
+                /* the cycle is running, the next one is scheduled by measure_meter_complete() */
+                return -1;
+            }
+            poll_fault(idx, classes);
         }
+        poll_schedule(poll_next());
+    } else {
+        poll_schedule(DEFAULT_MEASUREMENT_PERIOD);
     }
 
-    return period;
+    return -1;
 }
 
-int32_t fault_measure_meterCb(void *arg) {
+#ifdef ZCL_DIAGNOSTICS
+/* duration of the successful cycles, the failed ones end on the timeouts and are in the error counters */
+static void poll_statistics() {
 
-    if (fault_measure_flag) {
-#if UART_PRINTF_MODE
-        printf("Fault get data from device. Reload electricity!!!\r\n");
+    zcl_diagAttr_t *diag = zcl_diagAttrs(poll_meter);
+    uint32_t ms = (clock_time() - poll_start) / CLOCK_16M_SYS_TIMER_CLK_1MS;
+
+    if (ms > 0xffff) ms = 0xffff;
+
+    /* the sum starts again from the average before it wraps */
+    if (poll_ms_sum[poll_meter] > 0xffffffff - 0xffff) {
+        poll_ms_sum[poll_meter] = diag->cycle_avg;
+        poll_ms_num[poll_meter] = 1;
+    }
+
+    diag->cycles++;
+    poll_ms_sum[poll_meter] += ms;
+    poll_ms_num[poll_meter]++;
+    if (ms < diag->cycle_min) diag->cycle_min = ms;
+    if (ms > diag->cycle_max) diag->cycle_max = ms;
+    diag->cycle_avg = poll_ms_sum[poll_meter] / poll_ms_num[poll_meter];
+}
 #endif
-//        zb_resetDevice();
-        set_device_model(dev_config.device_model);
+
+/* called by the device driver at the end of the measurement cycle of the meter */
+void measure_meter_complete(uint8_t ret) {
+
+    if (ret) {
+#ifdef ZCL_DIAGNOSTICS
+        poll_statistics();
+#endif
+        /* the period is counted from the start of the cycle, its length does not shift the next one */
+        for (uint8_t poll = POLL_ONCE+1; poll < POLL_CLASS_MAX; poll++) {
+            if (poll_classes & POLL_BIT(poll)) poll_at[poll_meter][poll] = poll_started + dev_config.poll_period[poll];
+        }
+        fault_measure_flag &= ~(1 << poll_meter);
+    } else {
+        /* the same classes are due again, the meter does not hold the bus meanwhile */
+        poll_fault(poll_meter, poll_classes);
+        fault_measure_flag |= 1 << poll_meter;
+        if (!timerFaultMeasurementEvt) {
+            timerFaultMeasurementEvt = TL_ZB_TIMER_SCHEDULE(fault_measure_meterCb, NULL, TIMEOUT_10MIN);
+        }
     }
 
-    timerFaultMeasurementEvt = NULL;
-    return -1;
+    poll_schedule(poll_next());
+}
+
+/* new period from ZCL attribute. The class is due the new period after its last reading,
+ * the other classes keep their time */
+void set_poll_period(poll_class_t poll, uint16_t period) {
+
+    uint16_t old = dev_config.poll_period[poll];
+
+    dev_config.poll_period[poll] = period;
+    write_config();
+
+    for (uint8_t idx = 0; idx < METER_MAX; idx++) {
+        poll_at[idx][poll] += (int32_t)period - old;
+    }
+
+    /* a running cycle schedules the next one itself */
+    if (g_appCtx.timerMeasurementEvt) poll_schedule(poll_next());
 }
 
 #if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
@@ -211,6 +403,9 @@ void print_error(pkt_error_t err_no) {
         case PKT_ERR_SEGMENTATION:
             printf("Segmentation not complete\r\n");
             break;
+        case PKT_ERR_SECURITY:
+            printf("Authentication of the meter failed\r\n");
+            break;
         default:
             printf("Unknown error\r\n");
             break;
@@ -0,0 +1,226 @@
+#include "tl_common.h"
+
+#include "dlms_gcm.h"
+
+/* reduction of the 4 bits shifted out of the GHASH register */
+static const uint16_t last4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+/* keys of the client. The table is out of structures, the packed ones are read by bytes */
+static uint8_t gcm_ek[DLMS_KEY_SIZE];
+static uint8_t gcm_ak[DLMS_KEY_SIZE];
+static uint32_t htab[16][4];                /* 4 bit multiples of H = E(EK, 0), high word first */
+
+/* one block by the AES engine of the chip, the same which the stack uses for its own security.
+ * Both are called from the main loop only, so they do not share the engine at the same time */
+static void aes_block(const uint8_t *in, uint8_t *out) {
+
+    drv_aes_encrypt(gcm_ek, (uint8_t*)in, out);
+}
+
+static uint32_t get_u32(const uint8_t *buf) {
+
+    return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+static void put_u32(uint8_t *buf, uint32_t value) {
+
+    buf[0] = (value >> 24) & 0xff;
+    buf[1] = (value >> 16) & 0xff;
+    buf[2] = (value >> 8) & 0xff;
+    buf[3] = value & 0xff;
+}
+
+/* z >>= 4 with the reduction of the bits shifted out */
+#define Z_SHIFT4(z)     do { \
+    uint8_t rem = z[3] & 0x0f; \
+    z[3] = (z[2] << 28) | (z[3] >> 4); \
+    z[2] = (z[1] << 28) | (z[2] >> 4); \
+    z[1] = (z[0] << 28) | (z[1] >> 4); \
+    z[0] = (z[0] >> 4) ^ ((uint32_t)last4[rem] << 16); \
+} while (0)
+
+#define Z_ADD(z, h)     do { z[0] ^= h[0]; z[1] ^= h[1]; z[2] ^= h[2]; z[3] ^= h[3]; } while (0)
+
+/* x = x * H in GF(2^128), 4 bits at a time with the table of the key */
+static void ghash_mult(uint8_t *x) {
+
+    uint32_t z[4];
+    int8_t i;
+
+    memcpy(z, htab[x[15] & 0x0f], sizeof(z));
+
+    for (i = 15; i >= 0; i--) {
+        if (i != 15) {
+            Z_SHIFT4(z);
+            Z_ADD(z, htab[x[i] & 0x0f]);
+        }
+        Z_SHIFT4(z);
+        Z_ADD(z, htab[x[i] >> 4]);
+    }
+
+    for (i = 0; i < 4; i++) {
+        put_u32(x + (i << 2), z[i]);
+    }
+}
+
+/* the partly filled block of GHASH is padded with zeros */
+static void ghash_flush(dlms_gcm_t *gcm) {
+
+    if (gcm->pos) {
+        ghash_mult(gcm->ghash);
+        gcm->pos = 0;
+    }
+}
+
+/* the key stream of the next counter block, only the last 32 bits are counted */
+static void next_stream(dlms_gcm_t *gcm) {
+
+    put_u32(gcm->counter+12, get_u32(gcm->counter+12) + 1);
+    aes_block(gcm->counter, gcm->stream);
+}
+
+static void text_start(dlms_gcm_t *gcm, size_t len) {
+
+    if (!gcm->text) {
+        ghash_flush(gcm);
+        gcm->text = true;
+    }
+
+    gcm->text_len += len;
+}
+
+/* H = E(EK, 0) and its multiples by all 4 bit values, once for all APDUs of the keys */
+void dlms_gcm_init(const uint8_t *ek, const uint8_t *ak) {
+
+    uint8_t zero[16] = {0};
+    uint8_t h[16];
+    uint32_t v[4];
+    uint8_t i, j, k;
+
+    memcpy(gcm_ek, ek, DLMS_KEY_SIZE);
+    memcpy(gcm_ak, ak, DLMS_KEY_SIZE);
+
+    aes_block(zero, h);
+
+    for (k = 0; k < 4; k++) {
+        v[k] = get_u32(h + (k << 2));
+        htab[0][k] = 0;
+        htab[8][k] = v[k];
+    }
+
+    /* 4, 2, 1 - H shifted right in the bit reflected order of GCM */
+    for (i = 4; i > 0; i >>= 1) {
+        uint32_t t = (v[3] & 1) * 0xe1000000;
+        v[3] = (v[2] << 31) | (v[3] >> 1);
+        v[2] = (v[1] << 31) | (v[2] >> 1);
+        v[1] = (v[0] << 31) | (v[1] >> 1);
+        v[0] = (v[0] >> 1) ^ t;
+        memcpy(htab[i], v, sizeof(v));
+    }
+
+    for (i = 2; i <= 8; i <<= 1) {
+        for (j = 1; j < i; j++) {
+            for (k = 0; k < 4; k++) {
+                htab[i+j][k] = htab[i][k] ^ htab[j][k];
+            }
+        }
+    }
+}
+
+/* IV = system title of the sender | invocation counter. The authenticated APDU
+ * starts its additional data with the security control byte and AK */
+void dlms_gcm_start(dlms_gcm_t *gcm, const uint8_t *system_title, uint8_t sc, uint32_t ic) {
+
+    memset(gcm, 0, sizeof(dlms_gcm_t));
+
+    memcpy(gcm->counter, system_title, DLMS_SYSTEM_TITLE_SIZE);
+    put_u32(gcm->counter+8, ic);
+    put_u32(gcm->counter+12, 1);
+
+    aes_block(gcm->counter, gcm->mask);
+
+    if (sc & DLMS_SC_AUTH) {
+        dlms_gcm_aad(gcm, &sc, 1);
+        dlms_gcm_aad(gcm, gcm_ak, DLMS_KEY_SIZE);
+    }
+}
+
+/* additional data goes before the text. It is the text of APDU with authentication only */
+void dlms_gcm_aad(dlms_gcm_t *gcm, const uint8_t *data, size_t len) {
+
+    gcm->aad_len += len;
+
+    while (len--) {
+        gcm->ghash[gcm->pos] ^= *data++;
+        if (++gcm->pos == 16) {
+            ghash_mult(gcm->ghash);
+            gcm->pos = 0;
+        }
+    }
+}
+
+/* in place, the text may be given in parts of any length */
+void dlms_gcm_encrypt(dlms_gcm_t *gcm, uint8_t *data, size_t len) {
+
+    text_start(gcm, len);
+
+    while (len--) {
+        if (gcm->pos == 0) next_stream(gcm);
+        *data ^= gcm->stream[gcm->pos];
+        gcm->ghash[gcm->pos] ^= *data++;
+        if (++gcm->pos == 16) {
+            ghash_mult(gcm->ghash);
+            gcm->pos = 0;
+        }
+    }
+}
+
+void dlms_gcm_decrypt(dlms_gcm_t *gcm, uint8_t *data, size_t len) {
+
+    text_start(gcm, len);
+
+    while (len--) {
+        if (gcm->pos == 0) next_stream(gcm);
+        gcm->ghash[gcm->pos] ^= *data;
+        *data++ ^= gcm->stream[gcm->pos];
+        if (++gcm->pos == 16) {
+            ghash_mult(gcm->ghash);
+            gcm->pos = 0;
+        }
+    }
+}
+
+/* 12 bytes, GHASH is over after the lengths of additional data and text */
+void dlms_gcm_tag(dlms_gcm_t *gcm, uint8_t *tag) {
+
+    uint8_t lengths[16] = {0};
+    uint8_t i;
+
+    ghash_flush(gcm);
+
+    put_u32(lengths+4, gcm->aad_len << 3);
+    put_u32(lengths+12, gcm->text_len << 3);
+    dlms_gcm_aad(gcm, lengths, sizeof(lengths));
+
+    for (i = 0; i < DLMS_TAG_SIZE; i++) {
+        tag[i] = gcm->ghash[i] ^ gcm->mask[i];
+    }
+}
+
+/* all bytes are compared, the time does not tell where the tag differs */
+uint8_t dlms_gcm_check(dlms_gcm_t *gcm, const uint8_t *tag) {
+
+    uint8_t calc[DLMS_TAG_SIZE];
+    uint8_t diff = 0;
+
+    dlms_gcm_tag(gcm, calc);
+
+    for (uint8_t i = 0; i < DLMS_TAG_SIZE; i++) {
+        diff |= calc[i] ^ tag[i];
+    }
+
+    return diff == 0;
+}
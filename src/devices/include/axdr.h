@@ -0,0 +1,72 @@
+#ifndef SRC_DEVICES_INCLUDE_AXDR_H_
+#define SRC_DEVICES_INCLUDE_AXDR_H_
+
+/* A-XDR type tags of DLMS data */
+enum {
+    TYPE_NULL           = 0x00,
+    TYPE_ARRAY          = 0x01,
+    TYPE_STRUCTURE      = 0x02,
+    TYPE_BOOLEAN        = 0x03,
+    TYPE_BIT_STRING     = 0x04,
+    TYPE_SIGNED_32      = 0x05,
+    TYPE_UNSIGNED_32    = 0x06,
+    TYPE_OCTET_STRING   = 0x09,
+    TYPE_VISIBLE_STRING = 0x0a,
+    TYPE_UTF8_STRING    = 0x0c,
+    TYPE_BCD            = 0x0d,
+    TYPE_INTEGER        = 0x0f,
+    TYPE_LONG           = 0x10,
+    TYPE_UNSIGNED       = 0x11,
+    TYPE_UNSIGNED_16    = 0x12,
+    TYPE_COMPACT_ARRAY  = 0x13,
+    TYPE_SIGNED_64      = 0x14,
+    TYPE_UNSIGNED_64    = 0x15,
+    TYPE_ENUM           = 0x16,
+    TYPE_FLOAT_32       = 0x17,
+    TYPE_FLOAT_64       = 0x18,
+    TYPE_DATE_TIME      = 0x19,
+    TYPE_DATE           = 0x1a,
+    TYPE_TIME           = 0x1b,
+};
+
+#define AXDR_LENGTH     -1          /* the length follows the type tag          */
+#define AXDR_UNKNOWN    -2          /* the type is not supported                */
+
+#define AXDR_DATE_TIME_SIZE 12
+
+/* cursor over A-XDR data, nothing is copied. After the first error all calls fail */
+typedef struct {
+    uint8_t    *ptr;                        /* next byte                                */
+    uint8_t    *end;                        /* after the last byte                      */
+    uint8_t     error;
+} axdr_t;
+
+typedef struct {
+    uint16_t    year;                       /* 0xffff - not specified                   */
+    uint8_t     month;
+    uint8_t     day;
+    uint8_t     day_of_week;
+    uint8_t     hour;
+    uint8_t     minute;
+    uint8_t     second;
+    uint8_t     hundredths;
+    int16_t     deviation;                  /* minutes to UTC, 0x8000 - not specified   */
+    uint8_t     status;
+} axdr_date_time_t;
+
+int8_t  axdr_value_size(uint8_t tag);
+void    axdr_init(axdr_t *axdr, uint8_t *data, size_t len);
+uint8_t axdr_end(axdr_t *axdr);
+uint8_t axdr_peek(axdr_t *axdr, uint8_t *tag);
+uint8_t axdr_get_length(axdr_t *axdr, uint16_t *len);
+uint8_t axdr_get_container(axdr_t *axdr, uint8_t tag, uint16_t *count);
+uint8_t axdr_get_int(axdr_t *axdr, int64_t *value);
+uint8_t axdr_get_float(axdr_t *axdr, float *value);
+uint8_t axdr_get_string(axdr_t *axdr, uint8_t *tag, uint8_t **str, uint16_t *len);
+uint8_t axdr_get_date_time(axdr_t *axdr, axdr_date_time_t *date_time);
+uint8_t axdr_skip(axdr_t *axdr);
+uint8_t axdr_date_time_to_sec(const axdr_date_time_t *date_time, uint32_t *sec);
+void    axdr_sec_to_date_time(uint32_t sec, axdr_date_time_t *date_time);
+void    axdr_put_date_time(uint8_t *buf, const axdr_date_time_t *date_time);
+
+#endif /* SRC_DEVICES_INCLUDE_AXDR_H_ */
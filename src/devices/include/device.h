@@ -10,10 +10,27 @@
 #define RESOURCE_BATTERY    120         /* in month                 */
 #define DEFAULT_MEASUREMENT_PERIOD  60  /* in sec                   */
 #define FAULT_MEASUREMENT_PERIOD    10  /* in sec                   */
+#define DEFAULT_POWER_PERIOD        10  /* in sec                   */
+#define DEFAULT_VOLTAGE_PERIOD      60  /* in sec                   */
+#define DEFAULT_TARIFF_PERIOD       300 /* in sec                   */
+#define DEFAULT_PROFILE_DEPTH       48  /* load profile entries taken on the first connect */
+#define PROFILE_REPORT_ENTRIES      8   /* load profile entries in one report, | time | value | each */
 
 #define SE_ATTR_SN_SIZE     25          /* 0 - len, 1..24 - str     */
 
-typedef uint8_t (*measure_meter_f)(void);
+/* quantities which are read with their own period */
+typedef enum {
+    POLL_ONCE = 0,                      /* after reset until the meter returns it           */
+    POLL_POWER,                         /* power and current                                */
+    POLL_VOLTAGE,
+    POLL_TARIFF,                        /* tariffs and time of the meter                    */
+    POLL_CLASS_MAX
+} poll_class_t;
+
+#define POLL_BIT(poll)      (1 << (poll))
+
+/* starts the cycle of the meter on the bus for the classes in the mask, the result comes to measure_meter_complete() */
+typedef uint8_t (*measure_meter_f)(uint8_t idx, uint8_t classes);
 
 typedef enum {
     DEVICE_UNDEFINED = 0,
@@ -37,6 +54,8 @@ typedef enum _pkt_error_t {
     PKT_ERR_UART,
     PKT_ERR_TYPE,
     PKT_ERR_SEGMENTATION,
+    PKT_ERR_SECURITY,
+    PKT_ERR_MAX
 } pkt_error_t;
 
 extern uint16_t attr_len;
@@ -45,8 +64,7 @@ extern uint8_t new_start;
 extern pkt_error_t pkt_error_no;
 extern measure_meter_f measure_meter;
 extern uint8_t device_model[DEVICE_MAX][32];
-extern uint8_t fault_measure_flag;
-extern ev_timer_event_t *timerFaultMeasurementEvt;
+extern uint8_t fault_measure_flag;         /* meters without data, bit per meter */
 
 //uint16_t get_divisor(const uint8_t division_factor);
 void print_error(pkt_error_t err_no);
@@ -54,8 +72,10 @@ void print_package(uint8_t *head, uint8_t *buff, size_t len);
 uint8_t set_device_model(device_model_t model);
 
 int32_t measure_meterCb(void *arg);
-int32_t fault_measure_meterCb(void *arg);
+void measure_meter_complete(uint8_t ret);
+void set_poll_period(poll_class_t poll, uint16_t period);
+uint32_t poll_clock();
 void nartis_i300_init();
-uint8_t measure_meter_nartis_i300();
+uint8_t measure_meter_nartis_i300(uint8_t idx, uint8_t classes);
 
 #endif /* SRC_INCLUDE_DEVICE_H_ */
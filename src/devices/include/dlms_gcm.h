@@ -0,0 +1,34 @@
+#ifndef SRC_DEVICES_INCLUDE_DLMS_GCM_H_
+#define SRC_DEVICES_INCLUDE_DLMS_GCM_H_
+
+#define DLMS_KEY_SIZE           16
+#define DLMS_SYSTEM_TITLE_SIZE  8
+#define DLMS_TAG_SIZE           12          /* GCM tag is cut to 96 bits in DLMS        */
+#define DLMS_SECURITY_HEAD      5           /* security control and invocation counter  */
+
+/* security control byte, security suite 0 (AES-GCM-128) */
+#define DLMS_SC_AUTH            0x10
+#define DLMS_SC_ENCRYPT         0x20
+#define DLMS_SC_AUTH_ENCRYPT    (DLMS_SC_AUTH | DLMS_SC_ENCRYPT)
+
+/* GCM of one APDU, the text may come in parts */
+typedef struct {
+    uint8_t     counter[16];                /* counter block of the key stream          */
+    uint8_t     stream[16];                 /* key stream of the counter block          */
+    uint8_t     mask[16];                   /* E(EK, J0) for the tag                    */
+    uint8_t     ghash[16];
+    uint8_t     pos;                        /* bytes of the current block               */
+    uint8_t     text;                       /* 1 - additional data is over              */
+    uint32_t    aad_len;
+    uint32_t    text_len;
+} dlms_gcm_t;
+
+void    dlms_gcm_init(const uint8_t *ek, const uint8_t *ak);
+void    dlms_gcm_start(dlms_gcm_t *gcm, const uint8_t *system_title, uint8_t sc, uint32_t ic);
+void    dlms_gcm_aad(dlms_gcm_t *gcm, const uint8_t *data, size_t len);
+void    dlms_gcm_encrypt(dlms_gcm_t *gcm, uint8_t *data, size_t len);
+void    dlms_gcm_decrypt(dlms_gcm_t *gcm, uint8_t *data, size_t len);
+void    dlms_gcm_tag(dlms_gcm_t *gcm, uint8_t *tag);
+uint8_t dlms_gcm_check(dlms_gcm_t *gcm, const uint8_t *tag);
+
+#endif /* SRC_DEVICES_INCLUDE_DLMS_GCM_H_ */
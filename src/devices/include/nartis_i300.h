@@ -1,6 +1,8 @@
 #ifndef SRC_DEVICES_INCLUDE_NARTIS_I300_H_
 #define SRC_DEVICES_INCLUDE_NARTIS_I300_H_
 
+#include "axdr.h"
+
 typedef enum _command_t {
     cmd_snrm = 0,
     cmd_disc,
@@ -49,26 +51,38 @@ typedef struct __attribute__((packed)) {
     uint8_t     attribute[2];
 } request_t;
 
-typedef struct __attribute__((packed)) {
-    uint8_t     type;
-    uint8_t     size;
-    uint8_t     str;
-} type_octet_string_t;
-
-typedef struct __attribute__((packed)) {
-    uint8_t     type;                       /* 0x15         */
-    uint64_t    value;
-} type_digit64_t;
-
-typedef struct __attribute__((packed)) {
-    uint8_t     type;                       /* 0x05 or 0x06 */
-    uint32_t    value;
-} type_digit32_t;
-
-typedef struct __attribute__((packed)) {
-    uint8_t     type;                       /* 0x12         */
-    uint16_t    value;
-} type_digit16_t;
+/* quantities with their own ZCL multiplier and divisor, from scaler_unit of the registers */
+typedef enum {
+    QUANTITY_NONE = 0,
+    QUANTITY_ENERGY,
+    QUANTITY_VOLTAGE,
+    QUANTITY_CURRENT,
+    QUANTITY_POWER,
+    QUANTITY_MAX
+} quantity_t;
+
+typedef struct _obis_item_t obis_item_t;
+
+/* called with cursor over A-XDR data or NULL if the meter did not return data,
+ * entry - number of the array entry for the arrays which come entry by entry.
+ * Returns true if the value is taken */
+typedef uint8_t (*obis_handler_t)(const obis_item_t *item, axdr_t *data, uint16_t entry);
+
+/* one row of the read plan */
+struct _obis_item_t {
+    request_t           request;            /* class, OBIS and attribute as sent        */
+    uint32_t            types;              /* accepted A-XDR types, bit per type tag   */
+    int8_t              scale;              /* power of 10 applied to the value         */
+    quantity_t          quantity;           /* scaler_unit of the register is read once */
+    uint8_t             endpoint;
+    uint16_t            cluster_id;
+    uint16_t            attr_id;            /* ZCL attribute                            */
+    poll_class_t        poll;
+    obis_handler_t      handler;            /* NULL - the value goes to ZCL attribute   */
+    const uint8_t      *access;             /* selector and parameters of selective access */
+    uint8_t             access_len;         /* 0 - no selective access                  */
+    uint8_t             head_only;          /* entry longer than the buffer goes cut    */
+};
 
 typedef struct __attribute__((packed)) {
     uint8_t     client_addr;
@@ -80,14 +94,16 @@ typedef struct __attribute__((packed)) {
     uint16_t    max_info_field_rx;
     uint32_t    window_tx;
     uint32_t    window_rx;
-    uint8_t     rrr;
-    uint8_t     sss;
+    uint8_t     vs;                         /* send state variable V(S)                 */
+    uint8_t     vr;                         /* receive state variable V(R)              */
+    uint8_t     va;                         /* oldest not acknowledged N(S)             */
+    uint8_t     get_list;                   /* 1 - meter supports GET-Request-With-List */
 } meter_t;
 
 typedef struct __attribute__((packed)) {
     size_t      size;
     uint8_t     complete;                   /* 1 - complete, 0 - not complete */
-    uint8_t     buff[UART_BUFF_SIZE*2];
+    uint8_t     buff[PKT_BUFF_MAX_LEN*2];   /* UA, AARE and the ciphered text until its tag is checked */
 } result_package_t;
 
 #endif /* SRC_DEVICES_INCLUDE_NARTIS_I300_H_ */
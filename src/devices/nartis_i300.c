@@ -6,6 +6,8 @@
 #include "app_dev_config.h"
 #include "device.h"
 #include "app_reporting.h"
+#include "axdr.h"
+#include "dlms_gcm.h"
 #include "nartis_i300.h"
 #include "zcl_custom_attr.h"
 
@@ -17,9 +19,40 @@
 #define FLAG            0x7E
 #define TYPE3           0x0A
 
-#define MAX_INFO_FIELD  0x80
 #define MIN_FRAME_SIZE  10      /* flag 1 + format 2 + address 3 + control 1 + FCS 2 + flag = 10 byte */
-
+#define FRAME_CONTROL   6       /* control field after flag, format and address                 */
+#define FRAME_HEAD      7       /* HCS or FCS after the control field                           */
+#define AARQ_INFO_MAX   (51 + sizeof(m_password_t))  /* LLC, AARQ and the longest password      */
+#define FRAME_TEMPLATE_MAX  (MIN_FRAME_SIZE + 2 + AARQ_INFO_MAX)
+#define DEF_INFO_FIELD  0x80    /* max info field without negotiation                           */
+#define DEF_WINDOW      1       /* window without negotiation                                   */
+/* whole frame with HCS has to fit in one uart dma buffer                                       */
+#define MAX_INFO_FIELD  (UART_DATA_LEN - MIN_FRAME_SIZE - 2)
+/* frames the meter may send without RR, all of them have to fit in the ring buffer             */
+#define MAX_WINDOW_RX   (UART_BUFF_SIZE / UART_DATA_LEN)
+#define MAX_WINDOW_TX   2       /* requests in flight, power of 2                               */
+
+#define SESSION_ATTEMPTS    3   /* attempts to restore the session for one failed request */
+#define LINK_ATTEMPTS       2   /* retransmissions after timeout before the session is restored */
+#define SESSION_POLLS       10  /* polls of the meter which has no response ready yet */
+#define RESPONSE_TIMEOUT    1000    /* ms, waiting of the response frame before the first round trip */
+#define POLL_DELAY          50      /* ms, between polls of the meter before the first round trip */
+#define RTO_MIN             50      /* ms, bounds of the learned response latency of the meter  */
+#define RTO_MAX             3000
+#define BYTE_TIME_US        1042    /* start, 8 data and stop bits at 9600 baud                 */
+#define RTO_GRANULARITY     10      /* ms, the least variance part of the timeout               */
+#define POLL_DELAY_MIN      10      /* ms, bounds of the learned delay between polls            */
+#define POLL_DELAY_MAX      200
+#define KEEP_SESSION_PERIOD 60      /* sec, the longest period of the poll class for that       */
+#define KEEP_ALIVE_PERIOD   30      /* sec, RR to the idle meter within its inactivity timeout  */
+#define METER_ADDRESS_MIN   0x10    /* lower HDLC address of the meter set by device_address    */
+#define METER_ADDRESS_MAX   0x7d
+
+#define POLL_FINAL      0x10    /* P/F bit of the control field                                 */
+#define S_FRAME_MASK    0x0f
+#define RR              0x01
+#define RNR             0x05
+#define REJ             0x09
 #define SNRM            0x93
 #define DISC            0x53
 #define UA              0x73
@@ -29,16 +62,49 @@
 #define AARQ            0x60
 #define AARE            0x61
 #define AUTH            0xac
+#define BER_OCTET_STRING 0x04  /* octet string of the AARQ and AARE fields, BER and not A-XDR       */
+#define LLC_HEAD        3       /* LSAP, LSAP and quality before APDU                           */
 #define GET_REQUEST     0xc0
 #define GET_RESPONSE    0xc4
-
-enum {
-    TYPE_SIGNED_32    = 0x05,
-    TYPE_UNSIGNED_32  = 0x06,
-    TYPE_OCTET_STRING = 0x09,
-    TYPE_UNSIGNED_16  = 0x12,
-    TYPE_UNSIGNED_64  = 0x15,
-};
+#define GET_NORMAL      0x01
+#define GET_WITH_LIST   0x03
+#define GET_NEXT        0x02    /* GET-Request-Next                                             */
+#define GET_DATABLOCK   0x02    /* GET-Response-With-Datablock                                  */
+#define INVOKE_PRIORITY 0xc0    /* high priority, confirmed service                             */
+#define ACTION_REQUEST  0xc3
+#define ACTION_RESPONSE 0xc7
+#define ACTION_NORMAL   0x01
+#define EXCEPTION_RESPONSE      0xd8    /* not ciphered by the meter */
+#define GLO_INITIATE_REQUEST    0x21
+#define GLO_INITIATE_RESPONSE   0x28
+#define GLO_GET_REQUEST         0xc8
+#define GLO_ACTION_REQUEST      0xcb
+#define GLO_GET_RESPONSE        0xcc
+#define GLO_ACTION_RESPONSE     0xcf
+#define CHALLENGE_SIZE  16      /* CtoS of HLS, 8 to 64 bytes                                   */
+#define CHALLENGE_MAX   64      /* StoC of the meter                                            */
+#define HLS_REPLY_SIZE  (DLMS_SECURITY_HEAD + DLMS_TAG_SIZE)    /* f(StoC) and f(CtoS)          */
+#define CIPHER_OVERHEAD (3 + DLMS_SECURITY_HEAD + DLMS_TAG_SIZE)  /* tag and length of glo-APDU */
+#define IC_RESERVE      4096    /* invocation counters stored ahead, one write of flash for them */
+#define INVOKE_ID_MASK  0x0f
+
+/* LLC 3 + | GET_REQUEST | GET_WITH_LIST | invoke-id | count | = 7 bytes, then descriptors */
+#define GET_LIST_HEAD   7
+#define GET_LIST_LIMIT  32      /* bits in the mask of failed items                             */
+#define SESSION_ITEMS   32      /* bits in the mask of items for retry                          */
+
+/* | LSAP | RESP_LSAP | 0 | GET_RESPONSE | type | invoke-id | */
+#define APDU_HEAD       6
+#define STREAM_DEPTH    8       /* nested arrays and structures                                 */
+#define STREAM_ELEM_MAX 256     /* one value or one entry of the array                          */
+
+/* SNRM and UA parameters */
+#define HDLC_FORMAT_ID          0x81
+#define HDLC_GROUP_ID           0x80
+#define HDLC_MAX_INFO_TX        0x05
+#define HDLC_MAX_INFO_RX        0x06
+#define HDLC_WINDOW_TX          0x07
+#define HDLC_WINDOW_RX          0x08
 
 static meter_t meter;
 static package_t raw_package;               /* in - out */
@@ -50,139 +116,421 @@ static uint16_t present_year;
 
 static uint64_t tariff_summ;
 
+
 static uint8_t serial_number[SE_ATTR_SN_SIZE+1] = {0};
 static uint8_t date_release[DATA_MAX_LEN+2] = {0};
-
-
-static request_t attr_descriptor_serial_number = {
-        .class =     {0x00, 0x01},
-        .obis =      {0x00, 0x00, 0x60, 0x01, 0x00, 0xff},   /* 0.0.96.01.00.255 */
-        .attribute = {0x02, 0x00}
-};
-
-static request_t attr_descriptor_date_release = {
-        .class =     {0x00, 0x01},
-        .obis =      {0x00, 0x00, 0x60, 0x01, 0x04, 0xff},   /* 0.0.96.1.4.255   */
-        .attribute = {0x02, 0x00}
+static uint8_t firmware[METER_FIRMWARE_SIZE] = {0};
+static uint8_t firmware_read;               /* firmware row is answered, even without data  */
+
+static uint8_t serial_number_data(const obis_item_t *item, axdr_t *data, uint16_t entry);
+static uint8_t date_release_data(const obis_item_t *item, axdr_t *data, uint16_t entry);
+static uint8_t firmware_data(const obis_item_t *item, axdr_t *data, uint16_t entry);
+static uint8_t object_list_data(const obis_item_t *item, axdr_t *data, uint16_t entry);
+static uint8_t time_data(const obis_item_t *item, axdr_t *data, uint16_t entry);
+static uint8_t tariff_data(const obis_item_t *item, axdr_t *data, uint16_t entry);
+static uint8_t profile_capture_data(const obis_item_t *item, axdr_t *data, uint16_t entry);
+static uint8_t profile_buffer_data(const obis_item_t *item, axdr_t *data, uint16_t entry);
+static uint8_t load_profile_entries_data(const obis_item_t *item, axdr_t *data, uint16_t entry);
+static uint8_t load_profile_data(const obis_item_t *item, axdr_t *data, uint16_t entry);
+static uint8_t scaler_unit_data(const obis_item_t *item, axdr_t *data, uint16_t entry);
+static void plan_execute(const obis_item_t *item, uint8_t *data, size_t len, uint16_t entry);
+static void session_execute(uint8_t i, uint8_t *data, size_t len, uint16_t entry);
+static void get_resbat_data();
+static void scaler_apply();
+
+static void session_send(uint8_t *frame, size_t size);
+static void session_frameCb(void *arg);
+static void session_fail(pkt_error_t err_no);
+static int32_t session_restoreCb(void *arg);
+static void session_open();
+static void session_close();
+static void session_finish();
+
+
+/* | class-id 2 | OBIS 6 | attribute-id | no selective access | */
+#define DESCRIPTOR(class, a, b, c, d, e, f, attr)   {{0x00, class}, {a, b, c, d, e, f}, {attr, 0x00}}
+#define TYPE_BIT(type)      (1UL << (type))
+#define TYPES_SIGNED        (TYPE_BIT(TYPE_INTEGER) | TYPE_BIT(TYPE_LONG) | TYPE_BIT(TYPE_SIGNED_32) | TYPE_BIT(TYPE_SIGNED_64))
+#define TYPES_UNSIGNED      (TYPE_BIT(TYPE_UNSIGNED) | TYPE_BIT(TYPE_UNSIGNED_16) | TYPE_BIT(TYPE_UNSIGNED_32) | TYPE_BIT(TYPE_UNSIGNED_64))
+#define TYPES_NUMBER        (TYPES_SIGNED | TYPES_UNSIGNED)
+#define TYPES_STRING        TYPE_BIT(TYPE_OCTET_STRING)
+
+/* entry_descriptor: | from_entry | to_entry | from_selected_value | to_selected_value - 0 all |.
+ * The instantaneous profile keeps the single entry captured at the request, it is the last one */
+static const uint8_t access_last_entry[] = {
+    0x02,                                   /* access selector - entry_descriptor           */
+    TYPE_STRUCTURE, 0x04,
+    TYPE_UNSIGNED_32, 0x00, 0x00, 0x00, 0x01,
+    TYPE_UNSIGNED_32, 0x00, 0x00, 0x00, 0x01,
+    TYPE_UNSIGNED_16, 0x00, 0x01,
+    TYPE_UNSIGNED_16, 0x00, 0x00,
 };
 
-static request_t attr_descriptor_tariff1AP = {
-        .class  =    {0x00, 0x03},
-        .obis   =    {0x01, 0x00, 0x01, 0x08, 0x01, 0xff},   /* 1.0.1.8.1.255   */
-        .attribute = {0x02, 0x00}
+/* entry_descriptor of the load profile, from_entry and to_entry are set before the cycle */
+#define LOAD_PROFILE_FROM_ENTRY 4
+#define LOAD_PROFILE_TO_ENTRY   9
+static uint8_t access_load_profile_entry[] = {
+    0x02,                                   /* access selector - entry_descriptor           */
+    TYPE_STRUCTURE, 0x04,
+    TYPE_UNSIGNED_32, 0x00, 0x00, 0x00, 0x00,
+    TYPE_UNSIGNED_32, 0x00, 0x00, 0x00, 0x00,
+    TYPE_UNSIGNED_16, 0x00, 0x01,
+    TYPE_UNSIGNED_16, 0x00, 0x00,
 };
 
-//static request_t attr_descriptor_tariff1AM = {
-//        .class  =    {0x00, 0x03},
-//        .obis   =    {0x01, 0x00, 0x02, 0x08, 0x01, 0xff},   /* 1.0.2.8.1.255   */
-//        .attribute = {0x02, 0x00}
-//};
-
-static request_t attr_descriptor_tariff2AP = {
-        .class  =    {0x00, 0x03},
-        .obis   =    {0x01, 0x00, 0x01, 0x08, 0x02, 0xff},   /* 1.0.1.8.2.255   */
-        .attribute = {0x02, 0x00}
-};
-
-//static request_t attr_descriptor_tariff2AM = {
-//        .class  =    {0x00, 0x03},
-//        .obis   =    {0x01, 0x00, 0x02, 0x08, 0x02, 0xff},   /* 1.0.2.8.2.255   */
-//        .attribute = {0x02, 0x00}
-//};
-
-static request_t attr_descriptor_tariff3AP = {
-        .class  =    {0x00, 0x03},
-        .obis   =    {0x01, 0x00, 0x01, 0x08, 0x03, 0xff},   /* 1.0.1.8.3.255   */
-        .attribute = {0x02, 0x00}
+/* range_descriptor of the load profile by the clock: | restricting_object | from_value |
+ * to_value | selected_values - empty, all columns |. from_value is set before the cycle */
+#define LOAD_PROFILE_FROM_VALUE 23
+static uint8_t access_load_profile_range[] = {
+    0x01,                                   /* access selector - range_descriptor           */
+    TYPE_STRUCTURE, 0x04,
+    TYPE_STRUCTURE, 0x04,                   /* clock 0.0.1.0.0.255, attribute 2             */
+    TYPE_UNSIGNED_16, 0x00, 0x08,
+    TYPE_OCTET_STRING, 0x06, 0x00, 0x00, 0x01, 0x00, 0x00, 0xff,
+    TYPE_INTEGER, 0x02,
+    TYPE_UNSIGNED_16, 0x00, 0x00,
+    TYPE_OCTET_STRING, AXDR_DATE_TIME_SIZE,
+    0x07, 0xd0, 0x01, 0x01, 0xff, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00, 0xff,
+    TYPE_OCTET_STRING, AXDR_DATE_TIME_SIZE, /* 2099-12-31 23:59:59, all entries up to now   */
+    0x08, 0x33, 0x0c, 0x1f, 0xff, 0x17, 0x3b, 0x3b, 0xff, 0x80, 0x00, 0xff,
+    TYPE_ARRAY, 0x00,
 };
 
-//static request_t attr_descriptor_tariff3AM = {
-//        .class  =    {0x00, 0x03},
-//        .obis   =    {0x01, 0x00, 0x02, 0x08, 0x03, 0xff},   /* 1.0.2.8.3.255   */
-//        .attribute = {0x02, 0x00}
-//};
-
-static request_t attr_descriptor_tariff4AP = {
-        .class  =    {0x00, 0x03},
-        .obis   =    {0x01, 0x00, 0x01, 0x08, 0x04, 0xff},   /* 1.0.1.8.4.255   */
-        .attribute = {0x02, 0x00}
-};
-
-//static request_t attr_descriptor_tariff4AM = {
-//        .class  =    {0x00, 0x03},
-//        .obis   =    {0x01, 0x00, 0x02, 0x08, 0x04, 0xff},   /* 1.0.2.8.4.255   */
-//        .attribute = {0x02, 0x00}
-//};
-
-static request_t attr_descriptor_voltageA = {
-        .class  =    {0x00, 0x03},
-        .obis   =    {0x01, 0x00, 0x20, 0x07, 0x00, 0xff},   /* 1.0.32.7.0.255  */
-        .attribute = {0x02, 0x00}
+/* read plan, in the order of reading. A new quantity is one more row */
+static const obis_item_t obis_plan[] = {
+    /* 0.0.96.1.0.255 */
+    {DESCRIPTOR(1, 0x00, 0x00, 0x60, 0x01, 0x00, 0xff, 2), TYPES_STRING | TYPE_BIT(TYPE_UNSIGNED_32), 0, QUANTITY_NONE,
+     APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING,               ZCL_ATTRID_METER_SERIAL_NUMBER,             POLL_ONCE,    serial_number_data},
+    /* 0.0.96.1.4.255 */
+    {DESCRIPTOR(1, 0x00, 0x00, 0x60, 0x01, 0x04, 0xff, 2), TYPES_STRING,                              0, QUANTITY_NONE,
+     APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING,               ZCL_ATTRID_CUSTOM_DATE_RELEASE,             POLL_ONCE,    date_release_data},
+    /* 0.0.96.1.2.255 firmware version */
+    {DESCRIPTOR(1, 0x00, 0x00, 0x60, 0x01, 0x02, 0xff, 2), TYPES_STRING | TYPE_BIT(TYPE_VISIBLE_STRING), 0, QUANTITY_NONE,
+     APP_ENDPOINT_1, 0,                                     0,                                          POLL_ONCE,    firmware_data},
+    /* 0.0.40.0.0.255 object_list of the association, when the meter or its firmware is new */
+    {DESCRIPTOR(15, 0x00, 0x00, 0x28, 0x00, 0x00, 0xff, 2), TYPE_BIT(TYPE_STRUCTURE),                 0, QUANTITY_NONE,
+     APP_ENDPOINT_1, 0,                                     0,                                          POLL_ONCE,    object_list_data,
+     NULL, 0, true},
+    /* 1.0.94.7.0.255 capture_objects of the instantaneous profile */
+    {DESCRIPTOR(7, 0x01, 0x00, 0x5e, 0x07, 0x00, 0xff, 3), TYPE_BIT(TYPE_STRUCTURE),                  0, QUANTITY_NONE,
+     APP_ENDPOINT_1, 0,                                     0,                                          POLL_ONCE,    profile_capture_data},
+    /* 0.0.1.0.0.255 */
+    {DESCRIPTOR(8, 0x00, 0x00, 0x01, 0x00, 0x00, 0xff, 2), TYPES_STRING,                              0, QUANTITY_NONE,
+     APP_ENDPOINT_1, 0,                                     0,                                          POLL_TARIFF,  time_data},
+    /* 1.0.32.7.0.255 */
+    {DESCRIPTOR(3, 0x01, 0x00, 0x20, 0x07, 0x00, 0xff, 2), TYPES_UNSIGNED,                            0, QUANTITY_VOLTAGE,
+     APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_VOLTAGE,                     POLL_VOLTAGE, NULL},
+    /* 1.0.52.7.0.255 */
+    {DESCRIPTOR(3, 0x01, 0x00, 0x34, 0x07, 0x00, 0xff, 2), TYPES_UNSIGNED,                            0, QUANTITY_VOLTAGE,
+     APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_VOLTAGE_PHB,                 POLL_VOLTAGE, NULL},
+    /* 1.0.72.7.0.255 */
+    {DESCRIPTOR(3, 0x01, 0x00, 0x48, 0x07, 0x00, 0xff, 2), TYPES_UNSIGNED,                            0, QUANTITY_VOLTAGE,
+     APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_VOLTAGE_PHC,                 POLL_VOLTAGE, NULL},
+    /* 1.0.31.7.0.255 */
+    {DESCRIPTOR(3, 0x01, 0x00, 0x1f, 0x07, 0x00, 0xff, 2), TYPES_NUMBER,                              0, QUANTITY_CURRENT,
+     APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_CURRENT,                     POLL_POWER,   NULL},
+    /* 1.0.51.7.0.255 */
+    {DESCRIPTOR(3, 0x01, 0x00, 0x33, 0x07, 0x00, 0xff, 2), TYPES_NUMBER,                              0, QUANTITY_CURRENT,
+     APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_CURRENT_PHB,                 POLL_POWER,   NULL},
+    /* 1.0.71.7.0.255 */
+    {DESCRIPTOR(3, 0x01, 0x00, 0x47, 0x07, 0x00, 0xff, 2), TYPES_NUMBER,                              0, QUANTITY_CURRENT,
+     APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_CURRENT_PHC,                 POLL_POWER,   NULL},
+    /* 1.0.91.7.0.255 */
+    {DESCRIPTOR(3, 0x01, 0x00, 0x5b, 0x07, 0x00, 0xff, 2), TYPES_NUMBER,                              0, QUANTITY_CURRENT,
+     APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_NEUTRAL_CURRENT,                 POLL_POWER,   NULL},
+    /* 1.0.21.7.0.255 */
+    {DESCRIPTOR(3, 0x01, 0x00, 0x15, 0x07, 0x00, 0xff, 2), TYPES_NUMBER,                              0, QUANTITY_POWER,
+     APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_ACTIVE_POWER,                    POLL_POWER,   NULL},
+    /* 1.0.41.7.0.255 */
+    {DESCRIPTOR(3, 0x01, 0x00, 0x29, 0x07, 0x00, 0xff, 2), TYPES_NUMBER,                              0, QUANTITY_POWER,
+     APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_ACTIVE_POWER_PHB,                POLL_POWER,   NULL},
+    /* 1.0.61.7.0.255 */
+    {DESCRIPTOR(3, 0x01, 0x00, 0x3d, 0x07, 0x00, 0xff, 2), TYPES_NUMBER,                              0, QUANTITY_POWER,
+     APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_ACTIVE_POWER_PHC,                POLL_POWER,   NULL},
+    /* 1.0.94.7.0.255 buffer, instead of the rows above which are in capture_objects */
+    {DESCRIPTOR(7, 0x01, 0x00, 0x5e, 0x07, 0x00, 0xff, 2), TYPE_BIT(TYPE_STRUCTURE),                  0, QUANTITY_NONE,
+     APP_ENDPOINT_1, 0,                                     0,                                          POLL_POWER,   profile_buffer_data,
+     access_last_entry, sizeof(access_last_entry)},
+    /* 1.0.1.8.1.255 */
+    {DESCRIPTOR(3, 0x01, 0x00, 0x01, 0x08, 0x01, 0xff, 2), TYPES_NUMBER,                              0, QUANTITY_ENERGY,
+     APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING,               ZCL_ATTRID_CURRENT_TIER_1_SUMMATION_DELIVERD, POLL_TARIFF,  tariff_data},
+    /* 1.0.1.8.2.255 */
+    {DESCRIPTOR(3, 0x01, 0x00, 0x01, 0x08, 0x02, 0xff, 2), TYPES_NUMBER,                              0, QUANTITY_ENERGY,
+     APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING,               ZCL_ATTRID_CURRENT_TIER_2_SUMMATION_DELIVERD, POLL_TARIFF,  tariff_data},
+    /* 1.0.1.8.3.255 */
+    {DESCRIPTOR(3, 0x01, 0x00, 0x01, 0x08, 0x03, 0xff, 2), TYPES_NUMBER,                              0, QUANTITY_ENERGY,
+     APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING,               ZCL_ATTRID_CURRENT_TIER_3_SUMMATION_DELIVERD, POLL_TARIFF,  tariff_data},
+    /* 1.0.1.8.4.255 */
+    {DESCRIPTOR(3, 0x01, 0x00, 0x01, 0x08, 0x04, 0xff, 2), TYPES_NUMBER,                              0, QUANTITY_ENERGY,
+     APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING,               ZCL_ATTRID_CURRENT_TIER_4_SUMMATION_DELIVERD, POLL_TARIFF,  tariff_data},
+    /* 1.0.99.1.0.255 entries_in_use of the load profile, the number of the last entry */
+    {DESCRIPTOR(7, 0x01, 0x00, 0x63, 0x01, 0x00, 0xff, 7), TYPES_UNSIGNED,                            0, QUANTITY_NONE,
+     APP_ENDPOINT_1, 0,                                     0,                                          POLL_TARIFF,  load_profile_entries_data},
+    /* 1.0.99.1.0.255 buffer, the entries of the depth when nothing is stored yet */
+    {DESCRIPTOR(7, 0x01, 0x00, 0x63, 0x01, 0x00, 0xff, 2), TYPES_NUMBER,                              0, QUANTITY_NONE,
+     APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING,               ZCL_ATTRID_CUSTOM_PROFILE_ENERGY,           POLL_TARIFF,  load_profile_data,
+     access_load_profile_entry, sizeof(access_load_profile_entry)},
+    /* 1.0.99.1.0.255 buffer, the entries after the stored one */
+    {DESCRIPTOR(7, 0x01, 0x00, 0x63, 0x01, 0x00, 0xff, 2), TYPES_NUMBER,                              0, QUANTITY_NONE,
+     APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING,               ZCL_ATTRID_CUSTOM_PROFILE_ENERGY,           POLL_TARIFF,  load_profile_data,
+     access_load_profile_range, sizeof(access_load_profile_range)},
 };
 
-static request_t attr_descriptor_voltageB = {
-        .class  =    {0x00, 0x03},
-        .obis   =    {0x01, 0x00, 0x34, 0x07, 0x00, 0xff},   /* 1.0.52.7.0.255  */
-        .attribute = {0x02, 0x00}
-};
+#define OBIS_PLAN_NUM   (sizeof(obis_plan)/sizeof(obis_plan[0]))
 
-static request_t attr_descriptor_voltageC = {
-        .class  =    {0x00, 0x03},
-        .obis   =    {0x01, 0x00, 0x48, 0x07, 0x00, 0xff},   /* 1.0.72.7.0.255  */
-        .attribute = {0x02, 0x00}
-};
+static uint32_t plan_once;                  /* POLL_ONCE rows already read, bit per row */
 
-static request_t attr_descriptor_powerA = {
-        .class  =    {0x00, 0x03},
-        .obis   =    {0x01, 0x00, 0x15, 0x07, 0x00, 0xff},   /* 1.0.21.7.0.255  */
-        .attribute = {0x02, 0x00}
-};
+#define PROFILE_COLUMNS_MAX 32
+#define PROFILE_NO_ROW      0xff
 
-static request_t attr_descriptor_powerB = {
-        .class  =    {0x00, 0x03},
-        .obis   =    {0x01, 0x00, 0x29, 0x07, 0x00, 0xff},   /* 1.0.41.7.0.255  */
-        .attribute = {0x02, 0x00}
-};
+/* capture_objects of the instantaneous profile mapped to the rows of the plan */
+typedef struct {
+    uint8_t         ready;                  /* buffer is read instead of the covered rows   */
+    uint16_t        columns;                /* capture objects                              */
+    uint8_t         row[PROFILE_COLUMNS_MAX];   /* row of the column or PROFILE_NO_ROW      */
+    uint32_t        covered;                /* rows in the buffer, bit per row              */
+} profile_t;
 
-static request_t attr_descriptor_powerC = {
-        .class  =    {0x00, 0x03},
-        .obis   =    {0x01, 0x00, 0x3d, 0x07, 0x00, 0xff},   /* 1.0.61.7.0.255  */
-        .attribute = {0x02, 0x00}
-};
+static profile_t profile;
 
-static request_t attr_descriptor_currentA = {
-        .class  =    {0x00, 0x03},
-        .obis   =    {0x01, 0x00, 0x1f, 0x07, 0x00, 0xff},   /* 1.0.31.7.0.255  */
-        .attribute = {0x02, 0x00}
-};
+typedef enum {
+    LOAD_PROFILE_ANCHOR = 0,                /* entries_in_use is the number of the last entry */
+    LOAD_PROFILE_LAST,                      /* the entries of the depth up to the last by their numbers */
+    LOAD_PROFILE_RANGE                      /* the entries after the stored one by the clock */
+} load_profile_state_t;
 
-static request_t attr_descriptor_currentB = {
-        .class  =    {0x00, 0x03},
-        .obis   =    {0x01, 0x00, 0x33, 0x07, 0x00, 0xff},   /* 1.0.51.7.0.255  */
-        .attribute = {0x02, 0x00}
-};
+static uint8_t meter_cache_dirty;           /* meter_cache is to be written                 */
+static uint32_t object_list_rows;           /* rows found in object_list being received     */
+static uint8_t object_list_taken;           /* object_list has come, it is stored at the end */
 
-static request_t attr_descriptor_currentC = {
-        .class  =    {0x00, 0x03},
-        .obis   =    {0x01, 0x00, 0x47, 0x07, 0x00, 0xff},   /* 1.0.71.7.0.255  */
-        .attribute = {0x02, 0x00}
-};
+#define UNIT_WH         30                  /* DLMS units of energy, ZCL metering is in kWh */
+#define UNIT_VAH        31
+#define UNIT_VARH       32
 
-static request_t attr_descriptor_currentN = {
-        .class  =    {0x00, 0x03},
-        .obis   =    {0x01, 0x00, 0x5b, 0x07, 0x00, 0xff},   /* 1.0.91.7.0.255  */
-        .attribute = {0x02, 0x00}
-};
+typedef struct {
+    uint16_t        cluster_id;
+    uint16_t        multiplier_id;
+    uint16_t        divisor_id;
+} quantity_attr_t;
 
-static request_t attr_descriptor_time = {
-        .class  =    {0x00, 0x08},
-        .obis   =    {0x00, 0x00, 0x01, 0x00, 0x00, 0xff},   /* 0.0.1.0.0.255  */
-        .attribute = {0x02, 0x00}
+static const quantity_attr_t quantity_attr[QUANTITY_MAX] = {
+    [QUANTITY_ENERGY]   = {ZCL_CLUSTER_SE_METERING,               ZCL_ATTRID_MULTIPLIER,            ZCL_ATTRID_DIVISOR},
+    [QUANTITY_VOLTAGE]  = {ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_VOLTAGE_MULTIPLIER, ZCL_ATTRID_AC_VOLTAGE_DIVISOR},
+    [QUANTITY_CURRENT]  = {ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_CURRENT_MULTIPLIER, ZCL_ATTRID_AC_CURRENT_DIVISOR},
+    [QUANTITY_POWER]    = {ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_AC_POWER_MULTIPLIER,   ZCL_ATTRID_AC_POWER_DIVISOR},
 };
 
-
-
-static void send_notification();
+static load_profile_state_t load_profile_state;
+static uint32_t load_profile_last;          /* number of the last entry                     */
+static uint32_t load_profile_next;          /* number of the next entry of the depth        */
+static uint8_t load_profile_dirty;          /* load_profile_cfg is to be written            */
+/* new entries of the cycle, one report: | size | time | energy | ... |, ZCL octet string */
+static uint8_t load_profile_report[1+PROFILE_REPORT_ENTRIES*8];
+
+typedef enum {
+    RX_FLAG = 0,
+    RX_FORMAT_TYPE,
+    RX_FORMAT_LENGTH,
+    RX_FRAME,
+    RX_COMPLETE
+} hdlc_rx_state_t;
+
+typedef enum {
+    SESSION_IDLE = 0,
+    SESSION_CONNECT,                        /* SNRM -> UA                                   */
+    SESSION_OPEN,                           /* AARQ -> AARE                                 */
+    SESSION_AUTH,                           /* f(StoC) -> f(CtoS), HLS pass 3 and 4         */
+    SESSION_GET,                            /* GET-Request -> GET-Response                  */
+    SESSION_DISCONNECT,                     /* DISC -> UA                                   */
+    SESSION_KEEP_ALIVE,                     /* RR -> RR between cycles                      */
+    SESSION_RESTORE                         /* late frames of the failed request are let out */
+} session_state_t;
+
+typedef struct {
+    hdlc_rx_state_t state;
+    uint16_t        length;                 /* length from format field                     */
+    uint16_t        load_size;              /* received bytes of the frame with the flag    */
+    uint16_t        crc;                    /* FCS register updated by every received byte  */
+} hdlc_rx_t;
+
+typedef enum {
+    ST_COUNT = 0,                           /* items in the list                            */
+    ST_CHOICE,                              /* data or data-access-result                   */
+    ST_DAR,
+    ST_TAG,
+    ST_LENGTH,
+    ST_LENGTH_NEXT,
+    ST_VALUE,
+    ST_DONE,
+    ST_ERROR
+} stream_state_t;
+
+typedef enum {
+    BLOCK_LAST = 0,
+    BLOCK_NUMBER,
+    BLOCK_CHOICE,
+    BLOCK_LENGTH,
+    BLOCK_LENGTH_NEXT,
+    BLOCK_RAW
+} block_state_t;
+
+/* incremental decoder of Get-Data-Result, it keeps its place between segments and blocks */
+typedef struct {
+    stream_state_t  state;
+    uint8_t         item;                   /* current item of the request                  */
+    uint8_t         tag;
+    uint8_t         base;                   /* depth of delivered values, 1 - array entries */
+    uint8_t         depth;
+    uint16_t        count[STREAM_DEPTH];    /* values left in open arrays and structures    */
+    uint16_t        need;                   /* bytes left of the value or of the length     */
+    uint16_t        length;
+    block_state_t   block_state;
+    uint8_t         last_block;
+    uint32_t        block;                  /* last received block number                   */
+    uint32_t        number;
+    uint8_t         raw_need;
+    uint16_t        raw_left;               /* raw-data bytes left in the block             */
+    uint16_t        entry;                  /* entries of the array at the top delivered    */
+    uint16_t        elem_len;
+    uint8_t         overflow;               /* value does not fit, the handler is skipped   */
+    uint8_t         elem[STREAM_ELEM_MAX];
+} stream_t;
+
+typedef struct {
+    uint8_t         idx;                    /* first item                                   */
+    uint8_t         len;                    /* items                                        */
+    uint8_t         list;                   /* 1 - GET-Request-With-List                    */
+    uint8_t         invoke;                 /* invoke-id                                    */
+    uint8_t         ns;                     /* N(S) of the I-frame                          */
+    uint8_t         pending;                /* 1 - waiting for sending                      */
+    uint8_t         started;                /* response is being received                   */
+    uint8_t         bad;                    /* response is not valid, the rest is skipped   */
+    uint32_t        failed;                 /* items without data                           */
+    stream_t        st;
+    uint8_t         info_len;
+    uint8_t         info[MAX_INFO_FIELD];   /* LLC and APDU for retransmission              */
+} session_req_t;
+
+typedef struct {
+    session_state_t state;
+    uint8_t         established;            /* link and association are open                */
+    uint8_t         complete;               /* all requests of the cycle are done           */
+    uint8_t         attempt;
+    uint8_t         retrans;                /* retransmissions after timeout                */
+    uint8_t         polls;                  /* polls without response                       */
+    uint8_t         invoke;
+    uint8_t         classes;                /* poll classes of the cycle                    */
+    uint8_t         count;                  /* items in the cycle                           */
+    uint8_t         next;                   /* first item not requested yet                 */
+    uint32_t        retry;                  /* items for single GET after the list          */
+    uint8_t         tx_num;                 /* requests in flight                           */
+    session_req_t   tx[MAX_WINDOW_TX];      /* in the order of sending                      */
+    const obis_item_t *items[SESSION_ITEMS];  /* rows of the plan in the cycle   */
+    uint32_t        scaler;                 /* items which ask scaler_unit (attribute 3) of their row, bit per item */
+} session_t;
+
+typedef enum {
+    GLO_START = 0,                          /* tag of glo-get-response                      */
+    GLO_PLAIN,                              /* exception-response is not ciphered           */
+    GLO_LENGTH,
+    GLO_LENGTH_NEXT,
+    GLO_SECURITY,                           /* security control and invocation counter      */
+    GLO_TEXT,                               /* GET-Response is deciphered on the fly        */
+    GLO_MAC,                                /* GCM tag after the text                       */
+    GLO_ERROR
+} glo_state_t;
+
+typedef struct {
+    uint8_t         len;
+    uint8_t         head[APDU_HEAD];
+    uint8_t         req;                    /* request of the response                      */
+    uint8_t         type;
+    glo_state_t     glo;
+    uint8_t         need;                   /* bytes of the length, the header or the tag   */
+    uint16_t        length;
+    uint16_t        text_left;              /* ciphertext bytes left                        */
+    uint8_t         security[DLMS_SECURITY_HEAD];
+    uint8_t         tag[DLMS_TAG_SIZE];
+    dlms_gcm_t      gcm;
+} apdu_rx_t;
+
+/* HLS with the keys of the client, all APDUs of the association are ciphered */
+typedef struct {
+    uint8_t         ciphered;               /* 1 - HLS GMAC, 0 - LLS                        */
+    uint32_t        ic;                     /* next invocation counter of the client        */
+    uint8_t         server_ic_valid;
+    uint32_t        server_ic;              /* last invocation counter of the meter         */
+    uint8_t         server_title[DLMS_SYSTEM_TITLE_SIZE];
+    uint8_t         challenge[CHALLENGE_SIZE];  /* CtoS                                     */
+    uint8_t         stoc_len;
+    uint8_t         stoc[CHALLENGE_MAX];
+} security_t;
+
+/* constant frame encoded once, only the control field and the checks after it change */
+typedef struct {
+    uint8_t         len;                    /* whole frame with both flags                  */
+    uint8_t         info_len;               /* 0 - no information field and no HCS          */
+    uint16_t        crc_head;               /* CRC register over format and addresses       */
+    uint8_t         frame[FRAME_TEMPLATE_MAX];
+} frame_template_t;
+
+typedef enum {
+    RTT_LINK = 0,                           /* SNRM, DISC -> UA                             */
+    RTT_OPEN,                               /* AARQ -> AARE                                 */
+    RTT_GET,                                /* I-frame or RR -> the next frame of the meter */
+    RTT_MAX
+} rtt_type_t;
+
+/* latency of one kind of exchange with the meter, as TCP RTO. The transfer time of
+ * the frames is taken away, it depends on their size and is added to the timeout */
+typedef struct {
+    uint16_t        srtt;                   /* smoothed latency, ms * 8, 0 - no samples     */
+    uint16_t        rttvar;                 /* mean deviation, ms * 4                       */
+    uint16_t        rto;                    /* latency timeout, ms                          */
+} rtt_t;
+
+static hdlc_rx_t hdlc_rx;
+static rtt_t rtt[RTT_MAX];
+static uint32_t rtt_sent;                   /* clock_time() of the frame which asks the response */
+static uint16_t rtt_tx_len;                 /* bytes sent, their transfer is not the latency */
+static uint8_t rtt_pending;                 /* the round trip is being measured             */
+static uint8_t tx_waiting;                  /* the frames are queued, the uart has not sent them yet */
+static uint8_t rtt_ambiguous;               /* the next frame may answer the repeated request */
+static frame_template_t frame_snrm, frame_aarq, frame_disc, frame_s;
+static session_t session;
+static apdu_rx_t apdu_rx;
+static security_t security;
+static ev_timer_event_t *timerResponseEvt = NULL;
+static ev_timer_event_t *timerKeepAliveEvt = NULL;
+
+/* meter on the bus. The driver works with the module variables of the active meter,
+ * the others keep here their link, their latency and what is read from them */
+typedef struct {
+    meter_t         meter;
+    rtt_t           rtt[RTT_MAX];
+    security_t      security;
+    uint8_t         established;
+    uint32_t        left_time;              /* poll_clock() when the bus went to another meter */
+    uint8_t         fresh;                  /* nothing is read after reset                  */
+    uint8_t         serial_number[SE_ATTR_SN_SIZE+1];
+    uint8_t         date_release[DATA_MAX_LEN+2];
+    uint8_t         firmware[METER_FIRMWARE_SIZE];
+    uint8_t         firmware_read;
+    uint8_t         release_month;
+    uint16_t        release_year;
+    uint8_t         present_month;
+    uint16_t        present_year;
+    uint32_t        plan_once;
+    profile_t       profile;
+    load_profile_state_t load_profile_state;
+    uint32_t        load_profile_last;
+    uint32_t        load_profile_next;
+} bus_meter_t;
+
+static bus_meter_t bus[METER_MAX];
+static uint8_t bus_active;                  /* meter in the module variables                */
+
+#define ENDPOINT(ep)    ((ep) + bus_active) /* endpoint of the plan row for the active meter */
 
 static const uint16_t fcstab[256] = {
      0x0000, 0x1189, 0x2312, 0x329b, 0x4624, 0x57ad, 0x6536, 0x74bf,
@@ -219,19 +567,32 @@ static const uint16_t fcstab[256] = {
      0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78
 };
 
-static uint16_t checksum(const uint8_t *src_buffer, size_t len) {
+#define CRC_INIT        0xffff
+#define CRC_FINAL(crc)  ((crc) ^ 0xffff)
 
-    uint16_t crc = 0xffff;
+/* CRC-16/X.25 register without the final inversion, may be continued with the next bytes */
+static uint16_t crc_update(uint16_t crc, const uint8_t *src_buffer, size_t len) {
 
     while(len--) {
         crc = (crc >> 8) ^ fcstab[(crc ^ *src_buffer++) & 0xff];
     }
 
-    crc ^= 0xffff;
-
     return crc;
 }
 
+static void put_u32(uint8_t *buf, uint32_t value) {
+
+    *buf++ = (value >> 24) & 0xff;
+    *buf++ = (value >> 16) & 0xff;
+    *buf++ = (value >> 8) & 0xff;
+    *buf = value & 0xff;
+}
+
+static uint32_t get_u32(const uint8_t *buf) {
+
+    return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+}
+
 static uint8_t from_bcd_to_dec(uint8_t bcd) {
 
     uint8_t dec = ((bcd >> 4) & 0x0f) * 10 + (bcd & 0x0f);
@@ -329,29 +690,12 @@ static uint8_t get_address(uint8_t *buff, uint8_t len, uint16_t *lower, uint16_t
 
 static size_t send_command(uint8_t *buff, size_t size) {
 
-    size_t len = 0;
-
-//    app_uart_rx_off();
-    flush_buff_uart();
-
-    for (uint8_t attempt = 0; attempt < 3; attempt++) {
-        len = write_bytes_to_uart(buff, size);
-        if (len == size) {
-            break;
-        } else {
-            len = 0;
-        }
-#if UART_PRINTF_MODE
-        printf("Attempt to send data to uart: %d\r\n", attempt+1);
-#endif
-        sleep_ms(250);
+    size_t len = write_bytes_to_uart(buff, size);
 
+    if (len != size) {
+        len = 0;
     }
 
-    sleep_ms(100);
-//    app_uart_rx_on();
-
-
 #if UART_PRINTF_MODE && DEBUG_PACKAGE
     if (len == 0) {
         uint8_t head[] = "write to uart error";
@@ -365,940 +709,2623 @@ static size_t send_command(uint8_t *buff, size_t size) {
     return len;
 }
 
+static void hdlc_rx_reset() {
+
+    hdlc_rx.state = RX_FLAG;
+    hdlc_rx.load_size = 0;
+    hdlc_rx.length = 0;
+}
+
+/* frame is ready or broken, the bytes remain in the ring buffer until the next request */
+static void hdlc_rx_done(pkt_error_t err_no) {
 
+    hdlc_rx.state = RX_COMPLETE;
+
+#if UART_PRINTF_MODE && DEBUG_PACKAGE
+    if (err_no == PKT_OK) {
+        uint8_t head[] = "read from uart";
+        print_package(head, (uint8_t*)&raw_package, hdlc_rx.load_size);
+    } else {
+        uint8_t head[] = "read from uart error";
+        print_package(head, (uint8_t*)&raw_package, hdlc_rx.load_size);
+    }
+#endif
 
+    TL_SCHEDULE_TASK(session_frameCb, (void*)err_no);
+}
 
-uint8_t response_meter() {
+/* the last byte of FCS has been received */
+static void hdlc_rx_complete() {
 
-    size_t load_size, len;
+    uint8_t *pkt_buff = (uint8_t*)&raw_package;
     uint16_t crc, check_crc, lower, upper;
-    uint8_t ch = 0;
-    uint8_t *ptr_format;
-    format_t format;
-    pkt_error_no = PKT_ERR_TIMEOUT;
 
-    memset(&raw_package, 0, sizeof(package_t));
+    uint8_t size_d = get_address_size(raw_package.header.addr);
+
+    if (size_d == 0 || !get_address(raw_package.header.addr, size_d, &lower, &upper)) {
+        hdlc_rx_done(PKT_ERR_DEST_ADDRESS);
+        return;
+    }
+
+    if (upper != meter.client_addr) {
+        /* to another client, the bytes after it are read on */
+        hdlc_rx_reset();
+        return;
+    }
+
+    uint8_t size_s = get_address_size(raw_package.header.addr+size_d);
+
+    if (size_s == 0 || !get_address(raw_package.header.addr+size_d, size_s, &lower, &upper)) {
+        hdlc_rx_done(PKT_ERR_SRC_ADDRESS);
+        return;
+    }
+
+    if (lower != meter.server_lower_addr || upper != meter.server_upper_addr) {
+        /* another meter on the bus answers late */
+        hdlc_rx_reset();
+        return;
+    }
+
+    crc = CRC_FINAL(hdlc_rx.crc);
+    check_crc = pkt_buff[hdlc_rx.length];
+    check_crc = (check_crc << 8) + pkt_buff[hdlc_rx.length-1];
+
+    if (crc != check_crc) {
+        hdlc_rx_done(PKT_ERR_CRC);
+        return;
+    }
+
+    hdlc_rx_done(PKT_OK);
+}
+
+/* called from the main loop for every portion of bytes received from uart, parses them in place */
+static void hdlc_rx_handler() {
 
     uint8_t *pkt_buff = (uint8_t*)&raw_package;
+    uint8_t *span, ch;
+    size_t len, i;
 
-    /* trying to read for 1 seconds */
-    for(uint8_t i = 0; i < 100; i++ ) {
-        load_size = 0;
-        if (available_buff_uart()) {
+    while (hdlc_rx.state != RX_COMPLETE && (span = span_buff_uart(&len))) {
 
-            if (get_queue_len_buff_uart() < MIN_FRAME_SIZE) {
-                pkt_error_no = PKT_ERR_NO_PKT;
-                flush_buff_uart();
-                break;
-            }
+        for (i = 0; i < len && hdlc_rx.state != RX_COMPLETE; i++) {
 
-            while (available_buff_uart()) {
-                ch = read_byte_from_buff_uart();
+            ch = span[i];
 
-                if (ch == FLAG) {
-                    pkt_buff[load_size++] = ch;
+            switch (hdlc_rx.state) {
+                case RX_FLAG:
+                    if (ch == FLAG) {
+                        pkt_buff[0] = ch;
+                        hdlc_rx.load_size = 1;
+                        hdlc_rx.crc = CRC_INIT;
+                        hdlc_rx.state = RX_FORMAT_TYPE;
+                    }
+                    break;
+                case RX_FORMAT_TYPE:
+                    if (ch == FLAG) {
+                        /* closing flag of the previous frame */
+                        break;
+                    }
+                    pkt_buff[hdlc_rx.load_size++] = ch;
+                    hdlc_rx.crc = (hdlc_rx.crc >> 8) ^ fcstab[(hdlc_rx.crc ^ ch) & 0xff];
+                    if ((ch >> 4) != TYPE3) {
+                        hdlc_rx_done(PKT_ERR_TYPE);
+                        break;
+                    }
+                    hdlc_rx.state = RX_FORMAT_LENGTH;
+                    break;
+                case RX_FORMAT_LENGTH:
+                    pkt_buff[hdlc_rx.load_size++] = ch;
+                    hdlc_rx.crc = (hdlc_rx.crc >> 8) ^ fcstab[(hdlc_rx.crc ^ ch) & 0xff];
+                    hdlc_rx.length = ((pkt_buff[1] & 0x07) << 8) | ch;
+                    if (hdlc_rx.length < MIN_FRAME_SIZE-2 || hdlc_rx.length+2 > sizeof(package_t)) {
+                        hdlc_rx_done(PKT_ERR_UNKNOWN_FORMAT);
+                        break;
+                    }
+                    hdlc_rx.state = RX_FRAME;
+                    break;
+                case RX_FRAME:
+                    /* FCS covers bytes 1 .. length-2 */
+                    if (hdlc_rx.load_size <= hdlc_rx.length-2) {
+                        hdlc_rx.crc = (hdlc_rx.crc >> 8) ^ fcstab[(hdlc_rx.crc ^ ch) & 0xff];
+                    }
+                    pkt_buff[hdlc_rx.load_size++] = ch;
+                    /* opening flag + length, the closing flag is not needed */
+                    if (hdlc_rx.load_size == hdlc_rx.length+1) {
+                        hdlc_rx_complete();
+                    }
+                    break;
+                default:
                     break;
-                } else {
-                    pkt_error_no = PKT_ERR_UNKNOWN_FORMAT;
-                }
             }
+        }
 
-            if (ch != FLAG) continue;
-
-            if (get_queue_len_buff_uart() < 2) {
-                pkt_error_no = PKT_ERR_NO_PKT;
-                flush_buff_uart();
-                break;
-            }
+        consume_buff_uart(i);
+    }
+}
 
-            ptr_format = (uint8_t*)&format;
+static void session_retransmit();
 
-            *(ptr_format+1) = pkt_buff[load_size++] = read_byte_from_buff_uart();
-            *ptr_format = pkt_buff[load_size++] = read_byte_from_buff_uart();
+static rtt_type_t rtt_type() {
 
-            if (format.type != TYPE3) {
-                pkt_error_no = PKT_ERR_TYPE;
-                flush_buff_uart();
-                break;
-            }
+    switch (session.state) {
+        case SESSION_OPEN:
+        case SESSION_AUTH:
+            return RTT_OPEN;
+        case SESSION_GET:
+        case SESSION_KEEP_ALIVE:
+            return RTT_GET;
+        default:
+            return RTT_LINK;
+    }
+}
 
-            if (format.length > load_size+get_queue_len_buff_uart()-2) {
-                pkt_error_no = PKT_ERR_INCOMPLETE;
-                flush_buff_uart();
-                break;
-            }
+static void rtt_reset() {
 
-            meter.format = format;
+    memset(rtt, 0, sizeof(rtt));
 
-            if (format.segmentation) {
-                len = format.length + 1 - load_size;
-            } else {
-                len = format.length + 2 - load_size;
-            }
+    for (uint8_t i = 0; i < RTT_MAX; i++) {
+        rtt[i].rto = RESPONSE_TIMEOUT;
+    }
 
-            for(size_t i = 0; i < len; i++) {
-                pkt_buff[load_size++] = read_byte_from_buff_uart();
+    rtt_pending = false;
+    rtt_ambiguous = false;
+}
 
-            }
+/* ms of the transfer of the bytes over uart */
+static uint32_t bytes_time(uint32_t bytes) {
 
-            meter.rrr = (raw_package.header.control >> 5) & 0x07;
-            meter.sss = (raw_package.header.control >> 1) & 0x07;
+    return bytes * BYTE_TIME_US / 1000;
+}
 
+/* the frames ask the response. After a timeout or a retransmission the response is not measured */
+static void rtt_start(size_t tx_len) {
 
-            if (!format.segmentation) {
-                if (pkt_buff[load_size-1] != FLAG) {
-                    pkt_error_no = PKT_ERR_INCOMPLETE;
-                    break;
-                }
-            }
+    rtt_sent = clock_time();
+    rtt_tx_len = tx_len;
+    rtt_pending = !rtt_ambiguous;
+}
 
-            uint8_t size_d = get_address_size(raw_package.header.addr);
+/* the first valid frame of the response: srtt += (r - srtt)/8, rttvar += (|r - srtt| - rttvar)/4,
+ * rto = srtt + 4*rttvar */
+static void rtt_sample() {
 
-            if (size_d == 0) {
-                pkt_error_no = PKT_ERR_DEST_ADDRESS;
-                break;
-            }
-            if (!get_address(raw_package.header.addr, size_d, &lower, &upper)) {
-                pkt_error_no = PKT_ERR_DEST_ADDRESS;
-                break;
-            }
+    rtt_t *est = &rtt[rtt_type()];
+    uint32_t r, rto;
+    int32_t err;
 
-            uint8_t size_s = get_address_size(raw_package.header.addr+size_d);
+    rtt_ambiguous = false;
 
-            if (size_s == 0) {
-                pkt_error_no = PKT_ERR_SRC_ADDRESS;
-                break;
-            }
-            if (!get_address(raw_package.header.addr+size_d, size_s, &lower, &upper)) {
-                pkt_error_no = PKT_ERR_SRC_ADDRESS;
-                break;
-            }
+    if (!rtt_pending) return;
 
-            crc = checksum(pkt_buff+1, format.length-2);
-            check_crc = pkt_buff[load_size-(meter.format.segmentation?1:2)];
-            check_crc = (check_crc << 8) + pkt_buff[load_size-(meter.format.segmentation?2:3)];
+    rtt_pending = false;
 
-            if (crc != check_crc) {
-                pkt_error_no = PKT_ERR_CRC;
-                break;
-            }
+    r = (clock_time() - rtt_sent) / CLOCK_16M_SYS_TIMER_CLK_1MS;
+    rto = bytes_time(rtt_tx_len + hdlc_rx.length + 2);
+    r = r > rto ? r - rto : 1;
+    if (r > RTO_MAX) r = RTO_MAX;
 
-            i = 100;
-            pkt_error_no = PKT_OK;
-            break;
-        }
-        sleep_ms(10);
+    if (est->srtt == 0) {
+        est->srtt = r << 3;
+        est->rttvar = r << 1;
+    } else {
+        err = r - (est->srtt >> 3);
+        est->srtt += err;
+        if (err < 0) err = -err;
+        est->rttvar += err - (est->rttvar >> 2);
     }
 
-    if (load_size) {
+    rto = (est->srtt >> 3) + (est->rttvar > RTO_GRANULARITY ? est->rttvar : RTO_GRANULARITY);
+    if (rto < RTO_MIN) rto = RTO_MIN;
+    if (rto > RTO_MAX) rto = RTO_MAX;
+    est->rto = rto;
+
 #if UART_PRINTF_MODE && DEBUG_PACKAGE
-        uint8_t head[] = "read from uart";
-        print_package(head, pkt_buff, load_size);
+    printf("Latency: %d ms, srtt: %d ms, rto: %d ms\r\n", r, est->srtt >> 3, est->rto);
 #endif
+}
+
+/* the timeout of the exchange. Before its first sample it is not shorter than the learned
+ * ones of the other exchanges, a slow meter is slow in all of them */
+static uint16_t rtt_rto() {
+
+    rtt_t *est = &rtt[rtt_type()];
+    uint16_t rto = est->rto;
+
+    if (est->srtt) return rto;
+
+    for (uint8_t i = 0; i < RTT_MAX; i++) {
+        if (rtt[i].srtt && rtt[i].rto > rto) rto = rtt[i].rto;
+    }
 
+    return rto;
+}
+
+/* no response in time, the meter is slower than learned */
+static void rtt_backoff() {
+
+    rtt_t *est = &rtt[rtt_type()];
+    uint16_t rto = rtt_rto();
+
+    est->rto = rto < RTO_MAX/2 ? rto << 1 : RTO_MAX;
+    rtt_pending = false;
+    rtt_ambiguous = true;
+}
+
+/* the meter which is processing is polled after about a half of its latency */
+static uint16_t poll_delay() {
+
+    uint16_t delay;
+
+    if (rtt[RTT_GET].srtt == 0) return POLL_DELAY;
+
+    delay = rtt[RTT_GET].srtt >> 4;
+    if (delay < POLL_DELAY_MIN) delay = POLL_DELAY_MIN;
+    if (delay > POLL_DELAY_MAX) delay = POLL_DELAY_MAX;
+
+    return delay;
+}
+
+static int32_t session_timeoutCb(void *arg) {
+
+    timerResponseEvt = NULL;
+
+    rtt_backoff();
+
+    if (session.state == SESSION_GET && ++session.retrans <= LINK_ATTEMPTS) {
+        /* the frames or the answer are lost, the link is probably still alive */
+        zcl_diagInc(pkt_errors[PKT_ERR_TIMEOUT]);
+        session_retransmit();
     } else {
-#if UART_PRINTF_MODE && DEBUG_PACKAGE
-        uint8_t head[] = "read from uart error";
-        print_package(head, pkt_buff, load_size);
-#endif
+        session_fail(PKT_ERR_TIMEOUT);
     }
 
-#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
-    if (pkt_error_no != PKT_OK) print_error(pkt_error_no);
-#endif
+    return -1;
+}
 
-    if (load_size && pkt_error_no == PKT_OK) {
-        if (meter.format.segmentation) {
+/* waits for the next frame after tx_len bytes sent, the bytes already received stay in the ring buffer.
+ * The timeout is the learned latency and the transfer of the frames both ways. It starts again
+ * without the transfer of the request when the uart has sent it */
+static void session_wait(size_t tx_len) {
 
-            memcpy(result_package.buff+result_package.size, raw_package.data+2, load_size-(sizeof(header_t)+4));
-            result_package.size += load_size-(sizeof(header_t)+4);
-            send_notification();
-        } else {
-            memcpy(result_package.buff+result_package.size, raw_package.data+2, load_size-(sizeof(header_t)+3));
-            result_package.size += load_size-(sizeof(header_t)+3);
-            result_package.complete = true;
-        }
+    uint32_t timeout = rtt_rto() + bytes_time(tx_len + meter.max_info_field_rx + MIN_FRAME_SIZE + 2);
+
+    if (timerResponseEvt) {
+        TL_ZB_TIMER_CANCEL(&timerResponseEvt);
     }
 
-    return pkt_error_no;
-}
-
-static size_t set_header() {
-
-    raw_package.header.flag = FLAG;
-    meter.format.length = 2;   /* format 2 bytes */
-    set_address(raw_package.header.addr, 2, meter.server_lower_addr, meter.server_upper_addr);
-    set_address(raw_package.header.addr+2, 1, 0, meter.client_addr);
-    meter.format.length += 3;
-
-    return meter.format.length;
-}
-
-//static uint8_t send_cmd_snrm() {
-//
-//#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
-//    printf("\r\nCommand running of connect\r\n");
-//#endif
-//
-//    uint8_t *pkt_buff = (uint8_t*)&raw_package;
-//    uint8_t info_field_data[PKT_BUFF_MAX_LEN] = {0};
-//    uint8_t info_field_len = 0;
-//
-//    memset(pkt_buff, 0, sizeof(package_t));
-//    memset(&result_package, 0, sizeof(result_package_t));
-//
-//    info_field_data[info_field_len++] = 0x81;
-//    info_field_data[info_field_len++] = 0x80;
-//    info_field_data[info_field_len++] = 0x00;
-//    info_field_data[info_field_len++] = 0x05;
-//    info_field_data[info_field_len++] = 0x02;
-//    info_field_data[info_field_len++] = (meter.max_info_field_tx >> 8) & 0xff;
-//    info_field_data[info_field_len++] = meter.max_info_field_tx & 0xff;
-//    info_field_data[info_field_len++] = 0x06;
-//    info_field_data[info_field_len++] = 0x02;
-//    info_field_data[info_field_len++] = (meter.max_info_field_rx >> 8) & 0xff;
-//    info_field_data[info_field_len++] = meter.max_info_field_rx & 0xff;
-//    info_field_data[info_field_len++] = 0x07;
-//    info_field_data[info_field_len++] = 0x04;
-//    info_field_data[info_field_len++] = (meter.window_tx >> 24) & 0xff;
-//    info_field_data[info_field_len++] = (meter.window_tx >> 16) & 0xff;
-//    info_field_data[info_field_len++] = (meter.window_tx >> 8) & 0xff;
-//    info_field_data[info_field_len++] = meter.window_tx & 0xff;
-//    info_field_data[info_field_len++] = 0x08;
-//    info_field_data[info_field_len++] = 0x04;
-//    info_field_data[info_field_len++] = (meter.window_rx >> 24) & 0xff;
-//    info_field_data[info_field_len++] = (meter.window_rx >> 16) & 0xff;
-//    info_field_data[info_field_len++] = (meter.window_rx >> 8) & 0xff;
-//    info_field_data[info_field_len++] = meter.window_rx & 0xff;
-//    info_field_data[2] = info_field_len-3;
-//
-//    uint8_t hcs_len = set_header() + 1;
-//    raw_package.header.control = SNRM;
-//    meter.format.length += 3;                       /* + size command + size HCS   */
-//
-//    memcpy(raw_package.data+2, info_field_data, info_field_len);
-//
-//    meter.format.length += info_field_len + 2;      /* + size FCS                   */
-//
-//    uint8_t *format = (uint8_t*)&(meter.format);
-//
-//    raw_package.header.format[0] = format[1];
-//    raw_package.header.format[1] = format[0];
-//
-//    uint16_t crc = checksum(pkt_buff+1, hcs_len);
-//
-//    raw_package.data[1] = (crc >> 8) & 0xff;
-//    raw_package.data[0] = crc & 0xff;
-//
-//    crc = checksum(pkt_buff+1, meter.format.length-2);
-//    raw_package.data[info_field_len+2] = crc & 0xff;
-//    raw_package.data[info_field_len+3] = (crc >> 8) & 0xff;
-//    raw_package.data[info_field_len+4] = FLAG;
-//
-//
-//    if (send_command(pkt_buff, meter.format.length+2)) {
-//        if (response_meter() == PKT_OK) {
-//            if (raw_package.header.control == UA)
-//                return true;
-//        }
-//    }
-//
-//
-//    return false;
-//}
+    hdlc_rx_reset();
 
-static void send_cmd_disc() {
+    tx_waiting = tx_len != 0;
+    timerResponseEvt = TL_ZB_TIMER_SCHEDULE(session_timeoutCb, NULL, timeout);
+}
 
-#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
-    printf("\r\nCommand running of disconnect\r\n");
-#endif
+/* the last stop bit of the request is out, the latency is counted from here */
+static void hdlc_tx_done(uint32_t done_time) {
 
-    uint8_t *pkt_buff = (uint8_t*)&raw_package;
+    uint32_t timeout, elapsed;
 
-    memset(pkt_buff, 0, sizeof(package_t));
-    memset(&result_package, 0, sizeof(result_package_t));
+    if (!tx_waiting) return;
 
-    set_header();
-    raw_package.header.control = DISC;
-    meter.format.length += 3;                       /* + size command + size FCS   */
+    tx_waiting = false;
+    rtt_sent = done_time;
+    rtt_tx_len = 0;
 
-    uint8_t *format = (uint8_t*)&(meter.format);
+    if (!timerResponseEvt) return;
 
-    raw_package.header.format[0] = format[1];
-    raw_package.header.format[1] = format[0];
+    timeout = rtt_rto() + bytes_time(meter.max_info_field_rx + MIN_FRAME_SIZE + 2);
+    elapsed = (clock_time() - done_time) / CLOCK_16M_SYS_TIMER_CLK_1MS;
+    timeout = timeout > elapsed ? timeout - elapsed : 1;
 
-    uint16_t crc = checksum(pkt_buff+1, meter.format.length-2);
-    raw_package.data[0] = crc & 0xff;
-    raw_package.data[1] = (crc >> 8) & 0xff;
-    raw_package.data[2] = FLAG;
+    TL_ZB_TIMER_CANCEL(&timerResponseEvt);
+    timerResponseEvt = TL_ZB_TIMER_SCHEDULE(session_timeoutCb, NULL, timeout);
+}
+
+/* sends the frame and waits for the response without blocking */
+static void session_send(uint8_t *frame, size_t size) {
+
+    flush_buff_uart();
+
+    /* if the uart has not sent, the timeout will repeat the request */
+    session_wait(size);
+    rtt_start(size);
+
+    send_command(frame, size);
+}
+
+/* | FLAG | Format 2 | Dest addr 2 | Src addr 1 |, the same for all frames of the link */
+static void set_header(uint8_t *frame, uint16_t length) {
 
-    if (send_command(pkt_buff, meter.format.length+2)) {
-        response_meter();
+    frame[0] = FLAG;
+    frame[1] = (TYPE3 << 4) | ((length >> 8) & 0x07);
+    frame[2] = length & 0xff;
+    set_address(frame+3, 2, meter.server_lower_addr, meter.server_upper_addr);
+    set_address(frame+5, 1, 0, meter.client_addr);
+}
+
+/* HCS and FCS for the new control field. The CRC of format and addresses is kept */
+static void frame_set_control(frame_template_t *tpl, uint8_t control) {
+
+    uint8_t *frame = tpl->frame;
+    uint16_t crc_state, crc;
+
+    frame[FRAME_CONTROL] = control;
+    crc_state = crc_update(tpl->crc_head, &control, 1);
+
+    if (tpl->info_len) {
+        /* FCS continues from the HCS state over HCS and information */
+        crc = CRC_FINAL(crc_state);
+        frame[FRAME_HEAD] = crc & 0xff;
+        frame[FRAME_HEAD+1] = (crc >> 8) & 0xff;
+        crc_state = crc_update(crc_state, frame+FRAME_HEAD, tpl->info_len+2);
     }
+
+    crc = CRC_FINAL(crc_state);
+    frame[tpl->len-3] = crc & 0xff;
+    frame[tpl->len-2] = (crc >> 8) & 0xff;
 }
 
-static void send_notification() {
+/* the frame is encoded once, the information field is copied into it */
+static void frame_template_init(frame_template_t *tpl, uint8_t control, const uint8_t *info, uint8_t info_len) {
 
-    uint8_t *pkt_buff = (uint8_t*)&raw_package;
+    /* between the flags, frames without information have no HCS */
+    uint16_t length = MIN_FRAME_SIZE - 2 + (info_len ? info_len + 2 : 0);
+
+    set_header(tpl->frame, length);
+    tpl->crc_head = crc_update(CRC_INIT, tpl->frame+1, FRAME_CONTROL-1);
+    tpl->len = length + 2;
+    tpl->info_len = info_len;
+    memcpy(tpl->frame+FRAME_HEAD+2, info, info_len);
+    tpl->frame[tpl->len-1] = FLAG;
 
-    memset(pkt_buff, 0, sizeof(package_t));
+    frame_set_control(tpl, control);
+}
 
-    set_header();
+/* only the control field and the checks after it are changed */
+static void frame_send(frame_template_t *tpl, uint8_t control) {
 
-    // I don't know how true
-    raw_package.header.control = ((((meter.rrr << 5) + (meter.sss << 1)) | 0x10)) & 0xFE;
-//    raw_package.header.control = ((((meter.rrr << 5) + (meter.sss << 1)) | 0x10) + 2) & 0xFE;
+    if (tpl->frame[FRAME_CONTROL] != control) {
+        frame_set_control(tpl, control);
+    }
 
-    meter.format.length += 3;                       /* + size command + size FCS   */
+    session_send(tpl->frame, tpl->len);
+}
 
-    uint8_t *format = (uint8_t*)&(meter.format);
+static uint8_t set_parameter(uint8_t *buff, uint8_t id, uint32_t value, uint8_t len) {
 
-    raw_package.header.format[0] = format[1];
-    raw_package.header.format[1] = format[0];
+    uint8_t *ptr = buff;
 
-    uint16_t crc = checksum(pkt_buff+1, meter.format.length-2);
-    raw_package.data[0] = crc & 0xff;
-    raw_package.data[1] = (crc >> 8) & 0xff;
-    raw_package.data[2] = FLAG;
+    *ptr++ = id;
+    *ptr++ = len;
 
-    if (send_command(pkt_buff, meter.format.length+2)) {
-        response_meter();
+    while (len--) {
+        *ptr++ = (value >> (len * 8)) & 0xff;
     }
+
+    return ptr - buff;
 }
 
-static uint8_t send_cmd_open_session() {
+/* SNRM with the proposed max info field and window */
+static void frame_snrm_init() {
 
-#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
-    printf("\r\nCommand running of open session\r\n");
-#endif
+    uint8_t info_field_data[32];
+    uint8_t info_field_len = 0;
 
-    uint8_t *pkt_buff = (uint8_t*)&raw_package;
+    info_field_data[info_field_len++] = HDLC_FORMAT_ID;
+    info_field_data[info_field_len++] = HDLC_GROUP_ID;
+    info_field_data[info_field_len++] = 0x00;
+    info_field_len += set_parameter(info_field_data+info_field_len, HDLC_MAX_INFO_TX, MAX_INFO_FIELD, 2);
+    info_field_len += set_parameter(info_field_data+info_field_len, HDLC_MAX_INFO_RX, MAX_INFO_FIELD, 2);
+    info_field_len += set_parameter(info_field_data+info_field_len, HDLC_WINDOW_TX, MAX_WINDOW_TX, 4);
+    info_field_len += set_parameter(info_field_data+info_field_len, HDLC_WINDOW_RX, MAX_WINDOW_RX, 4);
+    info_field_data[2] = info_field_len-3;
+
+    frame_template_init(&frame_snrm, SNRM, info_field_data, info_field_len);
+}
 
-    uint8_t app_const_name[] = {0xa1, 0x09, 0x06, 0x07, 0x60, 0x85, 0x74, 0x05, 0x08, 0x01, 0x01};
-    uint8_t asce[] = {0x8a, 0x02, 0x07, 0x80};
-    uint8_t mech_name[] = {0x8b, 0x07, 0x60, 0x85, 0x74, 0x05, 0x08, 0x02, 0x01};
-    uint8_t user_info[] = {0xbe, 0x10, 0x04, 0x0e, 0x01, 0x00, 0x00, 0x00, 0x06, 0x5f, 0x1f, 0x04, 0x00, 0x00, 0x1e, 0x9d, 0xff, 0xff};
+/* AARQ with the password of the meter, it is sent as the first I-frame of the link */
+static void frame_aarq_init() {
 
+    static const uint8_t app_const_name[] = {0xa1, 0x09, 0x06, 0x07, 0x60, 0x85, 0x74, 0x05, 0x08, 0x01, 0x01};
+    static const uint8_t asce[] = {0x8a, 0x02, 0x07, 0x80};
+    static const uint8_t mech_name[] = {0x8b, 0x07, 0x60, 0x85, 0x74, 0x05, 0x08, 0x02, 0x01};
+    static const uint8_t user_info[] = {0xbe, 0x10, 0x04, 0x0e, 0x01, 0x00, 0x00, 0x00, 0x06, 0x5f, 0x1f, 0x04, 0x00, 0x00, 0x1e, 0x9d, 0xff, 0xff};
 
-    uint8_t info_field_data[PKT_BUFF_MAX_LEN] = {0};
+    uint8_t info_field_data[AARQ_INFO_MAX];
     uint8_t info_field_len = 0;
-    uint8_t aarq_len = 0;
-    uint8_t aarq_len_idx;
-    uint8_t auth_len = 0;
-    uint8_t auth_len_idx;
 
     info_field_data[info_field_len++] = LSAP;
     info_field_data[info_field_len++] = CMD_LSAP;
     info_field_data[info_field_len++] = 0;
     info_field_data[info_field_len++] = AARQ;
-    aarq_len_idx = info_field_len;
-    info_field_data[info_field_len++] = aarq_len;
+    info_field_data[info_field_len++] = sizeof(app_const_name) + sizeof(asce) + sizeof(mech_name) +
+                                        4 + meter.password.size + sizeof(user_info);
     memcpy(info_field_data+info_field_len, app_const_name, sizeof(app_const_name));
     info_field_len += sizeof(app_const_name);
-    aarq_len += sizeof(app_const_name);
     memcpy(info_field_data+info_field_len, asce, sizeof(asce));
     info_field_len += sizeof(asce);
-    aarq_len += sizeof(asce);
     memcpy(info_field_data+info_field_len, mech_name, sizeof(mech_name));
     info_field_len += sizeof(mech_name);
-    aarq_len += sizeof(mech_name);
     info_field_data[info_field_len++] = AUTH;
-    aarq_len++;
-    auth_len_idx = info_field_len;
-    info_field_data[info_field_len++] = auth_len;
-    aarq_len++;
+    info_field_data[info_field_len++] = 2 + meter.password.size;
     info_field_data[info_field_len++] = 0x80;
-    aarq_len++;
-    auth_len++;
-    info_field_data[info_field_len++] = meter.password.size; //0x03;
-    aarq_len++;
-    auth_len++;
-    memcpy(&info_field_data[info_field_len], meter.password.data, meter.password.size);
+    info_field_data[info_field_len++] = meter.password.size;
+    memcpy(info_field_data+info_field_len, meter.password.data, meter.password.size);
     info_field_len += meter.password.size;
-    aarq_len += meter.password.size;
-    auth_len += meter.password.size;
-//    info_field_data[info_field_len++] = meter.password[0];
-//    aarq_len++;
-//    auth_len++;
-//    info_field_data[info_field_len++] = meter.password[1];
-//    aarq_len++;
-//    auth_len++;
-//    info_field_data[info_field_len++] = meter.password[2];
-//    aarq_len++;
-//    auth_len++;
-    info_field_data[auth_len_idx] = auth_len;
     memcpy(info_field_data+info_field_len, user_info, sizeof(user_info));
     info_field_len += sizeof(user_info);
-    aarq_len += sizeof(user_info);
-    info_field_data[aarq_len_idx] = aarq_len;
 
-    memset(pkt_buff, 0, sizeof(package_t));
-    memset(&result_package, 0, sizeof(result_package_t));
+    /* N(R) = 0, N(S) = 0 and the poll bit right after UA */
+    frame_template_init(&frame_aarq, POLL_FINAL, info_field_data, info_field_len);
+}
 
-    uint8_t hcs_len = set_header() + 1;
-    raw_package.header.control = 0x10; //(((meter.rrr << 5) + (meter.sss << 1)) | 0x10) & 0xFE;
-    meter.format.length += 3;                       /* + size command + size HCS   */
+/* the constant frames are encoded at init and with the new password */
+static void frame_templates_init() {
 
-    memcpy(raw_package.data+2, info_field_data, info_field_len);
+    frame_snrm_init();
+    frame_aarq_init();
+    frame_template_init(&frame_disc, DISC, NULL, 0);
+    frame_template_init(&frame_s, POLL_FINAL | RR, NULL, 0);
+}
 
-    meter.format.length += info_field_len + 2;      /* + size FCS                   */
+static void result_package_reset() {
 
-    uint8_t *format = (uint8_t*)&(meter.format);
+    result_package.size = 0;
+    result_package.complete = false;
+}
 
-    raw_package.header.format[0] = format[1];
-    raw_package.header.format[1] = format[0];
+static void send_cmd_run_connect() {
 
-    uint16_t crc = checksum(pkt_buff+1, hcs_len);
+#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
+    printf("\r\nCommand running of connect\r\n");
+#endif
 
-    raw_package.data[1] = (crc >> 8) & 0xff;
-    raw_package.data[0] = crc & 0xff;
+    result_package_reset();
 
-    crc = checksum(pkt_buff+1, meter.format.length-2);
-    raw_package.data[info_field_len+2] = crc & 0xff;
-    raw_package.data[info_field_len+3] = (crc >> 8) & 0xff;
-    raw_package.data[info_field_len+4] = FLAG;
+    /* the link starts with the defaults until UA */
+    meter.max_info_field_tx = DEF_INFO_FIELD;
+    meter.max_info_field_rx = DEF_INFO_FIELD;
+    meter.window_tx = DEF_WINDOW;
+    meter.window_rx = DEF_WINDOW;
 
-    if (send_command(pkt_buff, meter.format.length+2)) {
-        if (response_meter() == PKT_OK) {
-            if (result_package.complete) {
-                uint8_t *ptr = result_package.buff;
-
-                if (*ptr++ == LSAP) {
-                    if (*ptr++ == RESP_LSAP) {
-                        if (*ptr++ == 0) {
-                            if (*ptr++ == AARE) {
-                                uint8_t aare_len = *ptr;
-                                for(uint8_t i = 0; i < aare_len; i++) {
-                                    if (*ptr++ == 0xA2) {
-                                        ptr += *ptr;
-                                        if (*ptr == 0) {
-                                            /* open session successful */
-                                            return true;
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
+    session.state = SESSION_CONNECT;
+    frame_send(&frame_snrm, SNRM);
+}
 
-            } else {
-#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
-                print_error(PKT_ERR_SEGMENTATION);
-#endif
-            }
-        }
-    }
+/* parameters of UA are from the meter side: its tx is our rx.
+ * UA without information field keeps the defaults */
+static void set_link_parameters() {
 
+    uint8_t *ptr = result_package.buff;
+    uint8_t *end = result_package.buff + result_package.size;
+    uint32_t value;
+    uint8_t id, len;
 
-    return false;
-}
+    if (result_package.size < 3 || ptr[0] != HDLC_FORMAT_ID || ptr[1] != HDLC_GROUP_ID) return;
 
+    if (ptr + 3 + ptr[2] < end) end = ptr + 3 + ptr[2];
+    ptr += 3;
 
-static uint8_t *get_request_data(request_t *request) {
+    while (ptr + 2 <= end) {
+        id = *ptr++;
+        len = *ptr++;
+        if (len > 4 || ptr + len > end) break;
+        value = 0;
+        while (len--) {
+            value = (value << 8) | *ptr++;
+        }
+        switch (id) {
+            case HDLC_MAX_INFO_TX:
+                if (value) meter.max_info_field_rx = value < MAX_INFO_FIELD ? value : MAX_INFO_FIELD;
+                break;
+            case HDLC_MAX_INFO_RX:
+                if (value > GET_LIST_HEAD + sizeof(request_t))
+                    meter.max_info_field_tx = value < MAX_INFO_FIELD ? value : MAX_INFO_FIELD;
+                break;
+            case HDLC_WINDOW_TX:
+                if (value) meter.window_rx = value < MAX_WINDOW_RX ? value : MAX_WINDOW_RX;
+                break;
+            case HDLC_WINDOW_RX:
+                if (value) meter.window_tx = value < MAX_WINDOW_TX ? value : MAX_WINDOW_TX;
+                break;
+            default:
+                break;
+        }
+    }
 
-    uint8_t *pkt_buff = (uint8_t*)&raw_package;
+#if UART_PRINTF_MODE && DEBUG_PACKAGE
+    printf("Link info field tx: %d, rx: %d, window tx: %d, rx: %d\r\n",
+            meter.max_info_field_tx, meter.max_info_field_rx, meter.window_tx, meter.window_rx);
+#endif
+}
 
-    uint8_t info_field_data[PKT_BUFF_MAX_LEN] = {0};
-    uint8_t info_field_len = 0;
+static void send_cmd_disc() {
 
-    info_field_data[info_field_len++] = LSAP;
-    info_field_data[info_field_len++] = CMD_LSAP;
-    info_field_data[info_field_len++] = 0;
-    info_field_data[info_field_len++] = GET_REQUEST;
-    info_field_data[info_field_len++] = 0x01;
-    info_field_data[info_field_len++] = 0xc1;
+#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
+    printf("\r\nCommand running of disconnect\r\n");
+#endif
 
-    memcpy(info_field_data+info_field_len, request, sizeof(request_t));
-    info_field_len += sizeof(request_t);
+    result_package_reset();
 
-    memset(pkt_buff, 0, sizeof(package_t));
-    memset(&result_package, 0, sizeof(result_package_t));
+    session.state = SESSION_DISCONNECT;
+    frame_send(&frame_disc, DISC);
+}
 
+/* RR or REJ with the current N(R), the poll bit asks the meter to answer */
+static void send_s_frame(uint8_t type) {
 
-    uint8_t hcs_len = set_header() + 1;
-    raw_package.header.control = ((((meter.rrr << 5) + (meter.sss << 1)) | 0x10) + (meter.format.segmentation?0:2)) & 0xFE;
-    meter.format.length += 3;                       /* + size command + size HCS   */
+    frame_send(&frame_s, (meter.vr << 5) | POLL_FINAL | type);
+}
 
-    memcpy(raw_package.data+2, info_field_data, info_field_len);
+/* I-frame with N(S) and the current N(R). Only sends, the caller waits for the response.
+ * Returns the size of the frame */
+static size_t send_i_frame(uint8_t ns, uint8_t *info_field_data, uint8_t info_field_len, uint8_t poll) {
 
-    meter.format.length += info_field_len + 2;      /* + size FCS                   */
+    uint8_t *pkt_buff = (uint8_t*)&raw_package;
+    uint16_t length = MIN_FRAME_SIZE + info_field_len;      /* + size HCS, without flags */
 
-    uint8_t *format = (uint8_t*)&(meter.format);
+    /* addresses are the same as in the templates */
+    memcpy(pkt_buff+3, frame_s.frame+3, FRAME_CONTROL-3);
+    pkt_buff[0] = FLAG;
+    pkt_buff[1] = (TYPE3 << 4) | ((length >> 8) & 0x07);
+    pkt_buff[2] = length & 0xff;
+    raw_package.header.control = (meter.vr << 5) | (ns << 1) | (poll?POLL_FINAL:0);
 
-    raw_package.header.format[0] = format[1];
-    raw_package.header.format[1] = format[0];
+    memcpy(raw_package.data+2, info_field_data, info_field_len);
 
-    uint16_t crc = checksum(pkt_buff+1, hcs_len);
+    /* FCS continues from the HCS state over HCS and information */
+    uint16_t crc_state = crc_update(CRC_INIT, pkt_buff+1, FRAME_CONTROL);
+    uint16_t crc = CRC_FINAL(crc_state);
 
     raw_package.data[1] = (crc >> 8) & 0xff;
     raw_package.data[0] = crc & 0xff;
 
-    crc = checksum(pkt_buff+1, meter.format.length-2);
+    crc = CRC_FINAL(crc_update(crc_state, raw_package.data, info_field_len+2));
     raw_package.data[info_field_len+2] = crc & 0xff;
     raw_package.data[info_field_len+3] = (crc >> 8) & 0xff;
     raw_package.data[info_field_len+4] = FLAG;
 
-    if (send_command(pkt_buff, meter.format.length+2)) {
-        if (response_meter() == PKT_OK) {
-            if (result_package.complete) {
-                uint8_t *ptr = result_package.buff;
-
-                if (*ptr++ == LSAP) {
-                    if (*ptr++ == RESP_LSAP) {
-                        if (*ptr++ == 0) {
-                            if (*ptr == GET_RESPONSE) {
-                                ptr += 4;
-                                return ptr;
-                            }
-                        }
-                    }
-                }
-            } else {
-#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
-                print_error(PKT_ERR_SEGMENTATION);
-#endif
-            }
-        }
-    }
-    return NULL;
+    send_command(pkt_buff, length+2);
+
+    return length+2;
 }
 
-static void get_serial_number_data() {
+/* keys and level from the config. The counters below the stored one may be used already */
+static void security_init() {
 
-#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
-    printf("\r\nCommand get serial number\r\n");
-#endif
+    memset(&security, 0, sizeof(security_t));
 
-//    type_digit32_t *unsigned32 = (type_digit32_t*)get_request_data(attr_descriptor_serial_number);
-    uint8_t *ptr = get_request_data(&attr_descriptor_serial_number);
-    type_digit32_t *unsigned32 = (type_digit32_t*)ptr;
-    type_octet_string_t *str = (type_octet_string_t*)ptr;
+    security.ciphered = security_cfg.level == SECURITY_HLS_GMAC;
+    security.ic = security_cfg.invocation_counter;
+    dlms_gcm_init(security_cfg.ek, security_cfg.ak);
+}
 
+/* the meter rejects a counter which is not above the last one, so they are stored ahead */
+static uint32_t security_next_ic() {
 
-    if (ptr) {
-        if (unsigned32->type == TYPE_UNSIGNED_32) {
-            uint32_t addr = reverse32(unsigned32->value);
+    if (security.ic >= security_cfg.invocation_counter) {
+        security_cfg.invocation_counter = security.ic + IC_RESERVE;
+        write_security_cfg();
+    }
 
-            uint8_t sn[SE_ATTR_SN_SIZE];
+    return security.ic++;
+}
 
-            itoa(addr, sn);
+/* a repeated or an older APDU of the meter is not taken */
+static uint8_t security_server_ic(uint32_t ic) {
 
-            if (set_zcl_str(sn, serial_number, SE_ATTR_SN_SIZE)) {
-                zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_METER_SERIAL_NUMBER, (uint8_t*)&serial_number);
-#if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-                printf("Serial Number: %s, len: %d\r\n", serial_number+1, *serial_number);
+    return !security.server_ic_valid || ic > security.server_ic;
+}
+
+static void security_server_ic_set(uint32_t ic) {
+
+    security.server_ic = ic;
+    security.server_ic_valid = true;
+}
+
+/* | tag | length | SC | IC | ciphertext | GCM tag |, authenticated and encrypted.
+ * The APDU may be at the place of its ciphertext already. Returns the size */
+static uint8_t set_ciphered(uint8_t *buf, uint8_t tag, const uint8_t *apdu, uint8_t len) {
+
+    dlms_gcm_t gcm;
+    uint8_t size = DLMS_SECURITY_HEAD + len + DLMS_TAG_SIZE;
+    uint8_t head = size < 0x80 ? 2 : 3;
+    uint32_t ic = security_next_ic();
+    uint8_t *text = buf + head + DLMS_SECURITY_HEAD;
+
+    memmove(text, apdu, len);
+
+    buf[0] = tag;
+    buf[1] = 0x81;
+    buf[head-1] = size;
+    buf[head] = DLMS_SC_AUTH_ENCRYPT;
+    put_u32(buf+head+1, ic);
+
+    dlms_gcm_start(&gcm, security_cfg.system_title, DLMS_SC_AUTH_ENCRYPT, ic);
+    dlms_gcm_encrypt(&gcm, text, len);
+    dlms_gcm_tag(&gcm, text+len);
+
+    return head + size;
+}
+
+/* glo-APDU of the meter deciphered in place. Returns the APDU or NULL if it is not authentic */
+static uint8_t *apdu_decipher(uint8_t *buf, uint16_t size, uint8_t tag, uint16_t *len) {
+
+    dlms_gcm_t gcm;
+    uint32_t ic;
+
+    if (size < 2 + DLMS_SECURITY_HEAD + DLMS_TAG_SIZE || buf[0] != tag || buf[1] != size - 2 ||
+            buf[2] != DLMS_SC_AUTH_ENCRYPT) {
+        return NULL;
+    }
+
+    ic = get_u32(buf+3);
+    if (!security_server_ic(ic)) return NULL;
+
+    *len = size - 2 - DLMS_SECURITY_HEAD - DLMS_TAG_SIZE;
+    buf += 2 + DLMS_SECURITY_HEAD;
+
+    dlms_gcm_start(&gcm, security.server_title, DLMS_SC_AUTH_ENCRYPT, ic);
+    dlms_gcm_decrypt(&gcm, buf, *len);
+    if (!dlms_gcm_check(&gcm, buf + *len)) return NULL;
+
+    security_server_ic_set(ic);
+
+    return buf;
+}
+
+/* AARQ of HLS GMAC: the system title of the client, the new challenge CtoS and glo-initiateRequest.
+ * The association is ciphered, so the AARQ is built for every link. Returns the size */
+static uint8_t set_aarq_hls(uint8_t *info) {
+
+    static const uint8_t app_const_name[] = {0xa1, 0x09, 0x06, 0x07, 0x60, 0x85, 0x74, 0x05, 0x08, 0x01, 0x03};
+    static const uint8_t asce[] = {0x8a, 0x02, 0x07, 0x80};
+    static const uint8_t mech_name[] = {0x8b, 0x07, 0x60, 0x85, 0x74, 0x05, 0x08, 0x02, 0x05};
+    /* client-max-receive-pdu-size is the buffer where the ciphered text waits for its tag */
+    static const uint8_t initiate[] = {0x01, 0x00, 0x00, 0x00, 0x06, 0x5f, 0x1f, 0x04, 0x00, 0x00, 0x1e, 0x9d,
+                                       (sizeof(result_package.buff) >> 8) & 0xff, sizeof(result_package.buff) & 0xff};
+
+    uint8_t len = 0, aarq_len, user_len;
+
+    info[len++] = LSAP;
+    info[len++] = CMD_LSAP;
+    info[len++] = 0;
+    info[len++] = AARQ;
+    aarq_len = len++;
+    memcpy(info+len, app_const_name, sizeof(app_const_name));
+    len += sizeof(app_const_name);
+    /* calling-AP-title */
+    info[len++] = 0xa6;
+    info[len++] = 2 + DLMS_SYSTEM_TITLE_SIZE;
+    info[len++] = BER_OCTET_STRING;
+    info[len++] = DLMS_SYSTEM_TITLE_SIZE;
+    memcpy(info+len, security_cfg.system_title, DLMS_SYSTEM_TITLE_SIZE);
+    len += DLMS_SYSTEM_TITLE_SIZE;
+    memcpy(info+len, asce, sizeof(asce));
+    len += sizeof(asce);
+    memcpy(info+len, mech_name, sizeof(mech_name));
+    len += sizeof(mech_name);
+    drv_generateRandomData(security.challenge, CHALLENGE_SIZE);
+    info[len++] = AUTH;
+    info[len++] = 2 + CHALLENGE_SIZE;
+    info[len++] = 0x80;
+    info[len++] = CHALLENGE_SIZE;
+    memcpy(info+len, security.challenge, CHALLENGE_SIZE);
+    len += CHALLENGE_SIZE;
+    /* user-information, octet string of glo-initiateRequest */
+    info[len++] = 0xbe;
+    user_len = len++;
+    info[len++] = BER_OCTET_STRING;
+    len++;
+    info[len-1] = set_ciphered(info+len, GLO_INITIATE_REQUEST, initiate, sizeof(initiate));
+    len += info[len-1];
+    info[user_len] = len - user_len - 1;
+    info[aarq_len] = len - aarq_len - 1;
+
+    return len;
+}
+
+/* one I-frame of the association which polls the meter */
+static void session_send_info(uint8_t *info, uint8_t len) {
+
+    size_t size;
+
+    flush_buff_uart();
+
+    size = send_i_frame(meter.vs, info, len, true);
+    meter.vs = (meter.vs + 1) & 0x07;
+
+    session_wait(size);
+    rtt_start(size);
+}
+
+static void send_cmd_open_session() {
+
+#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
+    printf("\r\nCommand running of open session\r\n");
+#endif
+
+    result_package_reset();
+
+    session.state = SESSION_OPEN;
+
+    if (security.ciphered) {
+        uint8_t info[MAX_INFO_FIELD];
+        security.server_ic_valid = false;
+        session_send_info(info, set_aarq_hls(info));
+        return;
+    }
+
+    frame_send(&frame_aarq, (meter.vr << 5) | (meter.vs << 1) | POLL_FINAL);
+    meter.vs = (meter.vs + 1) & 0x07;
+}
+
+/* AARE with association-result accepted */
+static uint8_t open_session_accepted() {
+
+    uint8_t *ptr = result_package.buff;
+
+    if (*ptr++ == LSAP) {
+        if (*ptr++ == RESP_LSAP) {
+            if (*ptr++ == 0) {
+                if (*ptr++ == AARE) {
+                    uint8_t aare_len = *ptr;
+                    for(uint8_t i = 0; i < aare_len; i++) {
+                        if (*ptr++ == 0xA2) {
+                            ptr += *ptr;
+                            if (*ptr == 0) {
+                                /* open session successful */
+                                return true;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+/* AARE of HLS: accepted, the system title and the challenge StoC of the meter
+ * and its glo-initiateResponse which proves the same keys */
+static uint8_t open_session_hls() {
+
+    uint8_t *ptr = result_package.buff;
+    uint8_t *end = result_package.buff + result_package.size;
+    uint8_t tag, len, accepted = false, title = false, initiate = false;
+    uint16_t apdu_len;
+
+    if (result_package.size < LLC_HEAD + 2 || ptr[0] != LSAP || ptr[1] != RESP_LSAP || ptr[2] != 0 ||
+            ptr[3] != AARE || ptr + LLC_HEAD + 2 + ptr[4] > end) {
+        return false;
+    }
+
+    end = ptr + LLC_HEAD + 2 + ptr[4];
+    ptr += LLC_HEAD + 2;
+    security.stoc_len = 0;
+
+    while (ptr + 2 <= end) {
+        tag = *ptr++;
+        len = *ptr++;
+        if ((len & 0x80) || ptr + len > end) return false;
+        switch (tag) {
+            case 0xa2:
+                /* association-result */
+                accepted = len == 3 && ptr[2] == 0;
+                break;
+            case 0xa4:
+                /* responding-AP-title */
+                if (len == 2 + DLMS_SYSTEM_TITLE_SIZE && ptr[0] == BER_OCTET_STRING && ptr[1] == DLMS_SYSTEM_TITLE_SIZE) {
+                    memcpy(security.server_title, ptr+2, DLMS_SYSTEM_TITLE_SIZE);
+                    title = true;
+                }
+                break;
+            case 0xaa:
+                /* responding-authentication-value */
+                if (len > 2 && ptr[0] == 0x80 && ptr[1] == len - 2 && len - 2 <= CHALLENGE_MAX) {
+                    security.stoc_len = len - 2;
+                    memcpy(security.stoc, ptr+2, security.stoc_len);
+                }
+                break;
+            case 0xbe:
+                /* user-information, the AP title is before it */
+                if (title && len > 2 && ptr[0] == BER_OCTET_STRING && ptr[1] == len - 2) {
+                    initiate = apdu_decipher(ptr+2, len-2, GLO_INITIATE_RESPONSE, &apdu_len) != NULL;
+                }
+                break;
+            default:
+                break;
+        }
+        ptr += len;
+    }
+
+    return accepted && initiate && security.stoc_len;
+}
+
+/* HLS pass 3: f(StoC) = SC | IC | GMAC(SC | AK | StoC) to reply_to_HLS_authentication
+ * of the current association */
+static void send_cmd_hls_reply() {
+
+    static const uint8_t method[] = {0x00, 0x0f, 0x00, 0x00, 0x28, 0x00, 0x00, 0xff, 0x01};
+
+    uint8_t info[LLC_HEAD + CIPHER_OVERHEAD + 7 + sizeof(method) + HLS_REPLY_SIZE];
+    uint8_t apdu[4 + sizeof(method) + 2 + HLS_REPLY_SIZE];
+    uint8_t len = 0;
+    uint32_t ic = security_next_ic();
+    dlms_gcm_t gcm;
+
+#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
+    printf("\r\nCommand reply to HLS authentication\r\n");
+#endif
+
+    apdu[len++] = ACTION_REQUEST;
+    apdu[len++] = ACTION_NORMAL;
+    apdu[len++] = INVOKE_PRIORITY | session.invoke;
+    memcpy(apdu+len, method, sizeof(method));
+    len += sizeof(method);
+    apdu[len++] = 0x01;                     /* method-invocation-parameters present         */
+    apdu[len++] = TYPE_OCTET_STRING;
+    apdu[len++] = HLS_REPLY_SIZE;
+    apdu[len++] = DLMS_SC_AUTH;
+    put_u32(apdu+len, ic);
+    len += 4;
+
+    dlms_gcm_start(&gcm, security_cfg.system_title, DLMS_SC_AUTH, ic);
+    dlms_gcm_aad(&gcm, security.stoc, security.stoc_len);
+    dlms_gcm_tag(&gcm, apdu+len);
+    len += DLMS_TAG_SIZE;
+
+    info[0] = LSAP;
+    info[1] = CMD_LSAP;
+    info[2] = 0;
+
+    result_package_reset();
+
+    session.state = SESSION_AUTH;
+    session_send_info(info, LLC_HEAD + set_ciphered(info+LLC_HEAD, GLO_ACTION_REQUEST, apdu, len));
+}
+
+/* HLS pass 4: action-response with f(CtoS) = SC | IC | GMAC(SC | AK | CtoS) of the meter */
+static uint8_t hls_reply_accepted() {
+
+    uint8_t *ptr = result_package.buff;
+    uint16_t len;
+    dlms_gcm_t gcm;
+
+    if (result_package.size < LLC_HEAD || ptr[0] != LSAP || ptr[1] != RESP_LSAP || ptr[2] != 0) return false;
+
+    ptr = apdu_decipher(ptr+LLC_HEAD, result_package.size-LLC_HEAD, GLO_ACTION_RESPONSE, &len);
+
+    /* | ACTION_RESPONSE | normal | invoke | success | return-parameters | data | octet-string | size | */
+    if (!ptr || len != 8 + HLS_REPLY_SIZE || ptr[0] != ACTION_RESPONSE || ptr[1] != ACTION_NORMAL || ptr[3] != 0 ||
+            ptr[4] != 0x01 || ptr[5] != 0 || ptr[6] != TYPE_OCTET_STRING || ptr[7] != HLS_REPLY_SIZE ||
+            ptr[8] != DLMS_SC_AUTH) {
+        return false;
+    }
+
+    dlms_gcm_start(&gcm, security.server_title, DLMS_SC_AUTH, get_u32(ptr+9));
+    dlms_gcm_aad(&gcm, security.challenge, CHALLENGE_SIZE);
+
+    return dlms_gcm_check(&gcm, ptr+9+4);
+}
+
+/* glo-get-request in place of GET-Request after LLC */
+static void request_cipher(session_req_t *req) {
+
+    if (!security.ciphered) return;
+
+    req->info_len = LLC_HEAD + set_ciphered(req->info+LLC_HEAD, GLO_GET_REQUEST, req->info+LLC_HEAD, req->info_len-LLC_HEAD);
+}
+
+/* bytes of the descriptor of the item with its access selection */
+static uint8_t request_size(uint8_t i) {
+
+    if (session.scaler & (1UL << i)) return sizeof(request_t);
+
+    return sizeof(request_t) + session.items[i]->access_len;
+}
+
+static void set_request_descriptor(session_req_t *req, uint8_t i) {
+
+    const obis_item_t *item = session.items[i];
+
+    memcpy(req->info+req->info_len, &item->request, sizeof(request_t));
+    req->info_len += sizeof(request_t);
+
+    if (session.scaler & (1UL << i)) {
+        /* scaler_unit of the register, without selective access */
+        req->info[req->info_len-2] = 3;
+    } else if (item->access_len) {
+        /* access-selection present, then selector and parameters */
+        req->info[req->info_len-1] = 0x01;
+        memcpy(req->info+req->info_len, item->access, item->access_len);
+        req->info_len += item->access_len;
+    }
+}
+
+static void set_request_normal(session_req_t *req, uint8_t i) {
+
+#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
+    printf("\r\nCommand get request\r\n");
+#endif
+
+    req->info_len = 0;
+
+    req->info[req->info_len++] = LSAP;
+    req->info[req->info_len++] = CMD_LSAP;
+    req->info[req->info_len++] = 0;
+    req->info[req->info_len++] = GET_REQUEST;
+    req->info[req->info_len++] = GET_NORMAL;
+    req->info[req->info_len++] = INVOKE_PRIORITY | req->invoke;
+
+    set_request_descriptor(req, i);
+    request_cipher(req);
+}
+
+static void set_request_list(session_req_t *req, uint8_t first, uint8_t count) {
+
+#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
+    printf("\r\nCommand get request with list, count: %d\r\n", count);
+#endif
+
+    req->info_len = 0;
+
+    req->info[req->info_len++] = LSAP;
+    req->info[req->info_len++] = CMD_LSAP;
+    req->info[req->info_len++] = 0;
+    req->info[req->info_len++] = GET_REQUEST;
+    req->info[req->info_len++] = GET_WITH_LIST;
+    req->info[req->info_len++] = INVOKE_PRIORITY | req->invoke;
+    req->info[req->info_len++] = count;
+
+    for (uint8_t i = 0; i < count; i++) {
+        set_request_descriptor(req, first+i);
+    }
+
+    request_cipher(req);
+}
+
+/* GET-Request-Next asks the block after the last received one */
+static void set_request_next(session_req_t *req) {
+
+#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
+    printf("\r\nCommand get request next, block: %d\r\n", req->st.block);
 #endif
+
+    req->info_len = 0;
+
+    req->info[req->info_len++] = LSAP;
+    req->info[req->info_len++] = CMD_LSAP;
+    req->info[req->info_len++] = 0;
+    req->info[req->info_len++] = GET_REQUEST;
+    req->info[req->info_len++] = GET_NEXT;
+    req->info[req->info_len++] = INVOKE_PRIORITY | req->invoke;
+    req->info[req->info_len++] = (req->st.block >> 24) & 0xff;
+    req->info[req->info_len++] = (req->st.block >> 16) & 0xff;
+    req->info[req->info_len++] = (req->st.block >> 8) & 0xff;
+    req->info[req->info_len++] = req->st.block & 0xff;
+    request_cipher(req);
+}
+
+static void stream_put(stream_t *st, uint8_t ch) {
+
+    if (st->elem_len < STREAM_ELEM_MAX) {
+        st->elem[st->elem_len++] = ch;
+    } else {
+        st->overflow = true;
+    }
+}
+
+/* the result of the item is over, the next item of the list or the end of the response */
+static void stream_next_item(session_req_t *req) {
+
+    stream_t *st = &req->st;
+
+    st->item++;
+    st->depth = 0;
+    st->base = 0;
+    st->entry = 0;
+    st->elem_len = 0;
+    st->overflow = false;
+
+    if (req->list && st->item < req->len) {
+        st->state = ST_CHOICE;
+    } else {
+        st->state = ST_DONE;
+    }
+}
+
+/* the value at the current depth is complete. The element at the top (or the entry of
+ * the array at the top) goes to the handler of the item */
+static void stream_value_done(session_req_t *req) {
+
+    stream_t *st = &req->st;
+    uint8_t i = req->idx+st->item;
+
+    for (;;) {
+        if (st->depth == st->base) {
+            if (!st->overflow || session.items[i]->head_only) {
+                session_execute(i, st->elem, st->elem_len, st->entry);
+                if (st->base == 0) req->failed &= ~(1UL << st->item);
+            }
+            st->entry++;
+            st->elem_len = 0;
+            st->overflow = false;
+        }
+        if (st->depth == 0) {
+            /* the array is taken only with all its entries, a broken one is asked again */
+            if (st->base) req->failed &= ~(1UL << st->item);
+            stream_next_item(req);
+            return;
+        }
+        if (--st->count[st->depth-1]) {
+            st->state = ST_TAG;
+            return;
+        }
+        st->depth--;
+    }
+}
+
+/* the length of string, array or structure is received */
+static void stream_length_done(session_req_t *req) {
+
+    stream_t *st = &req->st;
+
+    switch (st->tag) {
+        case TYPE_ARRAY:
+        case TYPE_STRUCTURE:
+            if (st->length == 0) {
+                stream_value_done(req);
+                return;
+            }
+            if (st->depth == STREAM_DEPTH) {
+                st->state = ST_ERROR;
+                return;
+            }
+            if (st->depth == 0 && st->tag == TYPE_ARRAY) {
+                /* profiles and lists, every entry goes to the handler separately */
+                st->base = 1;
+                st->elem_len = 0;
+            }
+            st->count[st->depth++] = st->length;
+            st->state = ST_TAG;
+            return;
+        case TYPE_BIT_STRING:
+            st->need = (st->length + 7) / 8;
+            break;
+        default:
+            st->need = st->length;
+            break;
+    }
+
+    if (st->need) {
+        st->state = ST_VALUE;
+    } else {
+        stream_value_done(req);
+    }
+}
+
+/* Get-Data-Result of the items byte by byte, the data of every item is collected
+ * in the small buffer of the request and goes to the handler as soon as it is complete */
+static void stream_byte(session_req_t *req, uint8_t ch) {
+
+    stream_t *st = &req->st;
+    int8_t size;
+
+    switch (st->state) {
+        case ST_COUNT:
+            st->state = (ch == req->len) ? ST_CHOICE : ST_ERROR;
+            break;
+        case ST_CHOICE:
+            /* 0 - data, 1 - data-access-result */
+            st->state = ch ? ST_DAR : ST_TAG;
+            break;
+        case ST_DAR:
+            stream_next_item(req);
+            break;
+        case ST_TAG:
+            stream_put(st, ch);
+            st->tag = ch;
+            size = axdr_value_size(ch);
+            if (size == AXDR_UNKNOWN || ch == TYPE_COMPACT_ARRAY) {
+                st->state = ST_ERROR;
+            } else if (size == AXDR_LENGTH) {
+                st->state = ST_LENGTH;
+            } else if (size) {
+                st->need = size;
+                st->state = ST_VALUE;
+            } else {
+                stream_value_done(req);
+            }
+            break;
+        case ST_LENGTH:
+            stream_put(st, ch);
+            if (ch & 0x80) {
+                /* length in the next 1 or 2 bytes */
+                st->need = ch & 0x7f;
+                st->length = 0;
+                st->state = (st->need == 1 || st->need == 2) ? ST_LENGTH_NEXT : ST_ERROR;
+            } else {
+                st->length = ch;
+                stream_length_done(req);
+            }
+            break;
+        case ST_LENGTH_NEXT:
+            stream_put(st, ch);
+            st->length = (st->length << 8) | ch;
+            if (--st->need == 0) stream_length_done(req);
+            break;
+        case ST_VALUE:
+            stream_put(st, ch);
+            if (--st->need == 0) stream_value_done(req);
+            break;
+        default:
+            break;
+    }
+}
+
+/* GET-Response-With-Datablock: | last-block | block-number 4 | 0 raw-data | length | raw-data | */
+static void stream_block_byte(session_req_t *req, uint8_t ch) {
+
+    stream_t *st = &req->st;
+
+    switch (st->block_state) {
+        case BLOCK_LAST:
+            st->last_block = ch;
+            st->number = 0;
+            st->raw_need = 4;
+            st->block_state = BLOCK_NUMBER;
+            break;
+        case BLOCK_NUMBER:
+            st->number = (st->number << 8) | ch;
+            if (--st->raw_need == 0) {
+                if (st->number != st->block + 1) {
+                    st->state = ST_ERROR;
+                }
+                st->block = st->number;
+                st->block_state = BLOCK_CHOICE;
+            }
+            break;
+        case BLOCK_CHOICE:
+            if (ch) {
+                /* data-access-result instead of raw-data */
+                st->state = ST_ERROR;
+            }
+            st->block_state = BLOCK_LENGTH;
+            break;
+        case BLOCK_LENGTH:
+            if (ch & 0x80) {
+                st->raw_need = ch & 0x7f;
+                st->raw_left = 0;
+                st->block_state = BLOCK_LENGTH_NEXT;
+            } else {
+                st->raw_left = ch;
+                st->block_state = BLOCK_RAW;
+            }
+            break;
+        case BLOCK_LENGTH_NEXT:
+            st->raw_left = (st->raw_left << 8) | ch;
+            if (--st->raw_need == 0) st->block_state = BLOCK_RAW;
+            break;
+        case BLOCK_RAW:
+            if (st->raw_left) {
+                st->raw_left--;
+                stream_byte(req, ch);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/* | LSAP | RESP_LSAP | 0 | GET_RESPONSE | type | invoke-id | - the request is found by invoke-id */
+static void apdu_rx_head() {
+
+    uint8_t *head = apdu_rx.head;
+    uint8_t i;
+
+    apdu_rx.req = 0;
+
+    if (head[0] != LSAP || head[1] != RESP_LSAP || head[2] != 0 || head[3] != GET_RESPONSE) {
+        /* exception-response or something else, it can be only the oldest request */
+        apdu_rx.type = 0;
+        session.tx[0].bad = true;
+        return;
+    }
+
+    apdu_rx.type = head[4];
+
+    for (i = 0; i < session.tx_num; i++) {
+        if (session.tx[i].invoke == (head[5] & INVOKE_ID_MASK) && !session.tx[i].pending) {
+            break;
+        }
+    }
+
+    if (i == session.tx_num) {
+        session.tx[0].bad = true;
+        return;
+    }
+
+    apdu_rx.req = i;
+
+    session_req_t *req = &session.tx[i];
+
+    if (apdu_rx.type != GET_DATABLOCK && apdu_rx.type != (req->list ? GET_WITH_LIST : GET_NORMAL)) {
+        req->bad = true;
+        return;
+    }
+
+    if (!req->started) {
+        req->started = true;
+        if (apdu_rx.type == GET_DATABLOCK) {
+            req->st.state = req->list ? ST_COUNT : ST_TAG;
+        } else {
+            req->st.state = req->list ? ST_COUNT : ST_CHOICE;
+        }
+    }
+
+    req->st.block_state = BLOCK_LAST;
+}
+
+static void apdu_rx_reset() {
+
+    apdu_rx.len = 0;
+    apdu_rx.glo = GLO_START;
+    apdu_rx.need = 0;
+}
+
+/* GET-Response and LLC before it */
+static void apdu_rx_plain(uint8_t *data, size_t len) {
+
+    session_req_t *req;
+
+    while (len--) {
+        if (apdu_rx.len < APDU_HEAD) {
+            apdu_rx.head[apdu_rx.len++] = *data++;
+            if (apdu_rx.len == APDU_HEAD) apdu_rx_head();
+            continue;
+        }
+        req = &session.tx[apdu_rx.req];
+        if (req->bad) return;
+        if (apdu_rx.type == GET_DATABLOCK) {
+            stream_block_byte(req, *data++);
+        } else {
+            stream_byte(req, *data++);
+        }
+    }
+}
+
+static void apdu_rx_glo_length() {
+
+    if (apdu_rx.length < DLMS_SECURITY_HEAD + DLMS_TAG_SIZE) {
+        apdu_rx.glo = GLO_ERROR;
+        return;
+    }
+
+    apdu_rx.text_left = apdu_rx.length - DLMS_SECURITY_HEAD - DLMS_TAG_SIZE;
+    apdu_rx.need = 0;
+    apdu_rx.glo = GLO_SECURITY;
+}
+
+/* | glo-get-response | length | SC | IC | ... | GCM tag | around the text */
+static void apdu_rx_glo(uint8_t ch) {
+
+    uint32_t ic;
+
+    switch (apdu_rx.glo) {
+        case GLO_START:
+            if (ch == EXCEPTION_RESPONSE) {
+                /* it carries no data, only the request fails */
+                apdu_rx.glo = GLO_PLAIN;
+                apdu_rx_plain(&ch, 1);
+            } else {
+                apdu_rx.glo = ch == GLO_GET_RESPONSE ? GLO_LENGTH : GLO_ERROR;
+            }
+            break;
+        case GLO_PLAIN:
+            apdu_rx_plain(&ch, 1);
+            break;
+        case GLO_LENGTH:
+            if (ch & 0x80) {
+                apdu_rx.need = ch & 0x7f;
+                apdu_rx.length = 0;
+                apdu_rx.glo = apdu_rx.need && apdu_rx.need <= 2 ? GLO_LENGTH_NEXT : GLO_ERROR;
+            } else {
+                apdu_rx.length = ch;
+                apdu_rx_glo_length();
+            }
+            break;
+        case GLO_LENGTH_NEXT:
+            apdu_rx.length = (apdu_rx.length << 8) | ch;
+            if (--apdu_rx.need == 0) apdu_rx_glo_length();
+            break;
+        case GLO_SECURITY:
+            apdu_rx.security[apdu_rx.need++] = ch;
+            if (apdu_rx.need == DLMS_SECURITY_HEAD) {
+                ic = get_u32(apdu_rx.security+1);
+                if (apdu_rx.security[0] != DLMS_SC_AUTH_ENCRYPT || !security_server_ic(ic)) {
+                    apdu_rx.glo = GLO_ERROR;
+                    break;
+                }
+                dlms_gcm_start(&apdu_rx.gcm, security.server_title, DLMS_SC_AUTH_ENCRYPT, ic);
+                result_package.size = 0;
+                apdu_rx.need = 0;
+                apdu_rx.glo = apdu_rx.text_left ? GLO_TEXT : GLO_MAC;
+            }
+            break;
+        case GLO_MAC:
+            if (apdu_rx.need < DLMS_TAG_SIZE) {
+                apdu_rx.tag[apdu_rx.need++] = ch;
+            } else {
+                apdu_rx.glo = GLO_ERROR;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/* information field of the I-frame, one segment of APDU. The plain APDU is decoded on the fly.
+ * The ciphered text is deciphered into result_package and decoded only after its tag is checked
+ * at the end of APDU, so a forged text does not reach the attributes and the caches */
+static void apdu_rx_data(uint8_t *data, size_t len) {
+
+    size_t n;
+
+    if (session.tx_num == 0) return;
+
+    if (!security.ciphered) {
+        apdu_rx_plain(data, len);
+        return;
+    }
+
+    while (len) {
+        if (apdu_rx.len < LLC_HEAD) {
+            apdu_rx_plain(data++, 1);
+            len--;
+        } else if (apdu_rx.glo == GLO_TEXT) {
+            n = len < apdu_rx.text_left ? len : apdu_rx.text_left;
+            if (result_package.size + n > sizeof(result_package.buff)) {
+                /* longer than client-max-receive-pdu-size of the association */
+                apdu_rx.glo = GLO_ERROR;
+                return;
+            }
+            memcpy(result_package.buff+result_package.size, data, n);
+            dlms_gcm_decrypt(&apdu_rx.gcm, result_package.buff+result_package.size, n);
+            result_package.size += n;
+            data += n;
+            len -= n;
+            apdu_rx.text_left -= n;
+            if (apdu_rx.text_left == 0) apdu_rx.glo = GLO_MAC;
+        } else {
+            apdu_rx_glo(*data++);
+            len--;
+        }
+    }
+}
+
+/* the whole glo-APDU with its tag is authentic */
+static uint8_t apdu_rx_authentic() {
+
+    if (!security.ciphered || apdu_rx.glo == GLO_PLAIN) return true;
+
+    if (apdu_rx.glo != GLO_MAC || apdu_rx.need != DLMS_TAG_SIZE || !dlms_gcm_check(&apdu_rx.gcm, apdu_rx.tag)) {
+        return false;
+    }
+
+    security_server_ic_set(get_u32(apdu_rx.security+1));
+
+    return true;
+}
+
+/* the last segment of APDU is received. Returns false if the ciphered APDU is not authentic */
+static uint8_t apdu_rx_complete() {
+
+    session_req_t *req;
+    uint8_t i;
+
+    if (session.tx_num == 0) {
+        apdu_rx_reset();
+        return true;
+    }
+
+    if (!apdu_rx_authentic()) {
+        /* the deciphered text is dropped undecoded */
+        result_package.size = 0;
+        apdu_rx_reset();
+        return false;
+    }
+
+    if (security.ciphered && apdu_rx.glo == GLO_MAC) {
+        apdu_rx_plain(result_package.buff, result_package.size);
+        result_package.size = 0;
+    }
+
+    if (apdu_rx.len < APDU_HEAD) {
+        session.tx[0].bad = true;
+        apdu_rx.req = 0;
+    }
+
+    i = apdu_rx.req;
+    req = &session.tx[i];
+
+    apdu_rx_reset();
+    session.attempt = 0;
+
+    if (apdu_rx.type == GET_DATABLOCK && (req->st.block_state != BLOCK_RAW || req->st.raw_left)) {
+        /* the block is shorter than its header says */
+        req->st.state = ST_ERROR;
+    }
+
+    if (!req->bad && apdu_rx.type == GET_DATABLOCK && !req->st.last_block && req->st.state != ST_ERROR) {
+        /* the next block, the stream continues from the same place */
+        set_request_next(req);
+        req->pending = true;
+        return true;
+    }
+
+    if (req->list) {
+        if (req->bad && apdu_rx.type != GET_WITH_LIST && apdu_rx.type != GET_DATABLOCK) {
+            /* meter does not support the list, do not ask it any more */
+            meter.get_list = false;
+#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
+            printf("GET-Request-With-List not supported\r\n");
+#endif
+        }
+        /* items without data are asked once more with single GET */
+        session.retry |= req->failed << req->idx;
+    } else if (req->failed) {
+        session_execute(req->idx, NULL, 0, 0);
+    }
+
+    session.tx_num--;
+    memmove(session.tx+i, session.tx+i+1, (session.tx_num-i) * sizeof(session_req_t));
+
+    return true;
+}
+
+/* items from the first one in one GET-Request-With-List within the agreed info field */
+static uint8_t get_list_max(uint8_t first) {
+
+    uint16_t size = GET_LIST_HEAD + (security.ciphered ? CIPHER_OVERHEAD : 0);
+    uint8_t max = 0;
+
+    while (first+max < session.count && max < GET_LIST_LIMIT) {
+        size += request_size(first+max);
+        if (size > meter.max_info_field_tx) break;
+        max++;
+    }
+
+    return max;
+}
+
+/* the next request of the cycle: single GETs of the items which the list did not return,
+ * then the list or single GET of the items not requested yet */
+static uint8_t session_next_request(session_req_t *req) {
+
+    uint8_t i;
+
+    memset(req, 0, sizeof(session_req_t));
+
+    session.invoke = (session.invoke + 1) & INVOKE_ID_MASK;
+    req->invoke = session.invoke;
+    req->pending = true;
+
+    if (session.retry) {
+        for (i = 0; !(session.retry & (1 << i)); i++);
+        session.retry &= ~(1 << i);
+        req->idx = i;
+        req->len = 1;
+        req->failed = 1;
+        set_request_normal(req, i);
+        return true;
+    }
+
+    if (session.next < session.count) {
+        req->idx = session.next;
+        req->len = get_list_max(req->idx);
+        if (meter.get_list && req->len > 1) {
+            req->list = true;
+            set_request_list(req, req->idx, req->len);
+        } else {
+            req->len = 1;
+            set_request_normal(req, req->idx);
+        }
+        req->failed = req->len >= GET_LIST_LIMIT ? 0xffffffff : (1UL << req->len) - 1;
+        session.next += req->len;
+        return true;
+    }
+
+    return false;
+}
+
+/* requests lost with the previous link. The meter does not remember the block transfer,
+ * so the partly received requests are asked again only for the items without data */
+static void session_restart_requests() {
+
+    uint8_t i = 0;
+    session_req_t *req;
+
+    while (i < session.tx_num) {
+        req = &session.tx[i];
+        if (req->started || req->bad) {
+            if (req->list) {
+                session.retry |= req->failed << req->idx;
+                req->failed = 0;
+            }
+            if (!req->failed) {
+                session.tx_num--;
+                memmove(session.tx+i, session.tx+i+1, (session.tx_num-i) * sizeof(session_req_t));
+                continue;
+            }
+            set_request_normal(req, req->idx);
+            memset(&req->st, 0, sizeof(stream_t));
+            req->started = false;
+            req->bad = false;
+        } else if (security.ciphered) {
+            /* the meter keeps the last counter of the client over the associations */
+            if (req->list) {
+                set_request_list(req, req->idx, req->len);
+            } else {
+                set_request_normal(req, req->idx);
+            }
+        }
+        req->pending = true;
+        i++;
+    }
+
+    apdu_rx_reset();
+}
+
+/* sends I-frames of the requests waiting for sending, the last frame polls the meter */
+static void session_transmit() {
+
+    uint8_t i, last = 0;
+    size_t sent = 0;
+
+    for (i = 0; i < session.tx_num; i++) {
+        if (session.tx[i].pending) last = i;
+    }
+
+    flush_buff_uart();
+
+    for (i = 0; i < session.tx_num; i++) {
+        if (session.tx[i].pending) {
+            session.tx[i].pending = false;
+            session.tx[i].ns = meter.vs;
+            meter.vs = (meter.vs + 1) & 0x07;
+            sent += send_i_frame(session.tx[i].ns, session.tx[i].info, session.tx[i].info_len, i == last);
+        }
+    }
+
+    session_wait(sent);
+    rtt_start(sent);
+}
+
+static int32_t session_pollCb(void *arg) {
+
+    timerResponseEvt = NULL;
+
+    if (++session.polls > SESSION_POLLS) {
+        session_fail(PKT_ERR_TIMEOUT);
+    } else {
+        send_s_frame(RR);
+    }
+
+    return -1;
+}
+
+/* our turn to send: fills the window with new requests, polls the meter while
+ * the responses are not complete, disconnects at the end of the cycle */
+static void session_pump() {
+
+    uint8_t i, pending = 0;
+
+    while (session.tx_num < meter.window_tx && session_next_request(&session.tx[session.tx_num])) {
+        session.tx_num++;
+    }
+
+    for (i = 0; i < session.tx_num; i++) {
+        if (session.tx[i].pending) pending++;
+    }
+
+    if (pending) {
+        session_transmit();
+        return;
+    }
+
+    if (session.tx_num) {
+        /* the meter has not answered all requests yet. Right after I-frame it is the next
+         * segment, otherwise the meter is still processing and is polled a bit later */
+        if (session.polls++ == 0) {
+            send_s_frame(RR);
+        } else {
+            timerResponseEvt = TL_ZB_TIMER_SCHEDULE(session_pollCb, NULL, poll_delay());
+        }
+        return;
+    }
+
+    session.complete = true;
+
+    session_close();
+}
+
+/* N(R) of the meter acknowledges all our I-frames before it */
+static uint8_t session_ack(uint8_t nr) {
+
+    if (((nr - meter.va) & 0x07) > ((meter.vs - meter.va) & 0x07)) return false;
+
+    meter.va = nr;
+
+    return true;
+}
+
+/* repeats the I-frames which the meter has not acknowledged or polls it if there are no such */
+static void session_retransmit() {
+
+    uint8_t ns, i;
+    size_t sent = 0;
+
+    zcl_diagInc(retries);
+    flush_buff_uart();
+
+    for (ns = meter.va; ns != meter.vs; ns = (ns + 1) & 0x07) {
+        for (i = 0; i < session.tx_num; i++) {
+            if (!session.tx[i].pending && session.tx[i].ns == ns) {
+#if UART_PRINTF_MODE && DEBUG_PACKAGE
+                printf("Retransmit N(S): %d\r\n", ns);
+#endif
+                sent += send_i_frame(ns, session.tx[i].info, session.tx[i].info_len, ((ns + 1) & 0x07) == meter.vs);
+            }
+        }
+    }
+
+    if (sent) {
+        session_wait(sent);
+    } else {
+        send_s_frame(RR);
+    }
+
+    /* the response may be to the first sending */
+    rtt_pending = false;
+    rtt_ambiguous = true;
+}
+
+static uint8_t session_append() {
+
+    size_t len;
+
+    /* | header | HCS 2 | information | FCS 2 |, frames without information have no HCS */
+    if (hdlc_rx.length > sizeof(header_t)+3) {
+        len = hdlc_rx.length - (sizeof(header_t)+3);
+        if (result_package.size + len > sizeof(result_package.buff)) {
+            return false;
+        }
+        memcpy(result_package.buff+result_package.size, raw_package.data+2, len);
+        result_package.size += len;
+    }
+
+    return true;
+}
+
+/* SNRM and AARQ, the link and the association are used for all requests of the cycle */
+static void session_open() {
+
+    session.established = false;
+    session.retrans = 0;
+    session.polls = 0;
+    send_cmd_run_connect();
+}
+
+/* the link of the previous cycle is used while it is open. If the meter has closed it,
+ * it answers DM or does not answer and the session is restored as after any failure */
+static void session_start() {
+
+    if (timerKeepAliveEvt) {
+        TL_ZB_TIMER_CANCEL(&timerKeepAliveEvt);
+    }
+
+    if (!session.established || session.state != SESSION_IDLE) {
+        session_open();
+        return;
+    }
+
+    session.state = SESSION_GET;
+    session.retrans = 0;
+    session.polls = 0;
+    apdu_rx_reset();
+    session_pump();
+}
+
+/* the link is kept if it is allowed and the next cycle comes before the inactivity timeout of the meter */
+static uint8_t session_keep() {
+
+    if (!dev_config.keep_session) return false;
+
+    for (uint8_t poll = POLL_POWER; poll < POLL_CLASS_MAX; poll++) {
+        if (dev_config.poll_period[poll] <= KEEP_SESSION_PERIOD) return true;
+    }
+
+    return false;
+}
+
+static void session_close() {
+
+    if (session.established && !session_keep()) {
+        send_cmd_disc();
+    } else {
+        session_finish();
+    }
+}
+
+static int32_t session_keepAliveCb(void *arg) {
+
+    timerKeepAliveEvt = NULL;
+
+    if (session.state == SESSION_IDLE && session.established) {
+#if UART_PRINTF_MODE && DEBUG_PACKAGE
+        printf("\r\nKeep alive\r\n");
+#endif
+        session.state = SESSION_KEEP_ALIVE;
+        session.retrans = 0;
+        send_s_frame(RR);
+    }
+
+    return -1;
+}
+
+/* the meter answered RR or not, the next cycle opens the link anew if it is lost */
+static void session_keep_alive_done(uint8_t alive) {
+
+    if (timerResponseEvt) {
+        TL_ZB_TIMER_CANCEL(&timerResponseEvt);
+    }
+
+    session.state = SESSION_IDLE;
+    session.established = alive;
+
+    if (alive) {
+        timerKeepAliveEvt = TL_ZB_TIMER_SCHEDULE(session_keepAliveCb, NULL, KEEP_ALIVE_PERIOD * 1000);
+    }
+}
+
+/* the cycle is over */
+static void session_finish() {
+
+    uint8_t ret = session.complete;
+
+    if (timerResponseEvt) {
+        TL_ZB_TIMER_CANCEL(&timerResponseEvt);
+    }
+
+    session.state = SESSION_IDLE;
+
+    if (session.established) {
+        /* the link stays open till the next cycle */
+        timerKeepAliveEvt = TL_ZB_TIMER_SCHEDULE(session_keepAliveCb, NULL, KEEP_ALIVE_PERIOD * 1000);
+    }
+
+    if (load_profile_dirty) {
+        /* once for all new entries of the cycle */
+        write_load_profile_cfg();
+        load_profile_dirty = false;
+    }
+
+    if (load_profile_report[0]) {
+        /* the taken entries are reported even if the cycle failed, they are not asked again */
+        app_setAttrVal(ENDPOINT(APP_ENDPOINT_1), ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_PROFILE_ENTRIES, load_profile_report);
+        app_forcedReport(ENDPOINT(APP_ENDPOINT_1), ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_PROFILE_ENTRIES);
+        load_profile_report[0] = 0;
+    }
+
+    if (ret && object_list_taken) {
+        /* all entries are received */
+        meter_cache.supported = object_list_rows;
+        meter_cache.discovered = true;
+        meter_cache_dirty = true;
+    }
+    object_list_taken = false;
+
+    if (meter_cache_dirty) {
+        write_meter_cache();
+        scaler_apply();
+        meter_cache_dirty = false;
+    }
+
+    if (ret) {
+        if (session.classes & POLL_BIT(POLL_TARIFF)) {
+            /* all tariffs and the time of the meter are read in this cycle */
+            app_setAttrVal(ENDPOINT(APP_ENDPOINT_1), ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CURRENT_SUMMATION_DELIVERD, (uint8_t*)&tariff_summ);
+#if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
+            printf("tariff_summ: %d\r\n", tariff_summ);
+#endif
+            get_resbat_data();                  /* get resource battery                         */
+        }
+    }
+
+    measure_meter_complete(ret);
+}
+
+/* no valid response. Restore the link and the association and repeat the requests in flight */
+static void session_fail(pkt_error_t err_no) {
+
+#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
+    print_error(err_no);
+#endif
+
+    if (timerResponseEvt) {
+        TL_ZB_TIMER_CANCEL(&timerResponseEvt);
+    }
+
+    if (session.state == SESSION_IDLE) return;
+
+    zcl_diagInc(pkt_errors[err_no]);
+    if (session.state == SESSION_OPEN || session.state == SESSION_AUTH) zcl_diagInc(assoc_failures);
+
+    if (session.state == SESSION_KEEP_ALIVE) {
+        session_keep_alive_done(false);
+        return;
+    }
+
+    if (session.state == SESSION_DISCONNECT) {
+        session.established = false;
+        session_finish();
+        return;
+    }
+
+    if (++session.attempt >= SESSION_ATTEMPTS) {
+        session.established = false;
+        session_finish();
+        return;
+    }
+
+#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
+    printf("Restore session, attempt: %d\r\n", session.attempt);
+#endif
+
+    /* the meter may still answer the failed request, a new SNRM would take its late frames
+     * as the answer. The link is opened again after the timeout of the failed exchange */
+    timerResponseEvt = TL_ZB_TIMER_SCHEDULE(session_restoreCb, NULL, rtt_rto());
+    session.state = SESSION_RESTORE;
+}
+
+static int32_t session_restoreCb(void *arg) {
+
+    timerResponseEvt = NULL;
+
+    session_open();
+
+    return -1;
+}
+
+/* AARE or, with HLS, the result of the authentication is complete. Returns true if the requests are started */
+static uint8_t session_associate() {
+
+    result_package.complete = true;
+
+    if (session.state == SESSION_OPEN && security.ciphered) {
+        if (!open_session_hls()) {
+            session_fail(PKT_ERR_SECURITY);
+            return false;
+        }
+        send_cmd_hls_reply();
+        return false;
+    }
+
+    if (session.state == SESSION_AUTH ? !hls_reply_accepted() : !open_session_accepted()) {
+        session_fail(session.state == SESSION_AUTH ? PKT_ERR_SECURITY : PKT_ERR_RESPONSE);
+        return false;
+    }
+
+    session.established = true;
+    session.state = SESSION_GET;
+    session_restart_requests();
+    result_package_reset();
+
+    return true;
+}
+
+/* I and S frames of the association */
+static void session_link(uint8_t control) {
+
+    uint8_t nr = (control >> 5) & 0x07;
+    uint8_t ns = (control >> 1) & 0x07;
+
+    if ((control & 0x01) == 0) {
+        /* I-frame */
+        if (!session_ack(nr)) {
+            session_fail(PKT_ERR_RESPONSE);
+            return;
+        }
+        rtt_sample();
+        if (ns != meter.vr) {
+            /* out of sequence, after REJ the meter repeats from V(R) */
+            if (control & POLL_FINAL) {
+                send_s_frame(REJ);
+            } else {
+                session_wait(0);
+            }
+            return;
+        }
+        meter.vr = (meter.vr + 1) & 0x07;
+        session.retrans = 0;
+        session.polls = 0;
+        if (session.state == SESSION_GET) {
+            /* the segment goes to the decoder right away, APDU is not assembled */
+            if (hdlc_rx.length > sizeof(header_t)+3) {
+                apdu_rx_data(raw_package.data+2, hdlc_rx.length - (sizeof(header_t)+3));
+            }
+            if (!meter.format.segmentation && !apdu_rx_complete()) {
+                session_fail(PKT_ERR_SECURITY);
+                return;
             }
-        } else if (str->type == TYPE_OCTET_STRING) {
+        } else {
+            if (!session_append()) {
+                session_fail(PKT_ERR_SEGMENTATION);
+                return;
+            }
+            if (!meter.format.segmentation && !session_associate()) {
+                return;
+            }
+        }
+    } else if ((control & 0x03) == 0x01) {
+        /* S-frame */
+        if (!session_ack(nr)) {
+            session_fail(PKT_ERR_RESPONSE);
+            return;
+        }
+        rtt_sample();
+        switch (control & S_FRAME_MASK) {
+            case REJ:
+                session_retransmit();
+                return;
+            case RNR:
+                /* the meter is busy, ask it again later */
+                timerResponseEvt = TL_ZB_TIMER_SCHEDULE(session_pollCb, NULL, rtt[RTT_GET].rto);
+                return;
+            default:
+                if ((control & POLL_FINAL) && meter.va != meter.vs) {
+                    /* the meter has not received the last I-frames */
+                    session_retransmit();
+                    return;
+                }
+                break;
+        }
+    } else {
+        /* DM or FRMR, the link is lost */
+        session_fail(PKT_ERR_RESPONSE);
+        return;
+    }
 
-            serial_number[0] = str->size;
-            memcpy(serial_number+1, &str->str, str->size);
+    if (!(control & POLL_FINAL)) {
+        /* the meter sends the next frame of the window */
+        session_wait(0);
+        return;
+    }
 
-            zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_METER_SERIAL_NUMBER, (uint8_t*)&serial_number);
-#if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-            printf("Serial Number: %s, len: %d\r\n", serial_number+1, *serial_number);
-#endif
-        }
-        app_forcedReport(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_METER_SERIAL_NUMBER);
+    if (session.state == SESSION_OPEN || session.state == SESSION_AUTH) {
+        /* the next segment of AARE or of the action-response */
+        send_s_frame(RR);
+        return;
     }
+
+    session_pump();
 }
 
-static void get_date_release_data() {
+/* "frame complete" or "frame error" event from the HDLC receiver */
+static void session_frameCb(void *arg) {
+
+    pkt_error_t err_no = (pkt_error_t)(uint32_t)arg;
 
+    if (session.state == SESSION_IDLE || session.state == SESSION_RESTORE) return;
+
+    pkt_error_no = err_no;
+
+    if (err_no != PKT_OK) {
+        if (session.state == SESSION_GET) {
+            /* the broken frame is lost, the response timer will repeat or poll */
+            zcl_diagInc(pkt_errors[err_no]);
 #if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
-    printf("\r\nCommand get date release\r\n");
+            print_error(err_no);
 #endif
+            hdlc_rx_reset();
+            return;
+        }
+        session_fail(err_no);
+        return;
+    }
 
-    type_octet_string_t *o_str = (type_octet_string_t*)get_request_data(&attr_descriptor_date_release);
+    if (timerResponseEvt) {
+        TL_ZB_TIMER_CANCEL(&timerResponseEvt);
+    }
 
-    if (o_str) {
-        if (o_str->type == TYPE_OCTET_STRING && o_str->size) {
-            uint8_t *ptr = &o_str->str;
+    zcl_diagInc(frames_ok);
 
-            uint8_t  release_day = *ptr++;
-            release_month = *ptr++;
+    uint8_t *ptr_format = (uint8_t*)&meter.format;
+    *(ptr_format+1) = raw_package.header.format[0];
+    *ptr_format = raw_package.header.format[1];
 
-            uint8_t year = from_bcd_to_dec(*ptr++);
-            release_year = year * 100;
-            year = from_bcd_to_dec(*ptr++);
-            release_year += year;
-            uint8_t  dr[11] = {0};
-            uint8_t  dr_len = 0;
+    uint8_t control = raw_package.header.control;
 
-            if (release_day < 10) {
-                dr[dr_len++] = '0';
-                dr[dr_len++] = 0x30 + release_day;
+    switch (session.state) {
+        case SESSION_CONNECT:
+            if (control == UA && session_append()) {
+                rtt_sample();
+                set_link_parameters();
+                meter.vs = meter.vr = meter.va = 0;
+                send_cmd_open_session();
             } else {
-                dr[dr_len++] = 0x30 + release_day/10;
-                dr[dr_len++] = 0x30 + release_day%10;
+                session_fail(PKT_ERR_RESPONSE);
             }
-            dr[dr_len++] = '.';
-
-            if (release_month < 10) {
-                dr[dr_len++] = '0';
-                dr[dr_len++] = 0x30 + release_month;
+            break;
+        case SESSION_DISCONNECT:
+            rtt_sample();
+            session.established = false;
+            session_finish();
+            break;
+        case SESSION_KEEP_ALIVE:
+            if ((control & (S_FRAME_MASK | POLL_FINAL)) == (RR | POLL_FINAL) && session_ack((control >> 5) & 0x07)) {
+                rtt_sample();
+                session_keep_alive_done(true);
             } else {
-                dr[dr_len++] = 0x30 + release_month/10;
-                dr[dr_len++] = 0x30 + release_month%10;
+                session_keep_alive_done(false);
             }
-            dr[dr_len++] = '.';
+            break;
+        default:
+            session_link(control);
+            break;
+    }
+}
 
-            uint8_t year_str[8] = {0};
+static uint8_t serial_number_data(const obis_item_t *item, axdr_t *data, uint16_t entry) {
 
-            itoa(release_year, year_str);
+    uint8_t tag, *str;
+    uint16_t len;
+    int64_t value;
 
-            dr[dr_len++] = year_str[0];
-            dr[dr_len++] = year_str[1];
-            dr[dr_len++] = year_str[2];
-            dr[dr_len++] = year_str[3];
+    if (!data || !axdr_peek(data, &tag)) return false;
 
-            if (set_zcl_str(dr, date_release, DATA_MAX_LEN+1)) {
-                zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DATE_RELEASE, (uint8_t*)&date_release);
-#if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-                printf("Date of release: %s, len: %d\r\n", date_release+1, *date_release);
-#endif
+    if (tag == TYPE_OCTET_STRING || tag == TYPE_VISIBLE_STRING) {
+        if (!axdr_get_string(data, &tag, &str, &len) || len > SE_ATTR_SN_SIZE-1) return false;
 
-            }
-        }
-    }
-}
+        serial_number[0] = len;
+        memcpy(serial_number+1, str, len);
+    } else {
+        if (!axdr_get_int(data, &value)) return false;
 
-static void get_voltage_data() {
+        uint8_t sn[SE_ATTR_SN_SIZE];
 
-#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
-    printf("\r\nCommand get voltage\r\n");
+        itoa((uint32_t)value, sn);
+
+        if (!set_zcl_str(sn, serial_number, SE_ATTR_SN_SIZE)) return false;
+    }
+
+    app_setAttrVal(ENDPOINT(item->endpoint), item->cluster_id, item->attr_id, (uint8_t*)&serial_number);
+#if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
+    printf("Serial Number: %s, len: %d\r\n", serial_number+1, *serial_number);
 #endif
+    app_forcedReport(ENDPOINT(item->endpoint), item->cluster_id, item->attr_id);
 
-    uint16_t voltage = 0;
-    type_digit16_t *digit_voltageA = (type_digit16_t*)get_request_data(&attr_descriptor_voltageA);
+    return true;
+}
 
-    if (digit_voltageA) {
+/* | day | month | year BCD 2 |, bytes after them are not used */
+static uint8_t date_release_data(const obis_item_t *item, axdr_t *data, uint16_t entry) {
 
-        if (digit_voltageA->type == TYPE_UNSIGNED_32 || digit_voltageA->type == TYPE_UNSIGNED_16) {
+    uint8_t tag, *ptr;
+    uint16_t len;
 
-            voltage = reverse16(digit_voltageA->value);
+    if (!data || !axdr_get_string(data, &tag, &ptr, &len) || tag != TYPE_OCTET_STRING || len < 4) return false;
 
-            voltage *= 10;
+    uint8_t  release_day = *ptr++;
+    release_month = *ptr++;
 
-            zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_VOLTAGE, (uint8_t*)&voltage);
+    uint8_t year = from_bcd_to_dec(*ptr++);
+    release_year = year * 100;
+    year = from_bcd_to_dec(*ptr++);
+    release_year += year;
+    uint8_t  dr[11] = {0};
+    uint8_t  dr_len = 0;
 
-#if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-            printf("voltageA: %d\r\n", voltage);
-#endif
-        }
+    if (release_day < 10) {
+        dr[dr_len++] = '0';
+        dr[dr_len++] = 0x30 + release_day;
+    } else {
+        dr[dr_len++] = 0x30 + release_day/10;
+        dr[dr_len++] = 0x30 + release_day%10;
     }
+    dr[dr_len++] = '.';
 
-    type_digit16_t *digit_voltageB = (type_digit16_t*)get_request_data(&attr_descriptor_voltageB);
-
-    if (digit_voltageB) {
+    if (release_month < 10) {
+        dr[dr_len++] = '0';
+        dr[dr_len++] = 0x30 + release_month;
+    } else {
+        dr[dr_len++] = 0x30 + release_month/10;
+        dr[dr_len++] = 0x30 + release_month%10;
+    }
+    dr[dr_len++] = '.';
 
-        if (digit_voltageB->type == TYPE_UNSIGNED_32 || digit_voltageB->type == TYPE_UNSIGNED_16) {
+    uint8_t year_str[8] = {0};
 
-            voltage = reverse16(digit_voltageB->value);
+    itoa(release_year, year_str);
 
-            voltage *= 10;
+    dr[dr_len++] = year_str[0];
+    dr[dr_len++] = year_str[1];
+    dr[dr_len++] = year_str[2];
+    dr[dr_len++] = year_str[3];
 
-            zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_VOLTAGE_PHB, (uint8_t*)&voltage);
+    if (!set_zcl_str(dr, date_release, DATA_MAX_LEN+1)) return false;
 
+    app_setAttrVal(ENDPOINT(item->endpoint), item->cluster_id, item->attr_id, (uint8_t*)&date_release);
 #if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-            printf("voltageB: %d\r\n", voltage);
+    printf("Date of release: %s, len: %d\r\n", date_release+1, *date_release);
 #endif
-        }
-    }
-
-    type_digit16_t *digit_voltageC = (type_digit16_t*)get_request_data(&attr_descriptor_voltageC);
+    app_forcedReport(ENDPOINT(item->endpoint), item->cluster_id, item->attr_id);
 
-    if (digit_voltageC) {
+    return true;
+}
 
-        if (digit_voltageC->type == TYPE_UNSIGNED_32 || digit_voltageC->type == TYPE_UNSIGNED_16) {
+static uint8_t time_data(const obis_item_t *item, axdr_t *data, uint16_t entry) {
 
-            voltage = reverse16(digit_voltageC->value);
+    axdr_date_time_t present_date;
 
-            voltage *= 10;
+    if (!data || !axdr_get_date_time(data, &present_date)) return false;
 
-            zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_VOLTAGE_PHC, (uint8_t*)&voltage);
+    present_year = present_date.year;
+    present_month = present_date.month;
 
 #if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-            printf("voltageC: %d\r\n", voltage);
+    printf("year: %d, mon: %d\r\n", present_year, present_month);
 #endif
-        }
-    }
 
+    return true;
 }
 
-static void get_power_data() {
-
-#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
-    printf("\r\nCommand get power\r\n");
-#endif
+/* A-XDR integer of the type expected by the row */
+static uint8_t plan_value(const obis_item_t *item, axdr_t *data, int64_t *value) {
 
-    uint32_t power = 0;
-    uint16_t pwr = 0;
+    uint8_t type;
 
-    type_digit32_t *digit_powerA = (type_digit32_t*)get_request_data(&attr_descriptor_powerA);
+    if (!axdr_peek(data, &type) || !(item->types & TYPE_BIT(type)) || !axdr_get_int(data, value)) return false;
 
-    if (digit_powerA) {
+    for (int8_t scale = item->scale; scale > 0; scale--) {
+        *value *= 10;
+    }
+    for (int8_t scale = item->scale; scale < 0; scale++) {
+        *value /= 10;
+    }
 
-        if (digit_powerA->type == TYPE_UNSIGNED_32 || digit_powerA->type == TYPE_SIGNED_32) {
+    return true;
+}
 
-            power = reverse32(digit_powerA->value); // / 1000;
+/* value of the row to its ZCL attribute */
+static uint8_t plan_attribute(const obis_item_t *item, axdr_t *data) {
 
-            //power = 42258; //1505010; //
-            //power /= 1000;
+    int64_t value;
 
-            pwr = power & 0xffff;
+    if (!data || !plan_value(item, data, &value)) return false;
 
-            zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_ACTIVE_POWER, (uint8_t*)&pwr);
+    /* little endian, the attribute takes as many low bytes as it has */
+    app_setAttrVal(ENDPOINT(item->endpoint), item->cluster_id, item->attr_id, (uint8_t*)&value);
 
 #if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-            printf("powerA: %d\r\n", pwr);
+    printf("attribute 0x%04x/0x%04x: %d\r\n", item->cluster_id, item->attr_id, (int32_t)value);
 #endif
-        }
-    }
 
-    type_digit32_t *digit_powerB = (type_digit32_t*)get_request_data(&attr_descriptor_powerB);
+    return true;
+}
+
+/* the executor of the plan, called for every row of the cycle with its data or NULL */
+static void plan_execute(const obis_item_t *item, uint8_t *data, size_t len, uint16_t entry) {
 
-    if (digit_powerB) {
+    axdr_t axdr, *cursor = NULL;
+    uint8_t ret;
 
-        if (digit_powerB->type == TYPE_UNSIGNED_32 || digit_powerB->type == TYPE_SIGNED_32) {
+    if (data) {
+        axdr_init(&axdr, data, len);
+        cursor = &axdr;
+    }
 
-            power = reverse32(digit_powerB->value); // / 1000;
+    if (item->handler) {
+        ret = item->handler(item, cursor, entry);
+    } else {
+        ret = plan_attribute(item, cursor);
+    }
 
-            //power = 42258; //1505010; //
-            //power /= 1000;
+    if (ret && item->poll == POLL_ONCE) {
+        plan_once |= 1UL << (item - obis_plan);
+    }
+}
 
-            pwr = power & 0xffff;
+/* the item of the cycle goes to its row, or to scaler_unit_data() if it asks the scaler_unit of the row */
+static void session_execute(uint8_t i, uint8_t *data, size_t len, uint16_t entry) {
 
-            zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_ACTIVE_POWER_PHB, (uint8_t*)&pwr);
+    axdr_t axdr;
 
-#if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-            printf("powerB: %d\r\n", pwr);
-#endif
-        }
+    if (session.scaler & (1UL << i)) {
+        if (data) axdr_init(&axdr, data, len);
+        scaler_unit_data(session.items[i], data ? &axdr : NULL, entry);
+        return;
     }
 
-    type_digit32_t *digit_powerC = (type_digit32_t*)get_request_data(&attr_descriptor_powerC);
+    plan_execute(session.items[i], data, len, entry);
+}
+
+/* the buffer is not used until capture_objects is read again */
+static void profile_reset() {
 
-    if (digit_powerC) {
+    memset(&profile, 0, sizeof(profile_t));
+}
 
-        if (digit_powerC->type == TYPE_UNSIGNED_32 || digit_powerC->type == TYPE_SIGNED_32) {
+/* capture_objects entry by entry: | class_id | logical_name | attribute_index | data_index |.
+ * The column goes to the row of the plan which reads the same attribute alone */
+static uint8_t profile_capture_data(const obis_item_t *item, axdr_t *data, uint16_t entry) {
 
-            power = reverse32(digit_powerC->value); // / 1000;
+    uint16_t count, class_id, len;
+    int64_t attr, index;
+    uint8_t tag, *obis;
+    const obis_item_t *row;
 
-            //power = 42258; //1505010; //
-            //power /= 1000;
+    if (entry == 0) profile_reset();
 
-            pwr = power & 0xffff;
+    /* the meter has no profile or the list of columns is empty, the rows are read alone */
+    if (!data || !axdr_peek(data, &tag) || tag == TYPE_ARRAY) return true;
 
-            zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_ACTIVE_POWER_PHC, (uint8_t*)&pwr);
+    profile.columns = entry + 1;
 
-#if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-            printf("powerC: %d\r\n", pwr);
-#endif
-        }
+    if (entry >= PROFILE_COLUMNS_MAX) return true;
+
+    profile.row[entry] = PROFILE_NO_ROW;
+
+    if (!axdr_get_container(data, TYPE_STRUCTURE, &count) || count != 4 ||
+        !axdr_get_int(data, &attr) ||
+        !axdr_get_string(data, &tag, &obis, &len) || tag != TYPE_OCTET_STRING || len != 6) {
+        return false;
     }
 
-}
+    class_id = attr;
 
-static void get_current_data() {
+    /* data_index 0 - the whole attribute */
+    if (!axdr_get_int(data, &attr) || !axdr_get_int(data, &index) || index != 0) return true;
 
-#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
-    printf("\r\nCommand get current\r\n");
+    for (row = obis_plan; row < obis_plan + OBIS_PLAN_NUM; row++) {
+        if (row->handler == NULL &&
+            BUILD_U16(row->request.class[1], row->request.class[0]) == class_id &&
+            row->request.attribute[0] == attr &&
+            memcmp(row->request.obis, obis, 6) == 0) {
+            profile.row[entry] = row - obis_plan;
+            profile.covered |= 1UL << profile.row[entry];
+            profile.ready = true;
+            break;
+        }
+    }
+
+#if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
+    printf("profile column %d, row: %d\r\n", entry, profile.row[entry]);
 #endif
 
-    uint16_t current = 0;
-    type_digit32_t *digit_currentA = (type_digit32_t*)get_request_data(&attr_descriptor_currentA);
+    return true;
+}
 
-    if (digit_currentA) {
+/* the entry of the buffer, every column goes to the executor as the value of its row */
+static uint8_t profile_buffer_data(const obis_item_t *item, axdr_t *data, uint16_t entry) {
 
-        if (digit_currentA->type == TYPE_SIGNED_32 || digit_currentA->type == TYPE_UNSIGNED_32) {
+    uint16_t count;
+    uint8_t *value;
 
-            current = reverse32(digit_currentA->value) & 0xffff;
+    if (!data) {
+        /* no selective access or no buffer, the rows are read alone until reset */
+        profile.ready = false;
+        profile.covered = 0;
+        return false;
+    }
 
-            zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_CURRENT, (uint8_t*)&current);
+    if (!axdr_get_container(data, TYPE_STRUCTURE, &count)) return false;
 
-#if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-            printf("currentA: %d\r\n", current);
-#endif
+    if (count != profile.columns) {
+        /* capture_objects is changed, it is read again in the next cycle */
+        profile_reset();
+        for (uint8_t i = 0; i < OBIS_PLAN_NUM; i++) {
+            if (obis_plan[i].handler == profile_capture_data) plan_once &= ~(1UL << i);
         }
+        return false;
     }
 
-    type_digit32_t *digit_currentB = (type_digit32_t*)get_request_data(&attr_descriptor_currentB);
+    for (uint16_t column = 0; column < count; column++) {
+        value = data->ptr;
+        if (!axdr_skip(data)) return false;
+        if (column < PROFILE_COLUMNS_MAX && profile.row[column] != PROFILE_NO_ROW) {
+            plan_execute(&obis_plan[profile.row[column]], value, data->ptr - value, 0);
+        }
+    }
 
-    if (digit_currentB) {
+    return true;
+}
 
-        if (digit_currentB->type == TYPE_SIGNED_32 || digit_currentB->type == TYPE_UNSIGNED_32) {
+/* the row of the load profile is in the cycle if the state needs it, its access is set here.
+ * The stored entry belongs to the meter with the same serial number. The entries are taken
+ * only when they can be reported */
+static uint8_t load_profile_select(const obis_item_t *row) {
 
-            current = reverse32(digit_currentB->value) & 0xffff;
+    axdr_date_time_t from;
+    uint32_t to;
 
-            zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_CURRENT_PHB, (uint8_t*)&current);
+    if (!serial_number[0] || !zb_isDeviceJoinedNwk()) return false;
 
-#if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-            printf("currentB: %d\r\n", current);
-#endif
-        }
+    if (memcmp(load_profile_cfg.serial_number, serial_number, serial_number[0]+1) != 0) {
+        memset(load_profile_cfg.serial_number, 0, SE_ATTR_SN_SIZE);
+        memcpy(load_profile_cfg.serial_number, serial_number, serial_number[0]+1);
+        load_profile_cfg.entry_time = 0;
+        load_profile_state = LOAD_PROFILE_ANCHOR;
     }
 
-    type_digit32_t *digit_currentC = (type_digit32_t*)get_request_data(&attr_descriptor_currentC);
+    if (row->access == access_load_profile_entry) {
+        if (load_profile_state != LOAD_PROFILE_LAST) return false;
+        /* no more entries than one report takes */
+        to = load_profile_next + PROFILE_REPORT_ENTRIES - 1;
+        if (to > load_profile_last) to = load_profile_last;
+        put_u32(access_load_profile_entry+LOAD_PROFILE_FROM_ENTRY, load_profile_next);
+        put_u32(access_load_profile_entry+LOAD_PROFILE_TO_ENTRY, to);
+    } else if (row->access == access_load_profile_range) {
+        if (load_profile_state != LOAD_PROFILE_RANGE) return false;
+        /* the stored entry is not asked again */
+        axdr_sec_to_date_time(load_profile_cfg.entry_time + 1, &from);
+        axdr_put_date_time(access_load_profile_range+LOAD_PROFILE_FROM_VALUE, &from);
+    } else if (load_profile_state != LOAD_PROFILE_ANCHOR) {
+        return false;
+    }
 
-    if (digit_currentC) {
+    return true;
+}
 
-        if (digit_currentC->type == TYPE_SIGNED_32 || digit_currentC->type == TYPE_UNSIGNED_32) {
+static uint8_t load_profile_entries_data(const obis_item_t *item, axdr_t *data, uint16_t entry) {
 
-            current = reverse32(digit_currentC->value) & 0xffff;
+    int64_t value;
 
-            zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_RMS_CURRENT_PHC, (uint8_t*)&current);
+    if (!data || !plan_value(item, data, &value)) return false;
 
-#if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-            printf("currentC: %d\r\n", current);
-#endif
-        }
+    if (value) {
+        /* the depth back from the last entry, the older ones are not taken */
+        load_profile_last = value;
+        load_profile_next = value > dev_config.profile_depth ? value - dev_config.profile_depth + 1 : 1;
+        load_profile_state = LOAD_PROFILE_LAST;
+    } else {
+        /* the profile is empty, all entries are new */
+        load_profile_state = LOAD_PROFILE_RANGE;
     }
 
-    type_digit32_t *digit_currentN = (type_digit32_t*)get_request_data(&attr_descriptor_currentN);
+    return true;
+}
 
-    if (digit_currentN) {
+/* the entry of the load profile: | clock | value | ... |. The first value goes to the report of
+ * the cycle with the capture time, the entry is stored as the last one taken. The entries which
+ * do not fit in the report are asked again in the next cycle */
+static uint8_t load_profile_data(const obis_item_t *item, axdr_t *data, uint16_t entry) {
 
-        if (digit_currentN->type == TYPE_SIGNED_32 || digit_currentN->type == TYPE_UNSIGNED_32) {
+    axdr_date_time_t date_time;
+    uint32_t time, energy = 0xffffffff;
+    uint16_t count;
+    uint8_t tag, *ptr;
+    int64_t value;
 
-            current = reverse32(digit_currentN->value) & 0xffff;
+    /* the same entries are asked in the next cycle */
+    if (!data || !axdr_peek(data, &tag)) return false;
 
-            zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_MS_ELECTRICAL_MEASUREMENT, ZCL_ATTRID_NEUTRAL_CURRENT, (uint8_t*)&current);
+    if (tag == TYPE_ARRAY) {
+        /* no new entries. The last entry is not found - the profile is cleared */
+        if (load_profile_state == LOAD_PROFILE_LAST) load_profile_state = LOAD_PROFILE_ANCHOR;
+        return true;
+    }
 
-#if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-            printf("currentN: %d\r\n", current);
-#endif
-        }
+    if (!axdr_get_container(data, TYPE_STRUCTURE, &count) || count < 2 ||
+        !axdr_get_date_time(data, &date_time) || !axdr_date_time_to_sec(&date_time, &time)) {
+        return false;
     }
-}
 
-static void get_time_data() {
+    if (load_profile_state == LOAD_PROFILE_LAST && ++load_profile_next > load_profile_last) {
+        /* the depth is taken, then the entries after the stored one */
+        load_profile_state = LOAD_PROFILE_RANGE;
+    }
 
-#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
-    printf("\r\nCommand get time\r\n");
-#endif
+    /* the meter which compares without seconds returns the stored entry again */
+    if (time <= load_profile_cfg.entry_time) return true;
 
-    uint8_t *ptr;
+    if (load_profile_report[0] >= PROFILE_REPORT_ENTRIES * 8) return true;
 
-    type_octet_string_t *present_date = (type_octet_string_t*)get_request_data(&attr_descriptor_time);
+    load_profile_cfg.entry_time = time;
+    load_profile_dirty = true;
 
-    if (present_date) {
+    /* the entry without the value is taken anyway, it is not asked again */
+    if (plan_value(item, data, &value)) energy = value;
 
-        if (present_date->type == TYPE_OCTET_STRING) {
+    ptr = load_profile_report + 1 + load_profile_report[0];
+    memcpy(ptr, &time, 4);
+    memcpy(ptr + 4, &energy, 4);
+    load_profile_report[0] += 8;
 
-            ptr = &present_date->str;
-            present_year = (uint16_t)((*ptr++) << 8);
-            present_year |= *ptr++;
-            present_month = *ptr++;
+    /* the last entry taken */
+    app_setAttrVal(ENDPOINT(item->endpoint), item->cluster_id, ZCL_ATTRID_CUSTOM_PROFILE_TIME, (uint8_t*)&time);
+    app_setAttrVal(ENDPOINT(item->endpoint), item->cluster_id, item->attr_id, (uint8_t*)&energy);
 
 #if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-            printf("year: %d, mon: %d\r\n", present_year, present_month);
+    printf("load profile %d.%d.%d %d:%d, value: %d\r\n", date_time.day, date_time.month, date_time.year,
+            date_time.hour, date_time.minute, energy);
 #endif
-        }
-    }
-}
 
-static uint32_t get_tariffA(request_t *attr_desc) {
+    return true;
+}
 
-    uint64_t tariff = 0;
-    type_digit64_t *tariff_A64 = (type_digit64_t*)get_request_data(attr_desc);
-    type_digit32_t *tariff_A32 = (type_digit32_t*)tariff_A64;
-
-    if (tariff_A64) {
-        if (tariff_A64->type == TYPE_UNSIGNED_64) {
-            tariff = reverse64(tariff_A64->value);
-        } else if (tariff_A32->type == TYPE_SIGNED_32 || tariff_A32->type == TYPE_UNSIGNED_32) {
-            tariff = reverse32(tariff_A32->value);
-        }
-    }
+/* serial number and firmware of the meter are read */
+static uint8_t meter_identified() {
 
-    return tariff;
+    return serial_number[0] && firmware_read;
 }
 
-static void get_tariffs_1_2_data() {
+/* the cache of another meter or of another firmware is not used, it is read anew */
+static void meter_cache_check() {
 
-    uint64_t tariff;
-    uint32_t tariffP; //, tariffM;
+    if (!meter_identified() ||
+        (memcmp(meter_cache.serial_number, serial_number, serial_number[0]+1) == 0 &&
+         memcmp(meter_cache.firmware, firmware, firmware[0]+1) == 0)) {
+        return;
+    }
 
-#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
-    printf("\r\nCommand get 1 and 2 tariffs\r\n");
-#endif
+    memset(meter_cache.serial_number, 0, SE_ATTR_SN_SIZE);
+    memcpy(meter_cache.serial_number, serial_number, serial_number[0]+1);
+    memset(meter_cache.firmware, 0, METER_FIRMWARE_SIZE);
+    memcpy(meter_cache.firmware, firmware, firmware[0]+1);
+    meter_cache.discovered = false;
+    meter_cache.supported = 0;
+    meter_cache.scaler_read = 0;
+    meter_cache_dirty = true;
+}
 
-    tariff_summ = 0;
+/* rows of the objects which the meter does not have are not asked */
+static uint8_t plan_supported(uint8_t row) {
 
-    tariffP = get_tariffA(&attr_descriptor_tariff1AP);
-//    tariffM = get_tariffA(&attr_descriptor_tariff1AM);
+    return !meter_cache.discovered || (meter_cache.supported & (1UL << row));
+}
 
-//    tariff = (tariffP + tariffM) & 0xffffffffffff;
-    tariff = tariffP & 0xffffffffffff;
+/* | scaler | unit | of the register. Only a real structure is cached, a refused or empty answer
+ * leaves the row unread, it is asked again the next cycle and the value is taken as it is meanwhile */
+static uint8_t scaler_unit_data(const obis_item_t *item, axdr_t *data, uint16_t entry) {
 
-    tariff_summ += tariff;
+    uint8_t row = item - obis_plan;
+    int64_t scaler, unit;
+    uint16_t count;
 
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CURRENT_TIER_1_SUMMATION_DELIVERD, (uint8_t*)&tariff);
+    if (!data || !axdr_get_container(data, TYPE_STRUCTURE, &count) || count != 2 ||
+        !axdr_get_int(data, &scaler) || !axdr_get_int(data, &unit)) {
+        return false;
+    }
+
+    meter_cache.scaler[row] = scaler;
+    meter_cache.unit[row] = unit;
+    meter_cache.scaler_read |= 1UL << row;
+    meter_cache_dirty = true;
 
 #if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-    printf("tariff1: %d\r\n", tariff);
+    printf("row %d, scaler: %d, unit: %d\r\n", row, meter_cache.scaler[row], meter_cache.unit[row]);
 #endif
 
-    tariffP = get_tariffA(&attr_descriptor_tariff2AP);
-//    tariffM = get_tariffA(&attr_descriptor_tariff2AM);
+    return true;
+}
 
-//    tariff = (tariffP + tariffM) & 0xffffffffffff;
-    tariff = tariffP & 0xffffffffffff;
+static uint8_t firmware_data(const obis_item_t *item, axdr_t *data, uint16_t entry) {
 
-    tariff_summ += tariff;
+    uint8_t tag, *str;
+    uint16_t len;
 
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CURRENT_TIER_2_SUMMATION_DELIVERD, (uint8_t*)&tariff);
+    firmware[0] = 0;
+    firmware_read = true;
+
+    /* the meter without the version is known by its serial number */
+    if (!data) return true;
+
+    if (!axdr_get_string(data, &tag, &str, &len) || tag == TYPE_BIT_STRING) return false;
+
+    if (len > METER_FIRMWARE_SIZE-1) len = METER_FIRMWARE_SIZE-1;
+    firmware[0] = len;
+    memcpy(firmware+1, str, len);
 
 #if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-    printf("tariff2: %d\r\n", tariff);
+    printf("Firmware version, len: %d\r\n", len);
 #endif
 
+    return true;
 }
 
-static void get_tariffs_3_4_data() {
+/* object_list entry by entry: | class_id | version | logical_name | access_rights |.
+ * Only the head of the entry is used, it may come cut. The rows of the object are supported */
+static uint8_t object_list_data(const obis_item_t *item, axdr_t *data, uint16_t entry) {
 
-    uint64_t tariff;
-    uint32_t tariffP; //, tariffM;
+    uint16_t count, class_id, len;
+    int64_t value;
+    uint8_t tag, *obis;
 
-#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
-    printf("\r\nCommand get 3 adn 4 tariffs\r\n");
-#endif
+    if (!data) {
+        /* no object_list, everything is asked */
+        object_list_rows = 0xffffffff;
+        object_list_taken = true;
+        return true;
+    }
 
-    tariffP = get_tariffA(&attr_descriptor_tariff3AP);
-//    tariffM = get_tariffA(&attr_descriptor_tariff3AM);
+    if (entry == 0) object_list_rows = 0;
 
-//    tariff = (tariffP + tariffM) & 0xffffffffffff;
-    tariff = tariffP & 0xffffffffffff;
+    object_list_taken = true;
 
-    tariff_summ += tariff;
+    if (!axdr_get_container(data, TYPE_STRUCTURE, &count) || count < 3 || !axdr_get_int(data, &value)) return false;
 
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CURRENT_TIER_3_SUMMATION_DELIVERD, (uint8_t*)&tariff);
+    class_id = value;
 
-#if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-    printf("tariff3: %d\r\n", tariff);
-#endif
+    if (!axdr_get_int(data, &value) ||
+        !axdr_get_string(data, &tag, &obis, &len) || tag != TYPE_OCTET_STRING || len != 6) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < OBIS_PLAN_NUM; i++) {
+        if (BUILD_U16(obis_plan[i].request.class[1], obis_plan[i].request.class[0]) == class_id &&
+            memcmp(obis_plan[i].request.obis, obis, 6) == 0) {
+            object_list_rows |= 1UL << i;
+        }
+    }
+
+    return true;
+}
 
-    tariffP = get_tariffA(&attr_descriptor_tariff4AP);
-//    tariffM = get_tariffA(&attr_descriptor_tariff4AM);
+/* ZCL multiplier and divisor of every quantity from the scaler of its first row */
+static void scaler_apply() {
 
-//    tariff = (tariffP + tariffM) & 0xffffffffffff;
-    tariff = tariffP & 0xffffffffffff;
+    uint32_t multiplier, divisor;
+    int8_t exponent;
+    uint8_t i, unit;
 
-    tariff_summ += tariff;
+    for (quantity_t quantity = QUANTITY_ENERGY; quantity < QUANTITY_MAX; quantity++) {
+        for (i = 0; i < OBIS_PLAN_NUM; i++) {
+            if (obis_plan[i].quantity == quantity && (meter_cache.scaler_read & (1UL << i))) break;
+        }
+        if (i == OBIS_PLAN_NUM) continue;
+
+        exponent = meter_cache.scaler[i] + obis_plan[i].scale;
+        unit = meter_cache.unit[i];
+        if (unit == UNIT_WH || unit == UNIT_VAH || unit == UNIT_VARH) exponent -= 3;
 
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CURRENT_TIER_4_SUMMATION_DELIVERD, (uint8_t*)&tariff);
+        multiplier = divisor = 1;
+        for (; exponent > 0; exponent--) multiplier *= 10;
+        for (; exponent < 0; exponent++) divisor *= 10;
+
+        /* little endian, 16-bit attributes take the low bytes */
+        app_setAttrVal(ENDPOINT(APP_ENDPOINT_1), quantity_attr[quantity].cluster_id, quantity_attr[quantity].multiplier_id, (uint8_t*)&multiplier);
+        app_setAttrVal(ENDPOINT(APP_ENDPOINT_1), quantity_attr[quantity].cluster_id, quantity_attr[quantity].divisor_id, (uint8_t*)&divisor);
+        app_forcedReport(ENDPOINT(APP_ENDPOINT_1), quantity_attr[quantity].cluster_id, quantity_attr[quantity].multiplier_id);
+        app_forcedReport(ENDPOINT(APP_ENDPOINT_1), quantity_attr[quantity].cluster_id, quantity_attr[quantity].divisor_id);
 
 #if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-    printf("tariff4: %d\r\n", tariff);
+        printf("quantity %d, multiplier: %d, divisor: %d\r\n", quantity, multiplier, divisor);
 #endif
+    }
+}
+
+static uint8_t tariff_data(const obis_item_t *item, axdr_t *data, uint16_t entry) {
+
+    int64_t value;
+    uint64_t tariff = 0;
+
+    if (data && plan_value(item, data, &value)) {
+        tariff = value;
+    }
+
+    tariff &= 0xffffffffffff;
+
+    tariff_summ += tariff;
+
+    app_setAttrVal(ENDPOINT(item->endpoint), item->cluster_id, item->attr_id, (uint8_t*)&tariff);
 
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CURRENT_SUMMATION_DELIVERD, (uint8_t*)&tariff_summ);
 #if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
-    printf("tariff_summ: %d\r\n", tariff_summ);
+    printf("tariff 0x%04x: %d\r\n", item->attr_id, tariff);
 #endif
 
+    return true;
 }
 
 static void get_resbat_data() {
@@ -1318,7 +3345,7 @@ static void get_resbat_data() {
         battery_level++;
     }
 
-    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_REMAINING_BATTERY_LIFE, (uint8_t*)&battery_level);
+    app_setAttrVal(ENDPOINT(APP_ENDPOINT_1), ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_REMAINING_BATTERY_LIFE, (uint8_t*)&battery_level);
 
 #if UART_PRINTF_MODE && DEBUG_DEVICE_DATA
     printf("Resource battery: %d.%d%%\r\n", (worktime*100)/lifetime, ((worktime*100)%lifetime)*100/lifetime);
@@ -1326,51 +3353,48 @@ static void get_resbat_data() {
 
 }
 
-static uint8_t send_cmd_run_connect() {
-
-#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
-    printf("\r\nCommand running of connect\r\n");
-#endif
-
-    uint8_t *pkt_buff = (uint8_t*)&raw_package;
-
-    memset(pkt_buff, 0, sizeof(package_t));
-    memset(&result_package, 0, sizeof(result_package_t));
-
-    set_header();
-    raw_package.header.control = SNRM;
-    meter.format.length += 3;                       /* + size command + size FCS   */
+/* stops the cycle without the result */
+static void session_abort() {
 
-    uint8_t *format = (uint8_t*)&(meter.format);
+    if (timerResponseEvt) {
+        TL_ZB_TIMER_CANCEL(&timerResponseEvt);
+    }
 
-    raw_package.header.format[0] = format[1];
-    raw_package.header.format[1] = format[0];
+    if (timerKeepAliveEvt) {
+        TL_ZB_TIMER_CANCEL(&timerKeepAliveEvt);
+    }
 
-    uint16_t crc = checksum(pkt_buff+1, meter.format.length-2);
-    raw_package.data[0] = crc & 0xff;
-    raw_package.data[1] = (crc >> 8) & 0xff;
-    raw_package.data[2] = FLAG;
+    session.established = false;
 
-    if (send_command(pkt_buff, meter.format.length+2)) {
-        return response_meter();
+    if (session.state == SESSION_KEEP_ALIVE) {
+        session.state = SESSION_IDLE;
+    } else if (session.state != SESSION_IDLE) {
+        session.state = SESSION_IDLE;
+        measure_meter_complete(false);
     }
-
-    return false;
 }
 
-void nartis_i300_init() {
+/* link parameters, address and password of the meter on the bus */
+static void meter_init(uint8_t idx) {
+
+    uint32_t address = meter_address(idx);
+    m_password_t *password = meter_password(idx);
+
     memset(&meter, 0, sizeof(meter_t));
 
     meter.client_addr = CLIENT_ADDRESS;
     meter.server_upper_addr = LOGICAL_DEVICE;
-    meter.server_lower_addr = PHY_DEVICE;
-    meter.max_info_field_rx = MAX_INFO_FIELD;
-    meter.max_info_field_tx = MAX_INFO_FIELD;
-    meter.window_rx = 1;
-    meter.window_tx = 1;
+    /* the first meter answers at the address of Nartis-I300 until another one is set */
+    meter.server_lower_addr = (address >= METER_ADDRESS_MIN && address <= METER_ADDRESS_MAX) ? address : PHY_DEVICE;
+    meter.max_info_field_rx = DEF_INFO_FIELD;
+    meter.max_info_field_tx = DEF_INFO_FIELD;
+    meter.window_rx = DEF_WINDOW;
+    meter.window_tx = DEF_WINDOW;
     meter.format.type = TYPE3;
-    if (dev_config.device_password.size) {
-        memcpy(&meter.password, &dev_config.device_password, sizeof(m_password_t));
+    meter.get_list = true;
+    if (password->size) {
+        memcpy(&meter.password, password, sizeof(m_password_t));
+        if (meter.password.size > sizeof(meter.password.data)) meter.password.size = sizeof(meter.password.data);
     } else {
         strcpy((char*)meter.password.data, PASSWORD);
         meter.password.size = sizeof(PASSWORD)-1;
@@ -1379,174 +3403,194 @@ void nartis_i300_init() {
 //    memcpy(&meter.password, PASSWORD, sizeof(PASSWORD));
 }
 
-static uint8_t measure_meter_nartis_i300_1() {
-
-    send_cmd_run_connect();                    /* start connection                             */
-
-    uint8_t ret = send_cmd_open_session();
-
-    if (ret) {
-        if (new_start) {                /* after reset                                  */
-            serial_number[0] = 0;
-            date_release[0] = 0;
-            new_start = false;
-        }
-        if (serial_number[0] == 0) {
-            get_serial_number_data();
-        }
-        if (date_release[0] == 0) {
-            get_date_release_data();
-            app_forcedReport(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DATE_RELEASE);
-        }
-
-        get_time_data();
-
-        get_resbat_data();              /* get resource battery                         */
-        send_cmd_disc();                /* disconnect                                   */
-
-        fault_measure_flag = false;
-    } else {
-        fault_measure_flag = true;
-        if (!timerFaultMeasurementEvt) {
-            timerFaultMeasurementEvt = TL_ZB_TIMER_SCHEDULE(fault_measure_meterCb, NULL, TIMEOUT_10MIN);
-        }
-    }
-
-    return ret;
+/* the active meter goes to its place on the bus */
+static void bus_save() {
+
+    bus_meter_t *m = &bus[bus_active];
+
+    m->meter = meter;
+    memcpy(m->rtt, rtt, sizeof(rtt));
+    m->security = security;
+    m->established = session.established;
+    m->left_time = poll_clock();
+    memcpy(m->serial_number, serial_number, sizeof(serial_number));
+    memcpy(m->date_release, date_release, sizeof(date_release));
+    memcpy(m->firmware, firmware, sizeof(firmware));
+    m->firmware_read = firmware_read;
+    m->release_month = release_month;
+    m->release_year = release_year;
+    m->present_month = present_month;
+    m->present_year = present_year;
+    m->plan_once = plan_once;
+    m->profile = profile;
+    m->load_profile_state = load_profile_state;
+    m->load_profile_last = load_profile_last;
+    m->load_profile_next = load_profile_next;
 }
 
-static uint8_t measure_meter_nartis_i300_voltage() {
-
-    send_cmd_run_connect();                    /* start connection                             */
+/* the link left for longer than the keep-alive period may be closed by the meter, it is opened anew.
+ * The time is in sec, clock_time() wraps in 268 sec. The invocation counter of the client is one for all meters */
+static void bus_load(uint8_t idx) {
+
+    bus_meter_t *m = &bus[idx];
+    uint32_t ic = security.ic;
+
+    bus_active = idx;
+    meter = m->meter;
+    memcpy(rtt, m->rtt, sizeof(rtt));
+    rtt_pending = false;
+    rtt_ambiguous = false;
+    security = m->security;
+    security.ic = ic;
+    session.established = m->established && poll_clock() - m->left_time < KEEP_ALIVE_PERIOD;
+    memcpy(serial_number, m->serial_number, sizeof(serial_number));
+    memcpy(date_release, m->date_release, sizeof(date_release));
+    memcpy(firmware, m->firmware, sizeof(firmware));
+    firmware_read = m->firmware_read;
+    release_month = m->release_month;
+    release_year = m->release_year;
+    present_month = m->present_month;
+    present_year = m->present_year;
+    plan_once = m->plan_once;
+    profile = m->profile;
+    load_profile_state = m->load_profile_state;
+    load_profile_last = m->load_profile_last;
+    load_profile_next = m->load_profile_next;
+
+    select_meter_cfg(idx);
+    frame_templates_init();
+}
 
-    uint8_t ret = send_cmd_open_session();
+/* the cycle goes to the meter. The link of the previous one stays open, the keep-alive is only for the active one */
+static void bus_select(uint8_t idx) {
 
-    if (ret) {
+    if (idx == bus_active) return;
 
-        get_voltage_data();
-        send_cmd_disc();                /* disconnect                                   */
+    if (timerKeepAliveEvt) {
+        TL_ZB_TIMER_CANCEL(&timerKeepAliveEvt);
+    }
 
-        fault_measure_flag = false;
-    } else {
-        fault_measure_flag = true;
-        if (!timerFaultMeasurementEvt) {
-            timerFaultMeasurementEvt = TL_ZB_TIMER_SCHEDULE(fault_measure_meterCb, NULL, TIMEOUT_10MIN);
+    if (session.state == SESSION_KEEP_ALIVE) {
+        /* RR does not change the link, the answer is not waited */
+        if (timerResponseEvt) {
+            TL_ZB_TIMER_CANCEL(&timerResponseEvt);
         }
+        session.state = SESSION_IDLE;
     }
 
-    return ret;
-}
-
-static uint8_t measure_meter_nartis_i300_current() {
+#if UART_PRINTF_MODE && (DEBUG_DEVICE_DATA || DEBUG_PACKAGE)
+    printf("Meter %d on the bus\r\n", idx);
+#endif
 
-    send_cmd_run_connect();                    /* start connection                             */
+    bus_save();
+    bus_load(idx);
+}
 
-    uint8_t ret = send_cmd_open_session();
+/* the links are opened anew with the new settings, what is read from the meters stays */
+void nartis_i300_init() {
 
-    if (ret) {
+    session_abort();
 
-        get_current_data();
-        send_cmd_disc();                /* disconnect                                   */
+    security_init();
+    rtt_reset();
 
-        fault_measure_flag = false;
-    } else {
-        fault_measure_flag = true;
-        if (!timerFaultMeasurementEvt) {
-            timerFaultMeasurementEvt = TL_ZB_TIMER_SCHEDULE(fault_measure_meterCb, NULL, TIMEOUT_10MIN);
-        }
+    for (uint8_t idx = 0; idx < METER_MAX; idx++) {
+        meter_init(idx);
+        bus[idx].meter = meter;
+        memcpy(bus[idx].rtt, rtt, sizeof(rtt));
+        bus[idx].security = security;
+        bus[idx].established = false;
     }
 
-    return ret;
-}
-
-static uint8_t measure_meter_nartis_i300_power() {
+    meter = bus[bus_active].meter;
+    frame_templates_init();
 
-    send_cmd_run_connect();                    /* start connection                             */
-
-    uint8_t ret = send_cmd_open_session();
+    hdlc_rx_reset();
+    app_uart_set_rx_handler(hdlc_rx_handler);
+    app_uart_set_tx_done_handler(hdlc_tx_done);
+}
 
-    if (ret) {
+/* starts the measurement cycle. The result comes to measure_meter_complete() */
+uint8_t measure_meter_nartis_i300(uint8_t idx, uint8_t classes) {
 
-        get_power_data();
-        send_cmd_disc();                /* disconnect                                   */
+    uint8_t count = 0;
+    uint8_t profile_due = false;
 
-        fault_measure_flag = false;
-    } else {
-        fault_measure_flag = true;
-        if (!timerFaultMeasurementEvt) {
-            timerFaultMeasurementEvt = TL_ZB_TIMER_SCHEDULE(fault_measure_meterCb, NULL, TIMEOUT_10MIN);
-        }
+    if (session.state != SESSION_IDLE && session.state != SESSION_KEEP_ALIVE) {
+        /* the previous cycle is not over yet */
+        return false;
     }
 
-    return ret;
-}
-
-static uint8_t measure_meter_nartis_i300_2() {
+    bus_select(idx);
 
-    send_cmd_run_connect();                    /* start connection                             */
-
-    uint8_t ret = send_cmd_open_session();
+    if (new_start) {                            /* after reset every meter is read anew         */
+        for (uint8_t i = 0; i < METER_MAX; i++) bus[i].fresh = true;
+        new_start = false;
+    }
 
-    if (ret) {
+    if (bus[bus_active].fresh) {
+        serial_number[0] = 0;
+        date_release[0] = 0;
+        plan_once = 0;
+        firmware_read = false;
+        profile_reset();
+        load_profile_state = load_profile_cfg.entry_time ? LOAD_PROFILE_RANGE : LOAD_PROFILE_ANCHOR;
+        /* scalers of the last meter until its serial number is read */
+        scaler_apply();
+        bus[bus_active].fresh = false;
+    }
 
-        get_tariffs_1_2_data();
-        send_cmd_disc();                /* disconnect                                   */
+    meter_cache_check();
 
-        fault_measure_flag = false;
-    } else {
-        fault_measure_flag = true;
-        if (!timerFaultMeasurementEvt) {
-            timerFaultMeasurementEvt = TL_ZB_TIMER_SCHEDULE(fault_measure_meterCb, NULL, TIMEOUT_10MIN);
+    for (uint8_t i = 0; i < OBIS_PLAN_NUM; i++) {
+        if (obis_plan[i].handler == object_list_data) {
+            if (meter_identified() && !meter_cache.discovered) session.items[count++] = &obis_plan[i];
+            continue;
+        }
+        if (obis_plan[i].poll != POLL_ONCE && !plan_supported(i)) continue;
+        if (obis_plan[i].handler == profile_buffer_data) {
+            /* one GET of the buffer for all covered rows of the cycle */
+            if (profile_due) session.items[count++] = &obis_plan[i];
+            continue;
+        }
+        if (obis_plan[i].poll == POLL_ONCE) {
+            if (plan_once & (1UL << i)) continue;
+        } else if (!(classes & POLL_BIT(obis_plan[i].poll))) {
+            continue;
+        }
+        if (profile.ready && (profile.covered & (1UL << i))) {
+            profile_due = true;
+            continue;
         }
+        if ((obis_plan[i].handler == load_profile_entries_data || obis_plan[i].handler == load_profile_data) &&
+            !load_profile_select(&obis_plan[i])) {
+            continue;
+        }
+        session.items[count++] = &obis_plan[i];
     }
 
-    return ret;
-}
-
-static uint8_t measure_meter_nartis_i300_3() {
-
-    send_cmd_run_connect();                    /* start connection                             */
-
-    uint8_t ret = send_cmd_open_session();
-
-    if (ret) {
-
-        get_tariffs_3_4_data();
-        send_cmd_disc();                /* disconnect                                   */
-
-        fault_measure_flag = false;
-    } else {
-        fault_measure_flag = true;
-        if (!timerFaultMeasurementEvt) {
-            timerFaultMeasurementEvt = TL_ZB_TIMER_SCHEDULE(fault_measure_meterCb, NULL, TIMEOUT_10MIN);
+    /* scaler_unit of the registers which are not in the cache yet, as many as fit in the cycle */
+    session.scaler = 0;
+    for (uint8_t i = 0; meter_identified() && i < OBIS_PLAN_NUM && count < SESSION_ITEMS; i++) {
+        if (obis_plan[i].quantity != QUANTITY_NONE && !(meter_cache.scaler_read & (1UL << i)) && plan_supported(i)) {
+            session.scaler |= 1UL << count;
+            session.items[count++] = &obis_plan[i];
         }
     }
 
-    return ret;
-}
-
-uint8_t measure_meter_nartis_i300() {
+    if (count == 0) return false;
 
-    uint8_t ret;
+    tariff_summ = 0;
 
-    ret = measure_meter_nartis_i300_1();
+    session.classes = classes;
+    session.count = count;
+    session.next = 0;
+    session.retry = 0;
+    session.tx_num = 0;
+    session.attempt = 0;
+    session.complete = false;
 
-    if (ret) {
-        ret = measure_meter_nartis_i300_voltage();
-        if (ret) {
-            ret = measure_meter_nartis_i300_current();
-            if (ret) {
-                ret = measure_meter_nartis_i300_power();
-                if (ret) {
-                    ret = measure_meter_nartis_i300_2();
-                    if (ret) {
-                        ret = measure_meter_nartis_i300_3();
-                    }
-                }
-            }
-        }
-    }
+    session_start();                            /* one link and association for all cycle    */
 
-    return ret;
+    return true;
 }
-
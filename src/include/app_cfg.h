@@ -77,6 +77,12 @@ extern "C" {
 /* PA */
 #define PA_ENABLE                       OFF
 
+/* Meters on one bus, the meter n is at the endpoint APP_ENDPOINT_1 + n */
+#define METER_MAX                       1
+
+/* RS-485 transceiver instead of the optoport, GPIO_UART_DE drives the bus while sending */
+#define UART_RS485                      OFF
+
 /* BDB */
 #define TOUCHLINK_SUPPORT               ON
 #define FIND_AND_BIND_SUPPORT           OFF
@@ -135,6 +141,11 @@ extern "C" {
         0x80000 End Flash
      */
     #define NV_ITEM_APP_USER_CFG        (NV_ITEM_APP_GP_TRANS_TABLE + 1)    // see sdk/proj/drivers/drv_nv.h
+    #define NV_ITEM_APP_LOAD_PROFILE    (NV_ITEM_APP_USER_CFG + 1)
+    #define NV_ITEM_APP_METER_CACHE     (NV_ITEM_APP_USER_CFG + 2)
+    #define NV_ITEM_APP_SECURITY        (NV_ITEM_APP_USER_CFG + 3)
+    #define NV_ITEM_APP_BUS             (NV_ITEM_APP_USER_CFG + 4)
+    #define NV_ITEM_APP_BUS_METER       (NV_ITEM_APP_USER_CFG + 5)    // load profile and cache of the meters 1.., two items per meter
 #elif defined(MCU_CORE_8278)
     #define FLASH_CAP_SIZE_1M           1
     #define BOARD                       BOARD_8278_DONGLE//BOARD_8278_EVK
@@ -225,6 +236,7 @@ extern "C" {
 #define ZCL_METERING_SUPPORT                        ON
 #define ZCL_ELECTRICAL_MEASUREMENT_SUPPORT          ON
 #define ZCL_DEV_TEMPERATURE_CFG_SUPPORT             ON
+#define ZCL_DIAGNOSTICS_SUPPORT                     ON
 
 /**********************************************************************
  * Stack configuration
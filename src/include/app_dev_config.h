@@ -9,17 +9,89 @@ typedef struct __attribute__((packed)) {
 /* must be no more than FLASH_PAGE_SIZE (256) bytes */
 typedef struct __attribute__((packed)) {
     uint32_t        id;                     /* ID - ID_CONFIG                                       */
-    uint16_t        measurement_period;     /* measurement period in sec.                           */
+    uint16_t        poll_period[POLL_CLASS_MAX];    /* in sec. by poll class, POLL_ONCE is not used */
     uint8_t         device_model;           /* manufacturer of electric meters                      */
     uint32_t        device_address;         /* see address on dislpay ID-20109                      */
     m_password_t    device_password;        /* password for electricity meter - "[size]12345678"    */
+    uint16_t        profile_depth;          /* load profile entries taken back from the first connect */
+    uint8_t         keep_session;           /* link and association stay open between short cycles  */
     uint16_t        crc;
 } dev_config_t;
 
+/* the last entry of the load profile taken from the meter */
+typedef struct __attribute__((packed)) {
+    uint32_t        id;                     /* ID - ID_LOAD_PROFILE                                 */
+    uint8_t         serial_number[SE_ATTR_SN_SIZE]; /* meter of the entry, the other one starts anew */
+    uint32_t        entry_time;             /* capture time, in sec. from 2000, 0 - no entry yet    */
+    uint16_t        crc;
+} load_profile_cfg_t;
+
+#define METER_CACHE_ROWS    32              /* rows of the read plan of the driver                  */
+#define METER_FIRMWARE_SIZE 17              /* 0 - len, 1..16 - str                                 */
+
+/* what is read from the meter once, valid while the serial number and the firmware are the same */
+typedef struct __attribute__((packed)) {
+    uint32_t        id;                     /* ID - ID_METER_CACHE                                  */
+    uint8_t         serial_number[SE_ATTR_SN_SIZE]; /* meter of the cache, ZCL string               */
+    uint8_t         firmware[METER_FIRMWARE_SIZE];  /* firmware version of the meter, ZCL string    */
+    uint8_t         discovered;             /* object_list is read                                  */
+    uint32_t        supported;              /* rows whose objects are in object_list, bit per row   */
+    uint32_t        scaler_read;            /* rows with scaler_unit, bit per row                   */
+    int8_t          scaler[METER_CACHE_ROWS];   /* power of 10 of the value of the row              */
+    uint8_t         unit[METER_CACHE_ROWS];     /* DLMS unit of the row                             */
+    uint16_t        crc;
+} meter_cache_t;
+
+#define SECURITY_KEY_SIZE   16
+#define SECURITY_TITLE_SIZE 8
+
+typedef enum {
+    SECURITY_LLS = 0,                       /* password of the meter                                */
+    SECURITY_HLS_GMAC,                      /* HLS mechanism 5, APDUs ciphered with AES-GCM         */
+    SECURITY_LEVEL_MAX
+} security_level_t;
+
+/* DLMS security of the client, the keys are never read back over the air */
+typedef struct __attribute__((packed)) {
+    uint32_t        id;                     /* ID - ID_SECURITY                                     */
+    uint8_t         level;                  /* security_level_t                                     */
+    uint8_t         system_title[SECURITY_TITLE_SIZE];  /* of the client, IEEE address by default   */
+    uint8_t         ek[SECURITY_KEY_SIZE];  /* global unicast encryption key                        */
+    uint8_t         ak[SECURITY_KEY_SIZE];  /* authentication key                                   */
+    uint32_t        invocation_counter;     /* counters below it may be used, the next start is above */
+    uint16_t        crc;
+} security_cfg_t;
+
+#if METER_MAX > 1
+/* meter on the bus after the first one, the first one is in dev_config */
+typedef struct __attribute__((packed)) {
+    uint32_t        device_address;         /* HDLC address of the meter, 0 - no meter              */
+    m_password_t    device_password;
+} bus_meter_cfg_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t        id;                     /* ID - ID_BUS                                          */
+    bus_meter_cfg_t meter[METER_MAX-1];
+    uint16_t        crc;
+} bus_cfg_t;
+#endif
+
 extern dev_config_t dev_config;
+extern load_profile_cfg_t load_profile_cfg;
+extern meter_cache_t meter_cache;
+extern security_cfg_t security_cfg;
 
 void init_config(uint8_t print);
 void write_config();
+void write_load_profile_cfg();
+void write_meter_cache();
+void write_security_cfg();
+uint32_t meter_address(uint8_t idx);
+void set_meter_address(uint8_t idx, uint32_t address);
+m_password_t *meter_password(uint8_t idx);
+uint8_t meter_present(uint8_t idx);
+void write_meter_cfg(uint8_t idx);
+void select_meter_cfg(uint8_t idx);
 
 
 #endif /* SRC_INCLUDE_APP_DEV_CONFIG_H_ */
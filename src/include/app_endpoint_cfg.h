@@ -7,6 +7,8 @@
 #define APP_ENDPOINT_2 0x02
 #define APP_ENDPOINT_3 0x03
 
+#define METER_ENDPOINT(idx)     (APP_ENDPOINT_1 + (idx))    /* endpoint of the meter on the bus */
+
 /**
  *  @brief Defined for basic cluster attributes
  */
@@ -51,6 +53,7 @@ typedef struct {
  *
  */
 
+/* values of the meter, one block per meter on the bus */
 typedef struct {
     uint64_t tariff_1;
     uint64_t tariff_2;
@@ -68,13 +71,28 @@ typedef struct {
     uint8_t  serial_number[1+24];
     uint8_t  date_release[1+DATA_MAX_LEN];
     uint8_t  device_type;
-    uint8_t  device_model;
     uint32_t device_address;
     uint8_t  device_name[1+DEVICE_NAME_LEN];
     uint8_t  device_password[9];    // [0] - size [1]...[8] - Password
-    uint8_t  measurement_period;
+    uint32_t profile_time;          // capture time of the load profile entry, UTC from 2000 in time of meter
+    uint32_t profile_energy;        // energy of the load profile entry, units of the meter
+    uint8_t  profile_entries[1+PROFILE_REPORT_ENTRIES*8];   // [0] - size, new entries of the cycle, | time | energy | LE each
 } zcl_seAttr_t;
 
+/* settings of the bus, at the first endpoint only */
+typedef struct {
+    uint8_t  device_model;
+    uint8_t  measurement_period;    // tariffs, in minutes
+    uint16_t power_period;          // power and current, in sec
+    uint16_t voltage_period;        // in sec
+    uint16_t profile_depth;         // load profile entries taken on the first connect
+    uint8_t  keep_session;          // 1 - link and association stay open between short cycles
+    uint8_t  security_level;        // 0 - LLS, 1 - HLS GMAC with ciphered APDU
+    uint8_t  system_title[1+8];     // [0] - size, of the client
+    uint8_t  encryption_key[1+16];  // write only
+    uint8_t  authentication_key[1+16];  // write only
+} zcl_seBusAttr_t;
+
 
 //0 Active measurement (AC)
 //1 Reactive measurement (AC)
@@ -124,24 +142,72 @@ typedef struct {
     int16_t high_threshold;     /* 70 in degrees Celsius                                              */
 } zcl_tempAttr_t;
 
+#ifdef ZCL_DIAGNOSTICS
+/* counters of the uart and of the link, one block per meter. Updated in place */
+typedef struct {
+    uint32_t uart_rx_bytes;
+    uint16_t uart_ring_overruns;                /* bytes did not fit in the rx ring buffer      */
+    uint16_t uart_dma_overflows;                /* rx dma buffer was full before the idle       */
+    uint32_t frames_ok;
+    uint16_t retries;
+    uint16_t assoc_failures;                    /* AARQ or HLS failed                           */
+    uint32_t cycles;
+    uint16_t cycle_min;                         /* ms, successful cycles                        */
+    uint16_t cycle_avg;
+    uint16_t cycle_max;
+    uint16_t pkt_errors[PKT_ERR_MAX];           /* by pkt_error_t, [PKT_OK] is not used         */
+} zcl_diagAttr_t;
+#endif
+
 extern uint8_t APP_CB_CLUSTER_NUM;
 extern const zcl_specClusterInfo_t g_appClusterList[];
 extern const af_simple_descriptor_t app_simpleDesc;
 
+#if METER_MAX > 1
+/* endpoints of the meters 1.., index idx-1 */
+#ifdef ZCL_DIAGNOSTICS
+#define APP_METER_CB_CLUSTER_NUM    3
+#else
+#define APP_METER_CB_CLUSTER_NUM    2
+#endif
+extern const zcl_specClusterInfo_t g_meterClusterList[METER_MAX-1][APP_METER_CB_CLUSTER_NUM];
+extern const af_simple_descriptor_t app_meterSimpleDesc[METER_MAX-1];
+#endif
+
 /* Attributes */
 extern zcl_basicAttr_t      g_zcl_basicAttrs;
 extern zcl_identifyAttr_t   g_zcl_identifyAttrs;
-extern zcl_seAttr_t         g_zcl_seAttrs;
-extern zcl_msAttr_t         g_zcl_msAttrs;
+extern zcl_seAttr_t         g_zcl_seAttrs[METER_MAX];
+extern zcl_seBusAttr_t      g_zcl_seBusAttrs;
+extern zcl_msAttr_t         g_zcl_msAttrs[METER_MAX];
+#ifdef ZCL_DIAGNOSTICS
+extern zcl_diagAttr_t       g_zcl_diagAttrs[METER_MAX];
+extern uint8_t              g_zcl_diagMeter;
+#endif
 
 #define zcl_iasZoneAttrGet()    &g_zcl_iasZoneAttrs
 #define zcl_pollCtrlAttrGet()   &g_zcl_pollCtrlAttrs
-#define zcl_seAttrs()           &g_zcl_seAttrs
-#define zcl_msAttrs()           &g_zcl_msAttrs
+#define zcl_seAttrs(idx)        &g_zcl_seAttrs[idx]
+#define zcl_msAttrs(idx)        &g_zcl_msAttrs[idx]
+
+#ifdef ZCL_DIAGNOSTICS
+#define zcl_diagAttrs(idx)      &g_zcl_diagAttrs[idx]
+/* the counters go to the meter of the running cycle */
+#define zcl_diagMeterSet(idx)   (g_zcl_diagMeter = (idx))
+#define zcl_diagAdd(field, n)   (g_zcl_diagAttrs[g_zcl_diagMeter].field += (n))
+#else
+#define zcl_diagMeterSet(idx)   do {} while (0)
+#define zcl_diagAdd(field, n)   do {} while (0)
+#endif
+#define zcl_diagInc(field)      zcl_diagAdd(field, 1)
 
 
 void app_zclProcessIncomingMsg(zclIncoming_t *pInHdlrMsg);
 
+clusterInfo_t *app_findCluster(uint8_t endpoint, uint16_t clusterId);
+zclAttrInfo_t *app_findAttribute(uint8_t endpoint, uint16_t clusterId, uint16_t attrId);
+status_t app_setAttrVal(uint8_t endpoint, uint16_t clusterId, uint16_t attrId, uint8_t *val);
+
 status_t app_basicCb(zclIncomingAddrInfo_t *pAddrInfo, uint8_t cmdId, void *cmdPayload);
 status_t app_identifyCb(zclIncomingAddrInfo_t *pAddrInfo, uint8_t cmdId, void *cmdPayload);
 status_t app_sceneCb(zclIncomingAddrInfo_t *pAddrInfo, uint8_t cmdId, void *cmdPayload);
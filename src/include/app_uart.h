@@ -2,8 +2,12 @@
 #define SRC_INCLUDE_APP_UART_H_
 
 #define UART_DATA_LEN  188
-#define UART_BUFF_SIZE 512              /* size ring buffer  */
-#define UART_BUFF_MASK UART_BUFF_SIZE-1 /* mask ring buffer  */
+#define UART_BUFF_SIZE 512                  /* size ring buffer, power of 2  */
+#define UART_BUFF_MASK (UART_BUFF_SIZE-1)   /* mask ring buffer  */
+#define UART_TX_BUFF_SIZE 512                       /* size tx queue, power of 2 */
+#define UART_TX_BUFF_MASK (UART_TX_BUFF_SIZE-1)
+#define UART_TX_TIMER     TIMER_IDX_1               /* hardware timer of the end of the transmit */
+#define UART_TX_POLL_US   100                       /* the fifo is checked again after, one bit at 9600 */
 
 #define app_uart_rx_on(a)  app_uart_init(a)
 
@@ -13,12 +17,22 @@ typedef struct {
     uint8_t  data[UART_DATA_LEN];
 } uart_data_t;
 
+typedef void (*uart_rx_handler_t)(void);
+typedef void (*uart_tx_done_handler_t)(uint32_t done_time);
+
 void app_uart_init(uint32_t baudrate);
 size_t write_bytes_to_uart(uint8_t *data, size_t len);
 uint8_t read_byte_from_buff_uart();
+size_t read_bytes_from_buff_uart(uint8_t *data, size_t len);
+size_t peek_bytes_buff_uart(uint8_t *data, size_t len);
+void consume_buff_uart(size_t len);
+uint8_t *span_buff_uart(size_t *len);
 uint8_t available_buff_uart();
 size_t get_queue_len_buff_uart();
 void flush_buff_uart();
 void app_uart_rx_off();
+void app_uart_set_rx_handler(uart_rx_handler_t handler);
+void app_uart_set_tx_done_handler(uart_tx_done_handler_t handler);
+void app_uart_handler();
 
 #endif /* SRC_INCLUDE_APP_UART_H_ */
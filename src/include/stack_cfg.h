@@ -49,13 +49,13 @@
  *  @brief  ZCL: MAX number of cluster list, in cluster number add  + out cluster number
  *
  */
-#define	ZCL_CLUSTER_NUM_MAX						16
+#define	ZCL_CLUSTER_NUM_MAX						(16 + 3 * (METER_MAX - 1))   /* + metering, electrical measurement and diagnostics of the meters 1.. */
 
 /**
  *  @brief  ZCL: maximum number for zcl reporting table
  *
  */
-#define ZCL_REPORTING_TABLE_NUM				    24
+#define ZCL_REPORTING_TABLE_NUM				    (24 + 6 * (METER_MAX - 1))    /* 37 bytes each, saved in the 4K NV sector of ZCL */
 
 /**
  *  @brief  ZCL: maximum number for zcl scene table
@@ -9,7 +9,36 @@
 #define ZCL_ATTRID_CUSTOM_DATE_RELEASE          0xF003
 #define ZCL_ATTRID_CUSTOM_DEVICE_MODEL          0xF004
 #define ZCL_ATTRID_CUSTOM_DEVICE_PASSWORD       0xF005
+#define ZCL_ATTRID_CUSTOM_POWER_PERIOD          0xF006
+#define ZCL_ATTRID_CUSTOM_VOLTAGE_PERIOD        0xF007
+#define ZCL_ATTRID_CUSTOM_PROFILE_TIME          0xF008
+#define ZCL_ATTRID_CUSTOM_PROFILE_ENERGY        0xF009
+#define ZCL_ATTRID_CUSTOM_SECURITY_LEVEL        0xF00A
+#define ZCL_ATTRID_CUSTOM_SYSTEM_TITLE          0xF00B
+#define ZCL_ATTRID_CUSTOM_ENCRYPTION_KEY        0xF00C
+#define ZCL_ATTRID_CUSTOM_AUTHENTICATION_KEY    0xF00D
+#define ZCL_ATTRID_CUSTOM_PROFILE_ENTRIES       0xF00E
+#define ZCL_ATTRID_CUSTOM_PROFILE_DEPTH         0xF00F
+#define ZCL_ATTRID_CUSTOM_KEEP_SESSION          0xF010
 
 #endif /* ZCL_METERING_SUPPORT */
 
+#if ZCL_DIAGNOSTICS_SUPPORT
+
+/* manufacturer specific, MANUFACTURER_CODE_TELINK. The same ids on every meter endpoint */
+
+#define ZCL_ATTRID_CUSTOM_UART_RX_BYTES         0xF000
+#define ZCL_ATTRID_CUSTOM_UART_RING_OVERRUNS    0xF001
+#define ZCL_ATTRID_CUSTOM_UART_DMA_OVERFLOWS    0xF002
+#define ZCL_ATTRID_CUSTOM_FRAMES_OK             0xF003
+#define ZCL_ATTRID_CUSTOM_RETRIES               0xF004
+#define ZCL_ATTRID_CUSTOM_ASSOCIATION_FAILURES  0xF005
+#define ZCL_ATTRID_CUSTOM_CYCLES                0xF006
+#define ZCL_ATTRID_CUSTOM_CYCLE_MIN             0xF007
+#define ZCL_ATTRID_CUSTOM_CYCLE_AVG             0xF008
+#define ZCL_ATTRID_CUSTOM_CYCLE_MAX             0xF009
+#define ZCL_ATTRID_CUSTOM_PKT_ERROR(err)        (0xF010 + (err))    /* err - pkt_error_t */
+
+#endif /* ZCL_DIAGNOSTICS_SUPPORT */
+
 #endif /* SRC_ZCL_ZCL_CUSTOM_ATTR_H_ */
@@ -46,7 +46,7 @@
 static void app_zclReadRspCmd(zclReadRspCmd_t *pReadRspCmd);
 #endif
 #ifdef ZCL_WRITE
-static void app_zclWriteReqCmd(uint16_t clusterId, zclWriteCmd_t *pWriteReqCmd);
+static void app_zclWriteReqCmd(uint8_t endPoint, uint16_t clusterId, zclWriteCmd_t *pWriteReqCmd);
 static void app_zclWriteRspCmd(zclWriteRspCmd_t *pWriteRspCmd);
 #endif
 #ifdef ZCL_REPORT
@@ -101,7 +101,7 @@ void app_zclProcessIncomingMsg(zclIncoming_t *pInHdlrMsg)
 #endif
 #ifdef ZCL_WRITE
         case ZCL_CMD_WRITE:
-            app_zclWriteReqCmd(pInHdlrMsg->msg->indInfo.cluster_id, pInHdlrMsg->attrCmd);
+            app_zclWriteReqCmd(endPoint, pInHdlrMsg->msg->indInfo.cluster_id, pInHdlrMsg->attrCmd);
             break;
         case ZCL_CMD_WRITE_RSP:
             app_zclWriteRspCmd(pInHdlrMsg->attrCmd);
@@ -153,6 +153,20 @@ static void app_zclReadRspCmd(zclReadRspCmd_t *pReadRspCmd)
 #endif
 
 #ifdef ZCL_WRITE
+/* the driver opens the next association with the new security settings */
+static void app_securityChanged()
+{
+    write_security_cfg();
+
+    switch (dev_config.device_model) {
+        case DEVICE_NARTIS_I300:
+            nartis_i300_init();
+            break;
+        default:
+            break;
+    }
+}
+
 /*********************************************************************
  * @fn      app_zclWriteReqCmd
  *
@@ -162,7 +176,7 @@ static void app_zclReadRspCmd(zclReadRspCmd_t *pReadRspCmd)
  *
  * @return  None
  */
-static void app_zclWriteReqCmd(uint16_t clusterId, zclWriteCmd_t *pWriteReqCmd)
+static void app_zclWriteReqCmd(uint8_t endPoint, uint16_t clusterId, zclWriteCmd_t *pWriteReqCmd)
 {
 
 //    printf("app_zclWriteReqCmd()\r\n");
@@ -171,27 +185,33 @@ static void app_zclWriteReqCmd(uint16_t clusterId, zclWriteCmd_t *pWriteReqCmd)
 
     uint8_t numAttr = pWriteReqCmd->numAttr;
     zclWriteRec_t *attr = pWriteReqCmd->attrList;
+    /* address and password of the meter n are at its endpoint, the other settings are for the bus */
+    uint8_t idx = endPoint - APP_ENDPOINT_1;
 
-    if (clusterId == ZCL_CLUSTER_SE_METERING) {
+    if (clusterId == ZCL_CLUSTER_SE_METERING && idx < METER_MAX) {
         for (uint8_t i = 0; i < numAttr; i++) {
             if (attr[i].attrID == ZCL_ATTRID_CUSTOM_DEVICE_ADDRESS && attr[i].dataType == ZCL_DATA_TYPE_UINT32) {
                 uint32_t device_address = BUILD_U32(attr[i].attrData[0], attr[i].attrData[1], attr[i].attrData[2], attr[i].attrData[3]);
-                if (dev_config.device_address != device_address) {
-                    dev_config.device_address = device_address;
-                    write_config();
+                if (meter_address(idx) != device_address) {
+                    set_meter_address(idx, device_address);
+                    write_meter_cfg(idx);
+                    switch (dev_config.device_model) {
+                        case DEVICE_NARTIS_I300:
+                            nartis_i300_init();
+                            break;
+                        default:
+                            break;
+                    }
 #if UART_PRINTF_MODE // && DEBUG_LEVEL
-                    printf("New device address: %d\r\n", dev_config.device_address);
+                    printf("New device address of meter %d: %d\r\n", idx, device_address);
 #endif
-                    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DEVICE_ADDRESS, (uint8_t*)&device_address);
+                    zcl_setAttrVal(endPoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DEVICE_ADDRESS, (uint8_t*)&device_address);
                 }
-            } else if (attr[i].attrID == ZCL_ATTRID_CUSTOM_DEVICE_MANUFACTURER && attr[i].attrData) {
-                device_model_t model = *attr[i].attrData;
-                set_device_model(model);
-                zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DEVICE_MANUFACTURER, (uint8_t*)&model);
             } else if (attr[i].attrID == ZCL_ATTRID_CUSTOM_DEVICE_PASSWORD && attr[i].dataType == ZCL_DATA_TYPE_OCTET_STR) {
-                dev_config.device_password.size = attr[i].attrData[0];
-                memset(dev_config.device_password.data, 0, sizeof(dev_config.device_password.data));
-                memcpy(dev_config.device_password.data, attr[i].attrData+1, attr[i].attrData[0]);
+                m_password_t *password = meter_password(idx);
+                password->size = attr[i].attrData[0];
+                memset(password->data, 0, sizeof(password->data));
+                memcpy(password->data, attr[i].attrData+1, attr[i].attrData[0]);
                 switch (dev_config.device_model) {
                     case DEVICE_NARTIS_I300:
                         nartis_i300_init();
@@ -204,27 +224,88 @@ static void app_zclWriteReqCmd(uint16_t clusterId, zclWriteCmd_t *pWriteReqCmd)
                     default:
                         break;
                 }
-                write_config();
+                write_meter_cfg(idx);
+#if UART_PRINTF_MODE // && DEBUG_LEVEL
+                printf("New device password of meter %d: %s\r\n", idx, print_str_zcl((uint8_t*)password));
+#endif
+                zcl_setAttrVal(endPoint, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DEVICE_PASSWORD, (uint8_t*)password);
+            } else if (idx) {
+                /* the settings of the bus are at the first endpoint */
+                continue;
+            } else if (attr[i].attrID == ZCL_ATTRID_CUSTOM_DEVICE_MANUFACTURER && attr[i].attrData) {
+                device_model_t model = *attr[i].attrData;
+                set_device_model(model);
+                zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DEVICE_MANUFACTURER, (uint8_t*)&model);
+            } else if (attr[i].attrID == ZCL_ATTRID_CUSTOM_SECURITY_LEVEL && attr[i].attrData) {
+                uint8_t level = *attr[i].attrData;
+                if (level < SECURITY_LEVEL_MAX && security_cfg.level != level) {
+                    security_cfg.level = level;
+                    app_securityChanged();
+#if UART_PRINTF_MODE // && DEBUG_LEVEL
+                    printf("New security level: %d\r\n", level);
+#endif
+                }
+                zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_SECURITY_LEVEL, &security_cfg.level);
+            } else if (attr[i].attrID == ZCL_ATTRID_CUSTOM_SYSTEM_TITLE && attr[i].dataType == ZCL_DATA_TYPE_OCTET_STR &&
+                    attr[i].attrData[0] == SECURITY_TITLE_SIZE) {
+                memcpy(security_cfg.system_title, attr[i].attrData+1, SECURITY_TITLE_SIZE);
+                app_securityChanged();
+            } else if ((attr[i].attrID == ZCL_ATTRID_CUSTOM_ENCRYPTION_KEY || attr[i].attrID == ZCL_ATTRID_CUSTOM_AUTHENTICATION_KEY) &&
+                    attr[i].dataType == ZCL_DATA_TYPE_OCTET_STR && attr[i].attrData[0] == SECURITY_KEY_SIZE) {
+                /* write only, the attribute is not read back */
+                memcpy(attr[i].attrID == ZCL_ATTRID_CUSTOM_ENCRYPTION_KEY ? security_cfg.ek : security_cfg.ak,
+                        attr[i].attrData+1, SECURITY_KEY_SIZE);
+                app_securityChanged();
 #if UART_PRINTF_MODE // && DEBUG_LEVEL
-                printf("New device password: %s\r\n", print_str_zcl((uint8_t*)&dev_config.device_password));
+                printf("New %s key\r\n", attr[i].attrID == ZCL_ATTRID_CUSTOM_ENCRYPTION_KEY ? "encryption" : "authentication");
 #endif
-                zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_DEVICE_PASSWORD, (uint8_t*)&dev_config.device_password);
             } else if (attr[i].attrID == ZCL_ATTRID_CUSTOM_MEASUREMENT_PERIOD && attr[i].dataType == ZCL_DATA_TYPE_UINT8) {
+                /* period of tariffs */
                 uint8_t period_in_min = *attr[i].attrData;
                 if (period_in_min == 0) period_in_min = 1;
                 uint16_t period_in_sec = period_in_min * 60;
-                if (dev_config.measurement_period != period_in_sec) {
-                    dev_config.measurement_period = period_in_sec;
-                    write_config();
+                if (dev_config.poll_period[POLL_TARIFF] != period_in_sec) {
+                    set_poll_period(POLL_TARIFF, period_in_sec);
 #if UART_PRINTF_MODE // && DEBUG_LEVEL
-                    printf("New measurement period: %d sec\r\n", dev_config.measurement_period);
+                    printf("New measurement period: %d sec\r\n", period_in_sec);
 #endif
                     zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_MEASUREMENT_PERIOD, (uint8_t*)&period_in_min);
-                    if (g_appCtx.timerMeasurementEvt) {
-                        TL_ZB_TIMER_CANCEL(&g_appCtx.timerMeasurementEvt);
-                    }
-                    g_appCtx.timerMeasurementEvt = TL_ZB_TIMER_SCHEDULE(measure_meterCb, NULL, dev_config.measurement_period * 1000);
                 }
+            } else if ((attr[i].attrID == ZCL_ATTRID_CUSTOM_POWER_PERIOD || attr[i].attrID == ZCL_ATTRID_CUSTOM_VOLTAGE_PERIOD)
+                    && attr[i].dataType == ZCL_DATA_TYPE_UINT16) {
+                poll_class_t poll = attr[i].attrID == ZCL_ATTRID_CUSTOM_POWER_PERIOD ? POLL_POWER : POLL_VOLTAGE;
+                uint16_t period_in_sec = BUILD_U16(attr[i].attrData[0], attr[i].attrData[1]);
+                if (period_in_sec == 0) period_in_sec = 1;
+                if (dev_config.poll_period[poll] != period_in_sec) {
+                    set_poll_period(poll, period_in_sec);
+#if UART_PRINTF_MODE // && DEBUG_LEVEL
+                    printf("New period of poll class %d: %d sec\r\n", poll, period_in_sec);
+#endif
+                    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, attr[i].attrID, (uint8_t*)&period_in_sec);
+                }
+            } else if (attr[i].attrID == ZCL_ATTRID_CUSTOM_PROFILE_DEPTH && attr[i].dataType == ZCL_DATA_TYPE_UINT16) {
+                /* taken on the next first connect, the entries already taken stay */
+                uint16_t depth = BUILD_U16(attr[i].attrData[0], attr[i].attrData[1]);
+                if (depth == 0) depth = 1;
+                if (dev_config.profile_depth != depth) {
+                    dev_config.profile_depth = depth;
+                    write_config();
+#if UART_PRINTF_MODE // && DEBUG_LEVEL
+                    printf("New load profile depth: %d entries\r\n", depth);
+#endif
+                    zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_PROFILE_DEPTH, (uint8_t*)&depth);
+                }
+            } else if (attr[i].attrID == ZCL_ATTRID_CUSTOM_KEEP_SESSION && attr[i].dataType == ZCL_DATA_TYPE_BOOLEAN) {
+                /* the open link is closed at the end of the next cycle */
+                uint8_t keep = *attr[i].attrData ? true : false;
+                if (dev_config.keep_session != keep) {
+                    dev_config.keep_session = keep;
+                    write_config();
+#if UART_PRINTF_MODE // && DEBUG_LEVEL
+                    printf("Keep session: %d\r\n", keep);
+#endif
+                }
+                zcl_setAttrVal(APP_ENDPOINT_1, ZCL_CLUSTER_SE_METERING, ZCL_ATTRID_CUSTOM_KEEP_SESSION, &dev_config.keep_session);
             }
         }
     }
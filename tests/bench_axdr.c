@@ -0,0 +1,146 @@
+#include <time.h>
+
+#include "tl_common.h"
+
+#include "axdr.h"
+
+/* axdr.c on the host over a load profile (class 7) buffer: an array of entries, each a structure
+ * of the date-time octet string, 3 unsigned-32 values and a long. The decode is checked first,
+ * then timed. Times are of x86 at -O2 with the bounds checks on */
+
+#define BENCH_ENTRIES   500
+#define BENCH_LOOPS     2000
+
+/* array header 4, entry: structure 2 + date-time 14 + 3 x unsigned-32 15 + long 3 */
+static uint8_t buff[4 + BENCH_ENTRIES * 34];
+
+static size_t profile_buff() {
+
+    size_t len = 0;
+
+    buff[len++] = TYPE_ARRAY;
+    buff[len++] = 0x82;
+    buff[len++] = BENCH_ENTRIES >> 8;
+    buff[len++] = BENCH_ENTRIES & 0xff;
+
+    for (int i = 0; i < BENCH_ENTRIES; i++) {
+        uint8_t date_time[AXDR_DATE_TIME_SIZE] = {0x07, 0xea, 10, 17, 6, 12, i % 60, 0, 0xff, 0x80, 0x00, 0x00};
+
+        buff[len++] = TYPE_STRUCTURE;
+        buff[len++] = 5;
+        buff[len++] = TYPE_OCTET_STRING;
+        buff[len++] = AXDR_DATE_TIME_SIZE;
+        memcpy(buff+len, date_time, AXDR_DATE_TIME_SIZE);
+        len += AXDR_DATE_TIME_SIZE;
+        for (int k = 0; k < 3; k++) {
+            buff[len++] = TYPE_UNSIGNED_32;
+            buff[len++] = 0x00;
+            buff[len++] = 0x01;
+            buff[len++] = i >> 8;
+            buff[len++] = i & 0xff;
+        }
+        buff[len++] = TYPE_LONG;
+        buff[len++] = 0xff;
+        buff[len++] = 0xfe;
+    }
+
+    return len;
+}
+
+static int check_decode(size_t len) {
+
+    axdr_t axdr;
+    axdr_date_time_t date_time;
+    uint16_t count, fields;
+    int64_t value;
+
+    axdr_init(&axdr, buff, len);
+    if (!axdr_get_container(&axdr, TYPE_ARRAY, &count) || count != BENCH_ENTRIES) {
+        printf("FAILED  the array header\n");
+        return 1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        axdr_get_container(&axdr, TYPE_STRUCTURE, &fields);
+        axdr_get_date_time(&axdr, &date_time);
+        if (date_time.year != 2026 || date_time.minute != i % 60) {
+            printf("FAILED  entry %d, date-time\n", i);
+            return 1;
+        }
+        for (int k = 0; k < 3; k++) {
+            if (!axdr_get_int(&axdr, &value) || value != 0x10000 + i) {
+                printf("FAILED  entry %d, unsigned-32\n", i);
+                return 1;
+            }
+        }
+        if (!axdr_get_int(&axdr, &value) || value != -2) {
+            printf("FAILED  entry %d, long\n", i);
+            return 1;
+        }
+    }
+
+    if (!axdr_end(&axdr)) {
+        printf("FAILED  bytes left after the array\n");
+        return 1;
+    }
+
+    axdr_init(&axdr, buff, len);
+    if (!axdr_skip(&axdr) || !axdr_end(&axdr)) {
+        printf("FAILED  skip of the array\n");
+        return 1;
+    }
+
+    /* one byte short, the skip must not run past the end */
+    axdr_init(&axdr, buff, len-1);
+    if (axdr_skip(&axdr)) {
+        printf("FAILED  skip of the truncated array\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static double now_ns() {
+
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+int main() {
+
+    size_t len = profile_buff();
+    axdr_t axdr;
+    axdr_date_time_t date_time;
+    uint16_t count, fields;
+    int64_t value;
+    volatile int64_t sum = 0;
+    double t0, ns;
+
+    if (check_decode(len)) {
+        printf("axdr bench: FAILED\n");
+        return 1;
+    }
+
+    t0 = now_ns();
+    for (int k = 0; k < BENCH_LOOPS; k++) {
+        axdr_init(&axdr, buff, len);
+        axdr_get_container(&axdr, TYPE_ARRAY, &count);
+        for (int i = 0; i < count; i++) {
+            axdr_get_container(&axdr, TYPE_STRUCTURE, &fields);
+            axdr_get_date_time(&axdr, &date_time);
+            for (int f = 0; f < 4; f++) {
+                axdr_get_int(&axdr, &value);
+                sum += value;
+            }
+        }
+    }
+    ns = (now_ns() - t0) / BENCH_LOOPS;
+
+    printf("decode %d entries, %u bytes   %5.1f ns/entry, %.0f MB/s\n",
+           BENCH_ENTRIES, (uint32_t)len, ns / BENCH_ENTRIES, len / ns * 1e3);
+    printf("axdr bench: done\n");
+
+    return 0;
+}
@@ -0,0 +1,242 @@
+#include "tl_common.h"
+#include "zcl_include.h"
+
+#include "app_uart.h"
+#include "app_endpoint_cfg.h"
+#include "app_dev_config.h"
+#include "app_utility.h"
+#include "device.h"
+
+/* HDLC link of nartis_i300.c on the host, the source is included to reach its static functions.
+ * The receiver takes one frame from the uart ring and checks it, the constant frames are sent
+ * from their templates. Times are of x86 at -O2, the ratios are what carries over to the chip */
+
+#define BENCH_LOOPS     1000000
+
+/* <time.h> does not go with the types of the SDK */
+struct timespec { long tv_sec; long tv_nsec; };
+int clock_gettime(int clk_id, struct timespec *tp);
+#define CLOCK_MONOTONIC 1
+
+/* the registers of the chip are not there, the time of the link does not matter */
+static uint32_t bench_tick;
+#define clock_time()                bench_clock_time()
+#define clock_time_exceed(ref, us)  (0)
+static uint32_t bench_clock_time() { return bench_tick++; }
+
+/* the driver side of the app */
+dev_config_t dev_config;
+load_profile_cfg_t load_profile_cfg;
+meter_cache_t meter_cache;
+security_cfg_t security_cfg;
+uint8_t new_start = true;
+pkt_error_t pkt_error_no;
+#ifdef ZCL_DIAGNOSTICS
+zcl_diagAttr_t g_zcl_diagAttrs[METER_MAX];
+uint8_t g_zcl_diagMeter;
+#endif
+
+static m_password_t bench_password = {8, "00000001"};
+
+void write_load_profile_cfg() {}
+void write_meter_cache() {}
+void write_security_cfg() {}
+void select_meter_cfg(uint8_t idx) {}
+uint32_t meter_address(uint8_t idx) { return 0; }
+m_password_t *meter_password(uint8_t idx) { return &bench_password; }
+void measure_meter_complete(uint8_t ret) {}
+uint32_t poll_clock() { return 0; }
+void print_error(pkt_error_t err_no) {}
+void print_package(uint8_t *head, uint8_t *buff, size_t len) {}
+void app_forcedReport(uint8_t endpoint, uint16_t claster_id, uint16_t attr_id) {}
+status_t app_setAttrVal(uint8_t endpoint, uint16_t clusterId, uint16_t attrId, uint8_t *val) { return ZCL_STA_SUCCESS; }
+uint32_t itoa(uint32_t value, uint8_t *ptr) { return 0; }
+uint8_t set_zcl_str(uint8_t *str_in, uint8_t *str_out, uint8_t len) { return 0; }
+bool zb_isDeviceJoinedNwk(void) { return true; }
+int tl_printf(const char *format, ...) { return 0; }
+void drv_generateRandomData(u8 *pData, u8 len) { memset(pData, 0x5a, len); }
+
+/* the task of the frame is not run, its error is kept */
+static uint32_t rx_result = ~0;
+
+u8 tl_zbTaskPost(tl_zb_callback_t func, void *arg) {
+
+    rx_result = (uint32_t)(unsigned long)arg;
+    return 0;
+}
+
+static ev_timer_event_t bench_timer;
+
+ev_timer_event_t *ev_timer_taskPost(ev_timer_callback_t func, void *arg, u32 t_ms) { return &bench_timer; }
+u8 ev_timer_taskCancel(ev_timer_event_t **evt) { *evt = NULL; return 0; }
+
+/* uart: the ring holds one frame, what is sent goes nowhere */
+static uint8_t *rx_span;
+static size_t rx_span_len;
+static volatile uint32_t tx_sink;
+
+void app_uart_set_rx_handler(uart_rx_handler_t handler) {}
+void app_uart_set_tx_done_handler(uart_tx_done_handler_t handler) {}
+void flush_buff_uart() {}
+
+uint8_t *span_buff_uart(size_t *len) {
+
+    *len = rx_span_len;
+    return rx_span_len ? rx_span : NULL;
+}
+
+void consume_buff_uart(size_t len) {
+
+    rx_span += len;
+    rx_span_len -= len;
+}
+
+size_t write_bytes_to_uart(uint8_t *data, size_t len) {
+
+    tx_sink += data[len-3];
+    return len;
+}
+
+/* the driver is for the 32 bit chip, its casts of the task argument to uint32_t are whole there */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpointer-to-int-cast"
+#include "../src/devices/nartis_i300.c"
+#pragma GCC diagnostic pop
+
+/* printf of the SDK goes to the uart of the chip or nowhere */
+#undef printf
+int printf(const char *format, ...);
+
+/* FCS of the whole frame in one pass */
+static uint16_t checksum(const uint8_t *data, size_t len) {
+
+    return CRC_FINAL(crc_update(CRC_INIT, data, len));
+}
+
+static double now_ns() {
+
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/* I-frame of the meter to the client: flag, format, client address, 2 byte server address,
+ * control, HCS, information, FCS, flag */
+static size_t meter_frame(uint8_t *frame, size_t info_len) {
+
+    uint16_t length = MIN_FRAME_SIZE + info_len, crc;
+    size_t len = 0;
+
+    frame[len++] = FLAG;
+    frame[len++] = (TYPE3 << 4) | ((length >> 8) & 0x07);
+    frame[len++] = length & 0xff;
+    set_address(frame+len, 1, 0, meter.client_addr);
+    len += 1;
+    set_address(frame+len, 2, meter.server_lower_addr, meter.server_upper_addr);
+    len += 2;
+    frame[len++] = 0x30 | POLL_FINAL;
+    crc = checksum(frame+1, len-1);
+    frame[len++] = crc & 0xff;
+    frame[len++] = crc >> 8;
+    for (size_t i = 0; i < info_len; i++) frame[len++] = i * 7 + 3;
+    crc = checksum(frame+1, len-1);
+    frame[len++] = crc & 0xff;
+    frame[len++] = crc >> 8;
+    frame[len++] = FLAG;
+
+    return len;
+}
+
+/* the receiver: CRC-16/X.25 is taken with every byte, at the last one only the check is left */
+static int bench_receive() {
+
+    uint8_t frame[256];
+    size_t len = meter_frame(frame, 138 - MIN_FRAME_SIZE - 2);
+    volatile uint16_t fcs = 0;
+    double t0, rx_ns, done_ns, pass_ns;
+
+    hdlc_rx_reset();
+    rx_span = frame;
+    rx_span_len = len;
+    hdlc_rx_handler();
+    if (hdlc_rx.state != RX_COMPLETE || rx_result != PKT_OK) {
+        printf("FAILED  receive: state %d, result %u\n", hdlc_rx.state, rx_result);
+        return 1;
+    }
+
+    t0 = now_ns();
+    for (int k = 0; k < BENCH_LOOPS; k++) {
+        hdlc_rx_reset();
+        rx_span = frame;
+        rx_span_len = len;
+        hdlc_rx_handler();
+    }
+    rx_ns = (now_ns() - t0) / BENCH_LOOPS;
+
+    /* what is left after the last byte */
+    t0 = now_ns();
+    for (int k = 0; k < BENCH_LOOPS; k++) {
+        hdlc_rx.state = RX_FRAME;
+        hdlc_rx_complete();
+    }
+    done_ns = (now_ns() - t0) / BENCH_LOOPS;
+
+    /* a pass of the FCS over the whole frame, as it was done after the last byte before */
+    t0 = now_ns();
+    for (int k = 0; k < BENCH_LOOPS; k++) {
+        fcs ^= checksum(frame+1, len-4);
+    }
+    pass_ns = (now_ns() - t0) / BENCH_LOOPS;
+
+    printf("receive %u byte frame   %6.1f ns, %.0f MB/s\n", (uint32_t)len, rx_ns, len / rx_ns * 1e3);
+    printf("  after the last byte   %6.1f ns\n", done_ns);
+    printf("  full FCS pass         %6.1f ns\n", pass_ns);
+
+    return 0;
+}
+
+/* the constant frames: only the control field is patched, the checks are taken again only
+ * when it changes. The send itself is the stub of the uart */
+#define BENCH_SEND(name, call) do {                                             \
+    double t0 = now_ns();                                                       \
+    for (int k = 0; k < BENCH_LOOPS; k++) {                                     \
+        call;                                                                   \
+    }                                                                           \
+    printf("  %-22s%6.1f ns\n", name, (now_ns() - t0) / BENCH_LOOPS);          \
+} while (0)
+
+static int bench_send() {
+
+    uint32_t sink = tx_sink;
+
+    printf("send from the templates, %u B of RAM\n",
+           (uint32_t)(sizeof(frame_snrm) + sizeof(frame_aarq) + sizeof(frame_disc) + sizeof(frame_s)));
+
+    BENCH_SEND("SNRM", send_cmd_run_connect());
+    BENCH_SEND("AARQ", (meter.vs = 0, send_cmd_open_session()));
+    BENCH_SEND("AARQ, control changes", (meter.vs = k & 1, send_cmd_open_session()));
+    BENCH_SEND("RR", send_s_frame(RR));
+    BENCH_SEND("DISC", send_cmd_disc());
+
+    if (tx_sink == sink) {
+        printf("FAILED  send: nothing is sent\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+int main() {
+
+    int failed = 0;
+
+    nartis_i300_init();
+
+    failed += bench_receive();
+    failed += bench_send();
+
+    printf("hdlc bench: %s\n", failed ? "FAILED" : "done");
+
+    return failed ? 1 : 0;
+}
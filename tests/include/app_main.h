@@ -0,0 +1,67 @@
+#ifndef TESTS_INCLUDE_APP_MAIN_H_
+#define TESTS_INCLUDE_APP_MAIN_H_
+
+/* the part of the SDK and of the app which app_uart.c needs on the host, the chip side
+ * (uart, dma, hardware timer, DE pin) is modelled by the test */
+
+#include "tl_common.h"
+
+#define MCU_CORE_8258           1
+
+#define UART_RS485              1
+#define UART_RS485_ECHO         1
+#ifndef UART_DE_PRE_US
+#define UART_DE_PRE_US          50
+#endif
+#ifndef UART_DE_POST_US
+#define UART_DE_POST_US         0
+#endif
+
+#define GPIO_UART_TX            1
+#define GPIO_UART_RX            2
+#define GPIO_UART_DE            3
+
+#define TIMER_IDX_1             1
+#define TIMER_MODE_SCLK         0
+#define S_TIMER_CLOCK_1US       16
+
+#define FLD_DMA_CHN_UART_TX     0x02
+#define FLD_UART_TIMEOUT_MUL    0x03
+#define UART_BW_MUL1            0
+
+typedef void (*uart_irq_callback)(void);
+typedef int (*timerCb_t)(void *p);
+
+typedef enum {
+    HW_TIMER_SUCC       = 0,
+    HW_TIMER_IS_RUNNING = 1,
+    HW_TIMER_INVALID,
+} hw_timer_sts_t;
+
+extern u8 reg_uart_rx_timeout1;
+extern u8 reg_dma_chn_irq_msk;
+
+u32 clock_time(void);
+void sleep_us(u32 us);
+u8 irq_disable(void);
+void irq_restore(u8 r);
+
+void dma_irq_disable(u32 msk);
+void drv_gpio_write(u32 pin, u8 value);
+void drv_gpio_input_en(u32 pin, u8 enable);
+void drv_uart_pin_set(u32 txPin, u32 rxPin);
+u8 drv_uart_init(u32 baudrate, u8 *rxBuf, u16 rxBufLen, uart_irq_callback uartRecvCb);
+void uart_recbuff_init(unsigned char *recAddr, unsigned short recBuffLen);
+unsigned char uart_dma_send(unsigned char *addr);
+unsigned char uart_tx_is_busy(void);
+
+void drv_hwTmr_init(u8 tmrIdx, u8 mode);
+hw_timer_sts_t drv_hwTmr_set(u8 tmrIdx, u32 t_us, timerCb_t func, void *arg);
+void drv_hwTmr_cancel(u8 tmrIdx);
+
+#define zcl_diagAdd(field, n)   do {} while (0)
+#define zcl_diagInc(field)      zcl_diagAdd(field, 1)
+
+#include "app_uart.h"
+
+#endif /* TESTS_INCLUDE_APP_MAIN_H_ */
@@ -0,0 +1,23 @@
+#ifndef TESTS_INCLUDE_TL_COMMON_H_
+#define TESTS_INCLUDE_TL_COMMON_H_
+
+/* the part of the SDK which the host built sources of the driver need */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef uint8_t     u8;
+typedef uint16_t    u16;
+typedef uint32_t    u32;
+
+#ifndef true
+#define true        1
+#define false       0
+#endif
+
+/* AES-128 of one block, aes_soft.c instead of the engine of the chip */
+void drv_aes_encrypt(u8 *key, u8 *plain, u8 *result);
+
+#endif /* TESTS_INCLUDE_TL_COMMON_H_ */
@@ -0,0 +1,184 @@
+#include "tl_common.h"
+
+#include "dlms_gcm.h"
+
+/* AES-GCM of dlms_gcm.c on the host against the published vectors. Any mismatch is the
+ * exit code 1, which stops the build */
+
+static int failed;
+
+static void check(const char *name, const uint8_t *calc, const uint8_t *expect, size_t len) {
+
+    if (memcmp(calc, expect, len) == 0) {
+        printf("ok      %s\n", name);
+        return;
+    }
+
+    failed++;
+    printf("FAILED  %s\n  got:    ", name);
+    for (size_t i = 0; i < len; i++) printf("%02x", calc[i]);
+    printf("\n  expect: ");
+    for (size_t i = 0; i < len; i++) printf("%02x", expect[i]);
+    printf("\n");
+}
+
+static void check_true(const char *name, int value) {
+
+    if (value) {
+        printf("ok      %s\n", name);
+    } else {
+        failed++;
+        printf("FAILED  %s\n", name);
+    }
+}
+
+/* FIPS-197 appendix C.1, the block cipher under the test */
+static void test_aes() {
+
+    uint8_t key[] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+    uint8_t plain[] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+    static const uint8_t cipher[] = {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+    uint8_t out[16];
+
+    drv_aes_encrypt(key, plain, out);
+    check("FIPS-197 AES-128", out, cipher, sizeof(cipher));
+}
+
+/* GCM spec test case 4: additional data and the text not a multiple of the block,
+ * the tag is cut to 96 bits. IV = 8 bytes of the title | 4 bytes of the counter */
+static void test_nist_tc4() {
+
+    static const uint8_t key[] = {0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c, 0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08};
+    static const uint8_t iv[] = {0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88};
+    static const uint8_t aad[] = {
+        0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef, 0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+        0xab, 0xad, 0xda, 0xd2
+    };
+    static const uint8_t plain[] = {
+        0xd9, 0x31, 0x32, 0x25, 0xf8, 0x84, 0x06, 0xe5, 0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a,
+        0x86, 0xa7, 0xa9, 0x53, 0x15, 0x34, 0xf7, 0xda, 0x2e, 0x4c, 0x30, 0x3d, 0x8a, 0x31, 0x8a, 0x72,
+        0x1c, 0x3c, 0x0c, 0x95, 0x95, 0x68, 0x09, 0x53, 0x2f, 0xcf, 0x0e, 0x24, 0x49, 0xa6, 0xb5, 0x25,
+        0xb1, 0x6a, 0xed, 0xf5, 0xaa, 0x0d, 0xe6, 0x57, 0xba, 0x63, 0x7b, 0x39
+    };
+    static const uint8_t cipher[] = {
+        0x42, 0x83, 0x1e, 0xc2, 0x21, 0x77, 0x74, 0x24, 0x4b, 0x72, 0x21, 0xb7, 0x84, 0xd0, 0xd4, 0x9c,
+        0xe3, 0xaa, 0x21, 0x2f, 0x2c, 0x02, 0xa4, 0xe0, 0x35, 0xc1, 0x7e, 0x23, 0x29, 0xac, 0xa1, 0x2e,
+        0x21, 0xd5, 0x14, 0xb2, 0x54, 0x66, 0x93, 0x1c, 0x7d, 0x8f, 0x6a, 0x5a, 0xac, 0x84, 0xaa, 0x05,
+        0x1b, 0xa3, 0x0b, 0x39, 0x6a, 0x0a, 0xac, 0x97, 0x3d, 0x58, 0xe0, 0x91
+    };
+    static const uint8_t tag[] = {0x5b, 0xc9, 0x4f, 0xbc, 0x32, 0x21, 0xa5, 0xdb, 0x94, 0xfa, 0xe9, 0x5a};
+    uint32_t ic = ((uint32_t)iv[8] << 24) | ((uint32_t)iv[9] << 16) | ((uint32_t)iv[10] << 8) | iv[11];
+    uint8_t text[sizeof(plain)];
+    uint8_t calc[DLMS_TAG_SIZE];
+    dlms_gcm_t gcm;
+
+    dlms_gcm_init(key, key);
+
+    memcpy(text, plain, sizeof(plain));
+    dlms_gcm_start(&gcm, iv, 0, ic);
+    dlms_gcm_aad(&gcm, aad, sizeof(aad));
+    dlms_gcm_encrypt(&gcm, text, sizeof(text));
+    dlms_gcm_tag(&gcm, calc);
+    check("GCM test case 4, encrypt", text, cipher, sizeof(cipher));
+    check("GCM test case 4, tag", calc, tag, sizeof(tag));
+}
+
+/* DLMS UA 1000-2 (Green Book), security suite 0: xDLMS InitiateRequest of the example */
+static const uint8_t gb_ek[] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+static const uint8_t gb_ak[] = {0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf};
+static const uint8_t gb_title[] = {0x4d, 0x4d, 0x4d, 0x00, 0x00, 0xbc, 0x61, 0x4e};
+static const uint32_t gb_ic = 0x01234567;
+static const uint8_t gb_plain[] = {
+    0x01, 0x01, 0x10, 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc,
+    0xdd, 0xee, 0xff, 0x00, 0x00, 0x06, 0x5f, 0x1f, 0x04, 0x00, 0x00, 0x7e, 0x1f, 0x04, 0xb0
+};
+static const uint8_t gb_cipher[] = {
+    0x80, 0x13, 0x02, 0xff, 0x8a, 0x78, 0x74, 0x13, 0x3d, 0x41, 0x4c, 0xed, 0x25, 0xb4, 0x25, 0x34,
+    0xd2, 0x8d, 0xb0, 0x04, 0x77, 0x20, 0x60, 0x6b, 0x17, 0x5b, 0xd5, 0x22, 0x11, 0xbe, 0x68
+};
+static const uint8_t gb_tag_encrypted[] = {0x41, 0xdb, 0x20, 0x4d, 0x39, 0xee, 0x6f, 0xdb, 0x8e, 0x35, 0x68, 0x55};
+static const uint8_t gb_tag_auth[] = {0xce, 0x0f, 0x5b, 0x42, 0x6a, 0xa5, 0x3e, 0x1f, 0xfb, 0x73, 0x6c, 0x1e};
+
+static void test_green_book_encrypt() {
+
+    uint8_t text[sizeof(gb_plain)];
+    uint8_t calc[DLMS_TAG_SIZE];
+    dlms_gcm_t gcm;
+
+    dlms_gcm_init(gb_ek, gb_ak);
+
+    memcpy(text, gb_plain, sizeof(gb_plain));
+    dlms_gcm_start(&gcm, gb_title, DLMS_SC_AUTH_ENCRYPT, gb_ic);
+    dlms_gcm_encrypt(&gcm, text, sizeof(text));
+    dlms_gcm_tag(&gcm, calc);
+    check("Green Book, authenticated encryption", text, gb_cipher, sizeof(gb_cipher));
+    check("Green Book, authenticated encryption tag", calc, gb_tag_encrypted, sizeof(gb_tag_encrypted));
+}
+
+/* in parts as the segments of the response, every split of the text */
+static void test_green_book_decrypt() {
+
+    uint8_t text[sizeof(gb_cipher)];
+    uint8_t tag[DLMS_TAG_SIZE];
+    uint8_t ok = true;
+    dlms_gcm_t gcm;
+
+    dlms_gcm_init(gb_ek, gb_ak);
+
+    for (size_t split = 0; split <= sizeof(gb_cipher); split++) {
+        memcpy(text, gb_cipher, sizeof(gb_cipher));
+        dlms_gcm_start(&gcm, gb_title, DLMS_SC_AUTH_ENCRYPT, gb_ic);
+        dlms_gcm_decrypt(&gcm, text, split);
+        dlms_gcm_decrypt(&gcm, text+split, sizeof(text)-split);
+        if (memcmp(text, gb_plain, sizeof(gb_plain)) || !dlms_gcm_check(&gcm, gb_tag_encrypted)) ok = false;
+    }
+    check_true("Green Book, decryption in two parts", ok);
+
+    /* the changed text or tag is not taken */
+    memcpy(text, gb_cipher, sizeof(gb_cipher));
+    text[5] ^= 0x01;
+    dlms_gcm_start(&gcm, gb_title, DLMS_SC_AUTH_ENCRYPT, gb_ic);
+    dlms_gcm_decrypt(&gcm, text, sizeof(text));
+    check_true("Green Book, changed text is rejected", !dlms_gcm_check(&gcm, gb_tag_encrypted));
+
+    memcpy(text, gb_cipher, sizeof(gb_cipher));
+    memcpy(tag, gb_tag_encrypted, DLMS_TAG_SIZE);
+    tag[DLMS_TAG_SIZE-1] ^= 0x80;
+    dlms_gcm_start(&gcm, gb_title, DLMS_SC_AUTH_ENCRYPT, gb_ic);
+    dlms_gcm_decrypt(&gcm, text, sizeof(text));
+    check_true("Green Book, changed tag is rejected", !dlms_gcm_check(&gcm, tag));
+}
+
+/* authentication only (GMAC): the text is additional data after SC | AK */
+static void test_green_book_gmac() {
+
+    uint8_t calc[DLMS_TAG_SIZE];
+    dlms_gcm_t gcm;
+
+    dlms_gcm_init(gb_ek, gb_ak);
+
+    dlms_gcm_start(&gcm, gb_title, DLMS_SC_AUTH, gb_ic);
+    dlms_gcm_aad(&gcm, gb_plain, sizeof(gb_plain));
+    dlms_gcm_tag(&gcm, calc);
+    check("Green Book, authentication only", calc, gb_tag_auth, sizeof(gb_tag_auth));
+
+    dlms_gcm_start(&gcm, gb_title, DLMS_SC_AUTH, gb_ic);
+    dlms_gcm_aad(&gcm, gb_plain, 9);
+    dlms_gcm_aad(&gcm, gb_plain+9, sizeof(gb_plain)-9);
+    check_true("Green Book, authentication only in two parts", dlms_gcm_check(&gcm, gb_tag_auth));
+}
+
+int main() {
+
+    test_aes();
+    test_nist_tc4();
+    test_green_book_encrypt();
+    test_green_book_decrypt();
+    test_green_book_gmac();
+
+    printf("dlms_gcm: %s\n", failed ? "FAILED" : "all passed");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,1613 @@
+#include "tl_common.h"
+#include "zcl_include.h"
+
+#include "app_uart.h"
+#include "app_endpoint_cfg.h"
+#include "app_dev_config.h"
+#include "app_utility.h"
+#include "device.h"
+
+/* nartis_i300.c and app_uart.c on the host against a model of the meter, in steps of 1 ms. The
+ * sources are included to replace the registers of the chip. The bytes go at 9600 baud, about
+ * 1 ms each, the rx dma ends a chunk on one ms of silence or when it is full. The meter keeps
+ * its HDLC link with windows, REJ and segmentation, answers GET, GET-with-list and GET-next with
+ * the registers, the instantaneous and the load profiles and its object_list. Frames are lost in
+ * both directions by a seeded generator, so every run is the same.
+ *
+ * A scenario runs the cycles and checks that they end well, that the values reported are those
+ * of a run without losses and that the link did what the scenario is about. The times printed
+ * are of the model, not of a real meter */
+
+/* the chip: 1 ms ticks, the irq flag, the registers the uart driver writes */
+static uint32_t now_ms;
+static uint8_t link_irq = true;
+static uint8_t link_rx_timeout1;
+
+#define clock_time()                link_clock_time()
+#define clock_time_exceed(ref, us)  ((uint32_t)(link_clock_time() - (ref)) > (us) * CLOCK_16M_SYS_TIMER_CLK_1US)
+#define irq_disable()               link_irq_disable()
+#define irq_restore(r)              link_irq_restore(r)
+#define uart_tx_is_busy()           link_tx_busy()
+#define dma_irq_disable(msk)        ((void)(msk))
+#undef reg_uart_rx_timeout1
+#define reg_uart_rx_timeout1        link_rx_timeout1
+
+static uint32_t link_clock_time() { return now_ms * CLOCK_16M_SYS_TIMER_CLK_1MS; }
+static uint8_t link_irq_disable() { uint8_t r = link_irq; link_irq = false; return r; }
+static void link_irq_restore(uint8_t r) { link_irq = r; }
+static uint8_t link_tx_busy();
+
+/* the app side of the driver */
+dev_config_t dev_config;
+load_profile_cfg_t load_profile_cfg;
+meter_cache_t meter_cache;
+security_cfg_t security_cfg;
+uint8_t new_start = true;
+pkt_error_t pkt_error_no;
+zcl_diagAttr_t g_zcl_diagAttrs[METER_MAX];
+uint8_t g_zcl_diagMeter;
+
+static m_password_t link_password = {8, "00000001"};
+static uint32_t nv_writes;
+static uint8_t cycle_done, cycle_ret;
+
+void write_load_profile_cfg() { nv_writes++; }
+void write_meter_cache() {}
+void write_security_cfg() {}
+void select_meter_cfg(uint8_t idx) {}
+uint32_t meter_address(uint8_t idx) { return 0; }
+m_password_t *meter_password(uint8_t idx) { return &link_password; }
+void measure_meter_complete(uint8_t ret) { cycle_done = true; cycle_ret = ret; }
+uint32_t poll_clock() { return now_ms / 1000; }
+void print_error(pkt_error_t err_no) {}
+void print_package(uint8_t *head, uint8_t *buff, size_t len) {}
+void app_forcedReport(uint8_t endpoint, uint16_t claster_id, uint16_t attr_id) {}
+uint32_t itoa(uint32_t value, uint8_t *ptr) { return 0; }
+bool zb_isDeviceJoinedNwk(void) { return true; }
+int tl_printf(const char *format, ...) { return 0; }
+void drv_generateRandomData(u8 *pData, u8 len) { memset(pData, 0x5a, len); }
+
+uint8_t set_zcl_str(uint8_t *str_in, uint8_t *str_out, uint8_t len) {
+
+    uint8_t n = strlen((char*)str_in);
+
+    if (n > len - 1) n = len - 1;
+    str_out[0] = n;
+    memcpy(str_out + 1, str_in, n);
+
+    return true;
+}
+
+/* the tasks and the software timers of the stack */
+#define TASKS_MAX       64
+#define TIMERS_MAX      16
+
+typedef struct {
+    tl_zb_callback_t    func;
+    void                *arg;
+} link_task_t;
+
+static link_task_t tasks[TASKS_MAX];
+static uint8_t task_head, task_tail;
+
+typedef struct {
+    uint8_t             used;
+    ev_timer_callback_t func;
+    void                *arg;
+    uint32_t            at;
+    ev_timer_event_t    evt;
+} link_timer_t;
+
+static link_timer_t timers[TIMERS_MAX];
+
+u8 tl_zbTaskPost(tl_zb_callback_t func, void *arg) {
+
+    tasks[task_head].func = func;
+    tasks[task_head].arg = arg;
+    task_head = (task_head + 1) % TASKS_MAX;
+
+    return 0;
+}
+
+ev_timer_event_t *ev_timer_taskPost(ev_timer_callback_t func, void *arg, u32 t_ms) {
+
+    for (uint8_t i = 0; i < TIMERS_MAX; i++) {
+        if (!timers[i].used) {
+            timers[i].used = true;
+            timers[i].func = func;
+            timers[i].arg = arg;
+            timers[i].at = now_ms + t_ms;
+            return &timers[i].evt;
+        }
+    }
+
+    return NULL;
+}
+
+u8 ev_timer_taskCancel(ev_timer_event_t **evt) {
+
+    for (uint8_t i = 0; i < TIMERS_MAX; i++) {
+        if (timers[i].used && &timers[i].evt == *evt) {
+            timers[i].used = false;
+            *evt = NULL;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* the sources under the test */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpointer-to-int-cast"
+#include "../src/app_uart.c"
+#include "../src/devices/nartis_i300.c"
+#pragma GCC diagnostic pop
+
+/* printf of the SDK goes to the uart of the chip or nowhere, <stdio.h> does not go with its types */
+#undef printf
+int printf(const char *format, ...);
+int sprintf(char *str, const char *format, ...);
+
+/* the reported values, the last one of every attribute */
+#define ATTRS_MAX       64
+#define ATTR_VALUE_MAX  64
+
+typedef struct {
+    uint16_t    cluster_id;
+    uint16_t    attr_id;
+    uint8_t     len;
+    uint8_t     value[ATTR_VALUE_MAX];
+} link_attr_t;
+
+static link_attr_t attrs[ATTRS_MAX];
+static uint8_t attrs_num;
+
+/* load profile entries as reported, the value of the entry is its number in the meter */
+static uint32_t lp_entries, lp_reports, lp_errors;
+static uint32_t lp_first, lp_last;
+
+static void lp_report(uint8_t *val) {
+
+    uint32_t number;
+
+    lp_reports++;
+
+    for (uint8_t i = 1; i + 8 <= val[0] + 1; i += 8) {
+        memcpy(&number, val + i + 4, 4);
+        if (!lp_first) lp_first = number;
+        if (lp_last && number != lp_last + 1) {
+            printf("  load profile entry %u after %u\n", number, lp_last);
+            lp_errors++;
+        }
+        lp_last = number;
+        lp_entries++;
+    }
+}
+
+/* the size of the attribute by its type, the strings have their length first */
+static uint8_t attr_size(uint16_t cluster_id, uint16_t attr_id, uint8_t *val) {
+
+    if (cluster_id == ZCL_CLUSTER_SE_METERING) {
+        switch (attr_id) {
+            case ZCL_ATTRID_METER_SERIAL_NUMBER:
+            case ZCL_ATTRID_CUSTOM_DATE_RELEASE:
+                return val[0] + 1;
+            case ZCL_ATTRID_REMAINING_BATTERY_LIFE:
+                return 1;
+            case ZCL_ATTRID_CUSTOM_PROFILE_TIME:
+            case ZCL_ATTRID_CUSTOM_PROFILE_ENERGY:
+                return 4;
+            case ZCL_ATTRID_CURRENT_SUMMATION_DELIVERD:
+            case ZCL_ATTRID_CURRENT_TIER_1_SUMMATION_DELIVERD:
+            case ZCL_ATTRID_CURRENT_TIER_2_SUMMATION_DELIVERD:
+            case ZCL_ATTRID_CURRENT_TIER_3_SUMMATION_DELIVERD:
+            case ZCL_ATTRID_CURRENT_TIER_4_SUMMATION_DELIVERD:
+                return 6;
+            default:
+                break;
+        }
+    }
+
+    return 2;
+}
+
+status_t app_setAttrVal(uint8_t endpoint, uint16_t clusterId, uint16_t attrId, uint8_t *val) {
+
+    link_attr_t *attr;
+    uint8_t i;
+
+    if (clusterId == ZCL_CLUSTER_SE_METERING && attrId == ZCL_ATTRID_CUSTOM_PROFILE_ENTRIES) {
+        lp_report(val);
+        return ZCL_STA_SUCCESS;
+    }
+
+    for (i = 0; i < attrs_num; i++) {
+        if (attrs[i].cluster_id == clusterId && attrs[i].attr_id == attrId) break;
+    }
+    if (i == ATTRS_MAX) return ZCL_STA_INSUFFICIENT_SPACE;
+    if (i == attrs_num) attrs_num++;
+
+    attr = &attrs[i];
+    attr->cluster_id = clusterId;
+    attr->attr_id = attrId;
+    attr->len = attr_size(clusterId, attrId, val);
+    if (attr->len > ATTR_VALUE_MAX) attr->len = ATTR_VALUE_MAX;
+    memcpy(attr->value, val, attr->len);
+
+    return ZCL_STA_SUCCESS;
+}
+
+/* seeded generator of the losses */
+static uint32_t link_seed;
+
+static uint32_t link_rand() {
+
+    link_seed = link_seed * 1103515245 + 12345;
+    return (link_seed >> 16) & 0x7fff;
+}
+
+static uint8_t drop_pct;                    /* frames lost in both directions, % */
+static uint16_t drop_every;                 /* and every n-th frame of them, 0 - none */
+static uint32_t drop_count;
+
+static uint8_t link_lost() {
+
+    if (drop_every && ++drop_count % drop_every == 0) return true;
+
+    return drop_pct && link_rand() % 100 < drop_pct;
+}
+
+/* wires, one byte a ms. The meter to the client goes to the rx dma, the client to the meter
+ * from the tx dma */
+#define WIRE_SIZE       8192
+
+typedef struct {
+    uint8_t     byte[WIRE_SIZE];
+    uint32_t    at[WIRE_SIZE];
+    uint16_t    head, tail;
+    uint32_t    free_at;
+} link_wire_t;
+
+static link_wire_t wire_rx, wire_tx;
+
+static void wire_put(link_wire_t *wire, uint8_t *data, size_t len, uint32_t delay) {
+
+    uint32_t t = now_ms + delay;
+
+    if (t < wire->free_at) t = wire->free_at;
+
+    for (size_t i = 0; i < len; i++) {
+        wire->byte[wire->head] = data[i];
+        wire->at[wire->head] = t + i + 1;
+        wire->head = (wire->head + 1) % WIRE_SIZE;
+    }
+
+    wire->free_at = t + len;
+}
+
+static uint8_t wire_get(link_wire_t *wire, uint8_t *byte) {
+
+    if (wire->tail == wire->head || wire->at[wire->tail] > now_ms) return false;
+
+    *byte = wire->byte[wire->tail];
+    wire->tail = (wire->tail + 1) % WIRE_SIZE;
+
+    return true;
+}
+
+/* rx dma of the chip, the irq on one ms of silence or on the full buffer */
+static uart_data_t *rx_dma;
+static uart_irq_callback rx_cb;
+static uint32_t rx_last;
+
+u8 drv_uart_init(u32 baudrate, u8 *rxBuf, u16 rxBufLen, uart_irq_callback uartRecvCb) {
+
+    rx_dma = (uart_data_t*)rxBuf;
+    rx_cb = uartRecvCb;
+
+    return 0;
+}
+
+void uart_recbuff_init(unsigned char *recAddr, unsigned short recBuffLen) {
+
+    rx_dma = (uart_data_t*)recAddr;
+}
+
+void drv_uart_pin_set(u32 txPin, u32 rxPin) {}
+void drv_gpio_input_en(u32 pin, bool enable) {}
+void sleep_us(unsigned long us) {}
+
+static void rx_dma_run() {
+
+    uint8_t byte;
+
+    while (wire_get(&wire_rx, &byte)) {
+        rx_dma->data[rx_dma->dma_len++] = byte;
+        rx_last = now_ms;
+        if (rx_dma->dma_len == UART_DATA_LEN) rx_cb();
+    }
+
+    if (rx_dma->dma_len && now_ms - rx_last >= 1) rx_cb();
+}
+
+/* tx dma of the chip and the hardware timer of the end of the chunk */
+unsigned char uart_dma_send(unsigned char *addr) {
+
+    uart_data_t *tx = (uart_data_t*)addr;
+
+    wire_put(&wire_tx, tx->data, tx->dma_len, 0);
+
+    return 1;
+}
+
+static uint8_t link_tx_busy() { return now_ms < wire_tx.free_at; }
+
+static timerCb_t hw_func;
+static uint32_t hw_at;
+static uint8_t hw_run;
+
+void drv_hwTmr_init(u8 tmrIdx, u8 mode) {}
+void drv_hwTmr_cancel(u8 tmrIdx) { hw_run = false; }
+
+hw_timer_sts_t drv_hwTmr_set(u8 tmrIdx, u32 t_us, timerCb_t func, void *arg) {
+
+    if (hw_run) return HW_TIMER_IS_RUNNING;
+
+    hw_func = func;
+    hw_at = now_ms + (t_us + 999) / 1000;
+    hw_run = true;
+
+    return HW_TIMER_SUCC;
+}
+
+static void hw_timer_run() {
+
+    int r;
+
+    if (!link_irq || !hw_run || now_ms < hw_at) return;
+
+    r = hw_func(NULL);
+    if (r < 0) {
+        hw_run = false;
+    } else {
+        hw_at = now_ms + (r + 999) / 1000;
+    }
+}
+
+/*
+ * The meter.
+ */
+#define MTR_LOWER       0x11
+#define MTR_UPPER       0x01
+#define MTR_CLIENT      0x20
+#define MTR_DM          0x1f        /* DM with the final bit */
+#define MTR_APDU_MAX    4096
+#define MTR_PENDING     4
+#define MTR_INFO_MAX    256
+
+typedef struct {
+    uint8_t     window;                     /* frames it sends before the poll, at most */
+    uint16_t    info;                       /* max info field it sends */
+    uint16_t    seg_info;                   /* info of the segments of a long APDU, 0 - the max */
+    uint16_t    block;                      /* datablocks of GET of that size, 0 - in one response */
+    uint16_t    proc;                       /* ms from the poll to the first byte of the answer */
+    uint32_t    inactivity;                 /* ms, the link is closed after */
+    uint8_t     no_list;                    /* no GET-with-list */
+    uint8_t     no_profile;                 /* no instantaneous profile */
+    uint8_t     no_object_list;             /* no object_list in the association */
+    uint32_t    lp_period;                  /* ms of the model per entry of the load profile */
+    uint32_t    lp_start;                   /* entries before the first ms */
+} mtr_cfg_t;
+
+static mtr_cfg_t mtr_cfg;
+
+/* the counters of the scenarios */
+typedef struct {
+    uint32_t    snrm;
+    uint32_t    disc;
+    uint32_t    dm;
+    uint32_t    rej_sent;                   /* out of sequence I-frames of the client */
+    uint32_t    rej_received;               /* the client has missed the frames of the meter */
+    uint32_t    resent;                     /* I-frames sent again */
+    uint32_t    gets;                       /* GET-Request, any */
+    uint32_t    get_next;                   /* GET-Request-next */
+    uint32_t    blocks;                     /* datablocks sent */
+    uint32_t    segments;                   /* I-frames with the segmentation bit */
+    uint32_t    object_list;                /* object_list asked */
+    uint32_t    unsupported;                /* the objects it has not, asked */
+    uint32_t    bytes;                      /* bytes on both wires */
+    uint32_t    lp_anchor;                  /* entries_in_use when it was asked first */
+} mtr_stat_t;
+
+static mtr_stat_t mtr_stat;
+
+/* link */
+static uint8_t mtr_link, mtr_vs, mtr_vr, mtr_assoc;
+static uint8_t mtr_window;
+static uint16_t mtr_info;
+static uint32_t mtr_last;
+
+/* the I-frames sent, by N(S), for REJ */
+typedef struct {
+    uint8_t     info[MTR_INFO_MAX];
+    uint16_t    len;
+    uint8_t     seg;
+} mtr_frame_t;
+
+static mtr_frame_t mtr_sent[8];
+
+/* the responses waiting for the poll, then sent in the segments of the window */
+static uint8_t mtr_pending[MTR_PENDING][MTR_APDU_MAX];
+static uint16_t mtr_pending_len[MTR_PENDING];
+static uint8_t mtr_pending_num;
+static uint16_t mtr_out_pos;                /* of the first pending response */
+
+/* the GET-Response in datablocks, by invoke-id */
+static uint8_t mtr_raw[16][MTR_APDU_MAX];
+static uint16_t mtr_raw_len[16], mtr_raw_pos[16];
+static uint32_t mtr_block_no[16];
+
+/* frame from the meter, with HCS if there is the information field */
+static void mtr_frame(uint8_t control, uint8_t *info, uint16_t len, uint8_t seg) {
+
+    uint8_t frame[MTR_INFO_MAX + 16];
+    uint16_t length = len ? len + 10 : 8, crc;
+    uint16_t n = 0;
+
+    frame[n++] = FLAG;
+    frame[n++] = (TYPE3 << 4) | (seg ? 0x08 : 0) | ((length >> 8) & 0x07);
+    frame[n++] = length & 0xff;
+    frame[n++] = (MTR_CLIENT << 1) | 1;
+    frame[n++] = MTR_UPPER << 1;
+    frame[n++] = (MTR_LOWER << 1) | 1;
+    frame[n++] = control;
+    if (len) {
+        crc = CRC_FINAL(crc_update(CRC_INIT, frame+1, n-1));
+        frame[n++] = crc & 0xff;
+        frame[n++] = crc >> 8;
+        memcpy(frame+n, info, len);
+        n += len;
+    }
+    crc = CRC_FINAL(crc_update(CRC_INIT, frame+1, n-1));
+    frame[n++] = crc & 0xff;
+    frame[n++] = crc >> 8;
+    frame[n++] = FLAG;
+
+    mtr_stat.bytes += n;
+    if (link_lost()) return;
+
+    wire_put(&wire_rx, frame, n, mtr_cfg.proc);
+}
+
+static void mtr_i_frame(uint8_t ns, uint8_t final) {
+
+    mtr_frame_t *f = &mtr_sent[ns];
+
+    if (f->seg) mtr_stat.segments++;
+    mtr_frame((mtr_vr << 5) | (ns << 1) | (final ? POLL_FINAL : 0), f->info, f->len, f->seg);
+}
+
+/* registers of the meter, data of the attribute or 0 if it has not the object */
+static const uint8_t mtr_columns[][7] = {
+    {8, 0, 0, 1, 0, 0, 255},
+    {3, 1, 0, 0x20, 7, 0, 255}, {3, 1, 0, 0x34, 7, 0, 255}, {3, 1, 0, 0x48, 7, 0, 255},
+    {3, 1, 0, 0x1f, 7, 0, 255}, {3, 1, 0, 0x33, 7, 0, 255}, {3, 1, 0, 0x47, 7, 0, 255}, {3, 1, 0, 0x5b, 7, 0, 255},
+    {3, 1, 0, 0x15, 7, 0, 255}, {3, 1, 0, 0x29, 7, 0, 255}, {3, 1, 0, 0x3d, 7, 0, 255},
+};
+
+#define MTR_COLUMNS     (sizeof(mtr_columns)/sizeof(mtr_columns[0]))
+
+/* the objects of the association, all but the neutral current */
+static const uint8_t mtr_objects[][7] = {
+    {1, 0, 0, 0x60, 1, 0, 255}, {1, 0, 0, 0x60, 1, 4, 255}, {1, 0, 0, 0x60, 1, 2, 255},
+    {7, 1, 0, 0x5e, 7, 0, 255}, {7, 1, 0, 0x63, 1, 0, 255}, {15, 0, 0, 0x28, 0, 0, 255}, {8, 0, 0, 1, 0, 0, 255},
+    {3, 1, 0, 0x20, 7, 0, 255}, {3, 1, 0, 0x34, 7, 0, 255}, {3, 1, 0, 0x48, 7, 0, 255},
+    {3, 1, 0, 0x1f, 7, 0, 255}, {3, 1, 0, 0x33, 7, 0, 255}, {3, 1, 0, 0x47, 7, 0, 255},
+    {3, 1, 0, 0x15, 7, 0, 255}, {3, 1, 0, 0x29, 7, 0, 255}, {3, 1, 0, 0x3d, 7, 0, 255},
+    {3, 1, 0, 1, 8, 1, 255}, {3, 1, 0, 1, 8, 2, 255}, {3, 1, 0, 1, 8, 3, 255}, {3, 1, 0, 1, 8, 4, 255},
+};
+
+#define MTR_OBJECTS     (sizeof(mtr_objects)/sizeof(mtr_objects[0]))
+
+/* load profile: entry k (from 1) is captured at LP_BASE + k * 30 min */
+#define LP_BASE         845424000u          /* 2026-10-16 00:00:00 in sec from 2000 */
+#define LP_PERIOD       1800
+
+static uint32_t mtr_lp_entries() {
+
+    return mtr_cfg.lp_start + now_ms / mtr_cfg.lp_period;
+}
+
+static uint16_t put_u32_be(uint8_t *out, uint32_t value) {
+
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+
+    return 4;
+}
+
+static uint32_t get_u32_be(uint8_t *in) {
+
+    return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+}
+
+static uint16_t mtr_lp_entry(uint32_t k, uint8_t *out) {
+
+    axdr_date_time_t date_time;
+    uint16_t n = 0;
+
+    axdr_sec_to_date_time(LP_BASE + k * LP_PERIOD, &date_time);
+    out[n++] = TYPE_STRUCTURE;
+    out[n++] = 2;
+    out[n++] = TYPE_OCTET_STRING;
+    out[n++] = AXDR_DATE_TIME_SIZE;
+    axdr_put_date_time(out+n, &date_time);
+    n += AXDR_DATE_TIME_SIZE;
+    out[n++] = TYPE_UNSIGNED_32;
+    n += put_u32_be(out+n, k);
+
+    return n;
+}
+
+/* entries_in_use or the buffer by entry (selector 2) or by range of the clock (selector 1) */
+static uint16_t mtr_load_profile(uint8_t *desc, uint8_t *out) {
+
+    uint32_t entries = mtr_lp_entries(), from = 1, to = 0, count, time;
+    axdr_date_time_t date_time;
+    axdr_t axdr;
+    uint16_t n = 0;
+    uint8_t *access = desc + 10;
+
+    if (desc[8] == 7) {
+        if (!mtr_stat.lp_anchor) mtr_stat.lp_anchor = entries;
+        out[n++] = TYPE_UNSIGNED_32;
+        return n + put_u32_be(out+n, entries);
+    }
+
+    if (desc[8] != 2 || desc[9] != 1) return 0;
+
+    if (access[0] == 2) {
+        from = get_u32_be(access + 4);
+        to = get_u32_be(access + 9);
+    } else if (access[0] == 1) {
+        /* selector, structure of 4, the restricting object of 18 bytes, then from */
+        axdr_init(&axdr, access + 21, 14);
+        if (!axdr_get_date_time(&axdr, &date_time) || !axdr_date_time_to_sec(&date_time, &time)) return 0;
+        from = time <= LP_BASE + LP_PERIOD ? 1 : (time - LP_BASE + LP_PERIOD - 1) / LP_PERIOD;
+    } else {
+        return 0;
+    }
+
+    if (to == 0 || to > entries) to = entries;
+    count = from <= to ? to - from + 1 : 0;
+
+    out[n++] = TYPE_ARRAY;
+    if (count > 127) {
+        out[n++] = 0x82;
+        out[n++] = count >> 8;
+    }
+    out[n++] = count;
+
+    for (uint32_t k = from; k <= to && n + 32 < MTR_APDU_MAX; k++) {
+        n += mtr_lp_entry(k, out+n);
+    }
+
+    return n;
+}
+
+static uint16_t mtr_data(uint8_t *desc, uint8_t *out);
+
+/* capture_objects and the last entry of the instantaneous profile */
+static uint16_t mtr_profile(uint8_t *desc, uint8_t *out) {
+
+    uint8_t column[10];
+    uint16_t n = 0, len;
+    uint32_t unsupported = mtr_stat.unsupported;
+
+    if (desc[4] == 0x63) return mtr_load_profile(desc, out);
+    if (mtr_cfg.no_profile) return 0;
+
+    if (desc[8] == 3) {
+        out[n++] = TYPE_ARRAY;
+        out[n++] = MTR_COLUMNS;
+        for (uint8_t i = 0; i < MTR_COLUMNS; i++) {
+            out[n++] = TYPE_STRUCTURE;
+            out[n++] = 4;
+            out[n++] = TYPE_UNSIGNED_16;
+            out[n++] = 0;
+            out[n++] = mtr_columns[i][0];
+            out[n++] = TYPE_OCTET_STRING;
+            out[n++] = 6;
+            memcpy(out+n, mtr_columns[i]+1, 6);
+            n += 6;
+            out[n++] = TYPE_INTEGER;
+            out[n++] = 2;
+            out[n++] = TYPE_UNSIGNED_16;
+            out[n++] = 0;
+            out[n++] = 0;
+        }
+        return n;
+    }
+
+    if (desc[8] == 2 && desc[9] == 1) {
+        out[n++] = TYPE_ARRAY;
+        out[n++] = 1;
+        out[n++] = TYPE_STRUCTURE;
+        out[n++] = MTR_COLUMNS;
+        for (uint8_t i = 0; i < MTR_COLUMNS; i++) {
+            column[0] = 0;
+            column[1] = mtr_columns[i][0];
+            memcpy(column+2, mtr_columns[i]+1, 6);
+            column[8] = 2;
+            column[9] = 0;
+            len = mtr_data(column, out+n);
+            if (len) {
+                n += len;
+            } else {
+                out[n++] = TYPE_NULL;
+            }
+        }
+        /* the empty column of the neutral current is not an ask */
+        mtr_stat.unsupported = unsupported;
+        return n;
+    }
+
+    return 0;
+}
+
+/* object_list with the long access rights of some entries */
+static uint16_t mtr_object_list(uint8_t *out) {
+
+    uint16_t n = 0, pad;
+
+    mtr_stat.object_list++;
+
+    out[n++] = TYPE_ARRAY;
+    out[n++] = MTR_OBJECTS;
+    for (uint8_t i = 0; i < MTR_OBJECTS; i++) {
+        pad = i % 7 == 3 ? 300 : 20;
+        out[n++] = TYPE_STRUCTURE;
+        out[n++] = 4;
+        out[n++] = TYPE_UNSIGNED_16;
+        out[n++] = 0;
+        out[n++] = mtr_objects[i][0];
+        out[n++] = TYPE_UNSIGNED;
+        out[n++] = 0;
+        out[n++] = TYPE_OCTET_STRING;
+        out[n++] = 6;
+        memcpy(out+n, mtr_objects[i]+1, 6);
+        n += 6;
+        out[n++] = TYPE_OCTET_STRING;
+        out[n++] = 0x82;
+        out[n++] = pad >> 8;
+        out[n++] = pad & 0xff;
+        memset(out+n, 0x55, pad);
+        n += pad;
+    }
+
+    return n;
+}
+
+/* the descriptor: class 2, obis 6, attribute 1, access flag 1 and the access selection */
+static uint16_t mtr_data(uint8_t *desc, uint8_t *out) {
+
+    static const uint8_t clock[] = {0x07, 0xea, 10, 17, 6, 12, 0, 0, 0xff, 0x80, 0x00, 0x00};
+    uint8_t class_id = desc[1], *obis = desc + 2;
+    uint16_t n = 0;
+
+    switch (class_id) {
+        case 1:
+            if (obis[2] != 0x60) return 0;
+            if (obis[4] == 0) {
+                out[n++] = TYPE_OCTET_STRING;
+                out[n++] = 7;
+                memcpy(out+n, "1234567", 7);
+                return n + 7;
+            }
+            if (obis[4] == 2) {
+                out[n++] = TYPE_VISIBLE_STRING;
+                out[n++] = 5;
+                memcpy(out+n, "1.2.3", 5);
+                return n + 5;
+            }
+            if (obis[4] == 4) {
+                out[n++] = TYPE_OCTET_STRING;
+                out[n++] = 4;
+                out[n++] = 15;
+                out[n++] = 6;
+                out[n++] = 0x20;
+                out[n++] = 0x21;
+                return n;
+            }
+            return 0;
+        case 3:
+            if (obis[2] == 0x5b) {
+                mtr_stat.unsupported++;
+                return 0;
+            }
+            if (desc[8] == 3) {
+                /* scaler_unit: voltage 0.1 V, current mA, power W, energy Wh */
+                out[n++] = TYPE_STRUCTURE;
+                out[n++] = 2;
+                out[n++] = TYPE_INTEGER;
+                out[n++] = obis[3] == 8 ? 0 : (obis[2] == 0x20 || obis[2] == 0x34 || obis[2] == 0x48) ? 0xff :
+                           obis[2] % 20 == 11 ? 0xfd : 0;
+                out[n++] = TYPE_ENUM;
+                out[n++] = obis[3] == 8 ? 30 : (obis[2] == 0x20 || obis[2] == 0x34 || obis[2] == 0x48) ? 35 :
+                           obis[2] % 20 == 11 ? 33 : 27;
+                return n;
+            }
+            if (obis[3] == 8) {
+                out[n++] = TYPE_UNSIGNED_64;
+                memset(out+n, 0, 8);
+                out[n+7] = 0x10 + obis[4];
+                return n + 8;
+            }
+            if (obis[2] == 0x20 || obis[2] == 0x34 || obis[2] == 0x48) {
+                out[n++] = TYPE_UNSIGNED_16;
+                out[n++] = 0x08;
+                out[n++] = 0xfc + (obis[2] >> 4);
+                return n;
+            }
+            out[n++] = TYPE_SIGNED_32;
+            return n + put_u32_be(out+n, 0x0123 + obis[2]);
+        case 7:
+            return mtr_profile(desc, out);
+        case 8:
+            out[n++] = TYPE_OCTET_STRING;
+            out[n++] = sizeof(clock);
+            memcpy(out+n, clock, sizeof(clock));
+            return n + sizeof(clock);
+        case 15:
+            if (!mtr_cfg.no_object_list) return mtr_object_list(out);
+            mtr_stat.object_list++;
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+/* the length of the descriptor with its access selection */
+static uint16_t mtr_desc_len(uint8_t *desc) {
+
+    axdr_t axdr;
+
+    if (!desc[9]) return 10;
+
+    axdr_init(&axdr, desc + 11, 64);
+    axdr_skip(&axdr);
+
+    return 11 + (axdr.ptr - (desc + 11));
+}
+
+static uint16_t mtr_result(uint8_t *desc, uint8_t *out) {
+
+    uint16_t len = mtr_data(desc, out + 1);
+
+    if (!len) {
+        out[0] = 1;                         /* data-access-result */
+        out[1] = 4;                         /* object-undefined */
+        return 2;
+    }
+
+    out[0] = 0;
+    return len + 1;
+}
+
+/* the next datablock of the response of the invoke-id */
+static uint16_t mtr_block(uint8_t invoke, uint8_t *out) {
+
+    uint8_t id = invoke & 0x0f;
+    uint16_t n = 0, len = mtr_raw_len[id] - mtr_raw_pos[id];
+
+    if (len > mtr_cfg.block) len = mtr_cfg.block;
+
+    out[n++] = GET_RESPONSE;
+    out[n++] = 0x02;
+    out[n++] = invoke;
+    out[n++] = mtr_raw_pos[id] + len >= mtr_raw_len[id];
+    n += put_u32_be(out+n, ++mtr_block_no[id]);
+    out[n++] = 0;
+    if (len > 255) {
+        out[n++] = 0x82;
+        out[n++] = len >> 8;
+    } else if (len > 127) {
+        out[n++] = 0x81;
+    }
+    out[n++] = len & 0xff;
+    memcpy(out+n, mtr_raw[id] + mtr_raw_pos[id], len);
+    mtr_raw_pos[id] += len;
+
+    mtr_stat.blocks++;
+
+    return n + len;
+}
+
+/* APDU of the client, the response waits for the poll */
+static void mtr_apdu(uint8_t *apdu, uint16_t len) {
+
+    static const uint8_t aare[] = {
+        0x61, 0x29, 0xa1, 0x09, 0x06, 0x07, 0x60, 0x85, 0x74, 0x05, 0x08, 0x01, 0x01, 0xa2, 0x03, 0x02,
+        0x01, 0x00, 0xa3, 0x05, 0xa1, 0x03, 0x02, 0x01, 0x00, 0xbe, 0x10, 0x04, 0x0e, 0x08, 0x00, 0x06,
+        0x5f, 0x1f, 0x04, 0x00, 0x00, 0x10, 0x1d, 0x00, 0x80, 0x00, 0x07};
+    uint8_t *r, invoke = apdu[2];
+    uint16_t n = 0, offset, head;
+
+    if (mtr_pending_num == MTR_PENDING) return;
+
+    r = mtr_pending[mtr_pending_num];
+    r[n++] = LSAP;
+    r[n++] = RESP_LSAP;
+    r[n++] = 0;
+
+    if (apdu[0] == AARQ) {
+        memcpy(r+n, aare, sizeof(aare));
+        n += sizeof(aare);
+        mtr_assoc = true;
+    } else if (apdu[0] != GET_REQUEST || !mtr_assoc || (apdu[1] == 0x03 && mtr_cfg.no_list)) {
+        r[n++] = 0xd8;                      /* exception-response */
+        r[n++] = 1;
+        r[n++] = 1;
+    } else if (apdu[1] == 0x02) {
+        mtr_stat.gets++;
+        mtr_stat.get_next++;
+        if (get_u32_be(apdu + 3) != mtr_block_no[invoke & 0x0f]) {
+            r[n++] = 0xd8;
+            r[n++] = 1;
+            r[n++] = 1;
+        } else {
+            n += mtr_block(invoke, r+n);
+        }
+    } else {
+        mtr_stat.gets++;
+        head = n;
+        r[n++] = GET_RESPONSE;
+        r[n++] = apdu[1];
+        r[n++] = invoke;
+        if (apdu[1] == 0x01) {
+            n += mtr_result(apdu + 3, r+n);
+        } else {
+            r[n++] = apdu[3];
+            offset = 4;
+            for (uint8_t i = 0; i < apdu[3] && offset < len; i++) {
+                n += mtr_result(apdu + offset, r+n);
+                offset += mtr_desc_len(apdu + offset);
+            }
+        }
+        /* the result goes as raw-data in the blocks, GET normal without its choice of data */
+        if (mtr_cfg.block && (apdu[1] == 0x03 || r[head+3] == 0)) {
+            offset = head + (apdu[1] == 0x01 ? 4 : 3);
+            mtr_raw_len[invoke & 0x0f] = n - offset;
+            memcpy(mtr_raw[invoke & 0x0f], r + offset, n - offset);
+            mtr_raw_pos[invoke & 0x0f] = 0;
+            mtr_block_no[invoke & 0x0f] = 0;
+            n = head + mtr_block(invoke, r + head);
+        }
+    }
+
+    mtr_pending_len[mtr_pending_num++] = n;
+}
+
+/* answers the poll: the pending responses in up to a window of frames, or RR */
+static void mtr_answer() {
+
+    mtr_frame_t *f;
+    uint16_t len, max_info = mtr_cfg.seg_info ? mtr_cfg.seg_info : mtr_info;
+    uint8_t frames = 0, last;
+
+    if (!mtr_pending_num) {
+        mtr_frame((mtr_vr << 5) | POLL_FINAL | RR, NULL, 0, false);
+        return;
+    }
+
+    while (mtr_pending_num && frames < mtr_window) {
+        len = mtr_pending_len[0] - mtr_out_pos;
+        f = &mtr_sent[mtr_vs];
+        f->seg = len > max_info;
+        if (f->seg) len = max_info;
+        f->len = len;
+        memcpy(f->info, mtr_pending[0] + mtr_out_pos, len);
+        mtr_out_pos += len;
+        if (mtr_out_pos == mtr_pending_len[0]) {
+            mtr_pending_num--;
+            memmove(mtr_pending[0], mtr_pending[1], sizeof(mtr_pending[0]) * mtr_pending_num);
+            memmove(mtr_pending_len, mtr_pending_len+1, sizeof(mtr_pending_len[0]) * mtr_pending_num);
+            mtr_out_pos = 0;
+        }
+        frames++;
+        last = !mtr_pending_num || frames == mtr_window;
+        mtr_i_frame(mtr_vs, last);
+        mtr_vs = (mtr_vs + 1) & 0x07;
+    }
+}
+
+/* the frames after N(R) of the client again, the last one with the final bit */
+static void mtr_resend(uint8_t nr) {
+
+    for (uint8_t ns = nr; ns != mtr_vs; ns = (ns + 1) & 0x07) {
+        mtr_stat.resent++;
+        mtr_i_frame(ns, ((ns + 1) & 0x07) == mtr_vs);
+    }
+}
+
+/* UA with the parameters of the link, the smaller of the meter and of the client */
+static void mtr_snrm(uint8_t *info, uint16_t len) {
+
+    uint8_t ua[23], n = 0;
+    uint32_t value;
+
+    mtr_window = mtr_cfg.window;
+    mtr_info = mtr_cfg.info;
+
+    for (uint16_t i = 3; i + 2 <= len; i += 2 + info[i+1]) {
+        value = 0;
+        for (uint8_t k = 0; k < info[i+1]; k++) value = (value << 8) | info[i+2+k];
+        if (info[i] == HDLC_MAX_INFO_RX && value < mtr_info) mtr_info = value;
+        if (info[i] == HDLC_WINDOW_RX && value < mtr_window) mtr_window = value;
+    }
+
+    ua[n++] = HDLC_FORMAT_ID;
+    ua[n++] = HDLC_GROUP_ID;
+    ua[n++] = 20;
+    ua[n++] = HDLC_MAX_INFO_TX;
+    ua[n++] = 2;
+    ua[n++] = mtr_info >> 8;
+    ua[n++] = mtr_info & 0xff;
+    ua[n++] = HDLC_MAX_INFO_RX;
+    ua[n++] = 2;
+    ua[n++] = mtr_cfg.info >> 8;
+    ua[n++] = mtr_cfg.info & 0xff;
+    ua[n++] = HDLC_WINDOW_TX;
+    ua[n++] = 4;
+    n += put_u32_be(ua+n, mtr_window);
+    ua[n++] = HDLC_WINDOW_RX;
+    ua[n++] = 4;
+    n += put_u32_be(ua+n, mtr_cfg.window);
+
+    mtr_link = true;
+    mtr_vs = mtr_vr = 0;
+    mtr_assoc = false;
+    mtr_pending_num = 0;
+    mtr_out_pos = 0;
+
+    mtr_frame(UA, ua, n, false);
+}
+
+/* the whole frame of the client */
+static void mtr_receive(uint8_t *frame, uint16_t len) {
+
+    uint16_t length = ((frame[1] & 0x07) << 8) | frame[2];
+    uint8_t control = frame[6], *info = frame + 9;
+    uint16_t info_len = length > 8 ? length - 10 : 0;
+    uint8_t nr = (control >> 5) & 0x07, ns = (control >> 1) & 0x07;
+
+    mtr_stat.bytes += len;
+    if (link_lost()) return;
+
+    if (CRC_FINAL(crc_update(CRC_INIT, frame+1, length-2)) != (frame[length-1] | (frame[length] << 8))) return;
+
+    if (mtr_link && now_ms - mtr_last > mtr_cfg.inactivity) mtr_link = false;
+    mtr_last = now_ms;
+
+    if (control == (SNRM | POLL_FINAL)) {
+        mtr_stat.snrm++;
+        mtr_snrm(info, info_len);
+        return;
+    }
+
+    if (!mtr_link) {
+        mtr_stat.dm++;
+        if (control & POLL_FINAL) mtr_frame(MTR_DM, NULL, 0, false);
+        return;
+    }
+
+    if (control == (DISC | POLL_FINAL)) {
+        mtr_stat.disc++;
+        mtr_link = false;
+        mtr_frame(UA | POLL_FINAL, NULL, 0, false);
+        return;
+    }
+
+    if ((control & 0x01) == 0) {
+        if (ns != mtr_vr) {
+            /* one of the window is lost, the client repeats from V(R) */
+            if (control & POLL_FINAL) {
+                mtr_stat.rej_sent++;
+                mtr_frame((mtr_vr << 5) | POLL_FINAL | REJ, NULL, 0, false);
+            }
+            return;
+        }
+        mtr_vr = (mtr_vr + 1) & 0x07;
+        mtr_apdu(info + 3, info_len - 3);
+        if (!(control & POLL_FINAL)) return;
+        if (nr != mtr_vs) {
+            mtr_resend(nr);
+            return;
+        }
+        mtr_answer();
+        return;
+    }
+
+    if ((control & 0x03) == 0x01 && (control & POLL_FINAL)) {
+        if ((control & S_FRAME_MASK) == REJ) mtr_stat.rej_received++;
+        if (nr != mtr_vs) {
+            mtr_resend(nr);
+            return;
+        }
+        mtr_answer();
+    }
+}
+
+/* the meter takes a frame when its closing flag is in */
+static uint8_t mtr_rx[MTR_INFO_MAX + 16];
+static uint16_t mtr_rx_len;
+
+static void mtr_run() {
+
+    uint8_t byte;
+
+    while (wire_get(&wire_tx, &byte)) {
+        if (mtr_rx_len == 0 && byte != FLAG) continue;
+        if (mtr_rx_len == 1 && byte == FLAG) continue;
+        mtr_rx[mtr_rx_len++] = byte;
+        if (mtr_rx_len >= 3 && mtr_rx_len == (((mtr_rx[1] & 0x07) << 8) | mtr_rx[2]) + 2) {
+            mtr_receive(mtr_rx, mtr_rx_len);
+            mtr_rx_len = 0;
+        }
+        if (mtr_rx_len == sizeof(mtr_rx)) mtr_rx_len = 0;
+    }
+}
+
+/* the main loop of the app and the time, until the cycle is done or up to the time */
+static void link_loop(uint32_t until) {
+
+    link_task_t task;
+    int32_t r;
+    uint8_t fired;
+
+    while (until ? now_ms < until : !cycle_done) {
+        if (task_tail != task_head) {
+            task = tasks[task_tail];
+            task_tail = (task_tail + 1) % TASKS_MAX;
+            task.func(task.arg);
+            continue;
+        }
+
+        rx_dma_run();
+        hw_timer_run();
+        mtr_run();
+        app_uart_handler();
+        if (task_tail != task_head) continue;
+
+        fired = false;
+        for (uint8_t i = 0; i < TIMERS_MAX && !fired; i++) {
+            if (timers[i].used && timers[i].at <= now_ms) {
+                timers[i].used = false;
+                r = timers[i].func(timers[i].arg);
+                if (r >= 0) {
+                    timers[i].used = true;
+                    timers[i].at = now_ms + r;
+                }
+                fired = true;
+            }
+        }
+        if (fired) continue;
+
+        now_ms++;
+
+        if (!until && now_ms > 1000000000) {
+            printf("  the cycle does not end\n");
+            cycle_done = true;
+            cycle_ret = false;
+        }
+    }
+}
+
+/* meter of the scenario */
+static const mtr_cfg_t mtr_default = {
+    .window = 1,
+    .info = 128,
+    .proc = 30,
+    .inactivity = 120000,
+    .lp_period = 2000,
+};
+
+/* the result of the run of a scenario */
+typedef struct {
+    uint16_t    cycles;
+    uint16_t    ok;
+    uint32_t    ms;                         /* of all cycles */
+} link_result_t;
+
+/* the driver after reset with the stored settings, the meter after power on */
+static void link_reset(const mtr_cfg_t *cfg, uint8_t drop, uint16_t every, uint32_t seed) {
+
+    /* the cycle of the previous scenario is over, its keep-alive is cancelled */
+    nartis_i300_init();
+
+    memset(timers, 0, sizeof(timers));
+    task_head = task_tail = 0;
+
+    memset(&dev_config, 0, sizeof(dev_config));
+    for (uint8_t poll = 0; poll < POLL_CLASS_MAX; poll++) dev_config.poll_period[poll] = 10;
+    dev_config.profile_depth = 48;
+
+    memset(&load_profile_cfg, 0, sizeof(load_profile_cfg));
+    memset(&meter_cache, 0, sizeof(meter_cache));
+    memset(&security_cfg, 0, sizeof(security_cfg));
+    memset(g_zcl_diagAttrs, 0, sizeof(g_zcl_diagAttrs));
+    new_start = true;
+
+    attrs_num = 0;
+    lp_entries = lp_reports = lp_errors = lp_first = lp_last = 0;
+    nv_writes = 0;
+
+    mtr_cfg = *cfg;
+    memset(&mtr_stat, 0, sizeof(mtr_stat));
+    mtr_link = false;
+    mtr_rx_len = 0;
+    wire_rx.tail = wire_rx.head;
+    wire_tx.tail = wire_tx.head;
+
+    /* the load profile of the meter counts from now */
+    now_ms = 0;
+    wire_rx.free_at = wire_tx.free_at = 0;
+    hw_run = false;
+
+    drop_pct = drop;
+    drop_every = every;
+    drop_count = 0;
+    link_seed = seed;
+
+    app_uart_init(9600);
+    nartis_i300_init();
+}
+
+static void link_run(link_result_t *result, uint16_t cycles, uint32_t gap) {
+
+    uint32_t start;
+
+    result->cycles = cycles;
+    result->ok = 0;
+    result->ms = 0;
+
+    for (uint16_t i = 0; i < cycles; i++) {
+        start = now_ms;
+        cycle_done = false;
+        if (!measure_meter_nartis_i300(0, POLL_BIT(POLL_POWER) | POLL_BIT(POLL_VOLTAGE) | POLL_BIT(POLL_TARIFF))) {
+            printf("  cycle %d is not started\n", i);
+            continue;
+        }
+        link_loop(0);
+        result->ms += now_ms - start;
+        if (cycle_ret) result->ok++;
+        link_loop(now_ms + gap);
+    }
+}
+
+/* the values of the run against those of the reference, the load profile aside */
+static link_attr_t attrs_ref[ATTRS_MAX];
+static uint8_t attrs_ref_num;
+
+static void attrs_keep() {
+
+    memcpy(attrs_ref, attrs, sizeof(attrs));
+    attrs_ref_num = attrs_num;
+}
+
+static int attrs_check() {
+
+    int failed = 0;
+    uint8_t i, k;
+
+    for (i = 0; i < attrs_ref_num; i++) {
+        if (attrs_ref[i].attr_id == ZCL_ATTRID_CUSTOM_PROFILE_TIME || attrs_ref[i].attr_id == ZCL_ATTRID_CUSTOM_PROFILE_ENERGY) continue;
+        for (k = 0; k < attrs_num; k++) {
+            if (attrs[k].cluster_id == attrs_ref[i].cluster_id && attrs[k].attr_id == attrs_ref[i].attr_id) break;
+        }
+        if (k == attrs_num || attrs[k].len != attrs_ref[i].len || memcmp(attrs[k].value, attrs_ref[i].value, attrs[k].len)) {
+            printf("  attribute 0x%04x/0x%04x differs\n", attrs_ref[i].cluster_id, attrs_ref[i].attr_id);
+            failed++;
+        }
+    }
+
+    return failed;
+}
+
+static int link_report(const char *name, link_result_t *result, int failed) {
+
+    printf("%s  %-42s %3d/%-3d cycles, avg %5u ms, snrm %u, get %u, rej %u/%u, resent %u, blocks %u, segments %u\n",
+           failed ? "FAILED" : "passed", name, result->ok, result->cycles, result->ms / (result->cycles ? result->cycles : 1),
+           mtr_stat.snrm, mtr_stat.gets, mtr_stat.rej_sent, mtr_stat.rej_received, mtr_stat.resent, mtr_stat.blocks,
+           mtr_stat.segments);
+
+    return failed ? 1 : 0;
+}
+
+/* one frame in the window, no losses. The values of the other scenarios are checked against these */
+static int test_reference() {
+
+    link_result_t result;
+    int failed = 0;
+
+    link_reset(&mtr_default, 0, 0, 1);
+    link_run(&result, 10, 1000);
+
+    failed += result.ok != result.cycles;
+    failed += attrs_num < 20;
+    failed += lp_entries == 0 || lp_errors != 0;
+
+    attrs_keep();
+
+    return link_report("reference", &result, failed);
+}
+
+/* the same meter without GET-with-list, with one frame in the window and with two, no losses.
+ * Two requests go back to back and the answers come in one window */
+static int test_window() {
+
+    mtr_cfg_t cfg = mtr_default;
+    link_result_t result;
+    uint32_t single;
+    int failed = 0;
+
+    cfg.info = MAX_INFO_FIELD;
+    cfg.no_list = true;
+
+    link_reset(&cfg, 0, 0, 2);
+    link_run(&result, 20, 1000);
+    failed += link_report("window 1, single GETs", &result, result.ok != result.cycles || attrs_check());
+    single = result.ms;
+
+    cfg.window = 7;
+
+    link_reset(&cfg, 0, 0, 2);
+    link_run(&result, 20, 1000);
+    failed += link_report("window 2, single GETs", &result, result.ok != result.cycles || attrs_check() || result.ms >= single);
+
+    return failed;
+}
+
+/* windows of two frames both ways and losses. The client asks the missed frames of the meter
+ * with REJ and repeats its own on REJ of the meter or on the timeout. A cycle may fail only when
+ * a frame is lost more times in a row than the session retries */
+static int test_window_loss(uint8_t drop, uint16_t every, uint16_t cycles, uint16_t min_ok) {
+
+    mtr_cfg_t cfg = mtr_default;
+    link_result_t result;
+    char name[64];
+    int failed = 0;
+
+    cfg.window = 7;
+    cfg.info = MAX_INFO_FIELD;
+
+    link_reset(&cfg, drop, every, 2);
+    link_run(&result, cycles, 1000);
+
+    failed += result.ok < min_ok;
+    failed += attrs_check();
+    failed += lp_errors != 0;
+    if (every) {
+        /* both sides have missed the frames of the other one and got them again */
+        failed += mtr_stat.rej_sent == 0 || mtr_stat.rej_received == 0 || mtr_stat.resent == 0;
+    }
+    if (drop || every) failed += g_zcl_diagAttrs[0].retries == 0 || mtr_stat.resent == 0;
+
+    if (every) {
+        sprintf(name, "window 2, every %d-th lost", every);
+    } else {
+        sprintf(name, "window 2, %d%% lost", drop);
+    }
+
+    return link_report(name, &result, failed);
+}
+
+/* GET-Response-with-datablock of the given size, the blocks cut the values anywhere. With seg_info
+ * the blocks are segmented too, the decoder keeps its place across both */
+static int test_datablocks(uint16_t block, uint16_t seg_info, uint8_t window, uint8_t drop, uint16_t cycles, uint16_t min_ok) {
+
+    mtr_cfg_t cfg = mtr_default;
+    link_result_t result;
+    char name[64];
+    int failed = 0;
+
+    cfg.block = block;
+    cfg.seg_info = seg_info;
+    cfg.window = window;
+
+    link_reset(&cfg, drop, 0, 3);
+    link_run(&result, cycles, 1000);
+
+    failed += result.ok < min_ok;
+    failed += attrs_check();
+    failed += lp_entries == 0 || lp_errors != 0;
+    failed += mtr_stat.blocks == 0 || mtr_stat.get_next == 0;
+    failed += seg_info && mtr_stat.segments == 0;
+
+    sprintf(name, "blocks of %d%s, window %d, %d%% lost", block, seg_info ? " segmented" : "", window, drop);
+
+    return link_report(name, &result, failed);
+}
+
+/* the meter without the instantaneous profile and with it. The buffer takes the place of the
+ * covered registers and must give the same values, without GET-with-list in fewer requests */
+static int test_profile(uint8_t no_list) {
+
+    mtr_cfg_t cfg = mtr_default;
+    link_result_t result;
+    uint32_t gets;
+    char name[64];
+    int failed = 0;
+
+    cfg.no_list = no_list;
+    cfg.no_profile = true;
+
+    link_reset(&cfg, 0, 0, 4);
+    link_run(&result, 20, 1000);
+    sprintf(name, "no profile%s", no_list ? ", single GETs" : "");
+    failed += link_report(name, &result, result.ok != result.cycles || attrs_check());
+    gets = mtr_stat.gets;
+
+    cfg.no_profile = false;
+
+    link_reset(&cfg, 0, 0, 4);
+    link_run(&result, 20, 1000);
+    sprintf(name, "profile buffer%s", no_list ? ", single GETs" : "");
+    failed += link_report(name, &result, result.ok != result.cycles || attrs_check() || (no_list && mtr_stat.gets >= gets));
+
+    return failed;
+}
+
+/* the load profile has a history before the first connect and a new entry every 2 s. The first
+ * reported entry is the depth back from the last one, then every entry is reported once and in
+ * order, a report per cycle at most. The stored position is the last entry reported. After the
+ * reset of the device only that position is left, the next cycles go on from it */
+static int test_load_profile(uint8_t drop, uint16_t block, uint16_t cycles) {
+
+    mtr_cfg_t cfg = mtr_default;
+    link_result_t result, before;
+    uint32_t entries, reports;
+    char name[64];
+    int failed = 0;
+
+    cfg.block = block;
+    cfg.lp_start = 100;
+
+    link_reset(&cfg, drop, 0, 5);
+    link_run(&before, cycles, 1000);
+    reports = lp_reports;
+
+    /* the reset, the NV items stay */
+    new_start = true;
+    nartis_i300_init();
+    link_loop(now_ms + 5000);
+
+    link_run(&result, cycles / 4, 1000);
+    entries = mtr_lp_entries();
+
+    result.cycles += before.cycles;
+    result.ok += before.ok;
+    result.ms += before.ms;
+
+    failed += result.ok < result.cycles - result.cycles / 50;
+    failed += lp_first != mtr_stat.lp_anchor - dev_config.profile_depth + 1;
+    failed += lp_errors != 0;
+    failed += lp_entries != lp_last - lp_first + 1;
+    failed += lp_last + 1 < entries;
+    failed += load_profile_cfg.entry_time != LP_BASE + lp_last * LP_PERIOD;
+    failed += memcmp(load_profile_cfg.serial_number, "\x07" "1234567", 8) != 0;
+    failed += nv_writes > lp_reports || reports == lp_reports;
+
+    sprintf(name, "load profile, blocks of %d, %d%% lost", block, drop);
+    failed = link_report(name, &result, failed);
+    printf("        entries %u..%u of %u in %u reports, %u nv writes\n", lp_first, lp_last, entries, lp_reports, nv_writes);
+
+    return failed;
+}
+
+/* the meter has all objects of the plan but the neutral current. The object_list is read once on
+ * the first connect, then the neutral current is not asked any more, its scaler_unit neither. The
+ * same bitmap comes with the list in datablocks, with losses and without GET-with-list */
+static int test_object_list(uint16_t block, uint8_t drop, uint8_t no_list) {
+
+    mtr_cfg_t cfg = mtr_default;
+    link_result_t result, first;
+    uint32_t supported = 0, unsupported;
+    char name[64];
+    int failed = 0;
+
+    for (uint8_t i = 0; i < OBIS_PLAN_NUM; i++) {
+        if (obis_plan[i].attr_id != ZCL_ATTRID_NEUTRAL_CURRENT) supported |= 1UL << i;
+    }
+
+    cfg.block = block;
+    cfg.no_list = no_list;
+
+    link_reset(&cfg, drop, 0, 6);
+    link_run(&first, 3, 1000);
+    unsupported = mtr_stat.unsupported;
+    link_run(&result, 20, 1000);
+
+    failed += first.ok + result.ok < first.cycles + result.cycles - (drop ? 1 : 0);
+    failed += !meter_cache.discovered || meter_cache.supported != supported;
+    failed += mtr_stat.object_list != 1 && !drop;
+    failed += mtr_stat.unsupported != unsupported;
+    failed += attrs_check();
+
+    sprintf(name, "object_list, blocks of %d, %d%% lost%s", block, drop, no_list ? ", single GETs" : "");
+    failed = link_report(name, &result, failed);
+    printf("        object_list read %u, neutral current asked %u, supported 0x%x\n",
+           mtr_stat.object_list, mtr_stat.unsupported, meter_cache.supported);
+
+    return failed;
+}
+
+/* the meter without object_list, everything is asked as before. The refused list is asked once
+ * in the GET-with-list and once more alone, then never again */
+static int test_no_object_list() {
+
+    mtr_cfg_t cfg = mtr_default;
+    link_result_t result, first;
+    uint32_t unsupported;
+    int failed = 0;
+
+    cfg.no_object_list = true;
+
+    link_reset(&cfg, 0, 0, 6);
+    link_run(&first, 3, 1000);
+    unsupported = mtr_stat.unsupported;
+    link_run(&result, 20, 1000);
+
+    failed += first.ok + result.ok != first.cycles + result.cycles;
+    failed += !meter_cache.discovered || (meter_cache.supported & ((1UL << OBIS_PLAN_NUM) - 1)) != (1UL << OBIS_PLAN_NUM) - 1;
+    failed += mtr_stat.object_list != 2;
+    failed += attrs_check();
+
+    failed = link_report("no object_list", &result, failed);
+    printf("        object_list asked %u, neutral current asked %u\n", mtr_stat.object_list, mtr_stat.unsupported - unsupported);
+
+    return failed;
+}
+
+/* a meter which answers in about a second. The first exchanges may time out on the default
+ * timeout, then the learned one fits the meter and the cycles go without timeouts */
+static int test_slow_meter(uint16_t proc) {
+
+    mtr_cfg_t cfg = mtr_default;
+    link_result_t result, first;
+    uint16_t timeouts;
+    char name[64];
+    int failed = 0;
+
+    cfg.proc = proc;
+
+    link_reset(&cfg, 0, 0, 7);
+    link_run(&first, 3, 1000);
+    timeouts = g_zcl_diagAttrs[0].pkt_errors[PKT_ERR_TIMEOUT];
+    link_run(&result, 20, 1000);
+
+    failed += first.ok + 1 < first.cycles || result.ok != result.cycles;
+    failed += g_zcl_diagAttrs[0].pkt_errors[PKT_ERR_TIMEOUT] != timeouts;
+    failed += (rtt[RTT_GET].srtt >> 3) + 20 < proc || (rtt[RTT_GET].srtt >> 3) > proc + 20;
+    failed += attrs_check();
+
+    sprintf(name, "meter answers in %u ms", proc);
+    failed = link_report(name, &result, failed);
+    printf("        first cycles %d/%d ok with %u timeouts, get latency %u ms, rto %u ms\n",
+           first.ok, first.cycles, timeouts, rtt[RTT_GET].srtt >> 3, rtt[RTT_GET].rto);
+
+    return failed;
+}
+
+/* the link and the association stay open between the cycles. The keep-alive holds the link over
+ * the gaps longer than the inactivity timeout of the meter. The meter which has closed the link
+ * answers DM, the link is opened again in the same cycle */
+static int test_keep_session(uint8_t keep, uint32_t gap, uint32_t inactivity, uint8_t drop) {
+
+    mtr_cfg_t cfg = mtr_default;
+    link_result_t result;
+    char name[64];
+    int failed = 0;
+
+    cfg.inactivity = inactivity;
+    /* an entry of the load profile in 30 min, the cycles read the instantaneous values */
+    cfg.lp_period = 1800000;
+
+    link_reset(&cfg, drop, 0, 8);
+    dev_config.keep_session = keep;
+    link_run(&result, 30, gap);
+
+    failed += result.ok + (drop ? 1 : 0) < result.cycles;
+    if (!drop) {
+        if (!keep) {
+            failed += mtr_stat.snrm != result.cycles || mtr_stat.disc != result.cycles;
+        } else if (gap < inactivity || KEEP_ALIVE_PERIOD * 1000 < inactivity) {
+            /* the keep-alive has held the link */
+            failed += mtr_stat.snrm != 1 || mtr_stat.disc != 0 || mtr_stat.dm != 0;
+        } else {
+            /* every cycle after the first one finds the link closed */
+            failed += mtr_stat.snrm != result.cycles || mtr_stat.dm != result.cycles - 1;
+        }
+    }
+    failed += attrs_check();
+
+    sprintf(name, "%s link, gaps %u s, meter timeout %u s, %d%% lost", keep ? "kept" : "closed",
+            gap / 1000, inactivity / 1000, drop);
+    failed = link_report(name, &result, failed);
+    printf("        %u bytes per cycle, disc %u, dm %u\n", mtr_stat.bytes / result.cycles, mtr_stat.disc, mtr_stat.dm);
+
+    return failed;
+}
+
+/* the window of the meter comes as frames back to back with no idle between them. The rx dma
+ * ends its chunks on the full buffer, the frames are cut across the chunks and the ring.
+ * The uart driver sets the idle of the end of the chunk to one character */
+static int test_back_to_back() {
+
+    mtr_cfg_t cfg = mtr_default;
+    link_result_t result;
+    zcl_diagAttr_t *diag = &g_zcl_diagAttrs[0];
+    int failed = 0;
+
+    cfg.window = 2;
+
+    /* the reset value of the sdk, two characters */
+    link_rx_timeout1 = 0xf0 | UART_BW_MUL2;
+
+    link_reset(&cfg, 0, 0, 9);
+    link_run(&result, 20, 1000);
+
+    failed += result.ok != result.cycles;
+    failed += link_rx_timeout1 != (0xf0 | UART_BW_MUL1);
+    failed += diag->uart_dma_overflows == 0 || diag->uart_ring_overruns != 0;
+    failed += diag->pkt_errors[PKT_ERR_CRC] + diag->pkt_errors[PKT_ERR_UNSTUFFING] + diag->pkt_errors[PKT_ERR_INCOMPLETE] != 0;
+    failed += mtr_stat.rej_sent + mtr_stat.rej_received + mtr_stat.resent != 0;
+    failed += attrs_check();
+
+    failed = link_report("window 2, frames back to back", &result, failed);
+    printf("        %u dma chunks ended full, ring overruns %u, crc errors %u\n",
+           diag->uart_dma_overflows, diag->uart_ring_overruns, diag->pkt_errors[PKT_ERR_CRC]);
+
+    return failed;
+}
+
+int main() {
+
+    int failed = 0;
+
+    failed += test_reference();
+    failed += test_window();
+    failed += test_window_loss(0, 7, 50, 50);
+    failed += test_window_loss(5, 0, 300, 294);
+    failed += test_datablocks(7, 0, 1, 0, 10, 10);
+    failed += test_datablocks(20, 0, 2, 0, 10, 10);
+    failed += test_datablocks(200, 40, 2, 0, 10, 10);
+    failed += test_datablocks(30, 0, 2, 5, 100, 98);
+    failed += test_profile(false);
+    failed += test_profile(true);
+    failed += test_load_profile(0, 0, 40);
+    failed += test_load_profile(0, 30, 40);
+    failed += test_load_profile(5, 0, 200);
+    failed += test_object_list(0, 0, false);
+    failed += test_object_list(60, 0, false);
+    failed += test_object_list(1000, 0, false);
+    failed += test_object_list(0, 5, false);
+    failed += test_object_list(0, 0, true);
+    failed += test_no_object_list();
+    failed += test_slow_meter(900);
+    failed += test_slow_meter(1200);
+    failed += test_keep_session(false, 10000, 120000, 0);
+    failed += test_keep_session(true, 10000, 120000, 0);
+    failed += test_keep_session(true, 50000, 40000, 0);
+    failed += test_keep_session(true, 10000, 5000, 0);
+    failed += test_keep_session(false, 10000, 120000, 5);
+    failed += test_keep_session(true, 10000, 120000, 5);
+    failed += test_back_to_back();
+
+    printf("nartis link: %s\n", failed ? "FAILED" : "passed");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,221 @@
+#include <stdlib.h>
+
+#include "app_main.h"
+
+/* the rx ring of app_uart.c: the dma chunks come in through the rx irq of the uart, the main
+ * loop takes them out with every call of the consumer side. A model of the queue holds what
+ * must come out, a chunk which does not fit the ring is cut to the free space. Checked over
+ * the wrap of the buffer and of the uint16 indices: the bytes come out in order and exact,
+ * the length, the span up to the end of the buffer, peek and flush */
+
+#define OPS             200000
+#define MODEL_SIZE      1024
+
+u8 reg_uart_rx_timeout1;
+u8 reg_dma_chn_irq_msk = FLD_DMA_CHN_UART_TX;
+
+u32 clock_time(void) { return 0; }
+void sleep_us(u32 us) {}
+u8 irq_disable(void) { return 0; }
+void irq_restore(u8 r) {}
+void dma_irq_disable(u32 msk) { reg_dma_chn_irq_msk &= ~msk; }
+
+void drv_gpio_write(u32 pin, u8 value) {}
+void drv_gpio_input_en(u32 pin, u8 enable) {}
+void drv_uart_pin_set(u32 txPin, u32 rxPin) {}
+
+/* rx dma, the chunk is put in the buffer and the irq comes at once */
+static uart_data_t *rx_dma;
+static uart_irq_callback rx_cb;
+
+u8 drv_uart_init(u32 baudrate, u8 *rxBuf, u16 rxBufLen, uart_irq_callback uartRecvCb) {
+
+    rx_dma = (uart_data_t*)rxBuf;
+    rx_cb = uartRecvCb;
+    return 0;
+}
+
+void uart_recbuff_init(unsigned char *recAddr, unsigned short recBuffLen) {
+
+    rx_dma = (uart_data_t*)recAddr;
+}
+
+/* nothing is sent, there is no echo to take out of the chunks */
+unsigned char uart_dma_send(unsigned char *addr) { return 1; }
+unsigned char uart_tx_is_busy(void) { return false; }
+
+void drv_hwTmr_init(u8 tmrIdx, u8 mode) {}
+void drv_hwTmr_cancel(u8 tmrIdx) {}
+hw_timer_sts_t drv_hwTmr_set(u8 tmrIdx, u32 t_us, timerCb_t func, void *arg) { return HW_TIMER_SUCC; }
+
+/* what is in the ring, in order. The consumer index of the ring is counted here as well,
+ * the span ends where it wraps */
+static u8 model[MODEL_SIZE];
+static u32 model_head, model_tail;
+static uint16_t ring_tail;
+
+static u32 produced, dropped, consumed, flushed, tail_wraps;
+static int failed;
+
+static void fail(const char *what, int op) {
+
+    if (failed++ < 10) printf("FAILED  op %d: %s\n", op, what);
+}
+
+static void take(size_t len) {
+
+    if ((uint16_t)(ring_tail + len) < ring_tail) tail_wraps++;
+    ring_tail += len;
+    model_tail += len;
+}
+
+static int same(const u8 *data, size_t len) {
+
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] != model[(model_tail + i) % MODEL_SIZE]) return false;
+    }
+
+    return true;
+}
+
+/* the uart irq with a chunk of the dma */
+static void produce(size_t len, int op) {
+
+    u32 free_space = UART_BUFF_SIZE - (model_head - model_tail);
+    size_t fit = len < free_space ? len : free_space;
+
+    for (size_t i = 0; i < len; i++) {
+        rx_dma->data[i] = rand();
+        if (i < fit) model[(model_head + i) % MODEL_SIZE] = rx_dma->data[i];
+    }
+    rx_dma->dma_len = len;
+    rx_cb();
+
+    model_head += fit;
+    produced += fit;
+    dropped += len - fit;
+
+    if (rx_dma->dma_len != 0) fail("the dma buffer is not released", op);
+}
+
+static void check_len(int op) {
+
+    u32 len = model_head - model_tail;
+
+    if (get_queue_len_buff_uart() != len) fail("queue length", op);
+    if (available_buff_uart() != (len != 0)) fail("available", op);
+}
+
+/* the main loop, one call of the consumer side */
+static void consume(int op) {
+
+    u8 data[UART_BUFF_SIZE + 100];
+    u32 queue_len = model_head - model_tail;
+    size_t len, got, span_len;
+    u8 *span;
+
+    switch (rand() % 5) {
+        case 0:
+            if (!queue_len) break;
+            if (read_byte_from_buff_uart() != model[model_tail % MODEL_SIZE]) fail("read_byte", op);
+            take(1);
+            consumed++;
+            break;
+        case 1:
+            len = rand() % sizeof(data);
+            got = read_bytes_from_buff_uart(data, len);
+            if (got != (len < queue_len ? len : queue_len)) fail("read_bytes length", op);
+            if (!same(data, got)) fail("read_bytes data", op);
+            take(got);
+            consumed += got;
+            break;
+        case 2:
+            len = rand() % sizeof(data);
+            got = peek_bytes_buff_uart(data, len);
+            if (got != (len < queue_len ? len : queue_len)) fail("peek length", op);
+            if (!same(data, got)) fail("peek data", op);
+            break;
+        case 3:
+            span = span_buff_uart(&span_len);
+            len = UART_BUFF_SIZE - (ring_tail & UART_BUFF_MASK);
+            if (span_len != (queue_len < len ? queue_len : len) || (span == NULL) != (span_len == 0)) {
+                fail("span length", op);
+                break;
+            }
+            if (!same(span, span_len)) fail("span data", op);
+            /* the framer consumes a part of the span or all of it */
+            len = span_len ? rand() % (span_len + 1) : 0;
+            consume_buff_uart(len);
+            take(len);
+            consumed += len;
+            break;
+        default:
+            if (rand() % 50) break;
+            flush_buff_uart();
+            flushed += queue_len;
+            take(queue_len);
+            break;
+    }
+
+    check_len(op);
+}
+
+/* the edges on the empty ring: all 512 bytes are usable, the chunk over them is dropped */
+static void check_full() {
+
+    u8 data[UART_BUFF_SIZE];
+    size_t span_len;
+
+    produce(UART_DATA_LEN, -1);
+    produce(UART_DATA_LEN, -1);
+    produce(UART_BUFF_SIZE - 2 * UART_DATA_LEN, -1);
+    check_len(-1);
+    if (get_queue_len_buff_uart() != UART_BUFF_SIZE) fail("the full ring", -1);
+
+    produce(10, -1);
+    if (get_queue_len_buff_uart() != UART_BUFF_SIZE || dropped != 10) fail("the chunk over the full ring", -1);
+
+    if (read_bytes_from_buff_uart(data, sizeof(data)) != UART_BUFF_SIZE || !same(data, UART_BUFF_SIZE)) {
+        fail("the full ring read back", -1);
+    }
+    take(UART_BUFF_SIZE);
+    consumed += UART_BUFF_SIZE;
+    check_len(-1);
+
+    if (span_buff_uart(&span_len) != NULL || span_len != 0) fail("the span of the empty ring", -1);
+    if (peek_bytes_buff_uart(data, sizeof(data)) != 0) fail("peek of the empty ring", -1);
+    consume_buff_uart(1);
+    check_len(-1);
+}
+
+int main() {
+
+    int chunks = 0;
+
+    srand(1);
+    app_uart_init(9600);
+
+    check_full();
+    printf("%s  the full ring: %d bytes usable, a chunk over them dropped\n", failed ? "FAILED" : "ok    ",
+           UART_BUFF_SIZE);
+
+    /* the producer is a bit faster than the consumer, the ring runs full at times */
+    for (int op = 0; op < OPS; op++) {
+        if (rand() % 100 < 30) {
+            produce(1 + rand() % UART_DATA_LEN, op);
+            chunks++;
+        } else {
+            consume(op);
+        }
+    }
+
+    if (tail_wraps < 3) fail("the indices have not wrapped", OPS);
+    if (produced != consumed + flushed + (model_head - model_tail)) fail("bytes are lost", OPS);
+
+    printf("%s  %d operations: %d chunks, %u bytes in order, %u dropped over the full ring, %u flushed, "
+           "indices wrapped %u times\n", failed ? "FAILED" : "ok    ", OPS, chunks, consumed, dropped, flushed, tail_wraps);
+
+    printf("uart ring: %s\n", failed ? "FAILED" : "all passed");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,328 @@
+#include <stdlib.h>
+
+#include "app_main.h"
+
+/* app_uart.c on a half duplex RS-485 bus at 9600 8N1, in steps of 5 us. The client frames go out
+ * through the dma, the transceiver has /RE tied low so every sent byte comes back to rx ahead of
+ * the answer of the meter. Checked for every cycle: DE is up UART_DE_PRE_US before the first start
+ * bit and is released UART_DE_POST_US (+ the poll of the tx timer) after the last stop bit, the
+ * meter never answers into a driven bus and the answer comes out of the ring byte-exact. The
+ * turnaround of the meter is counted from the release of the bus. A byte lost in a full rx dma
+ * buffer fails the cycle too, the echo has to leave the buffer before the answer comes */
+
+#define STEP_US         5
+#define CHAR_US         1042                /* 10 bits at 9600 */
+#define RX_TIMEOUT_US   1250                /* 12 bits of silence */
+#define LINE_SIZE       8192
+
+static uint64_t now_us;
+static u8 irq_en = true;
+
+u8 reg_uart_rx_timeout1;
+u8 reg_dma_chn_irq_msk = FLD_DMA_CHN_UART_TX;
+
+u32 clock_time(void) { return (u32)(now_us * S_TIMER_CLOCK_1US); }
+void sleep_us(u32 us) { now_us += us; }
+u8 irq_disable(void) { u8 r = irq_en; irq_en = false; return r; }
+void irq_restore(u8 r) { irq_en = r; }
+void dma_irq_disable(u32 msk) { reg_dma_chn_irq_msk &= ~msk; }
+
+/* DE pin */
+static u8 de;
+static uint64_t de_on_at, de_off_at;
+
+void drv_gpio_write(u32 pin, u8 value) {
+
+    if (pin != GPIO_UART_DE) return;
+    if (value && !de) de_on_at = now_us;
+    if (!value && de) de_off_at = now_us;
+    de = value;
+}
+
+void drv_gpio_input_en(u32 pin, u8 enable) {}
+void drv_uart_pin_set(u32 txPin, u32 rxPin) {}
+
+/* rx dma, the irq comes after RX_TIMEOUT_US of silence (no start bit since the last byte),
+ * what does not fit the buffer is lost */
+static uart_data_t *rx_dma;
+static uart_irq_callback rx_cb;
+static uint64_t rx_last;
+static u8 rx_pending;
+static u32 rx_dropped;
+
+u8 drv_uart_init(u32 baudrate, u8 *rxBuf, u16 rxBufLen, uart_irq_callback uartRecvCb) {
+
+    rx_dma = (uart_data_t*)rxBuf;
+    rx_cb = uartRecvCb;
+    return 0;
+}
+
+void uart_recbuff_init(unsigned char *recAddr, unsigned short recBuffLen) {
+
+    rx_dma = (uart_data_t*)recAddr;
+}
+
+static void rx_byte(u8 b) {
+
+    if (rx_dma->dma_len < UART_DATA_LEN) {
+        rx_dma->data[rx_dma->dma_len++] = b;
+    } else {
+        rx_dropped++;
+    }
+    rx_last = now_us;
+    rx_pending = true;
+}
+
+/* tx dma, the bytes leave back to back once the line is free */
+static u8 line[LINE_SIZE];
+static uint64_t line_end[LINE_SIZE];
+static int line_head, line_tail;
+static uint64_t line_free, first_start;
+static u8 first_set;
+
+unsigned char uart_dma_send(unsigned char *addr) {
+
+    uart_data_t *d = (uart_data_t*)addr;
+    uint64_t t = line_free > now_us ? line_free : now_us;
+
+    if (!first_set) {
+        first_set = true;
+        first_start = t;
+    }
+
+    for (u32 i = 0; i < d->dma_len; i++) {
+        line[line_head] = d->data[i];
+        line_end[line_head] = t + (uint64_t)(i + 1) * CHAR_US;
+        line_head = (line_head + 1) % LINE_SIZE;
+    }
+    line_free = t + (uint64_t)d->dma_len * CHAR_US;
+
+    return 1;
+}
+
+unsigned char uart_tx_is_busy(void) { return now_us < line_free; }
+
+/* the one-shot hardware timer of the SDK, the callback returns the next interval or -1 */
+static timerCb_t tmr_cb;
+static uint64_t tmr_at;
+static u32 tmr_interval;
+static u8 tmr_run;
+
+void drv_hwTmr_init(u8 tmrIdx, u8 mode) {}
+void drv_hwTmr_cancel(u8 tmrIdx) { tmr_run = false; }
+
+hw_timer_sts_t drv_hwTmr_set(u8 tmrIdx, u32 t_us, timerCb_t func, void *arg) {
+
+    if (tmr_run) return HW_TIMER_IS_RUNNING;
+    tmr_cb = func;
+    tmr_interval = t_us;
+    tmr_at = now_us + t_us;
+    tmr_run = true;
+    return HW_TIMER_SUCC;
+}
+
+/* the meter answers the frame with the poll bit after the turnaround */
+static u8 m_rx[1024];
+static int m_len, m_expect;
+static u8 reply[300];
+static int reply_len, reply_pos;
+static uint64_t reply_at, turnaround_us;
+static u32 undriven, contention;
+
+static void meter_byte(u8 b) {
+
+    if (m_len == 0 && b != 0x7e) return;
+    m_rx[m_len++] = b;
+    if (m_len == 3) m_expect = (((m_rx[1] & 7) << 8) | m_rx[2]) + 2;
+    if (m_len < 3 || m_len != m_expect) return;
+
+    m_len = 0;
+    if (m_rx[m_expect-2] & 1) {
+        reply_len = 20 + rand() % 150;
+        reply[0] = 0x7e;
+        reply[1] = 0xa0 | ((reply_len - 2) >> 8);
+        reply[2] = (reply_len - 2) & 0xff;
+        for (int i = 3; i < reply_len - 1; i++) reply[i] = rand();
+        reply[reply_len-1] = 0x7e;
+        reply_at = now_us + turnaround_us;
+        reply_pos = 0;
+    }
+}
+
+/* the echo of the transceiver */
+static u8 echo_lost;                        /* the whole echo of the cycle */
+static int echo_drop = -1;                  /* one byte of the echo */
+static int echo_pos;
+
+static void step() {
+
+    while (line_tail != line_head && line_end[line_tail] <= now_us) {
+        if (!de || de_on_at > line_end[line_tail] - CHAR_US) undriven++;
+        meter_byte(line[line_tail]);
+        if (!echo_lost && echo_pos != echo_drop) rx_byte(line[line_tail]);
+        echo_pos++;
+        line_tail = (line_tail + 1) % LINE_SIZE;
+    }
+
+    if (reply_len && reply_pos < reply_len && now_us >= reply_at + (uint64_t)(reply_pos + 1) * CHAR_US) {
+        if (de || de_off_at > reply_at) contention++;
+        rx_byte(reply[reply_pos++]);
+    }
+
+    if (!irq_en) return;
+
+    if (tmr_run && now_us >= tmr_at) {
+        int t = tmr_cb(NULL);
+        if (t < 0) {
+            tmr_run = false;
+        } else {
+            if (t) tmr_interval = t;
+            tmr_at = now_us + tmr_interval;
+        }
+    }
+
+    u8 rx_busy = (reply_len && reply_pos < reply_len && now_us >= reply_at + (uint64_t)reply_pos * CHAR_US) ||
+                 (line_tail != line_head && !echo_lost && now_us >= line_end[line_tail] - CHAR_US);
+
+    if (rx_pending && !rx_busy && now_us >= rx_last + RX_TIMEOUT_US) {
+        rx_pending = false;
+        rx_cb();
+    }
+}
+
+static u8 done_seen;
+static u32 done_time;
+
+static void tx_done(uint32_t time) {
+
+    done_seen = true;
+    done_time = time;
+}
+
+typedef struct {
+    const char *name;
+    int turnaround_min;                     /* us, + up to 5 ms */
+    int echo_lost_pct;
+    int echo_drop_pct;
+} scenario_t;
+
+static int run(const scenario_t *sc, int cycles) {
+
+    uint64_t lead_min = ~0ull, lead_max = 0, hold_min = ~0ull, hold_max = 0;
+    int ok = 0, dma_full = 0, bad = 0;
+    u8 got[2048];
+
+    undriven = contention = 0;
+
+    for (int c = 0; c < cycles; c++) {
+        u8 f[3][200];
+        int n[3], frames = 1 + rand() % 3, sent = 0, got_len = 0;
+        uint64_t t0;
+
+        first_set = false;
+        done_seen = false;
+        reply_len = 0;
+        rx_dropped = 0;
+        turnaround_us = UART_DE_POST_US + sc->turnaround_min + rand() % 5000;
+
+        for (int k = 0; k < frames; k++) {
+            n[k] = 12 + rand() % 150;
+            f[k][0] = 0x7e;
+            f[k][1] = 0xa0 | ((n[k] - 2) >> 8);
+            f[k][2] = (n[k] - 2) & 0xff;
+            for (int i = 3; i < n[k] - 1; i++) f[k][i] = rand() | 0x01;
+            f[k][n[k]-2] = (k == frames - 1) ? 0x01 : 0x00;
+            f[k][n[k]-1] = 0x7e;
+            sent += n[k];
+        }
+
+        echo_pos = 0;
+        echo_lost = rand() % 100 < sc->echo_lost_pct;
+        /* a byte inside a frame, a lost closing flag would take the opening flag of the answer */
+        echo_drop = rand() % 100 < sc->echo_drop_pct ? 1 + rand() % (n[0] - 2) : -1;
+
+        for (int k = 0; k < frames; k++) {
+            if (write_bytes_to_uart(f[k], n[k]) != (size_t)n[k]) {
+                printf("FAILED  %s: cycle %d, the tx queue is full\n", sc->name, c);
+                return 1;
+            }
+            now_us += 30;                   /* the next frame is built meanwhile */
+        }
+
+        t0 = now_us;
+        while (now_us - t0 < 2000000) {
+            step();
+            app_uart_handler();
+            got_len += read_bytes_from_buff_uart(got + got_len, sizeof(got) - got_len);
+            if (reply_len && reply_pos == reply_len && !rx_pending && !tmr_run) break;
+            now_us += STEP_US;
+        }
+
+        uint64_t lead = first_start - de_on_at, hold = de_off_at - line_free;
+        if (lead < lead_min) lead_min = lead;
+        if (lead > lead_max) lead_max = lead;
+        if (hold < hold_min) hold_min = hold;
+        if (hold > hold_max) hold_max = hold;
+
+        /* with a byte of the echo lost the rest of the echo is passed on, the answer is at the end */
+        u8 exact = echo_drop < 0 ? got_len == reply_len : got_len >= reply_len;
+        if (done_seen && reply_len && exact && !memcmp(got + got_len - reply_len, reply, reply_len)) {
+            ok++;
+        } else if (rx_dropped) {
+            dma_full++;
+        } else {
+            bad++;
+            printf("  cycle %d: done %d, got %d of the answer %d, sent %d, turnaround %u us, echo %s\n",
+                   c, done_seen, got_len, reply_len, sent, (u32)turnaround_us,
+                   echo_lost ? "lost" : echo_drop >= 0 ? "one byte lost" : "whole");
+        }
+
+        if ((int32_t)(done_time - (u32)(line_free * S_TIMER_CLOCK_1US)) < 0) {
+            bad++;
+            printf("  cycle %d: tx done before the last stop bit\n", c);
+        }
+
+        now_us += 1000 + rand() % 3000;
+    }
+
+    u8 fail = bad || dma_full || undriven || contention || lead_min != UART_DE_PRE_US || lead_max != UART_DE_PRE_US ||
+              hold_min < UART_DE_POST_US || hold_max > UART_DE_POST_US + UART_TX_POLL_US + STEP_US;
+
+    printf("%s  %s: %d/%d answers byte-exact, %d lost in the full rx dma, undriven %u, contention %u\n"
+           "        DE before the start bit %u..%u us, after the last stop bit %u..%u us\n",
+           fail ? "FAILED" : "ok    ", sc->name, ok, cycles, dma_full, undriven, contention,
+           (u32)lead_min, (u32)lead_max, (u32)hold_min, (u32)hold_max);
+
+    return fail;
+}
+
+static const scenario_t scenarios[] = {
+    { "turnaround 0.3..5.3 ms",                         300,    0,  0 },
+    { "turnaround 1.3..6.3 ms",                         1300,   0,  0 },
+    { "turnaround 0.3..5.3 ms, echo lost 20%",          300,    20, 0 },
+    { "turnaround 0.3..5.3 ms, echo byte lost 20%",     300,    0,  20 },
+    { "turnaround 0..5 ms",                             0,      0,  0 },
+};
+
+int main() {
+
+    int failed = 0;
+
+    srand(1);
+    app_uart_init(9600);
+    app_uart_set_tx_done_handler(tx_done);
+
+    /* the tx dma irq of the SDK driver stays off, it would change the status of drv_uart */
+    if (reg_dma_chn_irq_msk & FLD_DMA_CHN_UART_TX) {
+        printf("FAILED  the tx dma irq is on\n");
+        failed++;
+    }
+
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        failed += run(&scenarios[i], 500);
+    }
+
+    printf("uart rs485, post guard %d us: %s\n", UART_DE_POST_US, failed ? "FAILED" : "all passed");
+
+    return failed ? 1 : 0;
+}
@@ -17,8 +17,96 @@ const attrElCityMeterMeasurementPreset = 0xf002;
 const attrElCityMeterDateRelease = 0xf003;
 const attrElCityMeterModelName = 0xf004;
 const attrElCityMeterPasswordPreset = 0xf005;
+const attrElCityMeterPowerPeriodPreset = 0xf006;
+const attrElCityMeterVoltagePeriodPreset = 0xf007;
+const attrElCityMeterProfileTime = 0xf008;
+const attrElCityMeterProfileEnergy = 0xf009;
+const attrElCityMeterSecurityLevel = 0xf00a;
+const attrElCityMeterSystemTitle = 0xf00b;
+const attrElCityMeterEncryptionKey = 0xf00c;
+const attrElCityMeterAuthenticationKey = 0xf00d;
+const attrElCityMeterProfileEntries = 0xf00e;
+const attrElCityMeterProfileDepth = 0xf00f;
+const attrElCityMeterKeepSession = 0xf010;
+
+/* Diagnostics cluster, manufacturer specific attributes of the meter endpoint */
+const manufacturerCodeElCityMeter = 0x6565;
+const attrElCityDiagPktError = 0xf010;          /* + pkt_error_t of the firmware */
+
+/* endpoints of the meters on the bus, 1 + idx of the meter. Add 2.. when the firmware is built with METER_MAX > 1 */
+const elCityMeterEndpoints = [1];
+
+const elCityDiagAttrs = [
+    { ID: 0xf000, name: "uart_rx_bytes", description: "Bytes Received from the Meter" },
+    { ID: 0xf001, name: "uart_ring_overruns", description: "Received Bytes Lost in the Full Ring Buffer" },
+    { ID: 0xf002, name: "uart_dma_overflows", description: "RX DMA Buffers Filled before the Idle" },
+    { ID: 0xf003, name: "frames_ok", description: "HDLC Frames Received Correct" },
+    { ID: 0xf004, name: "retries", description: "Frames Sent Again" },
+    { ID: 0xf005, name: "association_failures", description: "Failed Associations (AARQ or HLS)" },
+    { ID: 0xf006, name: "cycles", description: "Successful Measurement Cycles" },
+    { ID: 0xf007, name: "cycle_min", unit: "ms", description: "Shortest Successful Cycle" },
+    { ID: 0xf008, name: "cycle_avg", unit: "ms", description: "Average Successful Cycle" },
+    { ID: 0xf009, name: "cycle_max", unit: "ms", description: "Longest Successful Cycle" },
+];
+
+/* in the order of pkt_error_t from PKT_ERR_NO_PKT */
+[
+    "no_packet", "timeout", "unknown_format", "different_command", "incomplete", "unstuffing", "address",
+    "dest_address", "src_address", "response", "crc", "uart", "type", "segmentation", "security",
+].forEach((name, i) => {
+    elCityDiagAttrs.push({ ID: attrElCityDiagPktError + 1 + i, name: "error_" + name, description: "Exchanges Failed with the Error" });
+});
+
+const elCityDiagName = (name, endpoint) => (endpoint === 1 ? name : `${name}_meter_${endpoint}`);
 
 const electricityMeterExtend = {
+    elDiagnostics: () => {
+        const exposes = [];
+        elCityMeterEndpoints.forEach((endpoint) => {
+            elCityDiagAttrs.forEach((attr) => {
+                let expose = e.numeric(elCityDiagName(attr.name, endpoint), ea.STATE_GET).withCategory("diagnostic");
+                if (attr.unit) {
+                    expose = expose.withUnit(attr.unit);
+                }
+                exposes.push(expose.withDescription(endpoint === 1 ? attr.description : `${attr.description}, Meter ${endpoint}`));
+            });
+        });
+        const toZigbee = [
+            {
+                key: elCityMeterEndpoints.flatMap((endpoint) => elCityDiagAttrs.map((attr) => elCityDiagName(attr.name, endpoint))),
+                convertGet: async (entity, key, meta) => {
+                    /* all counters of the meter at once, in parts that fit a frame */
+                    const match = key.match(/_meter_(\d+)$/);
+                    const endpoint = match ? meta.device.getEndpoint(Number.parseInt(match[1])) : entity;
+                    for (let i = 0; i < elCityDiagAttrs.length; i += 10) {
+                        const attrs = elCityDiagAttrs.slice(i, i + 10).map((attr) => attr.ID);
+                        await endpoint.read("haDiagnostic", attrs, { manufacturerCode: manufacturerCodeElCityMeter });
+                    }
+                },
+            },
+        ];
+        const fromZigbee = [
+            {
+                cluster: "haDiagnostic",
+                type: ["attributeReport", "readResponse"],
+                convert: (model, msg, publish, options, meta) => {
+                    const result = {};
+                    elCityDiagAttrs.forEach((attr) => {
+                        if (msg.data[attr.ID] !== undefined) {
+                            result[elCityDiagName(attr.name, msg.endpoint.ID)] = Number.parseInt(msg.data[attr.ID]);
+                        }
+                    });
+                    return result;
+                },
+            },
+        ];
+        return {
+            exposes,
+            fromZigbee,
+            toZigbee,
+            isModernExtend: true,
+        };
+    },
     elMeter: () => {
         const exposes = [
             e.numeric("energy_tier_1", ea.STATE_GET).withUnit("kWh").withDescription("Energy consumed at Tier 1"),
@@ -29,11 +117,22 @@ const electricityMeterExtend = {
             e.text("serial_number", ea.STATE_GET).withDescription("Meter Serial Number"),
             e.text("date_release", ea.STATE_GET).withDescription("Meter Date Release"),
             e.numeric("battery_life", ea.STATE_GET).withUnit("%").withDescription("Battery Life"),
+            e.text("profile_time", ea.STATE).withDescription("Capture Time of Load Profile Entry"),
+            e.numeric("profile_energy", ea.STATE).withDescription("Energy of Load Profile Entry"),
+            e.list("profile_entries", ea.STATE, e.composite("entry", "entry", ea.STATE)
+                .withFeature(e.text("time", ea.STATE))
+                .withFeature(e.numeric("energy", ea.STATE))).withDescription("Load Profile Entries Taken in the Last Cycle"),
             e.binary("tamper", ea.STATE, true, false).withDescription("Tamper"),
             e.binary("battery_low", ea.STATE, true, false).withDescription("Battery Low"),
             e.numeric("device_address_preset", ea.STATE_SET).withDescription("Device Address").withValueMin(1).withValueMax(9999999),
             e.text("device_password_preset", ea.STATE_SET).withDescription("Meter Password"),
-            e.numeric("device_measurement_preset", ea.ALL).withDescription("Measurement Period").withValueMin(1).withValueMax(255),
+            e.text("device_system_title_preset", ea.STATE_SET).withDescription("System Title of the Client, 8 bytes in hex"),
+            e.text("device_encryption_key_preset", ea.SET).withDescription("Global Unicast Encryption Key, 16 bytes in hex"),
+            e.text("device_authentication_key_preset", ea.SET).withDescription("Authentication Key, 16 bytes in hex"),
+            e.numeric("device_measurement_preset", ea.ALL).withUnit("min").withDescription("Tariffs Measurement Period").withValueMin(1).withValueMax(255),
+            e.numeric("device_power_period_preset", ea.ALL).withUnit("sec").withDescription("Power and Current Measurement Period").withValueMin(1).withValueMax(65535),
+            e.numeric("device_voltage_period_preset", ea.ALL).withUnit("sec").withDescription("Voltage Measurement Period").withValueMin(1).withValueMax(65535),
+            e.numeric("device_profile_depth_preset", ea.ALL).withDescription("Load Profile Entries Taken on the First Connect").withValueMin(1).withValueMax(65535),
         ];
         const toZigbee = [
             {
@@ -102,6 +201,21 @@ const electricityMeterExtend = {
                     return { readAfterWriteTime: 250, state: { device_password_preset: value } };
                 },
             },
+            {
+                key: ["device_system_title_preset"],
+                convertSet: async (entity, key, value, meta) => {
+                    const device_system_title_preset = Buffer.from(value.toString(), "hex");
+                    await entity.write("seMetering", { [attrElCityMeterSystemTitle]: { value: device_system_title_preset, type: 0x41 } });
+                    return { readAfterWriteTime: 250, state: { device_system_title_preset: value } };
+                },
+            },
+            {
+                key: ["device_encryption_key_preset", "device_authentication_key_preset"],
+                convertSet: async (entity, key, value, meta) => {
+                    const attr = key === "device_encryption_key_preset" ? attrElCityMeterEncryptionKey : attrElCityMeterAuthenticationKey;
+                    await entity.write("seMetering", { [attr]: { value: Buffer.from(value.toString(), "hex"), type: 0x41 } });
+                },
+            },
             {
                 key: ["device_measurement_preset"],
                 convertSet: async (entity, key, value, meta) => {
@@ -113,6 +227,39 @@ const electricityMeterExtend = {
                     await entity.read("seMetering", [attrElCityMeterMeasurementPreset]);
                 },
             },
+            {
+                key: ["device_power_period_preset"],
+                convertSet: async (entity, key, value, meta) => {
+                    const device_power_period_preset = value;
+                    await entity.write("seMetering", { [attrElCityMeterPowerPeriodPreset]: { value: device_power_period_preset, type: 0x21 } });
+                    return { readAfterWriteTime: 250, state: { device_power_period_preset: value } };
+                },
+                convertGet: async (entity, key, meta) => {
+                    await entity.read("seMetering", [attrElCityMeterPowerPeriodPreset]);
+                },
+            },
+            {
+                key: ["device_voltage_period_preset"],
+                convertSet: async (entity, key, value, meta) => {
+                    const device_voltage_period_preset = value;
+                    await entity.write("seMetering", { [attrElCityMeterVoltagePeriodPreset]: { value: device_voltage_period_preset, type: 0x21 } });
+                    return { readAfterWriteTime: 250, state: { device_voltage_period_preset: value } };
+                },
+                convertGet: async (entity, key, meta) => {
+                    await entity.read("seMetering", [attrElCityMeterVoltagePeriodPreset]);
+                },
+            },
+            {
+                key: ["device_profile_depth_preset"],
+                convertSet: async (entity, key, value, meta) => {
+                    const device_profile_depth_preset = value;
+                    await entity.write("seMetering", { [attrElCityMeterProfileDepth]: { value: device_profile_depth_preset, type: 0x21 } });
+                    return { readAfterWriteTime: 250, state: { device_profile_depth_preset: value } };
+                },
+                convertGet: async (entity, key, meta) => {
+                    await entity.read("seMetering", [attrElCityMeterProfileDepth]);
+                },
+            },
         ];
         const fromZigbee = [
             {
@@ -273,6 +420,38 @@ const electricityMeterExtend = {
                     return result;
                 },
             },
+            {
+                cluster: "seMetering",
+                type: ["attributeReport", "readResponse"],
+                convert: (model, msg, publish, options, meta) => {
+                    const result = {};
+                    if (msg.data[attrElCityMeterProfileTime] !== undefined) {
+                        /* seconds from 2000-01-01 in the time of the meter */
+                        const data = Number.parseInt(msg.data[attrElCityMeterProfileTime]);
+                        result.profile_time = new Date((data + 946684800) * 1000).toISOString().slice(0, 19).replace("T", " ");
+                    }
+                    if (msg.data[attrElCityMeterProfileEnergy] !== undefined) {
+                        const data = Number.parseInt(msg.data[attrElCityMeterProfileEnergy]);
+                        result.profile_energy = data;
+                    }
+                    if (msg.data[attrElCityMeterProfileEntries] !== undefined) {
+                        /* | time | energy | of uint32 LE each, the energy 0xffffffff - no value */
+                        const data = Buffer.from(msg.data[attrElCityMeterProfileEntries]);
+                        const entries = [];
+                        for (let i = 0; i + 8 <= data.length; i += 8) {
+                            const time = new Date((data.readUInt32LE(i) + 946684800) * 1000).toISOString().slice(0, 19).replace("T", " ");
+                            const energy = data.readUInt32LE(i + 4);
+                            entries.push({ time: time, energy: energy === 0xffffffff ? null : energy });
+                        }
+                        if (entries.length) {
+                            result.profile_entries = entries;
+                            result.profile_time = entries[entries.length - 1].time;
+                            result.profile_energy = entries[entries.length - 1].energy;
+                        }
+                    }
+                    return result;
+                },
+            },
             {
                 cluster: "seMetering",
                 type: ["attributeReport", "readResponse"],
@@ -294,6 +473,18 @@ const electricityMeterExtend = {
                         const data = Number.parseInt(msg.data[attrElCityMeterMeasurementPreset]);
                         result.device_measurement_preset = data;
                     }
+                    if (msg.data[attrElCityMeterPowerPeriodPreset] !== undefined) {
+                        const data = Number.parseInt(msg.data[attrElCityMeterPowerPeriodPreset]);
+                        result.device_power_period_preset = data;
+                    }
+                    if (msg.data[attrElCityMeterVoltagePeriodPreset] !== undefined) {
+                        const data = Number.parseInt(msg.data[attrElCityMeterVoltagePeriodPreset]);
+                        result.device_voltage_period_preset = data;
+                    }
+                    if (msg.data[attrElCityMeterProfileDepth] !== undefined) {
+                        const data = Number.parseInt(msg.data[attrElCityMeterProfileDepth]);
+                        result.device_profile_depth_preset = data;
+                    }
                     return result;
                 },
             },
@@ -324,7 +515,7 @@ const definition = {
         await endpoint1.read("seMetering", ["currentTier4SummDelivered"]);
         await endpoint1.read("seMetering", ["currentSummDelivered"]);
         await endpoint1.read("seMetering", ["meterSerialNumber"]);
-        await endpoint1.read("seMetering", [attrElCityMeterMeasurementPreset]);
+        await endpoint1.read("seMetering", [attrElCityMeterMeasurementPreset, attrElCityMeterPowerPeriodPreset, attrElCityMeterVoltagePeriodPreset, attrElCityMeterProfileDepth]);
         await endpoint1.read("seMetering", [attrElCityMeterModelName]);
         // await endpoint1.read("haElectricalMeasurement", ["acVoltageDivisor"]);
         // await endpoint1.read("haElectricalMeasurement", ["acVoltageMultiplier"]);
@@ -378,6 +569,7 @@ const definition = {
         m.deviceTemperature(),
         m.electricityMeter({threePhase: true}),
         electricityMeterExtend.elMeter(),
+        electricityMeterExtend.elDiagnostics(),
         m.enumLookup({
             name: "device_model_preset",
             lookup: {
@@ -388,6 +580,24 @@ const definition = {
             attribute: { ID: attrElCityMeterModelPreset, type: 0x30 },
             description: "Device Model",
         }),
+        m.enumLookup({
+            name: "device_security_level_preset",
+            lookup: {
+                "LLS": 0,
+                "HLS GMAC": 1,
+            },
+            cluster: "seMetering",
+            attribute: { ID: attrElCityMeterSecurityLevel, type: 0x30 },
+            description: "Security of the Meter Association",
+        }),
+        m.binary({
+            name: "device_keep_session_preset",
+            valueOn: ["ON", 1],
+            valueOff: ["OFF", 0],
+            cluster: "seMetering",
+            attribute: { ID: attrElCityMeterKeepSession, type: 0x10 },
+            description: "Keep the Link to the Meter Open Between Cycles of a Minute or Shorter",
+        }),
     ],
     ota: true,
 };